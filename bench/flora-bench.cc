@@ -0,0 +1,584 @@
+// throughput and latency of an in-process Dispatcher and Poll, driven by
+// clients over unix and tcp sockets
+// results printed as JSON, one object per scenario and transport
+#include "defs.h"
+#include "flora-cli.h"
+#include "flora-svc.h"
+#include "ser-helper.h"
+#include "stats.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <sys/resource.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+using namespace std;
+using namespace std::chrono;
+using namespace flora;
+using flora::internal::LatencyHistogram;
+using flora::internal::TraceHelper;
+
+#define BENCH_UNIX_URI "unix:/tmp/flora-bench.sock"
+#define BENCH_TCP_URI "tcp://127.0.0.1:%u/"
+#define BENCH_DEFAULT_TCP_PORT 37800
+// seconds waiting for all msgs of a scenario delivered
+#define BENCH_WAIT_TIMEOUT 60
+// outbound queue of subscribers, large enough for whole fan-out burst
+#define BENCH_WRITE_QUEUE_LIMIT (256 * 1024 * 1024)
+
+class BenchOptions {
+public:
+  // subscribers of fanout, publishers of fanin, subscribers of persist
+  uint32_t clients = 4;
+  // msgs posted by each publisher, or calls
+  uint32_t msgs = 10000;
+  // bytes of binary payload
+  uint32_t size = 64;
+  // outstanding calls of pipeline
+  uint32_t window = 32;
+  // persist topics
+  uint32_t topics = 100;
+  // connections of churn
+  uint32_t connects = 500;
+  uint32_t tcp_port = BENCH_DEFAULT_TCP_PORT;
+  bool unix_socket = true;
+  bool tcp = true;
+  vector<string> scenarios;
+  const char *output = nullptr;
+};
+
+class BenchResult {
+public:
+  // measured period begin, setup of clients excluded
+  void begin() {
+    wall_begin = TraceHelper::now();
+    cpu_begin = cpu_time();
+  }
+
+  void end() {
+    wall_ns = TraceHelper::now() - wall_begin;
+    cpu_ns = cpu_time() - cpu_begin;
+  }
+
+  // process cpu time, including dispatcher and poll threads
+  static uint64_t cpu_time() {
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    return ((uint64_t)ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1000000000 +
+           ((uint64_t)ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) * 1000;
+  }
+
+public:
+  // msgs, calls or connections completed
+  atomic<uint64_t> msgs{0};
+  // payload bytes delivered
+  atomic<uint64_t> bytes{0};
+  uint64_t expected = 0;
+  uint64_t wall_ns = 0;
+  uint64_t cpu_ns = 0;
+  LatencyHistogram latency;
+
+private:
+  uint64_t wall_begin = 0;
+  uint64_t cpu_begin = 0;
+};
+
+// wait until 'count' reached 'target'
+class Completion {
+public:
+  void add(uint64_t n = 1) {
+    lock_guard<mutex> locker(cmutex);
+    count += n;
+    if (count >= target)
+      cond.notify_all();
+  }
+
+  // return: false if timeout
+  bool wait(uint64_t t) {
+    unique_lock<mutex> locker(cmutex);
+    target = t;
+    return cond.wait_for(locker, seconds(BENCH_WAIT_TIMEOUT),
+                         [this]() { return count >= target; });
+  }
+
+private:
+  mutex cmutex;
+  condition_variable cond;
+  uint64_t count = 0;
+  uint64_t target = UINT64_MAX;
+};
+
+class BenchCallback : public ClientCallback {
+public:
+  void recv_post(const char *name, uint32_t msgtype, shared_ptr<Caps> &msg) {
+    if (on_post)
+      on_post(name, msg);
+  }
+
+  void recv_call(const char *name, shared_ptr<Caps> &msg,
+                 shared_ptr<Reply> &reply) {
+    reply->end(FLORA_CLI_SUCCESS, msg);
+  }
+
+  function<void(const char *, shared_ptr<Caps> &)> on_post;
+};
+
+class BenchClient {
+public:
+  // return: false if connect failed
+  bool connect(const string &uri, const char *name, uint32_t bufsize) {
+    ClientOptions opts;
+    opts.bufsize = bufsize;
+    string full = uri + "#" + name;
+    return Client::connect(full.c_str(), &callback, nullptr, &opts, client) ==
+           FLORA_CLI_SUCCESS;
+  }
+
+  // return after requests sent before handled by dispatcher
+  bool sync() {
+    shared_ptr<Caps> empty;
+    Response resp;
+    return client->call(FLORA_STATS_METHOD, empty, "", resp, 0) ==
+           FLORA_CLI_SUCCESS;
+  }
+
+  BenchCallback callback;
+  shared_ptr<Client> client;
+};
+
+static shared_ptr<Caps> new_payload(vector<uint8_t> &data) {
+  shared_ptr<Caps> msg = Caps::new_instance();
+  msg->write(TraceHelper::now());
+  msg->write(data.data(), data.size());
+  return msg;
+}
+
+// record latency of payload built by 'new_payload'
+static void recv_payload(shared_ptr<Caps> &msg, BenchResult &result) {
+  uint64_t ts;
+  if (msg == nullptr || msg->read(ts) != CAPS_SUCCESS)
+    return;
+  uint64_t now = TraceHelper::now();
+  result.latency.record(now > ts ? now - ts : 0);
+  result.msgs.fetch_add(1, memory_order_relaxed);
+}
+
+static uint32_t client_bufsize(const BenchOptions &opts) {
+  uint32_t size = opts.size + 4096;
+  return size > DEFAULT_MSG_BUF_SIZE ? size : DEFAULT_MSG_BUF_SIZE;
+}
+
+// 1 publisher, 'clients' subscribers
+static bool bench_fanout(const string &uri, const BenchOptions &opts,
+                         BenchResult &result) {
+  uint32_t bufsize = client_bufsize(opts);
+  // referred by callbacks, destroyed after clients
+  Completion done;
+  vector<BenchClient> subs(opts.clients);
+  BenchClient pub;
+  char name[32];
+  uint32_t i;
+
+  for (i = 0; i < subs.size(); ++i) {
+    subs[i].callback.on_post = [&](const char *, shared_ptr<Caps> &msg) {
+      recv_payload(msg, result);
+      done.add();
+    };
+    snprintf(name, sizeof(name), "fanout-sub-%u", i);
+    if (!subs[i].connect(uri, name, bufsize) ||
+        subs[i].client->subscribe("bench.fanout") != FLORA_CLI_SUCCESS ||
+        !subs[i].sync())
+      return false;
+  }
+  if (!pub.connect(uri, "fanout-pub", bufsize))
+    return false;
+  vector<uint8_t> data(opts.size);
+  result.expected = (uint64_t)opts.msgs * opts.clients;
+  result.begin();
+  for (i = 0; i < opts.msgs; ++i) {
+    shared_ptr<Caps> msg = new_payload(data);
+    if (pub.client->post("bench.fanout", msg, FLORA_MSGTYPE_INSTANT) !=
+        FLORA_CLI_SUCCESS)
+      return false;
+  }
+  bool r = done.wait(result.expected);
+  result.end();
+  result.bytes = result.msgs * opts.size;
+  return r;
+}
+
+// 'clients' publishers in threads, 1 subscriber
+static bool bench_fanin(const string &uri, const BenchOptions &opts,
+                        BenchResult &result) {
+  uint32_t bufsize = client_bufsize(opts);
+  Completion done;
+  vector<BenchClient> pubs(opts.clients);
+  BenchClient sub;
+  char name[32];
+  uint32_t i;
+
+  sub.callback.on_post = [&](const char *, shared_ptr<Caps> &msg) {
+    recv_payload(msg, result);
+    done.add();
+  };
+  if (!sub.connect(uri, "fanin-sub", bufsize) ||
+      sub.client->subscribe("bench.fanin") != FLORA_CLI_SUCCESS ||
+      !sub.sync())
+    return false;
+  for (i = 0; i < pubs.size(); ++i) {
+    snprintf(name, sizeof(name), "fanin-pub-%u", i);
+    if (!pubs[i].connect(uri, name, bufsize))
+      return false;
+  }
+  vector<thread> threads;
+  vector<uint8_t> data(opts.size);
+  result.expected = (uint64_t)opts.msgs * opts.clients;
+  result.begin();
+  for (i = 0; i < pubs.size(); ++i) {
+    threads.emplace_back([&opts, &data](BenchClient *pub) {
+      uint32_t j;
+      for (j = 0; j < opts.msgs; ++j) {
+        shared_ptr<Caps> msg = new_payload(data);
+        pub->client->post("bench.fanin", msg, FLORA_MSGTYPE_INSTANT);
+      }
+    }, &pubs[i]);
+  }
+  for (auto &thr : threads)
+    thr.join();
+  bool r = done.wait(result.expected);
+  result.end();
+  result.bytes = result.msgs * opts.size;
+  return r;
+}
+
+// synchronous calls one by one, latency is round trip
+static bool bench_call(const string &uri, const BenchOptions &opts,
+                       BenchResult &result) {
+  uint32_t bufsize = client_bufsize(opts);
+  BenchClient callee;
+  BenchClient caller;
+
+  if (!callee.connect(uri, "call-callee", bufsize) ||
+      callee.client->declare_method("bench.echo") != FLORA_CLI_SUCCESS ||
+      !callee.sync() || !caller.connect(uri, "call-caller", bufsize))
+    return false;
+  vector<uint8_t> data(opts.size);
+  result.expected = opts.msgs;
+  result.begin();
+  uint32_t i;
+  for (i = 0; i < opts.msgs; ++i) {
+    shared_ptr<Caps> msg = new_payload(data);
+    Response resp;
+    uint64_t begin = TraceHelper::now();
+    if (caller.client->call("bench.echo", msg, "call-callee", resp, 0) !=
+        FLORA_CLI_SUCCESS)
+      break;
+    result.latency.record(TraceHelper::now() - begin);
+    ++result.msgs;
+  }
+  result.end();
+  // request and reply
+  result.bytes = result.msgs * opts.size * 2;
+  return result.msgs == result.expected;
+}
+
+// asynchronous calls, at most 'window' outstanding
+static bool bench_pipeline(const string &uri, const BenchOptions &opts,
+                           BenchResult &result) {
+  uint32_t bufsize = client_bufsize(opts);
+  mutex wmutex;
+  condition_variable wcond;
+  uint32_t outstanding = 0;
+  atomic<uint32_t> failed{0};
+  BenchClient callee;
+  BenchClient caller;
+
+  if (!callee.connect(uri, "pipeline-callee", bufsize) ||
+      callee.client->declare_method("bench.echo") != FLORA_CLI_SUCCESS ||
+      !callee.sync() || !caller.connect(uri, "pipeline-caller", bufsize))
+    return false;
+  vector<uint8_t> data(opts.size);
+  result.expected = opts.msgs;
+  result.begin();
+  uint32_t i;
+  for (i = 0; i < opts.msgs; ++i) {
+    {
+      unique_lock<mutex> locker(wmutex);
+      wcond.wait(locker, [&]() { return outstanding < opts.window; });
+      ++outstanding;
+    }
+    shared_ptr<Caps> msg = new_payload(data);
+    uint64_t begin = TraceHelper::now();
+    int32_t r = caller.client->call(
+        "bench.echo", msg, "pipeline-callee",
+        [&, begin](int32_t code, Response &) {
+          if (code == FLORA_CLI_SUCCESS) {
+            result.latency.record(TraceHelper::now() - begin);
+            ++result.msgs;
+          } else {
+            ++failed;
+          }
+          lock_guard<mutex> locker(wmutex);
+          --outstanding;
+          wcond.notify_one();
+        },
+        0);
+    if (r != FLORA_CLI_SUCCESS) {
+      ++failed;
+      break;
+    }
+  }
+  {
+    unique_lock<mutex> locker(wmutex);
+    wcond.wait_for(locker, seconds(BENCH_WAIT_TIMEOUT),
+                   [&]() { return outstanding == 0; });
+  }
+  result.end();
+  result.bytes = result.msgs * opts.size * 2;
+  return failed == 0 && result.msgs == result.expected;
+}
+
+// 'clients' subscribers subscribe 'topics' persist msgs at the same time,
+// latency from subscribe to persist msg received
+static bool bench_persist(const string &uri, const BenchOptions &opts,
+                          BenchResult &result) {
+  uint32_t bufsize = client_bufsize(opts);
+  Completion done;
+  vector<uint64_t> sub_times(opts.clients);
+  vector<BenchClient> subs(opts.clients);
+  BenchClient pub;
+  vector<string> names(opts.topics);
+  char name[32];
+  uint32_t i, j;
+
+  if (!pub.connect(uri, "persist-pub", bufsize))
+    return false;
+  vector<uint8_t> data(opts.size);
+  for (i = 0; i < opts.topics; ++i) {
+    snprintf(name, sizeof(name), "bench.persist.%u", i);
+    names[i] = name;
+    shared_ptr<Caps> msg = new_payload(data);
+    if (pub.client->post(name, msg, FLORA_MSGTYPE_PERSIST) !=
+        FLORA_CLI_SUCCESS)
+      return false;
+  }
+  if (!pub.sync())
+    return false;
+  for (i = 0; i < subs.size(); ++i) {
+    uint64_t *sub_time = &sub_times[i];
+    subs[i].callback.on_post = [&, sub_time](const char *,
+                                             shared_ptr<Caps> &) {
+      result.latency.record(TraceHelper::now() - *sub_time);
+      ++result.msgs;
+      done.add();
+    };
+    snprintf(name, sizeof(name), "persist-sub-%u", i);
+    if (!subs[i].connect(uri, name, bufsize))
+      return false;
+  }
+  result.expected = (uint64_t)opts.clients * opts.topics;
+  result.begin();
+  for (i = 0; i < subs.size(); ++i) {
+    sub_times[i] = TraceHelper::now();
+    for (j = 0; j < names.size(); ++j) {
+      if (subs[i].client->subscribe(names[j].c_str()) != FLORA_CLI_SUCCESS)
+        return false;
+    }
+  }
+  bool r = done.wait(result.expected);
+  result.end();
+  result.bytes = result.msgs * opts.size;
+  return r;
+}
+
+// connect, subscribe and disconnect one by one
+static bool bench_churn(const string &uri, const BenchOptions &opts,
+                        BenchResult &result) {
+  uint32_t bufsize = client_bufsize(opts);
+  result.expected = opts.connects;
+  result.begin();
+  uint32_t i;
+  for (i = 0; i < opts.connects; ++i) {
+    uint64_t begin = TraceHelper::now();
+    BenchClient cli;
+    if (!cli.connect(uri, "churn", bufsize) ||
+        cli.client->subscribe("bench.churn") != FLORA_CLI_SUCCESS)
+      break;
+    cli.client.reset();
+    result.latency.record(TraceHelper::now() - begin);
+    ++result.msgs;
+  }
+  result.end();
+  return result.msgs == result.expected;
+}
+
+typedef bool (*BenchFunc)(const string &, const BenchOptions &,
+                          BenchResult &);
+static const struct {
+  const char *name;
+  BenchFunc func;
+} scenarios[] = {
+    {"fanout", bench_fanout},   {"fanin", bench_fanin},
+    {"call", bench_call},       {"pipeline", bench_pipeline},
+    {"persist", bench_persist}, {"churn", bench_churn},
+};
+
+static void print_result(FILE *out, bool first, const char *scenario,
+                         const char *transport, bool ok,
+                         BenchResult &result) {
+  double secs = (double)result.wall_ns / 1000000000;
+  uint64_t msgs = result.msgs;
+  fprintf(out,
+          "%s  {\"scenario\": \"%s\", \"transport\": \"%s\", \"ok\": %s, "
+          "\"msgs\": %llu, \"expected\": %llu, \"seconds\": %.6f, "
+          "\"msgs_per_sec\": %.1f, \"mb_per_sec\": %.3f, "
+          "\"p50_us\": %.3f, \"p99_us\": %.3f, \"p999_us\": %.3f, "
+          "\"cpu_ns_per_msg\": %.1f}",
+          first ? "" : ",\n", scenario, transport, ok ? "true" : "false",
+          (unsigned long long)msgs, (unsigned long long)result.expected,
+          secs, secs > 0 ? msgs / secs : 0.0,
+          secs > 0 ? result.bytes / secs / (1024 * 1024) : 0.0,
+          result.latency.value_at(0.5) / 1000.0,
+          result.latency.value_at(0.99) / 1000.0,
+          result.latency.value_at(0.999) / 1000.0,
+          msgs ? (double)result.cpu_ns / msgs : 0.0);
+  fflush(out);
+}
+
+static bool selected(const BenchOptions &opts, const char *name) {
+  if (opts.scenarios.empty())
+    return true;
+  for (auto &s : opts.scenarios) {
+    if (s == name)
+      return true;
+  }
+  return false;
+}
+
+// return: false if service failed to start
+static bool run_transport(const char *transport, const char *svc_uri,
+                          const char *cli_uri, const BenchOptions &opts,
+                          FILE *out, bool &first) {
+  auto disp = Dispatcher::new_instance(0, client_bufsize(opts));
+  auto poll = Poll::new_instance(svc_uri);
+  if (poll == nullptr)
+    return false;
+  poll->config(FLORA_POLL_OPT_WRITE_QUEUE_LIMIT,
+               (uint32_t)BENCH_WRITE_QUEUE_LIMIT);
+  if (poll->start(disp) != FLORA_POLL_SUCCESS)
+    return false;
+  disp->run(false);
+  for (auto &s : scenarios) {
+    if (!selected(opts, s.name))
+      continue;
+    BenchResult result;
+    bool ok = s.func(cli_uri, opts, result);
+    print_result(out, first, s.name, transport, ok, result);
+    first = false;
+  }
+  poll->stop();
+  disp->close();
+  return true;
+}
+
+static void print_usage(const char *progname) {
+  fprintf(stderr,
+          "USAGE: %s [options] [scenario ...]\n"
+          "scenarios: fanout fanin call pipeline persist churn (default all)\n"
+          "options:\n"
+          "--transport=unix|tcp|all  (default all)\n"
+          "--tcp-port=$PORT  (default %u)\n"
+          "--clients=$N  subscribers or publishers (default 4)\n"
+          "--msgs=$N  msgs of each publisher, or calls (default 10000)\n"
+          "--size=$BYTES  payload size (default 64)\n"
+          "--window=$N  outstanding calls of pipeline (default 32)\n"
+          "--topics=$N  persist msgs (default 100)\n"
+          "--connects=$N  connections of churn (default 500)\n"
+          "--output=$FILE  JSON output (default stdout)\n",
+          progname, BENCH_DEFAULT_TCP_PORT);
+}
+
+static bool parse_uint(const char *arg, const char *key, uint32_t &value) {
+  size_t len = strlen(key);
+  if (strncmp(arg, key, len) != 0 || arg[len] != '=')
+    return false;
+  value = strtoul(arg + len + 1, nullptr, 10);
+  return true;
+}
+
+static bool parse_cmdline(int argc, char **argv, BenchOptions &opts) {
+  int i;
+  for (i = 1; i < argc; ++i) {
+    const char *arg = argv[i];
+    if (strncmp(arg, "--", 2) != 0) {
+      opts.scenarios.push_back(arg);
+      continue;
+    }
+    arg += 2;
+    if (parse_uint(arg, "clients", opts.clients) ||
+        parse_uint(arg, "msgs", opts.msgs) ||
+        parse_uint(arg, "size", opts.size) ||
+        parse_uint(arg, "window", opts.window) ||
+        parse_uint(arg, "topics", opts.topics) ||
+        parse_uint(arg, "connects", opts.connects) ||
+        parse_uint(arg, "tcp-port", opts.tcp_port))
+      continue;
+    if (strncmp(arg, "transport=", 10) == 0) {
+      opts.unix_socket = strcmp(arg + 10, "tcp") != 0;
+      opts.tcp = strcmp(arg + 10, "unix") != 0;
+    } else if (strncmp(arg, "output=", 7) == 0) {
+      opts.output = arg + 7;
+    } else {
+      return false;
+    }
+  }
+  for (auto &s : opts.scenarios) {
+    bool found = false;
+    for (auto &sc : scenarios)
+      found = found || s == sc.name;
+    if (!found)
+      return false;
+  }
+  return opts.clients > 0 && opts.window > 0;
+}
+
+int main(int argc, char **argv) {
+  BenchOptions opts;
+  if (!parse_cmdline(argc, argv, opts)) {
+    print_usage(argv[0]);
+    return 1;
+  }
+  FILE *out = stdout;
+  if (opts.output) {
+    out = fopen(opts.output, "w");
+    if (out == nullptr) {
+      fprintf(stderr, "open %s failed\n", opts.output);
+      return 1;
+    }
+  }
+  bool first = true;
+  bool ok = true;
+  fprintf(out, "[\n");
+  if (opts.unix_socket)
+    ok = run_transport("unix", BENCH_UNIX_URI, BENCH_UNIX_URI, opts, out,
+                       first);
+  if (ok && opts.tcp) {
+    char uri[64];
+    snprintf(uri, sizeof(uri), BENCH_TCP_URI, opts.tcp_port);
+    ok = run_transport("tcp", uri, uri, opts, out, first);
+  }
+  fprintf(out, "\n]\n");
+  if (out != stdout)
+    fclose(out);
+  if (!ok)
+    fprintf(stderr, "service startup failed\n");
+  return ok ? 0 : 1;
+}
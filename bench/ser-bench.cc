@@ -0,0 +1,140 @@
+// compare frames built by Caps with frames reused from cache:
+// output must be byte identical, and cost per frame reported
+#include "defs.h"
+#include "ser-helper.h"
+#include <chrono>
+#include <functional>
+#include <stdio.h>
+#include <string.h>
+
+using namespace std;
+using namespace std::chrono;
+using namespace flora::internal;
+
+#define BENCH_BUF_SIZE 4096
+#define BENCH_LOOPS 200000
+
+typedef function<int32_t(void *, uint32_t, uint32_t)> SerializeFunc;
+
+static double ns_per_op(SerializeFunc &func, uint32_t flags) {
+  int8_t buf[BENCH_BUF_SIZE];
+  uint32_t i;
+  auto begin = steady_clock::now();
+  for (i = 0; i < BENCH_LOOPS; ++i)
+    func(buf, sizeof(buf), flags);
+  auto dur = duration_cast<nanoseconds>(steady_clock::now() - begin);
+  return (double)dur.count() / BENCH_LOOPS;
+}
+
+// 'ref': frame built by Caps as before
+// 'opt': same frame built by cached path
+static bool compare(const char *name, SerializeFunc ref, SerializeFunc opt) {
+  static const uint32_t all_flags[] = {0, CAPS_FLAG_NET_BYTEORDER};
+  int8_t ref_buf[BENCH_BUF_SIZE];
+  int8_t opt_buf[BENCH_BUF_SIZE];
+  bool ok = true;
+
+  for (auto flags : all_flags) {
+    // cached path may build cache by first call
+    opt(opt_buf, sizeof(opt_buf), flags);
+    int32_t r = ref(ref_buf, sizeof(ref_buf), flags);
+    int32_t o = opt(opt_buf, sizeof(opt_buf), flags);
+    bool same = r > 0 && r == o && memcmp(ref_buf, opt_buf, r) == 0;
+    printf("%-24s flags 0x%02x  %4d bytes  %s  caps %8.1f ns  cached %8.1f ns\n",
+           name, flags, r, same ? "identical" : "MISMATCH",
+           ns_per_op(ref, flags), ns_per_op(opt, flags));
+    ok = ok && same;
+  }
+  return ok;
+}
+
+static int32_t caps_frame(shared_ptr<Caps> &caps, void *data, uint32_t size,
+                          uint32_t flags) {
+  int32_t r = caps->serialize(data, size, flags);
+  if (r < 0 || r > size)
+    return -1;
+  return r;
+}
+
+int main(int argc, char **argv) {
+  bool ok = true;
+  shared_ptr<Caps> args = Caps::new_instance();
+  args->write(1);
+  args->write("hello");
+  args->write(2.0f);
+
+  ok = compare("ping",
+               [](void *data, uint32_t size, uint32_t flags) {
+                 shared_ptr<Caps> caps = Caps::new_instance();
+                 caps->write(CMD_PING_REQ);
+                 return caps_frame(caps, data, size, flags);
+               },
+               RequestSerializer::serialize_ping) &&
+       ok;
+  ok = compare("pong",
+               [](void *data, uint32_t size, uint32_t flags) {
+                 shared_ptr<Caps> caps = Caps::new_instance();
+                 caps->write(CMD_PONG_RESP);
+                 return caps_frame(caps, data, size, flags);
+               },
+               ResponseSerializer::serialize_pong) &&
+       ok;
+
+  // client: header of aliased raw post reused for each msgtype
+  vector<int8_t> headers[2];
+  ok = compare("alias raw post req",
+               [&args](void *data, uint32_t size, uint32_t flags) {
+                 shared_ptr<Caps> caps = Caps::new_instance();
+                 caps->write(CMD_ALIAS_RAW_POST_REQ);
+                 caps->write(0);
+                 caps->write(7);
+                 int32_t r = caps_frame(caps, data, size, flags);
+                 if (r < 0)
+                   return -1;
+                 int32_t r2 = caps_frame(args, (int8_t *)data + r, size - r,
+                                         flags);
+                 return r2 < 0 ? -1 : r + r2;
+               },
+               [&args, &headers](void *data, uint32_t size, uint32_t flags) {
+                 auto &header = headers[flags ? 1 : 0];
+                 if (header.empty()) {
+                   int32_t c = RequestSerializer::serialize_alias_raw_post_header(
+                       7, 0, data, size, flags);
+                   if (c <= 0)
+                     return -1;
+                   header.assign((int8_t *)data, (int8_t *)data + c);
+                 }
+                 return RequestSerializer::serialize_cached_raw_post(
+                     header.data(), header.size(), args, data, size, flags);
+               }) &&
+       ok;
+
+  // dispatcher: header of aliased raw post resp reused by topic
+  vector<int8_t> resp_headers[2];
+  ok = compare("alias raw post resp",
+               [](void *data, uint32_t size, uint32_t flags) {
+                 shared_ptr<Caps> caps = Caps::new_instance();
+                 caps->write(CMD_ALIAS_RAW_POST_RESP);
+                 caps->write(0);
+                 caps->write(3);
+                 caps->write((uint64_t)0x1234);
+                 caps->write(5);
+                 return caps_frame(caps, data, size, flags);
+               },
+               [&resp_headers](void *data, uint32_t size, uint32_t flags) {
+                 auto &header = resp_headers[flags ? 1 : 0];
+                 if (header.empty()) {
+                   int32_t c = ResponseSerializer::serialize_alias_raw_post(
+                       3, 0, 0x1234, 5, data, size, flags);
+                   if (c <= 0)
+                     return -1;
+                   header.assign((int8_t *)data, (int8_t *)data + c);
+                 }
+                 if (header.size() > size)
+                   return -1;
+                 memcpy(data, header.data(), header.size());
+                 return (int32_t)header.size();
+               }) &&
+       ok;
+  return ok ? 0 : 1;
+}
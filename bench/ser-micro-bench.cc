@@ -0,0 +1,724 @@
+// cost of each serializer of ser-helper and the parser of its frame:
+// ns and heap allocations (operator new) per op, for payloads of
+// different shapes and both byte orders
+#include "defs.h"
+#include "ser-helper.h"
+#include <chrono>
+#include <functional>
+#include <new>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+using namespace std;
+using namespace std::chrono;
+using namespace flora;
+using namespace flora::internal;
+
+#define MICRO_BUF_SIZE 16384
+#define MICRO_LOOPS 20000
+
+static uint64_t allocs = 0;
+
+void *operator new(size_t size) {
+  ++allocs;
+  void *p = malloc(size ? size : 1);
+  if (p == nullptr)
+    throw bad_alloc();
+  return p;
+}
+
+void *operator new[](size_t size) {
+  ++allocs;
+  void *p = malloc(size ? size : 1);
+  if (p == nullptr)
+    throw bad_alloc();
+  return p;
+}
+
+void operator delete(void *p) noexcept { free(p); }
+
+void operator delete[](void *p) noexcept { free(p); }
+
+// payload: args of post, call or reply, nullptr if none
+typedef function<int32_t(void *, uint32_t, uint32_t, shared_ptr<Caps> &)>
+    SerializeFunc;
+// 'caps' with leading fields read as dispatcher or client does
+typedef function<int32_t(shared_ptr<Caps> &)> ParseFunc;
+
+class MicroCase {
+public:
+  const char *name;
+  bool with_payload;
+  SerializeFunc serialize;
+  // integers read before 'parse': cmd, and subtype of monitor frames
+  uint32_t leading;
+  // nullptr if frame has no parser
+  ParseFunc parse;
+};
+
+class Payload {
+public:
+  const char *name;
+  shared_ptr<Caps> caps;
+};
+
+class Cost {
+public:
+  double ns = 0;
+  double allocs = 0;
+};
+
+template <typename F> static Cost measure(F func) {
+  Cost cost;
+  uint32_t i;
+  // warm up, caches of frames built by the first call
+  func();
+  uint64_t a = allocs;
+  auto begin = steady_clock::now();
+  for (i = 0; i < MICRO_LOOPS; ++i)
+    func();
+  auto dur = duration_cast<nanoseconds>(steady_clock::now() - begin);
+  cost.ns = (double)dur.count() / MICRO_LOOPS;
+  cost.allocs = (double)(allocs - a) / MICRO_LOOPS;
+  return cost;
+}
+
+static vector<Payload> make_payloads() {
+  vector<Payload> payloads;
+  payloads.push_back({"empty", Caps::new_instance()});
+
+  shared_ptr<Caps> ints = Caps::new_instance();
+  int32_t i;
+  for (i = 0; i < 10; ++i)
+    ints->write(i);
+  payloads.push_back({"10ints", ints});
+
+  shared_ptr<Caps> bin = Caps::new_instance();
+  vector<uint8_t> data(4096, 0x5a);
+  bin->write(data.data(), data.size());
+  payloads.push_back({"4kbin", bin});
+
+  // 4 children of 3 levels
+  shared_ptr<Caps> nested = Caps::new_instance();
+  for (i = 0; i < 4; ++i) {
+    shared_ptr<Caps> leaf = Caps::new_instance();
+    leaf->write(i);
+    shared_ptr<Caps> mid = Caps::new_instance();
+    mid->write(1.5f * i);
+    mid->write("middle");
+    mid->write(leaf);
+    shared_ptr<Caps> child = Caps::new_instance();
+    child->write("child");
+    child->write((int64_t)i);
+    child->write(mid);
+    nested->write(child);
+  }
+  payloads.push_back({"nested", nested});
+  return payloads;
+}
+
+static void run_case(MicroCase &c, const char *payload_name,
+                     shared_ptr<Caps> &payload, uint32_t flags) {
+  static int8_t buf[MICRO_BUF_SIZE];
+  static int8_t frame[MICRO_BUF_SIZE];
+  int32_t size = c.serialize(frame, sizeof(frame), flags, payload);
+  if (size <= 0) {
+    printf("%-28s %-7s 0x%02x  unimplemented\n", c.name, payload_name,
+           flags);
+    return;
+  }
+  Cost ser = measure(
+      [&]() { c.serialize(buf, sizeof(buf), flags, payload); });
+  printf("%-28s %-7s 0x%02x %6d bytes  ser %8.1f ns %6.2f allocs", c.name,
+         payload_name, flags, size, ser.ns, ser.allocs);
+  if (c.parse == nullptr) {
+    printf("\n");
+    return;
+  }
+  // parsers read the first frame, header of raw post
+  uint32_t version;
+  uint32_t length;
+  if (Caps::binary_info(frame, &version, &length) != CAPS_SUCCESS) {
+    printf("  parse: corrupted\n");
+    return;
+  }
+  int32_t r = 0;
+  Cost parse = measure([&]() {
+    shared_ptr<Caps> caps;
+    int32_t v;
+    uint32_t i;
+    r = Caps::parse(frame, length, caps);
+    for (i = 0; r == CAPS_SUCCESS && i < c.leading; ++i)
+      r = caps->read(v);
+    if (r == CAPS_SUCCESS)
+      r = c.parse(caps);
+  });
+  if (r != 0)
+    printf("  parse failed %d\n", r);
+  else
+    printf("  parse %8.1f ns %6.2f allocs\n", parse.ns, parse.allocs);
+}
+
+static vector<MicroCase> request_cases() {
+  vector<MicroCase> cases;
+  cases.push_back(
+      {"req auth", false,
+       [](void *data, uint32_t size, uint32_t flags, shared_ptr<Caps> &) {
+         return RequestSerializer::serialize_auth(
+             FLORA_VERSION, "bench-client", 1234, 0, data, size, flags);
+       },
+       1,
+       [](shared_ptr<Caps> &caps) {
+         uint32_t version, flags;
+         string extra;
+         int32_t pid;
+         return RequestParser::parse_auth(caps, version, extra, pid, flags);
+       }});
+  cases.push_back(
+      {"req subscribe", false,
+       [](void *data, uint32_t size, uint32_t flags, shared_ptr<Caps> &) {
+         return RequestSerializer::serialize_subscribe("foo.bar", data, size,
+                                                       flags);
+       },
+       1,
+       [](shared_ptr<Caps> &caps) {
+         string name;
+         SubscribeFilter filter;
+         return RequestParser::parse_subscribe(caps, name, filter);
+       }});
+  cases.push_back(
+      {"req subscribe filtered", false,
+       [](void *data, uint32_t size, uint32_t flags, shared_ptr<Caps> &) {
+         SubscribeFilter filter;
+         filter.equals(7).any().prefix("dev-");
+         return RequestSerializer::serialize_subscribe("foo.bar", data, size,
+                                                       flags, &filter);
+       },
+       1,
+       [](shared_ptr<Caps> &caps) {
+         string name;
+         SubscribeFilter filter;
+         return RequestParser::parse_subscribe(caps, name, filter);
+       }});
+  cases.push_back(
+      {"req unsubscribe", false,
+       [](void *data, uint32_t size, uint32_t flags, shared_ptr<Caps> &) {
+         return RequestSerializer::serialize_unsubscribe("foo.bar", data,
+                                                         size, flags);
+       },
+       1,
+       [](shared_ptr<Caps> &caps) {
+         string name;
+         return RequestParser::parse_unsubscribe(caps, name);
+       }});
+  cases.push_back(
+      {"req declare method", false,
+       [](void *data, uint32_t size, uint32_t flags, shared_ptr<Caps> &) {
+         return RequestSerializer::serialize_declare_method("foo.bar", data,
+                                                            size, flags);
+       },
+       1,
+       [](shared_ptr<Caps> &caps) {
+         string name;
+         return RequestParser::parse_declare_method(caps, name);
+       }});
+  cases.push_back(
+      {"req remove method", false,
+       [](void *data, uint32_t size, uint32_t flags, shared_ptr<Caps> &) {
+         return RequestSerializer::serialize_remove_method("foo.bar", data,
+                                                           size, flags);
+       },
+       1,
+       [](shared_ptr<Caps> &caps) {
+         string name;
+         return RequestParser::parse_remove_method(caps, name);
+       }});
+  cases.push_back(
+      {"req post", true,
+       [](void *data, uint32_t size, uint32_t flags, shared_ptr<Caps> &args) {
+         return RequestSerializer::serialize_post("foo.bar", 0, args, data,
+                                                  size, flags);
+       },
+       1,
+       [](shared_ptr<Caps> &caps) {
+         const char *name;
+         uint32_t msgtype;
+         shared_ptr<Caps> args;
+         return RequestParser::parse_post(caps, name, msgtype, args);
+       }});
+  cases.push_back(
+      {"req post traced", true,
+       [](void *data, uint32_t size, uint32_t flags, shared_ptr<Caps> &args) {
+         return RequestSerializer::serialize_post("foo.bar", 0, args, data,
+                                                  size, flags, 1234567);
+       },
+       1,
+       [](shared_ptr<Caps> &caps) {
+         const char *name;
+         uint32_t msgtype;
+         shared_ptr<Caps> args;
+         int32_t r = RequestParser::parse_post(caps, name, msgtype, args);
+         return r == 0 && RequestParser::parse_trace(caps) ? 0 : -1;
+       }});
+  cases.push_back(
+      {"req raw post", true,
+       [](void *data, uint32_t size, uint32_t flags, shared_ptr<Caps> &args) {
+         return RequestSerializer::serialize_raw_post("foo.bar", 0, args,
+                                                      data, size, flags);
+       },
+       1,
+       [](shared_ptr<Caps> &caps) {
+         const char *name;
+         uint32_t msgtype;
+         return RequestParser::parse_raw_post(caps, name, msgtype);
+       }});
+  cases.push_back(
+      {"req fd post", false,
+       [](void *data, uint32_t size, uint32_t flags, shared_ptr<Caps> &) {
+         return RequestSerializer::serialize_fd_post("foo.bar", 0, 65536,
+                                                     data, size, flags);
+       },
+       1,
+       [](shared_ptr<Caps> &caps) {
+         const char *name;
+         uint32_t msgtype, args_size;
+         return RequestParser::parse_fd_post(caps, name, msgtype, args_size);
+       }});
+  cases.push_back(
+      {"req alias", false,
+       [](void *data, uint32_t size, uint32_t flags, shared_ptr<Caps> &) {
+         return RequestSerializer::serialize_alias("foo.bar", 7, data, size,
+                                                   flags);
+       },
+       1,
+       [](shared_ptr<Caps> &caps) {
+         string name;
+         uint32_t alias;
+         return RequestParser::parse_alias(caps, name, alias);
+       }});
+  cases.push_back(
+      {"req alias post", true,
+       [](void *data, uint32_t size, uint32_t flags, shared_ptr<Caps> &args) {
+         return RequestSerializer::serialize_alias_post(7, 0, args, data, size,
+                                                        flags);
+       },
+       1,
+       [](shared_ptr<Caps> &caps) {
+         uint32_t alias, msgtype;
+         shared_ptr<Caps> args;
+         return RequestParser::parse_alias_post(caps, alias, msgtype, args);
+       }});
+  cases.push_back(
+      {"req alias raw post", true,
+       [](void *data, uint32_t size, uint32_t flags, shared_ptr<Caps> &args) {
+         return RequestSerializer::serialize_alias_raw_post(7, 0, args, data,
+                                                            size, flags);
+       },
+       1,
+       [](shared_ptr<Caps> &caps) {
+         uint32_t alias, msgtype;
+         return RequestParser::parse_alias_raw_post(caps, alias, msgtype);
+       }});
+  cases.push_back(
+      {"req alias raw post header", false,
+       [](void *data, uint32_t size, uint32_t flags, shared_ptr<Caps> &) {
+         return RequestSerializer::serialize_alias_raw_post_header(
+             7, 0, data, size, flags);
+       },
+       1,
+       [](shared_ptr<Caps> &caps) {
+         uint32_t alias, msgtype;
+         return RequestParser::parse_alias_raw_post(caps, alias, msgtype);
+       }});
+  // header built once by the first call for each byte order
+  cases.push_back(
+      {"req cached raw post", true,
+       [](void *data, uint32_t size, uint32_t flags, shared_ptr<Caps> &args) {
+         static vector<int8_t> headers[2];
+         auto &header = headers[flags ? 1 : 0];
+         if (header.empty()) {
+           int32_t c = RequestSerializer::serialize_alias_raw_post_header(
+               7, 0, data, size, flags);
+           if (c <= 0)
+             return -1;
+           header.assign((int8_t *)data, (int8_t *)data + c);
+         }
+         return RequestSerializer::serialize_cached_raw_post(
+             header.data(), header.size(), args, data, size, flags);
+       },
+       0, nullptr});
+  cases.push_back(
+      {"req call", true,
+       [](void *data, uint32_t size, uint32_t flags, shared_ptr<Caps> &args) {
+         return RequestSerializer::serialize_call("foo.bar", args, "target",
+                                                  42, 200, data, size, flags);
+       },
+       1,
+       [](shared_ptr<Caps> &caps) {
+         const char *name, *target;
+         shared_ptr<Caps> args;
+         int32_t id;
+         uint32_t timeout;
+         return RequestParser::parse_call(caps, name, args, target, id,
+                                          timeout);
+       }});
+  cases.push_back(
+      {"req reply", true,
+       [](void *data, uint32_t size, uint32_t flags, shared_ptr<Caps> &args) {
+         return RequestSerializer::serialize_reply(42, 0, args, data, size,
+                                                   flags);
+       },
+       1,
+       [](shared_ptr<Caps> &caps) {
+         int32_t id, code;
+         shared_ptr<Caps> values;
+         return RequestParser::parse_reply(caps, id, code, values);
+       }});
+  cases.push_back(
+      {"req ping", false,
+       [](void *data, uint32_t size, uint32_t flags, shared_ptr<Caps> &) {
+         return RequestSerializer::serialize_ping(data, size, flags);
+       },
+       0, nullptr});
+  // one post frame of 'args' in batch
+  cases.push_back(
+      {"req batch", true,
+       [](void *data, uint32_t size, uint32_t flags, shared_ptr<Caps> &args) {
+         static int8_t post[MICRO_BUF_SIZE];
+         int32_t c = RequestSerializer::serialize_post("foo.bar", 0, args,
+                                                       post, sizeof(post),
+                                                       flags);
+         if (c <= 0)
+           return -1;
+         return RequestSerializer::serialize_batch(post, c, data, size, flags);
+       },
+       1,
+       [](shared_ptr<Caps> &caps) {
+         const void *frames;
+         uint32_t size;
+         return RequestParser::parse_batch(caps, frames, size);
+       }});
+  return cases;
+}
+
+static vector<MicroCase> response_cases(AdapterInfoMap &infos) {
+  vector<MicroCase> cases;
+  cases.push_back(
+      {"resp auth", false,
+       [](void *data, uint32_t size, uint32_t flags, shared_ptr<Caps> &) {
+         return ResponseSerializer::serialize_auth(0, FLORA_VERSION, 32768,
+                                                   data, size, flags);
+       },
+       1,
+       [](shared_ptr<Caps> &caps) {
+         int32_t result;
+         uint32_t version, max_msg_size;
+         return ResponseParser::parse_auth(caps, result, version,
+                                           max_msg_size);
+       }});
+  cases.push_back(
+      {"resp post", true,
+       [](void *data, uint32_t size, uint32_t flags, shared_ptr<Caps> &args) {
+         return ResponseSerializer::serialize_post(
+             "foo.bar", 0, args, 0x1234, "sender", data, size, flags);
+       },
+       1,
+       [](shared_ptr<Caps> &caps) {
+         const char *name, *cliname;
+         uint32_t msgtype;
+         shared_ptr<Caps> args;
+         uint64_t tag;
+         return ResponseParser::parse_post(caps, name, msgtype, args, tag,
+                                           cliname);
+       }});
+  cases.push_back(
+      {"resp post traced", true,
+       [](void *data, uint32_t size, uint32_t flags, shared_ptr<Caps> &args) {
+         static const uint64_t trace[] = {1000, 2000, 3000};
+         return ResponseSerializer::serialize_post(
+             "foo.bar", 0, args, 0x1234, "sender", data, size, flags, trace);
+       },
+       1,
+       [](shared_ptr<Caps> &caps) {
+         const char *name, *cliname;
+         uint32_t msgtype;
+         shared_ptr<Caps> args;
+         uint64_t tag;
+         uint64_t trace[FLORA_TRACE_POINTS];
+         int32_t r = ResponseParser::parse_post(caps, name, msgtype, args, tag,
+                                                cliname);
+         ResponseParser::parse_trace(caps, trace);
+         return r == 0 && trace[FLORA_TRACE_SEND] ? 0 : -1;
+       }});
+  cases.push_back(
+      {"resp raw post", false,
+       [](void *data, uint32_t size, uint32_t flags, shared_ptr<Caps> &) {
+         return ResponseSerializer::serialize_raw_post(
+             "foo.bar", 0, 0x1234, "sender", data, size, flags);
+       },
+       1,
+       [](shared_ptr<Caps> &caps) {
+         const char *name, *cliname;
+         uint32_t msgtype;
+         uint64_t tag;
+         return ResponseParser::parse_raw_post(caps, name, msgtype, tag,
+                                               cliname);
+       }});
+  cases.push_back(
+      {"resp fd post", false,
+       [](void *data, uint32_t size, uint32_t flags, shared_ptr<Caps> &) {
+         return ResponseSerializer::serialize_fd_post(
+             "foo.bar", 0, 65536, 0x1234, "sender", data, size, flags);
+       },
+       1,
+       [](shared_ptr<Caps> &caps) {
+         const char *name, *cliname;
+         uint32_t msgtype, args_size;
+         uint64_t tag;
+         return ResponseParser::parse_fd_post(caps, name, msgtype, args_size,
+                                              tag, cliname);
+       }});
+  cases.push_back(
+      {"resp alias", false,
+       [](void *data, uint32_t size, uint32_t flags, shared_ptr<Caps> &) {
+         return ResponseSerializer::serialize_alias(ALIAS_KIND_TOPIC, 3,
+                                                    "foo.bar", data, size,
+                                                    flags);
+       },
+       1,
+       [](shared_ptr<Caps> &caps) {
+         uint32_t kind, id;
+         string name;
+         return ResponseParser::parse_alias(caps, kind, id, name);
+       }});
+  cases.push_back(
+      {"resp alias post", true,
+       [](void *data, uint32_t size, uint32_t flags, shared_ptr<Caps> &args) {
+         return ResponseSerializer::serialize_alias_post(3, 0, args, 0x1234, 5,
+                                                         data, size, flags);
+       },
+       1,
+       [](shared_ptr<Caps> &caps) {
+         uint32_t topic, msgtype, sender;
+         shared_ptr<Caps> args;
+         uint64_t tag;
+         return ResponseParser::parse_alias_post(caps, topic, msgtype, args,
+                                                 tag, sender);
+       }});
+  cases.push_back(
+      {"resp alias raw post", false,
+       [](void *data, uint32_t size, uint32_t flags, shared_ptr<Caps> &) {
+         return ResponseSerializer::serialize_alias_raw_post(
+             3, 0, 0x1234, 5, data, size, flags);
+       },
+       1,
+       [](shared_ptr<Caps> &caps) {
+         uint32_t topic, msgtype, sender;
+         uint64_t tag;
+         return ResponseParser::parse_alias_raw_post(caps, topic, msgtype, tag,
+                                                     sender);
+       }});
+  cases.push_back(
+      {"resp call", true,
+       [](void *data, uint32_t size, uint32_t flags, shared_ptr<Caps> &args) {
+         return ResponseSerializer::serialize_call("foo.bar", args, 42, 0x1234,
+                                                   "sender", data, size,
+                                                   flags);
+       },
+       1,
+       [](shared_ptr<Caps> &caps) {
+         const char *name, *cliname;
+         shared_ptr<Caps> args;
+         int32_t id;
+         uint64_t tag;
+         return ResponseParser::parse_call(caps, name, args, id, tag,
+                                           cliname);
+       }});
+  cases.push_back(
+      {"resp reply", true,
+       [](void *data, uint32_t size, uint32_t flags, shared_ptr<Caps> &args) {
+         Response reply;
+         reply.ret_code = 0;
+         reply.data = args;
+         return ResponseSerializer::serialize_reply(42, 0, &reply, 0x1234,
+                                                    data, size, flags);
+       },
+       1,
+       [](shared_ptr<Caps> &caps) {
+         int32_t id, rescode;
+         Response reply;
+         uint64_t tag;
+         return ResponseParser::parse_reply(caps, id, rescode, reply, tag);
+       }});
+  cases.push_back(
+      {"resp monitor list all", false,
+       [&infos](void *data, uint32_t size, uint32_t flags,
+                shared_ptr<Caps> &) {
+         return ResponseSerializer::serialize_monitor_list_all(infos, data,
+                                                               size, flags);
+       },
+       2,
+       [](shared_ptr<Caps> &caps) {
+         vector<MonitorListItem> items;
+         return ResponseParser::parse_monitor_list_all(caps, items);
+       }});
+  cases.push_back(
+      {"resp monitor list add", false,
+       [&infos](void *data, uint32_t size, uint32_t flags,
+                shared_ptr<Caps> &) {
+         return ResponseSerializer::serialize_monitor_list_add(
+             infos.begin()->second, data, size, flags);
+       },
+       2,
+       [](shared_ptr<Caps> &caps) {
+         MonitorListItem item;
+         return ResponseParser::parse_monitor_list_add(caps, item);
+       }});
+  cases.push_back(
+      {"resp monitor list remove", false,
+       [](void *data, uint32_t size, uint32_t flags, shared_ptr<Caps> &) {
+         return ResponseSerializer::serialize_monitor_list_remove(3, data,
+                                                                  size, flags);
+       },
+       2,
+       [](shared_ptr<Caps> &caps) {
+         uint32_t id;
+         return ResponseParser::parse_monitor_list_remove(caps, id);
+       }});
+  cases.push_back(
+      {"resp monitor sub all", false,
+       [&infos](void *data, uint32_t size, uint32_t flags,
+                shared_ptr<Caps> &) {
+         return ResponseSerializer::serialize_monitor_sub_all(infos, data,
+                                                              size, flags);
+       },
+       2,
+       [](shared_ptr<Caps> &caps) {
+         vector<MonitorSubscriptionItem> items;
+         return ResponseParser::parse_monitor_sub_all(caps, items);
+       }});
+  cases.push_back(
+      {"resp monitor sub add", false,
+       [](void *data, uint32_t size, uint32_t flags, shared_ptr<Caps> &) {
+         return ResponseSerializer::serialize_monitor_sub_add(3, "foo.bar",
+                                                              data, size,
+                                                              flags);
+       },
+       2,
+       [](shared_ptr<Caps> &caps) {
+         MonitorSubscriptionItem item;
+         return ResponseParser::parse_monitor_sub_add(caps, item);
+       }});
+  cases.push_back(
+      {"resp monitor sub remove", false,
+       [](void *data, uint32_t size, uint32_t flags, shared_ptr<Caps> &) {
+         return ResponseSerializer::serialize_monitor_sub_remove(
+             3, "foo.bar", data, size, flags);
+       },
+       2,
+       [](shared_ptr<Caps> &caps) {
+         MonitorSubscriptionItem item;
+         return ResponseParser::parse_monitor_sub_remove(caps, item);
+       }});
+  cases.push_back(
+      {"resp monitor decl all", false,
+       [&infos](void *data, uint32_t size, uint32_t flags,
+                shared_ptr<Caps> &) {
+         return ResponseSerializer::serialize_monitor_decl_all(infos, data,
+                                                               size, flags);
+       },
+       2,
+       [](shared_ptr<Caps> &caps) {
+         vector<MonitorDeclarationItem> items;
+         return ResponseParser::parse_monitor_decl_all(caps, items);
+       }});
+  cases.push_back(
+      {"resp monitor decl add", false,
+       [](void *data, uint32_t size, uint32_t flags, shared_ptr<Caps> &) {
+         return ResponseSerializer::serialize_monitor_decl_add(3, "foo.bar",
+                                                               data, size,
+                                                               flags);
+       },
+       2,
+       [](shared_ptr<Caps> &caps) {
+         MonitorDeclarationItem item;
+         return ResponseParser::parse_monitor_decl_add(caps, item);
+       }});
+  cases.push_back(
+      {"resp monitor decl remove", false,
+       [](void *data, uint32_t size, uint32_t flags, shared_ptr<Caps> &) {
+         return ResponseSerializer::serialize_monitor_decl_remove(
+             3, "foo.bar", data, size, flags);
+       },
+       2,
+       [](shared_ptr<Caps> &caps) {
+         MonitorDeclarationItem item;
+         return ResponseParser::parse_monitor_decl_remove(caps, item);
+       }});
+  cases.push_back(
+      {"resp monitor post", false,
+       [](void *data, uint32_t size, uint32_t flags, shared_ptr<Caps> &) {
+         return ResponseSerializer::serialize_monitor_post(3, "foo.bar", data,
+                                                           size, flags);
+       },
+       2,
+       [](shared_ptr<Caps> &caps) {
+         MonitorPostInfo info;
+         return ResponseParser::parse_monitor_post(caps, info);
+       }});
+  cases.push_back(
+      {"resp monitor call", false,
+       [](void *data, uint32_t size, uint32_t flags, shared_ptr<Caps> &) {
+         return ResponseSerializer::serialize_monitor_call(
+             3, "foo.bar", "target", 0, data, size, flags);
+       },
+       2,
+       [](shared_ptr<Caps> &caps) {
+         MonitorCallInfo info;
+         return ResponseParser::parse_monitor_call(caps, info);
+       }});
+  cases.push_back(
+      {"resp pong", false,
+       [](void *data, uint32_t size, uint32_t flags, shared_ptr<Caps> &) {
+         return ResponseSerializer::serialize_pong(data, size, flags);
+       },
+       0, nullptr});
+  return cases;
+}
+
+// usage: flora-ser-micro-bench [name filter]
+int main(int argc, char **argv) {
+  static const uint32_t all_flags[] = {0, CAPS_FLAG_NET_BYTEORDER};
+  const char *filter = argc > 1 ? argv[1] : nullptr;
+  vector<Payload> payloads = make_payloads();
+  shared_ptr<Caps> none;
+
+  // clients listed by monitor frames
+  AdapterInfoMap infos;
+  intptr_t i;
+  for (i = 0; i < 8; ++i) {
+    AdapterInfo &info = infos[i];
+    info.pid = 1000 + i;
+    info.name = "client-" + to_string(i);
+  }
+
+  vector<MicroCase> cases = request_cases();
+  vector<MicroCase> resp = response_cases(infos);
+  cases.insert(cases.end(), resp.begin(), resp.end());
+  printf("%d loops per op, allocs counted by operator new\n", MICRO_LOOPS);
+  for (auto &c : cases) {
+    if (filter && strstr(c.name, filter) == nullptr)
+      continue;
+    for (auto flags : all_flags) {
+      if (!c.with_payload) {
+        run_case(c, "-", none, flags);
+        continue;
+      }
+      for (auto &p : payloads)
+        run_case(c, p.name, p.caps, flags);
+    }
+  }
+  return 0;
+}
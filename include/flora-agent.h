@@ -25,6 +25,12 @@
 //   interval: interval of send beep packet
 //   timeout: timeout of flora service no response
 #define FLORA_AGENT_CONFIG_KEEPALIVE 4
+// config(KEY, uint32_t bytes, uint32_t interval)
+//   批量发送post消息, 见flora::Client::set_batch
+#define FLORA_AGENT_CONFIG_BATCH 5
+// config(KEY, uint32_t enable)
+//   post消息携带时间戳, 见FLORA_CLI_FLAG_TRACE
+#define FLORA_AGENT_CONFIG_TRACE 6
 
 #ifdef __cplusplus
 
@@ -33,6 +39,7 @@
 #include <functional>
 #include <map>
 #include <mutex>
+#include <set>
 #include <thread>
 #include <list>
 
@@ -45,6 +52,7 @@ typedef std::function<void(const char *, std::shared_ptr<Caps> &,
     CallHandler;
 typedef std::map<std::string, PostHandler> PostHandlerMap;
 typedef std::map<std::string, CallHandler> CallHandlerMap;
+typedef std::set<std::string> AliasSet;
 
 class Agent : public ClientCallback {
 public:
@@ -54,9 +62,20 @@ public:
 
   void config(uint32_t key, va_list ap);
 
-  void subscribe(const char *name, PostHandler &&cb);
+  int32_t subscribe(const char *name, PostHandler &&cb);
 
-  void subscribe(const char *name, PostHandler &cb);
+  int32_t subscribe(const char *name, PostHandler &cb);
+
+  // 带过滤条件订阅, 见Client::subscribe(name, filter)
+  // 已订阅时替换过滤条件并重新订阅, 保留原回调函数
+  // return: FLORA_CLI_SUCCESS 成功, 未连接时连接后订阅
+  //         FLORA_CLI_EINVAL 过滤条件不可用, 见Client::subscribe
+  //         失败时订阅及过滤条件不变
+  int32_t subscribe(const char *name, const SubscribeFilter &filter,
+                    PostHandler &&cb);
+
+  int32_t subscribe(const char *name, const SubscribeFilter &filter,
+                    PostHandler &cb);
 
   void unsubscribe(const char *name);
 
@@ -73,6 +92,16 @@ public:
   int32_t post(const char *name, std::shared_ptr<Caps> &msg,
                uint32_t msgtype = FLORA_MSGTYPE_INSTANT);
 
+  // 立即发送批量缓存的post消息, 见FLORA_AGENT_CONFIG_BATCH
+  int32_t flush();
+
+  // 见flora::Client::alias, 重连后自动重新注册
+  int32_t alias(const char *name);
+
+  // 见flora::Client::trace_stats, 重连后重新统计
+  // return: nullptr 未连接
+  std::shared_ptr<Caps> trace_stats();
+
   int32_t call(const char *name, std::shared_ptr<Caps> &msg, const char *target,
                Response &response, uint32_t timeout = 0);
 
@@ -102,6 +131,9 @@ private:
 
   void destroy_client();
 
+  // 更新post_filters中name的过滤条件, 条件为空时删除, 需持有conn_mutex
+  void set_filter(const std::string &name, const SubscribeFilter &filter);
+
   void clean_gabages(std::list<std::shared_ptr<Client> >& gabages);
 
 private:
@@ -115,11 +147,18 @@ private:
     MonitorCallback *mon_callback = nullptr;
     uint32_t beep_interval = FLORA_CLI_DEFAULT_BEEP_INTERVAL;
     uint32_t noresp_timeout = FLORA_CLI_DEFAULT_NORESP_TIMEOUT;
+    uint32_t batch_bytes = 0;
+    uint32_t batch_interval = 0;
   };
 
   Options options;
   PostHandlerMap post_handlers;
+  // post_handlers中带过滤条件的订阅
+  std::map<std::string, SubscribeFilter> post_filters;
+  // 订阅名称为通配模式的post_handlers数量
+  uint32_t pattern_handlers = 0;
   CallHandlerMap call_handlers;
+  AliasSet aliases;
   std::mutex conn_mutex;
   std::condition_variable conn_cond;
   // 'start' and try connect flora service once
@@ -165,6 +204,10 @@ void flora_agent_close(flora_agent_t agent);
 int32_t flora_agent_post(flora_agent_t agent, const char *name, caps_t msg,
                          uint32_t msgtype);
 
+int32_t flora_agent_flush(flora_agent_t agent);
+
+int32_t flora_agent_alias(flora_agent_t agent, const char *name);
+
 int32_t flora_agent_call(flora_agent_t agent, const char *name, caps_t msg,
                          const char *target, flora_call_result *result,
                          uint32_t timeout);
@@ -43,9 +43,38 @@
 #define FLORA_CLI_FLAG_MONITOR_DETAIL_POST 0x8
 #define FLORA_CLI_FLAG_MONITOR_DETAIL_CALL 0x10
 #define FLORA_CLI_FLAG_KEEPALIVE 0x20
+// post消息携带时间戳, 见MsgSender::timestamp
+#define FLORA_CLI_FLAG_TRACE 0x40
+
+// MsgSender::timestamp(point)
+// 发送者client发送
+#define FLORA_TRACE_SEND 0
+// 服务端收到
+#define FLORA_TRACE_SVC_RECV 1
+// 服务端转发
+#define FLORA_TRACE_SVC_DISPATCH 2
+// 本client收到
+#define FLORA_TRACE_RECV 3
+#define FLORA_TRACE_POINTS 4
+
+// SubscribeFilter::Condition::kind
+// 字段存在即可, 任意类型
+#define FLORA_FILTER_ANY 0
+// 整数字段(int32/int64)等于min
+#define FLORA_FILTER_INT_EQ 1
+// 整数字段在[min, max]内
+#define FLORA_FILTER_INT_RANGE 2
+// 字符串字段以str开头
+#define FLORA_FILTER_STR_PREFIX 3
+// 过滤条件最多作用于消息前8个字段
+#define FLORA_FILTER_MAX_FIELDS 8
+// SubscribeFilter::flags
+// 只保留最新值: 订阅者发送队列中尚未发出的旧消息被新消息替换
+#define FLORA_FILTER_FLAG_LATEST 0x1
 
 #define FLORA_CLI_DEFAULT_BEEP_INTERVAL 50000
 #define FLORA_CLI_DEFAULT_NORESP_TIMEOUT 100000
+#define FLORA_CLI_DEFAULT_BATCH_INTERVAL 10
 
 namespace flora {
 
@@ -71,6 +100,71 @@ public:
   virtual void end(int32_t code, std::shared_ptr<Caps> &data) = 0;
 };
 
+// 订阅过滤条件, 由服务端在转发post消息前检查, 不满足的消息不发送给订阅者
+// 第i个条件作用于消息的第i个字段, 所有条件满足时转发
+// 字段不存在或类型不符视为不满足
+// 另可指定只保留最新值及最大转发频率, 见latest, max_rate
+class SubscribeFilter {
+public:
+  class Condition {
+  public:
+    uint32_t kind = FLORA_FILTER_ANY;
+    int64_t min = 0;
+    int64_t max = 0;
+    std::string str;
+  };
+
+  SubscribeFilter &any() {
+    conditions.emplace_back();
+    return *this;
+  }
+
+  SubscribeFilter &equals(int64_t value) {
+    conditions.emplace_back();
+    conditions.back().kind = FLORA_FILTER_INT_EQ;
+    conditions.back().min = value;
+    return *this;
+  }
+
+  SubscribeFilter &range(int64_t min, int64_t max) {
+    conditions.emplace_back();
+    conditions.back().kind = FLORA_FILTER_INT_RANGE;
+    conditions.back().min = min;
+    conditions.back().max = max;
+    return *this;
+  }
+
+  SubscribeFilter &prefix(const char *str) {
+    conditions.emplace_back();
+    conditions.back().kind = FLORA_FILTER_STR_PREFIX;
+    conditions.back().str = str;
+    return *this;
+  }
+
+  // 订阅者来不及接收时只保留最新的一条消息
+  SubscribeFilter &latest() {
+    flags |= FLORA_FILTER_FLAG_LATEST;
+    return *this;
+  }
+
+  // 每秒最多转发'rate'条消息, 0不限制
+  // 间隔内收到的消息只保留最新一条, 间隔结束时转发
+  SubscribeFilter &max_rate(uint32_t rate) {
+    min_interval = rate ? 1000000 / rate : 0;
+    return *this;
+  }
+
+  bool empty() const {
+    return conditions.empty() && flags == 0 && min_interval == 0;
+  }
+
+  std::vector<Condition> conditions;
+  // FLORA_FILTER_FLAG_*
+  uint32_t flags = 0;
+  // 两次转发最小间隔, 微秒
+  uint32_t min_interval = 0;
+};
+
 class ClientCallback;
 class MonitorCallback;
 
@@ -87,8 +181,16 @@ class Client {
 public:
   virtual ~Client() = default;
 
+  // name: 以'.'分隔的多级名称, "*"级匹配任意一级,
+  //       最后一级"#"匹配零或多级, 如"sensor.*", "sensor.#"
   virtual int32_t subscribe(const char *name) = 0;
 
+  // 带过滤条件订阅, 已订阅时替换过滤条件
+  // name不能是通配模式, 条件不超过FLORA_FILTER_MAX_FIELDS个
+  // 服务端不支持过滤(或latest, max_rate)时返回FLORA_CLI_EINVAL
+  virtual int32_t subscribe(const char *name,
+                            const SubscribeFilter &filter) = 0;
+
   virtual int32_t unsubscribe(const char *name) = 0;
 
   virtual int32_t declare_method(const char *name) = 0;
@@ -112,6 +214,27 @@ public:
                        std::function<void(int32_t, Response &)> &cb,
                        uint32_t timeout = 0) = 0;
 
+  // 批量发送post消息: 缓存的消息达到'bytes'字节, 或缓存'interval'毫秒后,
+  // 一次发送. 其它请求发送前先发送缓存的消息, 保持消息顺序
+  // bytes: 0关闭批量发送, 不超过msg_buf_size
+  // interval: 0使用默认值FLORA_CLI_DEFAULT_BATCH_INTERVAL
+  virtual int32_t set_batch(uint32_t bytes, uint32_t interval = 0) = 0;
+
+  // 立即发送缓存的post消息
+  virtual int32_t flush() = 0;
+
+  // 为消息名'name'注册别名, 此后post此消息时以整数id代替消息名发送
+  // 别名仅在当前连接有效, 重连后需重新注册 (Agent自动重新注册)
+  // 服务端不支持别名时忽略, 返回成功
+  virtual int32_t alias(const char *name) = 0;
+
+  // 收到的带时间戳post消息各段延迟统计(纳秒), 按消息名分别统计
+  // 依次为: uint32 消息个数n, n个消息的caps:
+  //   string 消息名
+  //   uint64 count, p50, p99, p999: 服务端转发 --> 本client收到
+  //   uint64 count, p50, p99, p999: 发送者发送 --> 本client收到
+  virtual std::shared_ptr<Caps> trace_stats() = 0;
+
   virtual int get_socket() const = 0;
 
   static int32_t connect(const char *uri, ClientCallback *cb,
@@ -219,6 +342,11 @@ public:
 
   static const char* name();
 
+  // 消息经过'point'(FLORA_TRACE_*)的时间, CLOCK_MONOTONIC纳秒
+  // 仅同一主机的时间可比较
+  // return: 0 发送者未设置FLORA_CLI_FLAG_TRACE
+  static uint64_t timestamp(uint32_t point);
+
   // pid string, if connection type is unix domain socket connection
   // ipaddr:port, if connection type is tcp socket connection
   static void to_string(std::string& str);
@@ -319,6 +447,8 @@ typedef struct {
 // uri: 支持的schema:
 //     tcp://$(host):$(port)/<#extra>
 //     unix:$(domain_name)<#extra>         (unix domain socket)
+//     shm:$(domain_name)<#extra>          (unix domain socket建立连接后,
+//                                          通过共享内存传输数据, 仅linux)
 // #extra为客户端自定义字符串，用于粗略标识自身身份，不保证全局唯一性
 // async: 异步模式开关
 // result: 返回flora_cli_t对象
@@ -351,9 +481,20 @@ int32_t flora_cli_declare_method(flora_cli_t handle, const char *name);
 int32_t flora_cli_remove_method(flora_cli_t handle, const char *name);
 
 // msgtype: INSTANT | PERSIST
+// unix:连接时, 大于64K的msg通过memfd传递, 不受msg_buf_size限制
+// (订阅者无法接收fd时, 由服务端复制, 受服务端buf size限制)
 int32_t flora_cli_post(flora_cli_t handle, const char *name, caps_t msg,
                        uint32_t msgtype);
 
+// 见flora::Client::set_batch
+int32_t flora_cli_set_batch(flora_cli_t handle, uint32_t bytes,
+                            uint32_t interval);
+
+int32_t flora_cli_flush(flora_cli_t handle);
+
+// 见flora::Client::alias
+int32_t flora_cli_alias(flora_cli_t handle, const char *name);
+
 int32_t flora_cli_call(flora_cli_t handle, const char *name, caps_t msg,
                        const char *target, flora_call_result *result,
                        uint32_t timeout);
@@ -10,9 +10,39 @@
 
 // options of 'config'
 #define FLORA_POLL_OPT_KEEPALIVE_TIMEOUT 1
+// config(KEY, uint32_t selector), effective if invoked before 'start'
+//   selector: FLORA_POLL_SELECTOR_*
+#define FLORA_POLL_OPT_SELECTOR 2
+// config(KEY, uint32_t threads), effective if invoked before 'start'
+//   threads: number of threads reading connections, default 1
+//            if > 1, one more thread accepts connections and hands them
+//            over to the reading threads by turns
+#define FLORA_POLL_OPT_THREADS 3
+// config(KEY, uint32_t bytes)
+//   max bytes queued for a connection not writable, default 1MB
+#define FLORA_POLL_OPT_WRITE_QUEUE_LIMIT 4
+// config(KEY, uint32_t policy)
+//   policy: FLORA_POLL_WQ_*, applied when write queue limit exceeded
+#define FLORA_POLL_OPT_WRITE_QUEUE_POLICY 5
+
+// close the connection (default)
+#define FLORA_POLL_WQ_DISCONNECT 0
+// drop queued messages from the oldest
+#define FLORA_POLL_WQ_DROP_OLDEST 1
+// drop the message being written
+#define FLORA_POLL_WQ_DROP_NEWEST 2
+
+// readiness notification mechanism of Poll
+// default EPOLL if supported by platform, otherwise SELECT
+#define FLORA_POLL_SELECTOR_SELECT 0
+#define FLORA_POLL_SELECTOR_EPOLL 1
 
 #define FLORA_DISP_FLAG_MONITOR 1
 
+// built-in method of dispatcher, call with empty target
+// reply data: same as Dispatcher::stats
+#define FLORA_STATS_METHOD "flora.stats"
+
 #ifdef __cplusplus
 #include <memory>
 
@@ -26,6 +56,10 @@ public:
 
   virtual void close() = 0;
 
+  // snapshot of counters, may be invoked by any thread
+  // see docs/dispatcher.md for layout
+  virtual std::shared_ptr<Caps> stats() = 0;
+
   static std::shared_ptr<Dispatcher> new_instance(uint32_t flags = 0,
                                                   uint32_t msg_buf_size = 0);
 };
@@ -64,6 +98,10 @@ void flora_dispatcher_run(flora_dispatcher_t handle, int32_t block);
 
 void flora_dispatcher_close(flora_dispatcher_t handle);
 
+// 统计数据快照，格式同Dispatcher::stats
+// return: 调用者使用caps_destroy释放，handle为0时返回0
+caps_t flora_dispatcher_stats(flora_dispatcher_t handle);
+
 // void flora_dispatcher_forward_msg(flora_dispatcher_t handle, const char
 // *name,
 //                                   caps_t msg);
@@ -82,6 +120,7 @@ void flora_dispatcher_close(flora_dispatcher_t handle);
 // uri: 支持的schema:
 //     tcp://$(host):$(port)
 //     unix:$(domain_name)         (unix domain socket)
+//     shm:$(domain_name)          (同unix, 客户端可使用shm:连接)
 // return:
 //      SUCESS
 //      INVAL: uri参数不合法
@@ -1,14 +1,35 @@
 #pragma once
 
+#include "caps.h"
+#include "stats.h"
+#include <memory>
 #include <set>
 #include <stdint.h>
 #include <string>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <unordered_set>
+#include <vector>
 
 typedef struct {
   void *data;
   uint32_t size;
 } Frame;
 
+// fd owned by multiple writers, closed when last reference released
+class SharedFd {
+public:
+  explicit SharedFd(int f) : fd(f) {}
+
+  ~SharedFd() { ::close(fd); }
+
+  SharedFd(const SharedFd &) = delete;
+
+  SharedFd &operator=(const SharedFd &) = delete;
+
+  const int fd;
+};
+
 class AdapterInfo {
 public:
   AdapterInfo() { id = ++idseq; }
@@ -17,7 +38,20 @@ public:
   int32_t pid;
   std::string name;
   std::set<std::string> declared_methods;
+  // ids of subscribed topics, see TopicTable
+  std::vector<uint32_t> subscriptions;
+  // ids of subscribed patterns, see TopicTable::intern_pattern
+  std::vector<uint32_t> pattern_subscriptions;
+  // topic ids indexed by alias id of CMD_ALIAS_REQ, 0 if not bound
+  std::vector<uint32_t> aliases;
+  // ids of topics and senders written to this adapter by CMD_ALIAS_RESP
+  std::unordered_set<uint32_t> known_topics;
+  std::unordered_set<uint32_t> known_senders;
   uint32_t flags = 0;
+  // FLORA_VERSION of client
+  uint32_t version = 0;
+  // shared with Adapter, outlives it while snapshot reading
+  std::shared_ptr<flora::internal::AdapterStats> stats;
 
   static uint32_t idseq;
 
@@ -32,6 +66,34 @@ public:
   bool has_method(const std::string &name) {
     return declared_methods.find(name) != declared_methods.end();
   }
+
+  void add_subscription(uint32_t topic_id) {
+    subscriptions.push_back(topic_id);
+  }
+
+  void remove_subscription(uint32_t topic_id) {
+    erase_id(subscriptions, topic_id);
+  }
+
+  void add_pattern_subscription(uint32_t pattern_id) {
+    pattern_subscriptions.push_back(pattern_id);
+  }
+
+  void remove_pattern_subscription(uint32_t pattern_id) {
+    erase_id(pattern_subscriptions, pattern_id);
+  }
+
+private:
+  static void erase_id(std::vector<uint32_t> &ids, uint32_t id) {
+    size_t i;
+    for (i = 0; i < ids.size(); ++i) {
+      if (ids[i] == id) {
+        ids[i] = ids.back();
+        ids.pop_back();
+        break;
+      }
+    }
+  }
 };
 
 class Adapter {
@@ -46,6 +108,45 @@ public:
 
   virtual int32_t write(const void *data, uint32_t size) = 0;
 
+  // write frames gathered from 'iov' atomically
+  virtual int32_t writev(const struct iovec *iov, int iovcnt) = 0;
+
+  // writev, and frames of previous write with same 'key' discarded if not
+  // written yet, so peer behind receives the latest only
+  // key: nonzero
+  virtual int32_t writev_latest(const struct iovec *iov, int iovcnt,
+                                uint32_t key) {
+    return writev(iov, iovcnt);
+  }
+
+  // frame never dropped by backpressure policy once written,
+  // for frames that later frames depend on (CMD_ALIAS_RESP)
+  // corked frames written before it
+  virtual int32_t write_pinned(const void *data, uint32_t size) {
+    return write(data, size);
+  }
+
+  // whether fds can be passed to peer, see write_fd
+  virtual bool fd_passing() { return false; }
+
+  // write frame with 'fd' attached
+  virtual int32_t write_fd(const void *data, uint32_t size,
+                           std::shared_ptr<SharedFd> &fd) {
+    return -1;
+  }
+
+  // next fd received from peer, caller owns it
+  // accessed by reading thread only
+  // return: -1 if no fd received
+  virtual int take_fd() { return -1; }
+
+  // buffer following writes until 'uncork', written by one system call
+  // results of buffered writes are final, as if written uncorked
+  // return: false if already corked or not supported
+  virtual bool cork() { return false; }
+
+  virtual void uncork() {}
+
   virtual void close() = 0;
 
   virtual bool closed() = 0;
@@ -58,8 +159,10 @@ public:
   //   high 32 bits: 0x80000000 | ipv4port
   //   low 32 bits: ipv4addr
   uint64_t tag = 0;
-#ifdef FLORA_DEBUG
-  uint32_t recv_times = 0;
-  uint32_t recv_bytes = 0;
-#endif
+  // header of CMD_RAW_POST_REQ or CMD_ALIAS_RAW_POST_REQ, waiting for args
+  // frame, accessed by reading thread only
+  std::shared_ptr<Caps> raw_post_header;
+  int32_t raw_post_cmd = 0;
+  std::shared_ptr<flora::internal::AdapterStats> stats =
+      std::make_shared<flora::internal::AdapterStats>();
 };
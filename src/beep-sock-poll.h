@@ -4,7 +4,10 @@
 #include "rlog.h"
 #include "sock-poll.h"
 #include <chrono>
+#include <iterator>
+#include <list>
 #include <memory>
+#include <unordered_map>
 #include <errno.h>
 #include <stdarg.h>
 #include <string.h>
@@ -26,93 +29,88 @@ public:
   BeepSocketPoll(const std::string &host, int32_t port)
       : SocketPoll(host, port) {}
 
-  void config(uint32_t opt, ...) {
-    va_list ap;
-    va_start(ap, opt);
+  // stop run thread before active_adapters destroyed
+  ~BeepSocketPoll() { stop(); }
+
+private:
+  void vconfig(uint32_t opt, va_list ap) {
     switch (opt) {
     case FLORA_POLL_OPT_KEEPALIVE_TIMEOUT:
       options.beep_timeout = va_arg(ap, uint32_t);
       break;
+    default:
+      SocketPoll::vconfig(opt, ap);
+      break;
     }
-    va_end(ap);
   }
 
-private:
-  int32_t do_poll(fd_set *rfds, int max_fd) {
-    int r;
-    struct timeval tv;
-    struct timeval *ptv;
+  int32_t do_poll(SelectorEventList &events) {
+    int32_t timeout;
     std::chrono::steady_clock::time_point nowtp;
 
-    while (true) {
-      if (active_adapters.empty()) {
+    if (active_adapters.empty()) {
 #ifdef SELECT_BLOCK_IF_FD_CLOSED
-        tv.tv_sec = 5;
-        tv.tv_usec = 0;
-        ptv = &tv;
+      timeout = 5000;
 #else
-        ptv = nullptr;
+      timeout = -1;
 #endif
-      } else {
-        nowtp = std::chrono::steady_clock::now();
-        obtain_timeout(nowtp, &tv);
-        ptv = &tv;
-      }
-      r = select(max_fd, rfds, nullptr, nullptr, ptv);
-      if (r < 0) {
-        if (errno == EAGAIN) {
-          sleep(1);
-          continue;
-        }
-        KLOGE(TAG, "select failed: %s", strerror(errno));
-      }
+    } else {
       nowtp = std::chrono::steady_clock::now();
-      shutdown_timeout_adapter(nowtp);
-      break;
+      timeout = obtain_timeout(nowtp);
     }
+    int32_t r = wait_events(events, timeout);
+    nowtp = std::chrono::steady_clock::now();
+    shutdown_timeout_adapter(nowtp);
     return r;
   }
 
-  std::shared_ptr<Adapter> do_accept(int lfd) {
-    auto adap = SocketPoll::do_accept(lfd);
+  std::shared_ptr<Adapter> do_accept(int fd, uint64_t tag) {
+    auto adap = SocketPoll::do_accept(fd, tag);
     if (adap != nullptr) {
       auto it = active_adapters.emplace(active_adapters.end());
       it->adapter = adap;
       it->lastest_action_tp = std::chrono::steady_clock::now();
-      return adap;
+      active_index[adap.get()] = it;
     }
     return adap;
   }
 
   bool do_read(std::shared_ptr<Adapter> &adap) {
     bool r = SocketPoll::do_read(adap);
-    auto it = active_adapters.begin();
-    while (it != active_adapters.end()) {
-      if (it->adapter == adap)
-        break;
-      ++it;
-    }
-    if (it != active_adapters.end()) {
-      if (r) {
-        // move adapter to end of list
-        // adapter sorted by lastest_action_tp
-        it->lastest_action_tp = std::chrono::steady_clock::now();
-        if (it != active_adapters.rbegin().base())
-          active_adapters.splice(active_adapters.end(), active_adapters, it);
-      } else {
-        active_adapters.erase(it);
-      }
+    auto iit = active_index.find(adap.get());
+    if (r && iit != active_index.end()) {
+      auto it = iit->second;
+      // move adapter to end of list
+      // adapter sorted by lastest_action_tp
+      it->lastest_action_tp = std::chrono::steady_clock::now();
+      if (it != std::prev(active_adapters.end()))
+        active_adapters.splice(active_adapters.end(), active_adapters, it);
     }
     return r;
   }
 
-  void obtain_timeout(std::chrono::steady_clock::time_point &nowtp,
-                      struct timeval *tv) {
+  // fd of deleted adapter closed and may be reused, forget it before
+  // keepalive sweep shutdown it
+  void on_adapter_deleted(std::shared_ptr<Adapter> &adap) {
+    auto iit = active_index.find(adap.get());
+    if (iit != active_index.end()) {
+      active_adapters.erase(iit->second);
+      active_index.erase(iit);
+    }
+  }
+
+  SocketPoll *new_worker() {
+    auto worker = new BeepSocketPoll(std::string(), 0);
+    worker->options = options;
+    return worker;
+  }
+
+  // return: milliseconds until the earliest keepalive deadline
+  int32_t obtain_timeout(std::chrono::steady_clock::time_point &nowtp) {
     auto dur = std::chrono::duration_cast<std::chrono::milliseconds>(
         std::chrono::milliseconds(options.beep_timeout) -
         (nowtp - active_adapters.front().lastest_action_tp));
-    tv->tv_sec = dur.count() / 1000;
-    tv->tv_usec = (dur.count() % 1000) * 1000;
+    return dur.count() > 0 ? dur.count() : 0;
   }
 
   void shutdown_timeout_adapter(std::chrono::steady_clock::time_point &nowtp) {
@@ -129,6 +127,7 @@ private:
         int fd = std::static_pointer_cast<SocketAdapter>(it->adapter)->socket();
         KLOGW(TAG, "tcp socket %d keepalive timeout, shutdown!", fd);
         ::shutdown(fd, SHUT_RDWR);
+        active_index.erase(it->adapter.get());
         it = active_adapters.erase(it);
         continue;
       }
@@ -160,6 +159,7 @@ private:
     uint32_t beep_timeout = 60000;
   };
   ActiveAdapterList active_adapters;
+  std::unordered_map<Adapter *, ActiveAdapterList::iterator> active_index;
   Options options;
 };
 
@@ -1,14 +1,20 @@
 #include "cli.h"
+#include "deadline-sched.h"
+#include "memfd.h"
 #include "rlog.h"
 #include "ser-helper.h"
+#include "shm-conn.h"
 #include "sock-conn.h"
+#include "topic-match.h"
 #include "uri.h"
 #include <assert.h>
+#include <errno.h>
 #include <signal.h>
 #include <string.h>
 #include <sys/mman.h>
 #include <unistd.h>
 #include <algorithm>
+#include <tuple>
 
 using namespace std;
 using namespace std::chrono;
@@ -16,6 +22,7 @@ using rokid::Uri;
 
 thread_local uint64_t flora::internal::Client::tag = 0;
 thread_local string flora::internal::Client::sender_name;
+thread_local uint64_t flora::internal::Client::trace[FLORA_TRACE_POINTS];
 
 static bool ignore_sigpipe = false;
 int32_t flora::Client::connect(const char *uri, flora::ClientCallback *ccb,
@@ -109,6 +116,16 @@ int32_t Client::connect(const char *uri, ClientCallback *ccb,
     }
     connection.reset(conn);
     serialize_flags = CAPS_FLAG_NET_BYTEORDER;
+#ifdef HAVE_SHM
+  } else if (urip.scheme == "shm") {
+    ShmConn *sconn = new ShmConn();
+    if (!sconn->connect(urip.path)) {
+      delete sconn;
+      return FLORA_CLI_ECONN;
+    }
+    connection.reset(sconn);
+    serialize_flags = 0;
+#endif
   } else {
     KLOGE(TAG, "unsupported uri scheme %s", urip.scheme.c_str());
     return FLORA_CLI_EINVAL;
@@ -209,6 +226,11 @@ bool Client::handle_received(int32_t size) {
       return false;
     off += length;
 
+    if (raw_post.pending) {
+      if (!handle_raw_post_args(resp))
+        return false;
+      continue;
+    }
     if (resp->read(cmd) != CAPS_SUCCESS) {
       return false;
     }
@@ -227,9 +249,12 @@ bool Client::handle_cmd_before_auth(int32_t cmd, shared_ptr<Caps> &resp) {
     return false;
   int32_t result;
   uint32_t version;
+  uint32_t max_msg_size;
   lock_guard<mutex> locker(auth_result->amutex);
-  if (ResponseParser::parse_auth(resp, result, version) < 0)
+  if (ResponseParser::parse_auth(resp, result, version, max_msg_size) < 0)
     return false;
+  svc_version = version;
+  svc_msg_size = max_msg_size;
   auth_result->result = result;
   auth_result->acond.notify_one();
   cmd_handler = &Client::handle_cmd_after_auth;
@@ -240,30 +265,59 @@ bool Client::handle_cmd_after_auth(int32_t cmd, shared_ptr<Caps> &resp) {
   switch (cmd) {
   case CMD_POST_RESP: {
     uint32_t msgtype;
-    string name;
+    const char *name;
+    const char *cliname;
     shared_ptr<Caps> args;
 
-    if (ResponseParser::parse_post(resp, name, msgtype, args, tag,
-                                   sender_name) != 0) {
+    if (ResponseParser::parse_post(resp, name, msgtype, args, tag, cliname) !=
+        0) {
       return false;
     }
+    sender_name.assign(cliname);
+    recv_trace(name, resp);
     if (cli_callback) {
-      cli_callback->recv_post(name.c_str(), msgtype, args);
+      cli_callback->recv_post(name, msgtype, args);
+    }
+    break;
+  }
+  case CMD_RAW_POST_RESP: {
+    const char *name;
+    const char *cliname;
+    // tag, sender_name used by callback of args frame
+    if (ResponseParser::parse_raw_post(resp, name, raw_post.msgtype, tag,
+                                       cliname) != 0) {
+      return false;
     }
+    // args frame may be received after 'resp' released
+    raw_post.name.assign(name);
+    sender_name.assign(cliname);
+    recv_trace(name, resp);
+    raw_post.pending = true;
     break;
   }
+#ifdef HAVE_SHM
+  case CMD_FD_POST_RESP:
+    return handle_fd_post(resp);
+#endif
+  case CMD_ALIAS_RESP:
+    return handle_alias(resp);
+  case CMD_ALIAS_POST_RESP:
+  case CMD_ALIAS_RAW_POST_RESP:
+    return handle_alias_post(cmd, resp);
   case CMD_CALL_RESP: {
-    string name;
+    const char *name;
+    const char *cliname;
     int32_t msgid;
     shared_ptr<Caps> args;
-    if (ResponseParser::parse_call(resp, name, args, msgid, tag,
-                                   sender_name) != 0) {
+    if (ResponseParser::parse_call(resp, name, args, msgid, tag, cliname) !=
+        0) {
       return false;
     }
+    sender_name.assign(cliname);
     if (cli_callback) {
       shared_ptr<Reply> reply =
           make_shared<ReplyImpl>(this_weak_ptr.lock(), msgid);
-      cli_callback->recv_call(name.c_str(), args, reply);
+      cli_callback->recv_call(name, args, reply);
     }
     break;
   }
@@ -271,7 +325,7 @@ bool Client::handle_cmd_after_auth(int32_t cmd, shared_ptr<Caps> &resp) {
     string name;
     int32_t msgid;
     int32_t rescode;
-    PendingRequestList::iterator it;
+    PendingRequestMap::iterator it;
     Response response;
     RespCallback cb;
 
@@ -281,25 +335,24 @@ bool Client::handle_cmd_after_auth(int32_t cmd, shared_ptr<Caps> &resp) {
     }
 
     req_mutex.lock();
-    for (it = pending_requests.begin(); it != pending_requests.end(); ++it) {
-      if ((*it).id == msgid) {
-        if ((*it).result) {
-          (*it).id = 0;
-          (*it).rcode = rescode;
-          if (rescode == FLORA_CLI_SUCCESS) {
-            (*it).result->ret_code = response.ret_code;
-            (*it).result->data = response.data;
-            (*it).result->extra = response.extra;
-          }
-          req_reply_cond.notify_all();
-        } else {
-          if (rescode != FLORA_CLI_SUCCESS) {
-            response.ret_code = 0;
-          }
-          cb = (*it).callback;
-          pending_requests.erase(it);
+    it = pending_requests.find(msgid);
+    if (it != pending_requests.end()) {
+      PendingRequest &req = it->second;
+      if (req.result) {
+        req.id = 0;
+        req.rcode = rescode;
+        if (rescode == FLORA_CLI_SUCCESS) {
+          req.result->ret_code = response.ret_code;
+          req.result->data = response.data;
+          req.result->extra = response.extra;
         }
-        break;
+        req.reply_cond->notify_one();
+      } else {
+        if (rescode != FLORA_CLI_SUCCESS) {
+          response.ret_code = 0;
+        }
+        cb = req.callback;
+        pending_requests.erase(it);
       }
     }
     req_mutex.unlock();
@@ -333,6 +386,135 @@ bool Client::handle_cmd_after_auth(int32_t cmd, shared_ptr<Caps> &resp) {
   return true;
 }
 
+bool Client::handle_raw_post_args(shared_ptr<Caps> &args) {
+  raw_post.pending = false;
+  if (raw_post.dropped) {
+    raw_post.dropped = false;
+    return true;
+  }
+  if (cli_callback) {
+    cli_callback->recv_post(raw_post.name.c_str(), raw_post.msgtype, args);
+  }
+  return true;
+}
+
+bool Client::handle_alias(shared_ptr<Caps> &resp) {
+  uint32_t kind;
+  uint32_t id;
+  string name;
+
+  if (ResponseParser::parse_alias(resp, kind, id, name) != 0)
+    return false;
+  if (kind == ALIAS_KIND_TOPIC)
+    topic_names[id] = name;
+  else if (kind == ALIAS_KIND_SENDER)
+    sender_names[id] = name;
+  asked_aliases.erase(make_pair(kind, id));
+  return true;
+}
+
+void Client::ask_alias(uint32_t kind, uint32_t id) {
+  if (svc_version < FLORA_VERSION_UNKNOWN_ALIAS ||
+      !asked_aliases.insert(make_pair(kind, id)).second)
+    return;
+  lock_guard<mutex> locker(send_mutex);
+  int32_t c = RequestSerializer::serialize_unknown_alias(
+      kind, id, sbuffer, options.bufsize, serialize_flags);
+  if (c > 0)
+    send_frame(sbuffer, c);
+}
+
+bool Client::handle_alias_post(int32_t cmd, shared_ptr<Caps> &resp) {
+  uint32_t topic;
+  uint32_t sender;
+  uint32_t msgtype;
+  shared_ptr<Caps> args;
+  int32_t r;
+
+  if (cmd == CMD_ALIAS_RAW_POST_RESP)
+    r = ResponseParser::parse_alias_raw_post(resp, topic, msgtype, tag, sender);
+  else
+    r = ResponseParser::parse_alias_post(resp, topic, msgtype, args, tag,
+                                         sender);
+  if (r != 0)
+    return false;
+  auto it = topic_names.find(topic);
+  if (it == topic_names.end()) {
+    // CMD_ALIAS_RESP lost, drop the post and ask again
+    KLOGW(TAG, "post of unknown topic alias %u dropped", topic);
+    ask_alias(ALIAS_KIND_TOPIC, topic);
+    if (cmd == CMD_ALIAS_RAW_POST_RESP) {
+      raw_post.pending = true;
+      raw_post.dropped = true;
+    }
+    return true;
+  }
+  if (sender) {
+    auto sit = sender_names.find(sender);
+    if (sit != sender_names.end()) {
+      sender_name = sit->second;
+    } else {
+      sender_name.clear();
+      ask_alias(ALIAS_KIND_SENDER, sender);
+    }
+  } else {
+    sender_name.clear();
+  }
+  recv_trace(it->second.c_str(), resp);
+  if (cmd == CMD_ALIAS_RAW_POST_RESP) {
+    // tag, sender_name used by callback of args frame
+    raw_post.name = it->second;
+    raw_post.msgtype = msgtype;
+    raw_post.pending = true;
+  } else if (cli_callback) {
+    cli_callback->recv_post(it->second.c_str(), msgtype, args);
+  }
+  return true;
+}
+
+void Client::recv_trace(const char *name, shared_ptr<Caps> &resp) {
+  ResponseParser::parse_trace(resp, trace);
+  if (trace[FLORA_TRACE_SEND] == 0) {
+    trace[FLORA_TRACE_RECV] = 0;
+    return;
+  }
+  trace[FLORA_TRACE_RECV] = TraceHelper::now();
+  lock_guard<mutex> locker(trace_mutex);
+  auto it = recv_traces.find(name);
+  if (it == recv_traces.end())
+    it = recv_traces
+             .emplace(piecewise_construct, forward_as_tuple(name),
+                      forward_as_tuple())
+             .first;
+  // timestamps of other hosts not comparable
+  if (trace[FLORA_TRACE_RECV] >= trace[FLORA_TRACE_SVC_DISPATCH])
+    it->second.from_svc.record(trace[FLORA_TRACE_RECV] -
+                               trace[FLORA_TRACE_SVC_DISPATCH]);
+  if (trace[FLORA_TRACE_RECV] >= trace[FLORA_TRACE_SEND])
+    it->second.total.record(trace[FLORA_TRACE_RECV] - trace[FLORA_TRACE_SEND]);
+}
+
+static void write_latency(shared_ptr<Caps> &item, LatencyHistogram &h) {
+  item->write(h.count());
+  item->write(h.value_at(0.5));
+  item->write(h.value_at(0.99));
+  item->write(h.value_at(0.999));
+}
+
+shared_ptr<Caps> Client::trace_stats() {
+  shared_ptr<Caps> result = Caps::new_instance();
+  lock_guard<mutex> locker(trace_mutex);
+  result->write((uint32_t)recv_traces.size());
+  for (auto &it : recv_traces) {
+    shared_ptr<Caps> item = Caps::new_instance();
+    item->write(it.first);
+    write_latency(item, it.second.from_svc);
+    write_latency(item, it.second.total);
+    result->write(item);
+  }
+  return result;
+}
+
 void Client::keepalive_loop() {
   unique_lock<mutex> locker(ka_mutex);
   milliseconds inter(options.beep_interval);
@@ -352,7 +534,123 @@ void Client::ping() {
                                                 serialize_flags);
   if (c <= 0)
     return;
-  connection->send(sbuffer, c);
+  send_frame(sbuffer, c);
+}
+
+bool Client::send_frame(const int8_t *data, uint32_t size) {
+  if (batch_buffer.empty())
+    return connection->send(data, size);
+  // sent with batched posts together if possible
+  if (batch_buffer.size() + size <= options.bufsize) {
+    batch_buffer.insert(batch_buffer.end(), data, data + size);
+    ++batch_frames;
+    return flush_batch();
+  }
+  if (!flush_batch())
+    return false;
+  return connection->send(data, size);
+}
+
+bool Client::batch_post(uint32_t size) {
+  if (batch_buffer.size() + size > options.bufsize && !flush_batch())
+    return false;
+  batch_buffer.insert(batch_buffer.end(), sbuffer, sbuffer + size);
+  ++batch_frames;
+  if (batch_buffer.size() >= batch_bytes)
+    return flush_batch();
+  if (!batch_flush_scheduled) {
+    batch_flush_scheduled = true;
+    weak_ptr<Client> wcli = this_weak_ptr;
+    DeadlineScheduler::instance()->schedule(
+        steady_clock::now() + milliseconds(batch_interval), [wcli]() {
+          auto cli = wcli.lock();
+          if (cli)
+            cli->batch_timeout();
+        });
+  }
+  return true;
+}
+
+bool Client::flush_batch() {
+  if (batch_buffer.empty())
+    return true;
+  int32_t c = -1;
+  if (batch_frames > 1 && svc_version >= FLORA_VERSION_BATCH) {
+    // service parses and dispatches the frames as one command
+    batch_frame.resize(batch_buffer.size() + BATCH_FRAME_OVERHEAD);
+    c = RequestSerializer::serialize_batch(
+        batch_buffer.data(), batch_buffer.size(), batch_frame.data(),
+        batch_frame.size(), serialize_flags);
+    if (c > 0 && svc_msg_size && (uint32_t)c > svc_msg_size)
+      c = -1;
+  }
+  bool r;
+  if (c > 0)
+    r = connection->send(batch_frame.data(), c);
+  else
+    r = connection->send(batch_buffer.data(), batch_buffer.size());
+  batch_buffer.clear();
+  batch_frames = 0;
+  return r;
+}
+
+void Client::batch_timeout() {
+  lock_guard<mutex> locker(send_mutex);
+  batch_flush_scheduled = false;
+  flush_batch();
+}
+
+int32_t Client::set_batch(uint32_t bytes, uint32_t interval) {
+  if (options.flags & FLORA_CLI_FLAG_MONITOR)
+    return FLORA_CLI_EMONITOR;
+  lock_guard<mutex> locker(send_mutex);
+  if (!flush_batch())
+    return FLORA_CLI_ECONN;
+  batch_bytes = bytes < options.bufsize ? bytes : options.bufsize;
+  batch_interval = interval ? interval : FLORA_CLI_DEFAULT_BATCH_INTERVAL;
+  if (batch_bytes) {
+    batch_buffer.reserve(options.bufsize);
+  } else {
+    vector<int8_t>().swap(batch_buffer);
+    vector<int8_t>().swap(batch_frame);
+  }
+  return FLORA_CLI_SUCCESS;
+}
+
+int32_t Client::flush() {
+  lock_guard<mutex> locker(send_mutex);
+  if (connection == nullptr)
+    return FLORA_CLI_ECONN;
+  return flush_batch() ? FLORA_CLI_SUCCESS : FLORA_CLI_ECONN;
+}
+
+int32_t Client::alias(const char *name) {
+  if (name == nullptr || name[0] == '\0')
+    return FLORA_CLI_EINVAL;
+  if (options.flags & FLORA_CLI_FLAG_MONITOR)
+    return FLORA_CLI_EMONITOR;
+  lock_guard<mutex> locker(send_mutex);
+  // old service, posted by name
+  if (svc_version < FLORA_VERSION_ALIAS)
+    return FLORA_CLI_SUCCESS;
+  if (topic_aliases.find(name) != topic_aliases.end())
+    return FLORA_CLI_SUCCESS;
+  if (topic_aliases.size() >= MAX_TOPIC_ALIASES)
+    return FLORA_CLI_EINVAL;
+  uint32_t id = topic_aliases.size() + 1;
+  int32_t c = RequestSerializer::serialize_alias(
+      name, id, sbuffer, options.bufsize, serialize_flags);
+  if (c <= 0)
+    return FLORA_CLI_EINVAL;
+  // service binds the alias before handling following posts
+  if (!send_frame(sbuffer, c))
+    return FLORA_CLI_ECONN;
+  topic_aliases[name].id = id;
+#ifdef FLORA_DEBUG
+  ++send_times;
+  send_bytes += c;
+#endif
+  return FLORA_CLI_SUCCESS;
 }
 
 void Client::iclose(bool passive, int32_t err) {
@@ -363,18 +661,14 @@ void Client::iclose(bool passive, int32_t err) {
   vector<RespCallback> cbs;
   req_mutex.lock();
   close_reason = err;
-  req_reply_cond.notify_all();
-  PendingRequestList::iterator it = pending_requests.begin();
-  PendingRequestList::iterator rmit;
+  PendingRequestMap::iterator it = pending_requests.begin();
   while (it != pending_requests.end()) {
-    Response resp;
-    if ((*it).result == nullptr) {
-      cbs.push_back(it->callback);
-      rmit = it;
-      ++it;
-      pending_requests.erase(rmit);
+    if (it->second.result == nullptr) {
+      cbs.push_back(it->second.callback);
+      it = pending_requests.erase(it);
       continue;
     }
+    it->second.reply_cond->notify_one();
     ++it;
   }
   req_mutex.unlock();
@@ -400,10 +694,20 @@ int32_t Client::close(bool passive) {
   //   return FLORA_CLI_SUCCESS;
   if (this_thread::get_id() == callback_thr_id)
     return FLORA_CLI_EDEADLOCK;
+  if (!passive)
+    flush();
   iclose(passive, FLORA_CLI_ECLOSED);
   if (recv_thread.joinable())
     recv_thread.join();
   cmd_handler = &Client::handle_cmd_before_auth;
+  raw_post.pending = false;
+  raw_post.dropped = false;
+  topic_names.clear();
+  sender_names.clear();
+  asked_aliases.clear();
+  send_mutex.lock();
+  topic_aliases.clear();
+  send_mutex.unlock();
   if (keepalive_thread.joinable())
     keepalive_thread.join();
   return FLORA_CLI_SUCCESS;
@@ -416,20 +720,31 @@ void Client::send_reply(int32_t callid, int32_t code,
       callid, code, data, sbuffer, options.bufsize, serialize_flags);
   if (c <= 0)
     return;
-  connection->send(sbuffer, c);
+  send_frame(sbuffer, c);
 }
 
 int32_t Client::subscribe(const char *name) {
+  SubscribeFilter filter;
+  return subscribe(name, filter);
+}
+
+int32_t Client::subscribe(const char *name, const SubscribeFilter &filter) {
   if (name == nullptr)
     return FLORA_CLI_EINVAL;
   if (options.flags & FLORA_CLI_FLAG_MONITOR)
     return FLORA_CLI_EMONITOR;
+  if (!valid_filter(name, filter) ||
+      (!filter.empty() && svc_version < FLORA_VERSION_FILTER))
+    return FLORA_CLI_EINVAL;
+  if ((filter.flags || filter.min_interval) &&
+      svc_version < FLORA_VERSION_LATEST)
+    return FLORA_CLI_EINVAL;
   lock_guard<mutex> locker(send_mutex);
   int32_t c = RequestSerializer::serialize_subscribe(
-      name, sbuffer, options.bufsize, serialize_flags);
+      name, sbuffer, options.bufsize, serialize_flags, &filter);
   if (c <= 0)
     return FLORA_CLI_EINVAL;
-  if (!connection->send(sbuffer, c)) {
+  if (!send_frame(sbuffer, c)) {
     return FLORA_CLI_ECONN;
   }
 #ifdef FLORA_DEBUG
@@ -439,6 +754,12 @@ int32_t Client::subscribe(const char *name) {
   return FLORA_CLI_SUCCESS;
 }
 
+bool Client::valid_filter(const char *name, const SubscribeFilter &filter) {
+  return filter.empty() ||
+         (filter.conditions.size() <= FLORA_FILTER_MAX_FIELDS &&
+          !TopicMatcher::is_pattern(name));
+}
+
 int32_t Client::unsubscribe(const char *name) {
   if (name == nullptr)
     return FLORA_CLI_EINVAL;
@@ -449,7 +770,7 @@ int32_t Client::unsubscribe(const char *name) {
       name, sbuffer, options.bufsize, serialize_flags);
   if (c <= 0)
     return FLORA_CLI_EINVAL;
-  if (!connection->send(sbuffer, c)) {
+  if (!send_frame(sbuffer, c)) {
     return FLORA_CLI_ECONN;
   }
 #ifdef FLORA_DEBUG
@@ -469,7 +790,7 @@ int32_t Client::declare_method(const char *name) {
       name, sbuffer, options.bufsize, serialize_flags);
   if (c <= 0)
     return FLORA_CLI_EINVAL;
-  if (!connection->send(sbuffer, c)) {
+  if (!send_frame(sbuffer, c)) {
     return FLORA_CLI_ECONN;
   }
 #ifdef FLORA_DEBUG
@@ -489,7 +810,7 @@ int32_t Client::remove_method(const char *name) {
       name, sbuffer, options.bufsize, serialize_flags);
   if (c <= 0)
     return FLORA_CLI_EINVAL;
-  if (!connection->send(sbuffer, c)) {
+  if (!send_frame(sbuffer, c)) {
     return FLORA_CLI_ECONN;
   }
 #ifdef FLORA_DEBUG
@@ -506,11 +827,63 @@ int32_t Client::post(const char *name, shared_ptr<Caps> &msg,
   if (options.flags & FLORA_CLI_FLAG_MONITOR)
     return FLORA_CLI_EMONITOR;
   lock_guard<mutex> locker(send_mutex);
-  int32_t c = RequestSerializer::serialize_post(
-      name, msgtype, msg, sbuffer, options.bufsize, serialize_flags);
+  int32_t c;
+  uint64_t send_time =
+      (options.flags & FLORA_CLI_FLAG_TRACE) ? TraceHelper::now() : 0;
+  TopicAlias *alias = nullptr;
+  if (!topic_aliases.empty()) {
+    auto it = topic_aliases.find(name);
+    if (it != topic_aliases.end())
+      alias = &it->second;
+  }
+  if (msg != nullptr && svc_version >= FLORA_VERSION_RAW_POST) {
+    // service forwards args frame without decoding
+    if (alias && send_time) {
+      c = RequestSerializer::serialize_alias_raw_post(
+          alias->id, msgtype, msg, sbuffer, options.bufsize, serialize_flags,
+          send_time);
+    } else if (alias) {
+      // header never changed, only args serialized
+      auto &header = alias->raw_headers[msgtype];
+      if (header.empty()) {
+        c = RequestSerializer::serialize_alias_raw_post_header(
+            alias->id, msgtype, sbuffer, options.bufsize, serialize_flags);
+        if (c > 0)
+          header.assign(sbuffer, sbuffer + c);
+      }
+      c = header.empty() ? -1
+                         : RequestSerializer::serialize_cached_raw_post(
+                               header.data(), header.size(), msg, sbuffer,
+                               options.bufsize, serialize_flags);
+    } else {
+      c = RequestSerializer::serialize_raw_post(name, msgtype, msg, sbuffer,
+                                                options.bufsize,
+                                                serialize_flags, send_time);
+    }
+  } else if (alias) {
+    c = RequestSerializer::serialize_alias_post(alias->id, msgtype, msg,
+                                                sbuffer, options.bufsize,
+                                                serialize_flags, send_time);
+  } else {
+    c = RequestSerializer::serialize_post(name, msgtype, msg, sbuffer,
+                                          options.bufsize, serialize_flags,
+                                          send_time);
+  }
+#ifdef HAVE_SHM
+  // large or not fit in sbuffer, serialized again to memfd
+  if ((c <= 0 || c >= FD_POST_THRESHOLD) && msg != nullptr &&
+      svc_version >= FLORA_VERSION_FD_POST && connection->fd_passing()) {
+    int32_t r = post_by_fd(name, msgtype, msg,
+                           msg->serialize(nullptr, 0, serialize_flags),
+                           send_time);
+    if (r <= 0)
+      return r;
+    // memfd failed, inline frame still in sbuffer
+  }
+#endif
   if (c <= 0)
     return FLORA_CLI_EINVAL;
-  if (!connection->send(sbuffer, c)) {
+  if (!(batch_bytes ? batch_post(c) : send_frame(sbuffer, c))) {
     return FLORA_CLI_ECONN;
   }
 #ifdef FLORA_DEBUG
@@ -522,6 +895,86 @@ int32_t Client::post(const char *name, shared_ptr<Caps> &msg,
   return FLORA_CLI_SUCCESS;
 }
 
+#ifdef HAVE_SHM
+int32_t Client::post_by_fd(const char *name, uint32_t msgtype,
+                           shared_ptr<Caps> &msg, uint32_t size,
+                           uint64_t send_time) {
+  int fd = memfd_open("flora-post", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+  if (fd < 0) {
+    KLOGW(TAG, "memfd_create failed: %s", strerror(errno));
+    return 1;
+  }
+  int32_t r = 1;
+  int32_t c;
+  void *p = MAP_FAILED;
+  if (ftruncate(fd, size) < 0)
+    goto exit;
+  p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (p == MAP_FAILED)
+    goto exit;
+  c = msg->serialize(p, size, serialize_flags);
+  munmap(p, size);
+  // content could not be modified by anyone after sealed
+  if (c != (int32_t)size || fcntl(fd, F_ADD_SEALS, FD_POST_SEALS) < 0)
+    goto exit;
+  c = RequestSerializer::serialize_fd_post(name, msgtype, size, sbuffer,
+                                           options.bufsize, serialize_flags,
+                                           send_time);
+  if (c <= 0) {
+    r = FLORA_CLI_EINVAL;
+    goto exit;
+  }
+  r = flush_batch() && connection->send_fd(sbuffer, c, fd)
+          ? FLORA_CLI_SUCCESS
+          : FLORA_CLI_ECONN;
+#ifdef FLORA_DEBUG
+  ++post_times;
+  post_bytes += size;
+  ++send_times;
+  send_bytes += c;
+#endif
+
+exit:
+  if (r > 0)
+    KLOGW(TAG, "post %s by memfd failed: %s", name, strerror(errno));
+  ::close(fd);
+  return r;
+}
+
+bool Client::handle_fd_post(shared_ptr<Caps> &resp) {
+  uint32_t msgtype;
+  uint32_t size;
+  const char *name;
+  const char *cliname;
+  shared_ptr<Caps> args;
+
+  if (ResponseParser::parse_fd_post(resp, name, msgtype, size, tag, cliname) !=
+      0)
+    return false;
+  sender_name.assign(cliname);
+  recv_trace(name, resp);
+  int fd = connection->take_fd();
+  if (fd < 0) {
+    KLOGE(TAG, "fd of post %s not received", name);
+    return false;
+  }
+  void *p = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (p == MAP_FAILED) {
+    KLOGE(TAG, "mmap fd of post %s failed: %s", name, strerror(errno));
+    return false;
+  }
+  // args copied, memfd released before callback
+  int32_t r = Caps::parse(p, size, args);
+  munmap(p, size);
+  if (r != CAPS_SUCCESS)
+    return false;
+  if (cli_callback)
+    cli_callback->recv_post(name, msgtype, args);
+  return true;
+}
+#endif
+
 int32_t Client::call(const char *name, shared_ptr<Caps> &msg,
                      const char *target, Response &reply, uint32_t timeout) {
   if (name == nullptr)
@@ -538,17 +991,23 @@ int32_t Client::call(const char *name, shared_ptr<Caps> &msg,
     return FLORA_CLI_EINVAL;
 
   // timepoint of call timeout
-  // +200ms for socket data transfer cost time
-  auto tp = steady_clock::now() + milliseconds(timeout + 200);
+  if (timeout == 0)
+    timeout = DEFAULT_CALL_TIMEOUT;
+  auto tp = steady_clock::now() +
+            milliseconds(timeout + CALL_TIMEOUT_TRANSFER_COST);
 
+  int32_t id = reqseq;
+  condition_variable reply_cond;
   unique_lock<mutex> locker(req_mutex);
-  PendingRequestList::iterator it =
-      pending_requests.emplace(pending_requests.end());
-  (*it).id = reqseq;
-  (*it).result = &reply;
+  PendingRequest &req = pending_requests[id];
+  req.id = id;
+  req.result = &reply;
+  req.reply_cond = &reply_cond;
   locker.unlock();
 
-  if (!connection->send(sbuffer, c)) {
+  if (!send_frame(sbuffer, c)) {
+    locker.lock();
+    pending_requests.erase(id);
     return FLORA_CLI_ECONN;
   }
   sndlocker.unlock();
@@ -562,8 +1021,8 @@ int32_t Client::call(const char *name, shared_ptr<Caps> &msg,
   locker.lock();
   while (true) {
     // received reply
-    if ((*it).id == 0) {
-      retcode = (*it).rcode;
+    if (req.id == 0) {
+      retcode = req.rcode;
       break;
     }
 
@@ -572,7 +1031,7 @@ int32_t Client::call(const char *name, shared_ptr<Caps> &msg,
       goto exit;
     }
 
-    auto wr = req_reply_cond.wait_until(locker, tp);
+    auto wr = reply_cond.wait_until(locker, tp);
     if (wr == cv_status::timeout) {
       retcode = FLORA_CLI_ETIMEOUT;
       break;
@@ -580,7 +1039,7 @@ int32_t Client::call(const char *name, shared_ptr<Caps> &msg,
   }
 
 exit:
-  pending_requests.erase(it);
+  pending_requests.erase(id);
   return retcode;
 }
 
@@ -599,17 +1058,31 @@ int32_t Client::call(const char *name, shared_ptr<Caps> &msg,
   if (c <= 0)
     return FLORA_CLI_EINVAL;
 
+  int32_t id = reqseq;
   req_mutex.lock();
-  PendingRequestList::iterator it =
-      pending_requests.emplace(pending_requests.end());
-  (*it).id = reqseq;
-  (*it).result = nullptr;
-  (*it).callback = cb;
+  PendingRequest &req = pending_requests[id];
+  req.id = id;
+  req.result = nullptr;
+  req.reply_cond = nullptr;
+  req.callback = cb;
   req_mutex.unlock();
 
-  if (!connection->send(sbuffer, c)) {
+  if (!send_frame(sbuffer, c)) {
+    req_mutex.lock();
+    pending_requests.erase(id);
+    req_mutex.unlock();
     return FLORA_CLI_ECONN;
   }
+  if (timeout == 0)
+    timeout = DEFAULT_CALL_TIMEOUT;
+  weak_ptr<Client> wcli = this_weak_ptr;
+  DeadlineScheduler::instance()->schedule(
+      steady_clock::now() + milliseconds(timeout + CALL_TIMEOUT_TRANSFER_COST),
+      [wcli, id]() {
+        auto cli = wcli.lock();
+        if (cli)
+          cli->async_call_timeout(id);
+      });
 #ifdef FLORA_DEBUG
   ++req_times;
   req_bytes += c;
@@ -626,6 +1099,21 @@ int32_t Client::call(const char *name, shared_ptr<Caps> &msg,
   return call(name, msg, target, cb, timeout);
 }
 
+void Client::async_call_timeout(int32_t id) {
+  RespCallback cb;
+  req_mutex.lock();
+  auto it = pending_requests.find(id);
+  if (it != pending_requests.end() && it->second.result == nullptr) {
+    cb = it->second.callback;
+    pending_requests.erase(it);
+  }
+  req_mutex.unlock();
+  if (cb) {
+    Response resp;
+    cb(FLORA_CLI_ETIMEOUT, resp);
+  }
+}
+
 int Client::get_socket() const {
   auto conn = static_pointer_cast<SocketConn>(connection);
   if (conn)
@@ -803,6 +1291,12 @@ const char* MsgSender::name() {
   return flora::internal::Client::sender_name.c_str();
 }
 
+uint64_t MsgSender::timestamp(uint32_t point) {
+  if (point >= FLORA_TRACE_POINTS)
+    return 0;
+  return flora::internal::Client::trace[point];
+}
+
 void MsgSender::to_string(string& str) {
   str = "[";
   string tmp;
@@ -934,6 +1428,26 @@ int32_t flora_cli_post(flora_cli_t handle, const char *name, caps_t msg,
                                                               msgtype);
 }
 
+int32_t flora_cli_set_batch(flora_cli_t handle, uint32_t bytes,
+                            uint32_t interval) {
+  if (handle == 0)
+    return FLORA_CLI_EINVAL;
+  return reinterpret_cast<CClient *>(handle)->cxxclient->set_batch(bytes,
+                                                                   interval);
+}
+
+int32_t flora_cli_flush(flora_cli_t handle) {
+  if (handle == 0)
+    return FLORA_CLI_EINVAL;
+  return reinterpret_cast<CClient *>(handle)->cxxclient->flush();
+}
+
+int32_t flora_cli_alias(flora_cli_t handle, const char *name) {
+  if (handle == 0)
+    return FLORA_CLI_EINVAL;
+  return reinterpret_cast<CClient *>(handle)->cxxclient->alias(name);
+}
+
 void cxxresp_to_cresp(Response &resp, flora_call_result &result) {
   result.ret_code = resp.ret_code;
   result.data = Caps::convert(resp.data);
@@ -4,13 +4,16 @@
 #include "conn.h"
 #include "defs.h"
 #include "flora-cli.h"
+#include "stats.h"
 #include <chrono>
 #include <condition_variable>
-#include <list>
+#include <map>
 #include <memory>
 #include <mutex>
+#include <set>
 #include <string>
 #include <thread>
+#include <unordered_map>
 #include <vector>
 
 namespace flora {
@@ -21,9 +24,11 @@ typedef struct {
   int32_t id;
   int32_t rcode;
   Response *result;
+  // waiter of synchronous call, notified when reply received
+  std::condition_variable *reply_cond;
   RespCallback callback;
 } PendingRequest;
-typedef std::list<PendingRequest> PendingRequestList;
+typedef std::unordered_map<int32_t, PendingRequest> PendingRequestMap;
 
 class Client : public flora::Client {
 public:
@@ -42,6 +47,11 @@ public:
   // implementation of flora::Client
   int32_t subscribe(const char *name);
 
+  int32_t subscribe(const char *name, const SubscribeFilter &filter);
+
+  // whether 'filter' could be used for 'name' on any service version
+  static bool valid_filter(const char *name, const SubscribeFilter &filter);
+
   int32_t unsubscribe(const char *name);
 
   int32_t declare_method(const char *name);
@@ -59,6 +69,14 @@ public:
   int32_t call(const char *name, std::shared_ptr<Caps> &msg, const char *target,
                std::function<void(int32_t, Response &)> &cb, uint32_t timeout);
 
+  int32_t set_batch(uint32_t bytes, uint32_t interval);
+
+  int32_t flush();
+
+  int32_t alias(const char *name);
+
+  std::shared_ptr<Caps> trace_stats();
+
   int get_socket() const;
 
 private:
@@ -74,8 +92,47 @@ private:
 
   bool handle_cmd_after_auth(int32_t cmd, std::shared_ptr<Caps> &resp);
 
+  // args frame of CMD_RAW_POST_RESP
+  bool handle_raw_post_args(std::shared_ptr<Caps> &args);
+
+  bool handle_alias(std::shared_ptr<Caps> &resp);
+
+  // CMD_ALIAS_POST_RESP or CMD_ALIAS_RAW_POST_RESP
+  bool handle_alias_post(int32_t cmd, std::shared_ptr<Caps> &resp);
+
+  // ask service to write CMD_ALIAS_RESP of 'id' again, once until received
+  void ask_alias(uint32_t kind, uint32_t id);
+
+  // timestamps of post 'name' following fields of 'resp' parsed to 'trace'
+  void recv_trace(const char *name, std::shared_ptr<Caps> &resp);
+
+#ifdef HAVE_SHM
+  // args of 'size' bytes passed by sealed memfd
+  // return: FLORA_CLI_*, or 1 if memfd failed, should post args inline
+  int32_t post_by_fd(const char *name, uint32_t msgtype,
+                     std::shared_ptr<Caps> &msg, uint32_t size,
+                     uint64_t send_time);
+
+  // CMD_FD_POST_RESP
+  bool handle_fd_post(std::shared_ptr<Caps> &resp);
+#endif
+
+  // deadline of asynchronous call 'id' expired
+  void async_call_timeout(int32_t id);
+
   void iclose(bool passive, int32_t err);
 
+  // send_mutex locked, batched posts sent before 'data'
+  bool send_frame(const int8_t *data, uint32_t size);
+
+  // send_mutex locked, append post of 'size' bytes in sbuffer to batch
+  bool batch_post(uint32_t size);
+
+  // send_mutex locked
+  bool flush_batch();
+
+  void batch_timeout();
+
   bool handle_monitor_list_all(std::shared_ptr<Caps> &resp);
   bool handle_monitor_list_add(std::shared_ptr<Caps> &resp);
   bool handle_monitor_list_remove(std::shared_ptr<Caps> &resp);
@@ -98,13 +155,26 @@ private:
   std::shared_ptr<Connection> connection;
   std::thread recv_thread;
   std::mutex req_mutex;
-  std::condition_variable req_reply_cond;
-  PendingRequestList pending_requests;
+  PendingRequestMap pending_requests;
   std::thread keepalive_thread;
   std::mutex ka_mutex;
   std::condition_variable ka_cond;
   int32_t reqseq = 0;
   uint32_t serialize_flags = 0;
+  // FLORA_VERSION of service
+  uint32_t svc_version = 0;
+  // max frame size accepted by service, 0 if unknown
+  uint32_t svc_msg_size = 0;
+  // header of CMD_RAW_POST_RESP, waiting for args frame
+  class RawPostHeader {
+  public:
+    bool pending = false;
+    // topic alias unknown, args frame skipped
+    bool dropped = false;
+    uint32_t msgtype = 0;
+    std::string name;
+  };
+  RawPostHeader raw_post;
   int32_t close_reason = 0;
   std::weak_ptr<Client> this_weak_ptr;
   std::thread::id callback_thr_id;
@@ -120,6 +190,37 @@ private:
   };
   AuthResult *auth_result = nullptr;
   std::mutex send_mutex;
+  // posts batched by set_batch, protected by send_mutex
+  std::vector<int8_t> batch_buffer;
+  uint32_t batch_frames = 0;
+  // CMD_BATCH_REQ wrapping 'batch_buffer'
+  std::vector<int8_t> batch_frame;
+  uint32_t batch_bytes = 0;
+  uint32_t batch_interval = 0;
+  bool batch_flush_scheduled = false;
+  class TopicAlias {
+  public:
+    uint32_t id = 0;
+    // header of CMD_ALIAS_RAW_POST_REQ indexed by msgtype, built once
+    std::vector<int8_t> raw_headers[FLORA_NUMBER_OF_MSGTYPE];
+  };
+  // aliases of topic names, protected by send_mutex
+  std::unordered_map<std::string, TopicAlias> topic_aliases;
+  // names of ids told by CMD_ALIAS_RESP, accessed by recv thread only
+  std::unordered_map<uint32_t, std::string> topic_names;
+  std::unordered_map<uint32_t, std::string> sender_names;
+  // kind and id of unknown aliases asked by CMD_UNKNOWN_ALIAS_REQ
+  std::set<std::pair<uint32_t, uint32_t>> asked_aliases;
+  class RecvTrace {
+  public:
+    // FLORA_TRACE_SVC_DISPATCH --> FLORA_TRACE_RECV
+    LatencyHistogram from_svc;
+    // FLORA_TRACE_SEND --> FLORA_TRACE_RECV
+    LatencyHistogram total;
+  };
+  // latency of traced posts received, indexed by name
+  std::map<std::string, RecvTrace> recv_traces;
+  std::mutex trace_mutex;
 
   typedef bool (flora::internal::Client::*MonitorHandler)(
       std::shared_ptr<Caps> &);
@@ -130,6 +231,7 @@ public:
   ClientCallback *cli_callback = nullptr;
   static thread_local uint64_t tag;
   static thread_local std::string sender_name;
+  static thread_local uint64_t trace[FLORA_TRACE_POINTS];
 #ifdef FLORA_DEBUG
   uint32_t post_times = 0;
   uint32_t post_bytes = 0;
@@ -13,4 +13,15 @@ public:
   virtual void close() = 0;
 
   virtual bool closed() const = 0;
+
+  // whether fds could be sent and received with data
+  virtual bool fd_passing() const { return false; }
+
+  // send 'data' with 'fd', 'fd' not closed
+  virtual bool send_fd(const void *data, uint32_t size, int fd) {
+    return false;
+  }
+
+  // return: first fd received and not taken yet, -1 if none
+  virtual int take_fd() { return -1; }
 };
@@ -0,0 +1,60 @@
+#include "deadline-sched.h"
+#include <algorithm>
+
+using namespace std;
+
+namespace flora {
+namespace internal {
+
+DeadlineScheduler::~DeadlineScheduler() {
+  unique_lock<mutex> locker(sched_mutex);
+  closing = true;
+  sched_cond.notify_one();
+  locker.unlock();
+  if (run_thread.joinable())
+    run_thread.join();
+}
+
+void DeadlineScheduler::schedule(TimePoint tp, Task &&task) {
+  lock_guard<mutex> locker(sched_mutex);
+  if (closing)
+    return;
+  if (!run_thread.joinable())
+    run_thread = thread([this]() { run(); });
+  entries.emplace_back();
+  entries.back().tp = tp;
+  entries.back().seq = ++seq;
+  entries.back().task = std::move(task);
+  push_heap(entries.begin(), entries.end(), greater<Entry>());
+  // new deadline earlier than the one timer thread waiting for
+  if (entries.front().seq == seq)
+    sched_cond.notify_one();
+}
+
+DeadlineScheduler *DeadlineScheduler::instance() {
+  static DeadlineScheduler scheduler;
+  return &scheduler;
+}
+
+void DeadlineScheduler::run() {
+  unique_lock<mutex> locker(sched_mutex);
+  while (!closing) {
+    if (entries.empty()) {
+      sched_cond.wait(locker);
+      continue;
+    }
+    if (chrono::steady_clock::now() < entries.front().tp) {
+      sched_cond.wait_until(locker, entries.front().tp);
+      continue;
+    }
+    pop_heap(entries.begin(), entries.end(), greater<Entry>());
+    Task task = std::move(entries.back().task);
+    entries.pop_back();
+    locker.unlock();
+    task();
+    locker.lock();
+  }
+}
+
+} // namespace internal
+} // namespace flora
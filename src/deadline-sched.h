@@ -0,0 +1,56 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <stdint.h>
+#include <thread>
+#include <vector>
+
+namespace flora {
+namespace internal {
+
+// process wide timer thread, runs tasks at their deadline
+// tasks can not be cancelled, a task should check whether it is still
+// needed when run
+class DeadlineScheduler {
+public:
+  typedef std::chrono::steady_clock::time_point TimePoint;
+  typedef std::function<void()> Task;
+
+  ~DeadlineScheduler();
+
+  // timer thread started on first call
+  void schedule(TimePoint tp, Task &&task);
+
+  static DeadlineScheduler *instance();
+
+private:
+  DeadlineScheduler() = default;
+
+  void run();
+
+private:
+  class Entry {
+  public:
+    TimePoint tp;
+    // keeps order of tasks with same deadline
+    uint64_t seq;
+    Task task;
+
+    bool operator>(const Entry &o) const {
+      return tp > o.tp || (tp == o.tp && seq > o.seq);
+    }
+  };
+  std::mutex sched_mutex;
+  std::condition_variable sched_cond;
+  // min-heap, std::greater
+  std::vector<Entry> entries;
+  uint64_t seq = 0;
+  std::thread run_thread;
+  bool closing = false;
+};
+
+} // namespace internal
+} // namespace flora
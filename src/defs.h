@@ -1,9 +1,24 @@
 #pragma once
 
-#define FLORA_VERSION 4
+#define FLORA_VERSION 11
+// min version of peer that supports CMD_RAW_POST_*
+#define FLORA_VERSION_RAW_POST 5
+// min version of peer that supports CMD_FD_POST_*
+#define FLORA_VERSION_FD_POST 6
+// min version of peer that supports CMD_BATCH_REQ
+#define FLORA_VERSION_BATCH 7
+// min version of peer that supports CMD_ALIAS_*
+#define FLORA_VERSION_ALIAS 8
+// min version of peer that supports filter of CMD_SUBSCRIBE_REQ
+#define FLORA_VERSION_FILTER 9
+// min version of peer that supports flags and interval of CMD_SUBSCRIBE_REQ
+#define FLORA_VERSION_LATEST 10
+// min version of peer that supports CMD_UNKNOWN_ALIAS_REQ
+#define FLORA_VERSION_UNKNOWN_ALIAS 11
 
 // client --> server
 #define CMD_AUTH_REQ 0
+// topic name, optional SubscribeFilter caps, flags and interval
 #define CMD_SUBSCRIBE_REQ 1
 #define CMD_UNSUBSCRIBE_REQ 2
 #define CMD_POST_REQ 3
@@ -12,6 +27,21 @@
 #define CMD_REMOVE_METHOD_REQ 6
 #define CMD_CALL_REQ 7
 #define CMD_PING_REQ 8
+// post header, followed by serialized args as next frame
+#define CMD_RAW_POST_REQ 9
+// post header, serialized args in sealed memfd passed by SCM_RIGHTS
+#define CMD_FD_POST_REQ 10
+// serialized request frames packed in one frame
+#define CMD_BATCH_REQ 11
+// bind topic name to alias id chosen by client, for this connection only
+#define CMD_ALIAS_REQ 12
+// CMD_POST_REQ, topic name replaced by alias id
+#define CMD_ALIAS_POST_REQ 13
+// CMD_RAW_POST_REQ, topic name replaced by alias id
+#define CMD_ALIAS_RAW_POST_REQ 14
+// id of CMD_ALIAS_RESP not known by client, see ALIAS_KIND_*
+// written again before next post using it
+#define CMD_UNKNOWN_ALIAS_REQ 15
 // server --> client
 #define CMD_AUTH_RESP 101
 #define CMD_POST_RESP 102
@@ -19,8 +49,22 @@
 #define CMD_CALL_RESP 104
 #define CMD_MONITOR_RESP 105
 #define CMD_PONG_RESP 106
+// post header, followed by serialized args as next frame
+#define CMD_RAW_POST_RESP 107
+// post header, serialized args in sealed memfd passed by SCM_RIGHTS
+#define CMD_FD_POST_RESP 108
+// bind topic or sender name to id, see ALIAS_KIND_*
+#define CMD_ALIAS_RESP 109
+// CMD_POST_RESP, topic and sender name replaced by ids
+#define CMD_ALIAS_POST_RESP 110
+// CMD_RAW_POST_RESP, topic and sender name replaced by ids
+#define CMD_ALIAS_RAW_POST_RESP 111
 
-#define MSG_HANDLER_COUNT 9
+#define MSG_HANDLER_COUNT 16
+
+// kind of CMD_ALIAS_RESP
+#define ALIAS_KIND_TOPIC 0
+#define ALIAS_KIND_SENDER 1
 
 // subtype of CMD_MONITOR_RESP
 #define MONITOR_LIST_ALL 0
@@ -37,12 +81,31 @@
 #define MONITOR_SUBTYPE_NUM 11
 
 #define DEFAULT_MSG_BUF_SIZE 32768
-#define CLEAR_SUBSCRIPTION_TIME_THRESHOLD 10
-#define CLEAR_SUBSCRIPTION_THRESHOLD 50
+// milliseconds, used if timeout of call is 0
+#define DEFAULT_CALL_TIMEOUT 200
+// milliseconds, added to client side call timeout for data transfer cost
+#define CALL_TIMEOUT_TRANSFER_COST 200
+// capacity of dispatcher command queue, must be power of 2
+#define CMD_QUEUE_CAPACITY 4096
+// post frames larger than this pass args by memfd if possible
+#define FD_POST_THRESHOLD (64 * 1024)
+// max number of received fds not yet consumed by frames
+#define MAX_PENDING_FDS 16
+// bytes of CMD_BATCH_REQ frame except the packed frames
+#define BATCH_FRAME_OVERHEAD 64
+// max alias id of CMD_ALIAS_REQ
+#define MAX_TOPIC_ALIASES 1024
 
 #ifdef __APPLE__
 #define SELECT_BLOCK_IF_FD_CLOSED
 #endif
 
+#ifdef __linux__
+#define HAVE_EPOLL
+#define HAVE_EVENTFD
+// memfd shared memory transport, see shm-conn.h
+#define HAVE_SHM
+#endif
+
 #define TAG "flora"
 #define FILE_TAG "flora.filelog"
@@ -4,14 +4,22 @@
 #include "flora-svc.h"
 #include "rlog.h"
 #include "ser-helper.h"
+#include "topic-match.h"
 #include "file-log.h"
+#include "memfd.h"
+#include <errno.h>
+#include <fcntl.h>
 #include <signal.h>
+#include <string.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
+#include <tuple>
 
 using namespace std;
 using namespace std::chrono;
 
-#define DEFAULT_CALL_TIMEOUT 200
+// buffers of 'buf_size' bytes allocated by Dispatcher
+#define DISP_BUFFER_COUNT 7
 
 uint32_t AdapterInfo::idseq;
 
@@ -24,34 +32,86 @@ bool (Dispatcher::*(Dispatcher::msg_handlers[MSG_HANDLER_COUNT]))(
     &Dispatcher::handle_unsubscribe_req, &Dispatcher::handle_post_req,
     &Dispatcher::handle_reply_req,       &Dispatcher::handle_declare_method,
     &Dispatcher::handle_remove_method,   &Dispatcher::handle_call_req,
-    &Dispatcher::handle_ping_req,
+    &Dispatcher::handle_ping_req,        nullptr,
+    nullptr,                             nullptr,
+    &Dispatcher::handle_alias_req,       &Dispatcher::handle_alias_post_req,
+    nullptr,                             &Dispatcher::handle_unknown_alias_req,
 };
 
 Dispatcher::Dispatcher(uint32_t f, uint32_t bufsize) : flags(f) {
   buf_size = bufsize > DEFAULT_MSG_BUF_SIZE ? bufsize : DEFAULT_MSG_BUF_SIZE;
-  buffer = (int8_t *)mmap(NULL, buf_size, PROT_READ | PROT_WRITE,
-                          MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+  buffer = (int8_t *)mmap(NULL, buf_size * DISP_BUFFER_COUNT,
+                          PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE,
+                          -1, 0);
+  header_buffer = buffer + buf_size;
+  args_buffer = header_buffer + buf_size;
+  fd_header_buffer = args_buffer + buf_size;
+  alias_buffer = fd_header_buffer + buf_size;
+  alias_header_buffer = alias_buffer + buf_size;
+  alias_resp_buffer = alias_header_buffer + buf_size;
+  cmd_doorbell.init();
 }
 
 Dispatcher::~Dispatcher() noexcept {
-  subscriptions.clear();
-  munmap(buffer, buf_size);
+  held_deadlines.clear();
+  held_posts.clear();
+  topics.clear();
+  munmap(buffer, buf_size * DISP_BUFFER_COUNT);
   close();
 }
 
 bool Dispatcher::put(const void *data, uint32_t size,
                      std::shared_ptr<Adapter> &sender) {
-  shared_ptr<Caps> msg_caps;
+  CmdPacket packet;
+  packet.recv_time = TraceHelper::now();
 
-  if (Caps::parse(data, size, msg_caps) != CAPS_SUCCESS) {
-    KLOGE(TAG, "msg caps parse failed");
-    return false;
+  if (sender->raw_post_header != nullptr) {
+    // args frame of raw post header, forward without parsing
+    packet.cmd = sender->raw_post_cmd;
+    packet.caps = std::move(sender->raw_post_header);
+    packet.raw = make_shared<RawFrame>((const int8_t *)data,
+                                       (const int8_t *)data + size);
+  } else {
+    if (Caps::parse(data, size, packet.caps) != CAPS_SUCCESS) {
+      KLOGE(TAG, "msg caps parse failed");
+      return false;
+    }
+    if (packet.caps->read(packet.cmd) != CAPS_SUCCESS) {
+      KLOGE(TAG, "read msg cmd failed");
+      return false;
+    }
+    if (packet.cmd == CMD_RAW_POST_REQ ||
+        packet.cmd == CMD_ALIAS_RAW_POST_REQ) {
+      sender->raw_post_header = packet.caps;
+      sender->raw_post_cmd = packet.cmd;
+      return true;
+    }
+    if (packet.cmd == CMD_FD_POST_REQ) {
+      int fd = sender->take_fd();
+      if (fd < 0) {
+        KLOGE(TAG, "fd of CMD_FD_POST_REQ not received");
+        return false;
+      }
+      packet.fd = make_shared<SharedFd>(fd);
+    }
   }
+  packet.sender = sender;
+  return push_cmd(packet);
+}
 
-  cmd_mutex.lock();
-  cmd_packets.push_back(make_pair(msg_caps, sender));
-  cmd_cond.notify_one();
-  cmd_mutex.unlock();
+bool Dispatcher::push_cmd(CmdPacket &packet) {
+  while (!cmd_packets.push(packet)) {
+    // queue full, wait for dispatcher thread consuming
+    if (!working)
+      return false;
+    if (parked.exchange(false))
+      cmd_doorbell.ring();
+    this_thread::yield();
+  }
+  // pairs with fence in 'park'
+  atomic_thread_fence(memory_order_seq_cst);
+  if (parked.load(memory_order_relaxed) && parked.exchange(false))
+    cmd_doorbell.ring();
   return true;
 }
 
@@ -71,43 +131,61 @@ void Dispatcher::run(bool blocking) {
 }
 
 void Dispatcher::handle_cmds() {
-  unique_lock<mutex> locker(cmd_mutex, defer_lock);
-  CmdPacketList pending_cmds;
-  CmdPacketList::iterator it;
+  CmdPacket packet;
+  uint32_t count;
 
   while (true) {
-    locker.lock();
-
-  loop_begin_locked:
     if (!working) {
       KLOGI(TAG, "Dispatcher closed, thread exit");
       break;
     }
-    pending_cmds.splice(pending_cmds.begin(), cmd_packets);
-    if (pending_cmds.empty()) {
-      discard_pending_calls();
-      if (pending_calls.empty()) {
-        cmd_cond.wait(locker);
-        goto loop_begin_locked;
-      }
-      cmd_cond.wait_until(locker, pending_calls.front().discard_tp);
-      goto loop_begin_locked;
-    }
-    locker.unlock();
-
     // handle commands
     // may use thread poll at multi-core platform in future
-    for (it = pending_cmds.begin(); it != pending_cmds.end(); ++it) {
-      handle_cmd(it->first, it->second);
+    for (count = 0; count < CMD_QUEUE_CAPACITY && cmd_packets.pop(packet);
+         ++count) {
+      handle_cmd(packet);
     }
-    pending_cmds.clear();
+    packet = CmdPacket();
+    uncork_adapters();
+    discard_pending_calls();
+    write_held_posts();
+    if (count == 0)
+      park();
+  }
+}
+
+void Dispatcher::uncork_adapters() {
+  for (auto &adap : corked_adapters)
+    adap->uncork();
+  corked_adapters.clear();
+}
+
+void Dispatcher::park() {
+  int32_t timeout = -1;
+  PendingCallTable::TimePoint tp;
+  bool has_deadline = pending_calls.next_deadline(tp);
+  if (!held_deadlines.empty() &&
+      (!has_deadline || held_deadlines.begin()->first < tp)) {
+    tp = held_deadlines.begin()->first;
+    has_deadline = true;
+  }
+  if (has_deadline) {
+    auto dur = duration_cast<milliseconds>(tp - steady_clock::now());
+    timeout = dur.count() > 0 ? dur.count() + 1 : 0;
   }
+  parked.store(true);
+  // pairs with fence in 'push_cmd'
+  atomic_thread_fence(memory_order_seq_cst);
+  if (cmd_packets.empty() && working)
+    cmd_doorbell.wait(timeout);
+  parked.store(false);
+  cmd_doorbell.reset();
 }
 
-void Dispatcher::handle_cmd(shared_ptr<Caps> &msg_caps,
-                            shared_ptr<Adapter> &sender) {
+void Dispatcher::handle_cmd(CmdPacket &packet) {
+  shared_ptr<Adapter> &sender = packet.sender;
   // empty caps msg, erase adapter
-  if (msg_caps == nullptr) {
+  if (packet.caps == nullptr) {
     do_erase_adapter(sender);
     return;
   }
@@ -117,28 +195,34 @@ void Dispatcher::handle_cmd(shared_ptr<Caps> &msg_caps,
     return;
   }
 
-  int32_t cmd;
-  if (msg_caps->read(cmd) != CAPS_SUCCESS) {
-    KLOGE(TAG, "read msg cmd failed");
-    sender->close();
-    return;
-  }
-  if (cmd >= MSG_HANDLER_COUNT) {
+  int32_t cmd = packet.cmd;
+  bool r;
+  cmd_recv_time = packet.recv_time;
+  if (cmd == CMD_RAW_POST_REQ || cmd == CMD_ALIAS_RAW_POST_REQ) {
+    r = handle_raw_post_req(packet);
+  } else if (cmd == CMD_FD_POST_REQ) {
+    r = handle_fd_post_req(packet);
+  } else if (cmd == CMD_BATCH_REQ) {
+    r = handle_batch_req(packet);
+  } else if (cmd < 0 || cmd >= MSG_HANDLER_COUNT ||
+             msg_handlers[cmd] == nullptr) {
     KLOGE(TAG, "msg cmd invalid(normal): %d", cmd);
-    sender->close();
-    return;
+    r = false;
+  } else {
+    r = (this->*(msg_handlers[cmd]))(packet.caps, sender);
   }
-  if (!(this->*(msg_handlers[cmd]))(msg_caps, sender))
+  if (!r)
     sender->close();
-  handle_cmd_tp = steady_clock::now();
 }
 
 void Dispatcher::pending_call_timeout(PendingCall &pc) {
+  if (pc.stats)
+    pc.stats->timeouts.fetch_add(1, memory_order_relaxed);
   int32_t c = ResponseSerializer::serialize_reply(pc.cliid, FLORA_CLI_ETIMEOUT,
                                                   nullptr, 0, buffer, buf_size,
                                                   pc.sender->serialize_flags);
   if (pc.sender->write(buffer, c) == -2) {
-    KLOGW(FILE_TAG, "write timeout: pending call timeout, [0x%llx]%s >>> [0x%llx]%s",
+    KLOGW(FILE_TAG, "write dropped: pending call timeout, [0x%llx]%s >>> [0x%llx]%s",
         pc.sender->tag, pc.sender->info ? pc.sender->info->name.c_str() : "",
         pc.target->tag, pc.target->info ? pc.target->info->name.c_str() : "");
   }
@@ -146,20 +230,14 @@ void Dispatcher::pending_call_timeout(PendingCall &pc) {
 
 void Dispatcher::discard_pending_calls() {
   auto tp = steady_clock::now();
-  while (!pending_calls.empty()) {
-    auto it = pending_calls.begin();
-    if (tp < (*it).discard_tp)
-      break;
-    pending_call_timeout(*it);
-    pending_calls.erase(it);
-  }
+  PendingCall pc;
+  while (pending_calls.pop_expired(tp, pc))
+    pending_call_timeout(pc);
 }
 
 void Dispatcher::close() {
-  cmd_mutex.lock();
   working = false;
-  cmd_cond.notify_one();
-  cmd_mutex.unlock();
+  cmd_doorbell.ring();
 
   if (run_thread.joinable()) {
     run_thread.join();
@@ -169,11 +247,10 @@ void Dispatcher::close() {
 void Dispatcher::erase_adapter(shared_ptr<Adapter> &adapter) {
   if (adapter->info == nullptr)
     return;
-  lock_guard<mutex> locker(cmd_mutex);
   shared_ptr<Caps> empty;
   // add empty caps to queue for erase adapter
-  cmd_packets.push_back(make_pair(empty, adapter));
-  cmd_cond.notify_one();
+  CmdPacket packet(empty, adapter);
+  push_cmd(packet);
 }
 
 bool Dispatcher::handle_auth_req(shared_ptr<Caps> &msg_caps,
@@ -206,13 +283,16 @@ bool Dispatcher::handle_auth_req(shared_ptr<Caps> &msg_caps,
       result = FLORA_CLI_EDUPID;
       KLOGE(TAG, "<<< %s: auth failed. client id already used", extra.c_str());
     }
+    if (sender->info)
+      sender->info->version = version;
   }
   int32_t c = ResponseSerializer::serialize_auth(
-      result, FLORA_VERSION, buffer, buf_size, sender->serialize_flags);
+      result, FLORA_VERSION, buf_size, buffer, buf_size,
+      sender->serialize_flags);
   if (c < 0)
     return false;
   if (sender->write(buffer, c) == -2) {
-    KLOGW(FILE_TAG, "write timeout: auth resp, >>> [0x%llx]%s",
+    KLOGW(FILE_TAG, "write dropped: auth resp, >>> [0x%llx]%s",
         sender->tag, extra.c_str());
   }
   if (result == FLORA_CLI_SUCCESS) {
@@ -228,6 +308,7 @@ bool Dispatcher::handle_auth_req(shared_ptr<Caps> &msg_caps,
 void Dispatcher::do_erase_adapter(shared_ptr<Adapter> &sender) {
   if (sender->info == nullptr)
     return;
+  clear_subscriptions(sender);
   if (sender->info->name.length() > 0) {
     named_adapters.erase(sender->info->name);
   }
@@ -239,81 +320,135 @@ void Dispatcher::do_erase_adapter(shared_ptr<Adapter> &sender) {
     KLOGI(TAG, "erase adapter <%s>:%s", str.c_str(),
           sender->info->name.c_str());
     write_monitor_list_remove(sender->info->id);
+    lock_guard<mutex> locker(stats_mutex);
     adapter_infos.erase(reinterpret_cast<intptr_t>(sender.get()));
   }
-  check_subscriptions();
 }
 
-void Dispatcher::check_subscriptions() {
-  auto nowtp = steady_clock::now();
-  if (duration_cast<seconds>(nowtp - handle_cmd_tp).count() >=
-      CLEAR_SUBSCRIPTION_TIME_THRESHOLD) {
-    clear_sub_gabages();
-    clear_sub_prio = 0;
-    handle_cmd_tp = nowtp;
-    return;
+void Dispatcher::clear_subscriptions(shared_ptr<Adapter> &sender) {
+  for (auto id : sender->info->subscriptions) {
+    Topic *topic = topics.get(id);
+    if (topic == nullptr)
+      continue;
+    topic->remove_subscriber(sender.get());
+    topics.release_if_empty(topic);
   }
-  ++clear_sub_prio;
-  if (clear_sub_prio >= CLEAR_SUBSCRIPTION_THRESHOLD) {
-    clear_sub_gabages();
-    clear_sub_prio = 0;
-    handle_cmd_tp = nowtp;
+  sender->info->subscriptions.clear();
+  for (auto id : sender->info->pattern_subscriptions) {
+    TopicPattern *pattern = topics.get_pattern(id);
+    if (pattern == nullptr)
+      continue;
+    pattern->remove_subscriber(sender.get());
+    topics.release_pattern_if_empty(pattern);
   }
-}
-
-void Dispatcher::clear_sub_gabages() {
-  auto it = subscriptions.begin();
-  while (it != subscriptions.end()) {
-    auto ait = it->second.begin();
-    while (ait != it->second.end()) {
-      auto adap = ait->lock();
-      if (adap == nullptr)
-        ait = it->second.erase(ait);
-      else
-        ++ait;
-    }
-    if (it->second.empty())
-      it = subscriptions.erase(it);
-    else
-      ++it;
+  sender->info->pattern_subscriptions.clear();
+  for (auto id : sender->info->aliases) {
+    Topic *topic = id ? topics.get(id) : nullptr;
+    if (topic == nullptr)
+      continue;
+    --topic->alias_refs;
+    topics.release_if_empty(topic);
   }
+  sender->info->aliases.clear();
 }
 
 bool Dispatcher::handle_subscribe_req(shared_ptr<Caps> &msg_caps,
                                       shared_ptr<Adapter> &sender) {
   string name;
+  SubscribeFilter filter;
   if (sender->info == nullptr)
     return false;
-  if (RequestParser::parse_subscribe(msg_caps, name) != 0)
+  if (RequestParser::parse_subscribe(msg_caps, name, filter) != 0)
     return false;
-  KLOGI(TAG, "<<< %s: subscribe %s", sender->info->name.c_str(), name.c_str());
+  KLOGI(TAG, "<<< %s: subscribe %s, %u filter conditions",
+        sender->info->name.c_str(), name.c_str(),
+        (uint32_t)filter.conditions.size());
   if (name.length() == 0)
     return false;
-  AdapterList &adapters = subscriptions[name];
-  AdapterList::iterator it;
-  for (it = adapters.begin(); it != adapters.end(); ++it) {
-    auto adap = it->lock();
-    if (adap.get() == sender.get())
-      return true;
+  if (TopicMatcher::is_pattern(name.c_str())) {
+    // options of pattern not supported
+    if (!filter.empty())
+      return false;
+    subscribe_pattern(name, sender);
+    return true;
   }
-  adapters.push_back(sender);
+  Topic *topic = topics.intern(name);
+  topic->set_filter(sender.get(), filter);
+  if (!topic->add_subscriber(sender))
+    return true;
+  sender->info->add_subscription(topic->id);
 
-  // post persist messge to client
+  // post persist messge to client, if not posted by pattern subscribed
   PersistMsgMap::iterator pit = persist_msgs.find(name);
-  if (pit != persist_msgs.end()) {
-    int32_t c = ResponseSerializer::serialize_post(
-        name.c_str(), FLORA_MSGTYPE_PERSIST, pit->second.data, 0, "", buffer,
-        buf_size, sender->serialize_flags);
-    if (c > 0) {
-      KLOGI(TAG, ">>> %s: dispatch persist msg %s", sender->info->name.c_str(),
-            name.c_str());
-      if (sender->write(buffer, c) == -2) {
-        KLOGW(FILE_TAG, "write timeout: SUB persist msg, >>> [0x%llx]%s",
-            sender->tag, sender->info ? sender->info->name.c_str() : "");
+  if (pit != persist_msgs.end() &&
+      !pattern_subscribed(sender->info, name, 0) &&
+      PostFilter::match(filter, pit->second.data.leading_fields()))
+    write_persist_msg(topic, pit->second.data, sender.get());
+  return true;
+}
+
+void Dispatcher::subscribe_pattern(const string &name,
+                                   shared_ptr<Adapter> &sender) {
+  TopicPattern *pattern = topics.intern_pattern(name);
+  if (!pattern->add_subscriber(sender))
+    return;
+  sender->info->add_pattern_subscription(pattern->id);
+  topics.patterns_changed();
+
+  // persist messages of all matching topics not subscribed before
+  for (auto &it : persist_msgs) {
+    if (!TopicMatcher::match(name.c_str(), it.first.c_str()))
+      continue;
+    Topic *topic = topics.intern(it.first);
+    topics.match_patterns(topic);
+    bool subscribed = false;
+    for (auto &sub : topic->subscribers[TOPIC_SUBSCRIBER_GROUP(
+             sender->serialize_flags)]) {
+      if (sub.lock() == sender) {
+        subscribed = true;
+        break;
       }
     }
+    if (subscribed ||
+        pattern_subscribed(sender->info, it.first, pattern->id))
+      continue;
+    write_persist_msg(topic, it.second.data, sender.get());
+  }
+}
+
+bool Dispatcher::pattern_subscribed(AdapterInfo *info, const string &name,
+                                    uint32_t except) {
+  for (auto id : info->pattern_subscriptions) {
+    TopicPattern *pattern = id == except ? nullptr : topics.get_pattern(id);
+    if (pattern && TopicMatcher::match(pattern->name->c_str(), name.c_str()))
+      return true;
+  }
+  return false;
+}
+
+void Dispatcher::unsubscribe_pattern(const string &name,
+                                     shared_ptr<Adapter> &sender) {
+  TopicPattern *pattern = topics.find_pattern(name);
+  if (pattern) {
+    pattern->remove_subscriber(sender.get());
+    sender->info->remove_pattern_subscription(pattern->id);
+    topics.release_pattern_if_empty(pattern);
+  }
+}
+
+void Dispatcher::write_persist_msg(Topic *topic, PostArgs &data,
+                                   Adapter *adapter) {
+  PostFrames frames;
+  PostHeader header;
+  header.name = topic->name;
+  header.type = FLORA_MSGTYPE_PERSIST;
+  header.topic = topic->id;
+  KLOGI(TAG, ">>> %s: dispatch persist msg %s", adapter->info->name.c_str(),
+        topic->name->c_str());
+  if (write_post_msg(header, data, adapter, frames) == -2) {
+    KLOGW(FILE_TAG, "write dropped: SUB persist msg, >>> [0x%llx]%s",
+        adapter->tag, adapter->info ? adapter->info->name.c_str() : "");
   }
-  return true;
 }
 
 bool Dispatcher::handle_unsubscribe_req(shared_ptr<Caps> &msg_caps,
@@ -327,18 +462,15 @@ bool Dispatcher::handle_unsubscribe_req(shared_ptr<Caps> &msg_caps,
         name.c_str());
   if (name.length() == 0)
     return false;
-  auto it = subscriptions.find(name);
-  if (it != subscriptions.end()) {
-    auto ait = it->second.begin();
-    while (ait != it->second.end()) {
-      auto adap = ait->lock();
-      if (adap == nullptr || adap.get() == sender.get())
-        ait = it->second.erase(ait);
-      else
-        ++ait;
-    }
-    if (it->second.empty())
-      subscriptions.erase(it);
+  if (TopicMatcher::is_pattern(name.c_str())) {
+    unsubscribe_pattern(name, sender);
+    return true;
+  }
+  Topic *topic = topics.find(name);
+  if (topic) {
+    topic->remove_subscriber(sender.get());
+    sender->info->remove_subscription(topic->id);
+    topics.release_if_empty(topic);
   }
   return true;
 }
@@ -375,18 +507,205 @@ bool Dispatcher::handle_remove_method(shared_ptr<Caps> &msg_caps,
 bool Dispatcher::handle_post_req(shared_ptr<Caps> &msg_caps,
                                  shared_ptr<Adapter> &sender) {
   uint32_t msgtype;
+  const char *name;
+  PostArgs args;
+
+  if (sender->info == nullptr)
+    return false;
+  if (RequestParser::parse_post(msg_caps, name, msgtype, args.caps) != 0)
+    return false;
+  name_key.assign(name);
+  return post_msg(name_key, nullptr, msgtype, args, sender.get(),
+                  RequestParser::parse_trace(msg_caps));
+}
+
+bool Dispatcher::handle_alias_req(shared_ptr<Caps> &msg_caps,
+                                  shared_ptr<Adapter> &sender) {
   string name;
-  shared_ptr<Caps> args;
+  uint32_t alias;
 
   if (sender->info == nullptr)
     return false;
-  if (RequestParser::parse_post(msg_caps, name, msgtype, args) != 0)
+  if (RequestParser::parse_alias(msg_caps, name, alias) != 0)
     return false;
-  return post_msg(name, msgtype, args, sender.get());
+  KLOGI(TAG, "<<< %s: alias %u = %s", sender->info->name.c_str(), alias,
+        name.c_str());
+  if (name.length() == 0 || alias == 0 || alias > MAX_TOPIC_ALIASES)
+    return false;
+  auto &aliases = sender->info->aliases;
+  if (aliases.size() <= alias)
+    aliases.resize(alias + 1, 0);
+  Topic *topic = topics.intern(name);
+  if (aliases[alias] == topic->id)
+    return true;
+  // alias rebound to another topic
+  Topic *old = aliases[alias] ? topics.get(aliases[alias]) : nullptr;
+  ++topic->alias_refs;
+  aliases[alias] = topic->id;
+  if (old) {
+    --old->alias_refs;
+    topics.release_if_empty(old);
+  }
+  return true;
+}
+
+bool Dispatcher::handle_unknown_alias_req(shared_ptr<Caps> &msg_caps,
+                                          shared_ptr<Adapter> &sender) {
+  uint32_t kind;
+  uint32_t id;
+
+  if (sender->info == nullptr)
+    return false;
+  if (RequestParser::parse_unknown_alias(msg_caps, kind, id) != 0)
+    return false;
+  KLOGW(TAG, "<<< %s: unknown alias %u of kind %u",
+        sender->info->name.c_str(), id, kind);
+  if (kind == ALIAS_KIND_TOPIC)
+    sender->info->known_topics.erase(id);
+  else if (kind == ALIAS_KIND_SENDER)
+    sender->info->known_senders.erase(id);
+  return true;
 }
 
-bool Dispatcher::post_msg(const string &name, uint32_t type,
-                          shared_ptr<Caps> &args, Adapter *sender) {
+Topic *Dispatcher::alias_topic(AdapterInfo *info, uint32_t alias) {
+  if (alias >= info->aliases.size() || info->aliases[alias] == 0) {
+    KLOGE(TAG, "<<< %s: alias %u not bound", info->name.c_str(), alias);
+    return nullptr;
+  }
+  return topics.get(info->aliases[alias]);
+}
+
+bool Dispatcher::handle_alias_post_req(shared_ptr<Caps> &msg_caps,
+                                       shared_ptr<Adapter> &sender) {
+  uint32_t msgtype;
+  uint32_t alias;
+  PostArgs args;
+
+  if (sender->info == nullptr)
+    return false;
+  if (RequestParser::parse_alias_post(msg_caps, alias, msgtype, args.caps) !=
+      0)
+    return false;
+  Topic *topic = alias_topic(sender->info, alias);
+  if (topic == nullptr)
+    return false;
+  return post_msg(*topic->name, topic, msgtype, args, sender.get(),
+                  RequestParser::parse_trace(msg_caps));
+}
+
+bool Dispatcher::handle_raw_post_req(CmdPacket &packet) {
+  uint32_t msgtype;
+  const char *name;
+  PostArgs args;
+  Topic *topic = nullptr;
+
+  if (packet.sender->info == nullptr)
+    return false;
+  if (packet.cmd == CMD_ALIAS_RAW_POST_REQ) {
+    uint32_t alias;
+    if (RequestParser::parse_alias_raw_post(packet.caps, alias, msgtype) != 0)
+      return false;
+    topic = alias_topic(packet.sender->info, alias);
+    if (topic == nullptr)
+      return false;
+  } else if (RequestParser::parse_raw_post(packet.caps, name, msgtype) != 0) {
+    return false;
+  } else {
+    name_key.assign(name);
+  }
+  args.raw = packet.raw;
+  args.raw_flags = packet.sender->serialize_flags;
+  return post_msg(topic ? *topic->name : name_key, topic, msgtype, args,
+                  packet.sender.get(), RequestParser::parse_trace(packet.caps));
+}
+
+bool Dispatcher::handle_fd_post_req(CmdPacket &packet) {
+  uint32_t msgtype;
+  const char *name;
+  PostArgs args;
+
+  if (packet.sender->info == nullptr)
+    return false;
+  if (RequestParser::parse_fd_post(packet.caps, name, msgtype, args.fd_size) !=
+      0)
+    return false;
+#ifdef HAVE_SHM
+  // content of memfd must not be changed after checked
+  int seals = fcntl(packet.fd->fd, F_GET_SEALS);
+  struct stat st;
+  if (seals < 0 || (seals & FD_POST_SEALS) != FD_POST_SEALS ||
+      fstat(packet.fd->fd, &st) < 0 || st.st_size < args.fd_size) {
+    KLOGE(TAG, "<<< %s: post %s, invalid memfd",
+          packet.sender->info->name.c_str(), name);
+    return false;
+  }
+#else
+  return false;
+#endif
+  args.fd = packet.fd;
+  args.raw_flags = packet.sender->serialize_flags;
+  name_key.assign(name);
+  return post_msg(name_key, nullptr, msgtype, args, packet.sender.get(),
+                  RequestParser::parse_trace(packet.caps));
+}
+
+// frames in batch handled in order as received one by one
+bool Dispatcher::handle_batch_req(CmdPacket &packet) {
+  const void *frames;
+  uint32_t size;
+
+  if (packet.sender->info == nullptr ||
+      packet.sender->info->version < FLORA_VERSION_BATCH)
+    return false;
+  if (RequestParser::parse_batch(packet.caps, frames, size) != 0)
+    return false;
+  const int8_t *p = (const int8_t *)frames;
+  const int8_t *end = p + size;
+  CmdPacket sub;
+  sub.sender = packet.sender;
+  while (p < end) {
+    uint32_t version;
+    uint32_t length;
+    if (end - p < 8 ||
+        Caps::binary_info(p, &version, &length) != CAPS_SUCCESS ||
+        length == 0 || length > (uint32_t)(end - p)) {
+      KLOGE(TAG, "<<< %s: batch frame corrupted",
+            packet.sender->info->name.c_str());
+      return false;
+    }
+    if (sub.caps != nullptr) {
+      // args frame of raw post header
+      sub.raw = make_shared<RawFrame>(p, p + length);
+      if (!handle_raw_post_req(sub))
+        return false;
+      sub.caps.reset();
+      sub.raw.reset();
+    } else {
+      shared_ptr<Caps> caps;
+      int32_t cmd;
+      if (Caps::parse(p, length, caps) != CAPS_SUCCESS ||
+          caps->read(cmd) != CAPS_SUCCESS)
+        return false;
+      if (cmd == CMD_RAW_POST_REQ || cmd == CMD_ALIAS_RAW_POST_REQ) {
+        sub.cmd = cmd;
+        sub.caps = caps;
+      } else if (cmd <= CMD_AUTH_REQ || cmd >= MSG_HANDLER_COUNT ||
+                 msg_handlers[cmd] == nullptr) {
+        KLOGE(TAG, "msg cmd invalid(batch): %d", cmd);
+        return false;
+      } else if (!(this->*(msg_handlers[cmd]))(caps, packet.sender)) {
+        return false;
+      }
+    }
+    p += length;
+  }
+  // args frame of last CMD_RAW_POST_REQ missing
+  return sub.caps == nullptr;
+}
+
+bool Dispatcher::post_msg(const string &name, Topic *topic, uint32_t type,
+                          PostArgs &args, Adapter *sender,
+                          uint64_t send_time) {
   if (!is_valid_msgtype(type))
     return false;
   const char *cli_name = sender ? sender->info->name.c_str() : "";
@@ -394,35 +713,41 @@ bool Dispatcher::post_msg(const string &name, uint32_t type,
   if (name.length() == 0)
     return false;
 
-  SubscriptionMap::iterator sit;
-  sit = subscriptions.find(name);
-  if (sit != subscriptions.end()) {
-    AdapterList nobo_adapters; // no net byteorder
-    AdapterList bo_adapters;   // net byteorder
-    AdapterList::iterator ait;
-    ait = sit->second.begin();
-    while (ait != sit->second.end()) {
-      auto adap = ait->lock();
-      if (adap == nullptr || adap->closed()) {
-        ait = sit->second.erase(ait);
-        continue;
-      }
-      if (adap->serialize_flags == CAPS_FLAG_NET_BYTEORDER) {
-        bo_adapters.push_back(*ait);
-      } else {
-        nobo_adapters.push_back(*ait);
-      }
-      ++ait;
+  if (topic == nullptr)
+    topic = topics.find_or_match(name);
+  if (topic) {
+    topics.match_patterns(topic);
+    PostHeader header;
+    header.name = topic->name;
+    header.type = type;
+    header.topic = topic->id;
+    header.tag = sender->tag;
+    header.sender_name = cli_name;
+    header.sender = sender->info->id;
+    header.owner = topic;
+    uint64_t trace[FLORA_TRACE_SVC_DISPATCH + 1];
+    if (send_time) {
+      trace[FLORA_TRACE_SEND] = send_time;
+      trace[FLORA_TRACE_SVC_RECV] = cmd_recv_time;
+      trace[FLORA_TRACE_SVC_DISPATCH] = TraceHelper::now();
+      header.trace = trace;
+      topic->record_trace(trace);
     }
-    if (!nobo_adapters.empty())
-      write_post_msg_to_adapters(name, type, args, sender->tag, 0,
-                                 nobo_adapters, cli_name);
-    if (!bo_adapters.empty())
-      write_post_msg_to_adapters(name, type, args, sender->tag,
-                                 CAPS_FLAG_NET_BYTEORDER, bo_adapters,
-                                 cli_name);
-    if (sit->second.empty())
-      subscriptions.erase(sit);
+    topic->stats.posts.fetch_add(1, memory_order_relaxed);
+    uint32_t i;
+    for (i = 0; i < TOPIC_SUBSCRIBER_GROUPS; ++i) {
+      PostFrames frames;
+      if (!topic->subscribers[i].empty())
+        write_post_msg_to_adapters(
+            header, args, topic->subscribers[i], frames,
+            topic->options.empty() ? nullptr : &topic->options);
+      if (!topic->pattern_subscribers[i].empty())
+        write_post_msg_to_adapters(header, args,
+                                   topic->pattern_subscribers[i], frames,
+                                   nullptr);
+    }
+    topic->stats.bytes.fetch_add(header.bytes, memory_order_relaxed);
+    topics.release_if_empty(topic);
   }
 
   if (type == FLORA_MSGTYPE_PERSIST) {
@@ -432,56 +757,346 @@ bool Dispatcher::post_msg(const string &name, uint32_t type,
   return true;
 }
 
+// 'adapters' serialized with same flags
 void Dispatcher::write_post_msg_to_adapters(
-    const string &name, uint32_t type, shared_ptr<Caps> &args, uint64_t tag,
-    uint32_t flags, AdapterList &adapters, const char *sender_name) {
-  int32_t c = ResponseSerializer::serialize_post(
-      name.c_str(), type, args, tag, sender_name, buffer, buf_size, flags);
-  if (c < 0)
-    return;
-  AdapterList::iterator ait;
-  ait = adapters.begin();
-  while (ait != adapters.end()) {
-    auto adap = ait->lock();
-    if (adap != nullptr) {
-      KLOGI(TAG, "%s >>> %s: post %u..%s", sender_name,
-            adap->info->name.c_str(), type, name.c_str());
-      if (adap->write(buffer, c) == -2) {
-        KLOGW(FILE_TAG, "write timeout: post msg, [0x%llx]%s >>> [0x%llx]%s",
-            tag, sender_name, adap->tag,
-            adap->info ? adap->info->name.c_str() : "");
+    PostHeader &header, PostArgs &args, SubscriberVector &adapters,
+    PostFrames &frames, unordered_map<Adapter *, SubscriberOptions> *options) {
+  size_t i = 0;
+  uint32_t written = 0;
+  bool expired = false;
+  steady_clock::time_point now;
+  while (i < adapters.size()) {
+    auto adap = adapters[i].lock();
+    if (adap == nullptr || adap->closed()) {
+      adapters[i] = adapters.back();
+      adapters.pop_back();
+      expired = true;
+      continue;
+    }
+    ++i;
+    uint32_t latest = 0;
+    if (options) {
+      auto oit = options->find(adap.get());
+      if (oit != options->end()) {
+        SubscriberOptions &opts = oit->second;
+        if (!PostFilter::match(opts.filter, args.leading_fields()))
+          continue;
+        if (opts.filter.min_interval) {
+          if (now == steady_clock::time_point())
+            now = steady_clock::now();
+          if (opts.held || now < opts.next_write) {
+            hold_post(header, args, adap, opts);
+            continue;
+          }
+          opts.next_write = now + microseconds(opts.filter.min_interval);
+        }
+        if (opts.filter.flags & FLORA_FILTER_FLAG_LATEST)
+          latest = header.topic;
       }
     }
-    ++ait;
+    if (adap->cork())
+      corked_adapters.push_back(adap);
+    KLOGI(TAG, "%s >>> %s: post %u..%s", header.sender_name,
+          adap->info->name.c_str(), header.type, header.name->c_str());
+    int32_t r = write_post_msg(header, args, adap.get(), frames, latest);
+    if (r == 0) {
+      ++written;
+    } else if (r == -2) {
+      KLOGW(FILE_TAG, "write dropped: post msg, [0x%llx]%s >>> [0x%llx]%s",
+          header.tag, header.sender_name, adap->tag,
+          adap->info ? adap->info->name.c_str() : "");
+    } else if (r == -3) {
+      break;
+    }
+  }
+  if (header.owner) {
+    header.owner->stats.fanout.fetch_add(written, memory_order_relaxed);
+    if (expired)
+      header.owner->count_subscribers();
+  }
+}
+
+// return: adapter write result, or -3 if serialize failed
+int32_t Dispatcher::write_post_msg(PostHeader &header, PostArgs &args,
+                                   Adapter *adapter, PostFrames &frames,
+                                   uint32_t latest) {
+  uint32_t flags = adapter->serialize_flags;
+  if (args.fd != nullptr) {
+    if (args.raw_flags == flags && adapter->fd_passing() &&
+        adapter->info->version >= FLORA_VERSION_FD_POST) {
+      if (frames.fd_header == 0)
+        frames.fd_header = ResponseSerializer::serialize_fd_post(
+            header.name->c_str(), header.type, args.fd_size, header.tag,
+            header.sender_name, fd_header_buffer, buf_size, flags,
+            header.trace);
+      if (frames.fd_header < 0)
+        return -3;
+      int32_t r =
+          adapter->write_fd(fd_header_buffer, frames.fd_header, args.fd);
+      if (r == 0)
+        header.bytes += frames.fd_header + args.fd_size;
+      return r;
+    }
+    // peer can not receive fd, args inline if not too large
+    if (args.fd_size >= buf_size || args.loaded() == nullptr)
+      return -2;
+  }
+  bool aliased =
+      header.topic && adapter->info->version >= FLORA_VERSION_ALIAS;
+  if (aliased) {
+    // ids of topic and sender told before the first frame using them
+    if (!write_alias(ALIAS_KIND_TOPIC, header.topic, header.name->c_str(),
+                     adapter->info->known_topics, adapter))
+      return -2;
+    if (header.sender &&
+        !write_alias(ALIAS_KIND_SENDER, header.sender, header.sender_name,
+                     adapter->info->known_senders, adapter))
+      return -2;
+  }
+  if (args.raw != nullptr && adapter->info->version >= FLORA_VERSION_RAW_POST) {
+    int32_t &size = aliased ? frames.alias_header : frames.header;
+    int8_t *buf = aliased ? alias_header_buffer : header_buffer;
+    if (size == 0) {
+      if (aliased)
+        size = serialize_alias_raw_header(header, flags);
+      else
+        size = ResponseSerializer::serialize_raw_post(
+            header.name->c_str(), header.type, header.tag, header.sender_name,
+            buf, buf_size, flags, header.trace);
+      if (size > 0 && !prepare_args_frame(args, flags, frames))
+        size = -1;
+    }
+    if (size < 0)
+      return -3;
+    struct iovec iov[2];
+    iov[0].iov_base = buf;
+    iov[0].iov_len = size;
+    iov[1].iov_base = const_cast<void *>(frames.args);
+    iov[1].iov_len = frames.args_size;
+    int32_t r = latest ? adapter->writev_latest(iov, 2, latest)
+                       : adapter->writev(iov, 2);
+    if (r == 0)
+      header.bytes += size + frames.args_size;
+    return r;
+  }
+  int32_t &size = aliased ? frames.alias_full : frames.full;
+  int8_t *buf = aliased ? alias_buffer : buffer;
+  if (size == 0) {
+    auto &caps = args.decoded();
+    if (args.raw != nullptr && caps == nullptr)
+      size = -1;
+    else if (aliased)
+      size = ResponseSerializer::serialize_alias_post(
+          header.topic, header.type, caps, header.tag, header.sender, buf,
+          buf_size, flags, header.trace);
+    else
+      size = ResponseSerializer::serialize_post(
+          header.name->c_str(), header.type, caps, header.tag,
+          header.sender_name, buf, buf_size, flags, header.trace);
+  }
+  if (size < 0)
+    return -3;
+  int32_t r;
+  if (latest) {
+    struct iovec iov;
+    iov.iov_base = buf;
+    iov.iov_len = size;
+    r = adapter->writev_latest(&iov, 1, latest);
+  } else {
+    r = adapter->write(buf, size);
+  }
+  if (r == 0)
+    header.bytes += size;
+  return r;
+}
+
+void Dispatcher::hold_post(PostHeader &header, PostArgs &args,
+                           shared_ptr<Adapter> &adapter,
+                           SubscriberOptions &opts) {
+  HeldPostKey key(adapter.get(), header.topic);
+  HeldPost &held = held_posts[key];
+  if (opts.held) {
+    adapter->stats->conflated.fetch_add(1, memory_order_relaxed);
+  } else {
+    opts.held = true;
+    held_deadlines.emplace(opts.next_write, key);
+  }
+  held.adapter = adapter;
+  held.type = header.type;
+  held.tag = header.tag;
+  held.sender_name = header.sender_name;
+  held.sender = header.sender;
+  held.args = args;
+}
+
+void Dispatcher::write_held_posts() {
+  if (held_deadlines.empty())
+    return;
+  auto now = steady_clock::now();
+  while (!held_deadlines.empty() && held_deadlines.begin()->first <= now) {
+    HeldPostKey key = held_deadlines.begin()->second;
+    held_deadlines.erase(held_deadlines.begin());
+    auto hit = held_posts.find(key);
+    if (hit == held_posts.end())
+      continue;
+    auto adap = hit->second.adapter.lock();
+    Topic *topic = topics.get(key.second);
+    SubscriberOptions *opts = nullptr;
+    if (adap && !adap->closed() && topic) {
+      auto oit = topic->options.find(adap.get());
+      if (oit != topic->options.end() && oit->second.held)
+        opts = &oit->second;
+    }
+    // deadline of previous subscription, held post written by later one
+    if (opts && now < opts->next_write)
+      continue;
+    HeldPost held = move(hit->second);
+    held_posts.erase(hit);
+    // subscriber closed, unsubscribed or topic released since held
+    if (opts == nullptr)
+      continue;
+    opts->held = false;
+    opts->next_write = now + microseconds(opts->filter.min_interval);
+
+    PostFrames frames;
+    PostHeader header;
+    header.name = topic->name;
+    header.type = held.type;
+    header.topic = topic->id;
+    header.tag = held.tag;
+    header.sender_name = held.sender_name.c_str();
+    header.sender = held.sender;
+    header.owner = topic;
+    KLOGI(TAG, "%s >>> %s: held post %u..%s", header.sender_name,
+          adap->info->name.c_str(), header.type, header.name->c_str());
+    uint32_t latest =
+        opts->filter.flags & FLORA_FILTER_FLAG_LATEST ? topic->id : 0;
+    int32_t r = write_post_msg(header, held.args, adap.get(), frames, latest);
+    if (r == 0) {
+      topic->stats.fanout.fetch_add(1, memory_order_relaxed);
+      topic->stats.bytes.fetch_add(header.bytes, memory_order_relaxed);
+    } else if (r == -2) {
+      KLOGW(FILE_TAG, "write dropped: held post msg, [0x%llx]%s >>> [0x%llx]%s",
+          header.tag, header.sender_name, adap->tag,
+          adap->info ? adap->info->name.c_str() : "");
+    }
+  }
+}
+
+int32_t Dispatcher::serialize_alias_raw_header(PostHeader &header,
+                                               uint32_t flags) {
+  PostHeaderCache *cache = nullptr;
+  // timestamps differ per post, not cached
+  if (header.owner && header.sender && header.trace == nullptr) {
+    cache = header.owner->alias_headers + TOPIC_SUBSCRIBER_GROUP(flags);
+    if (cache->sender == header.sender && cache->type == header.type &&
+        !cache->frame.empty()) {
+      memcpy(alias_header_buffer, cache->frame.data(), cache->frame.size());
+      return cache->frame.size();
+    }
+  }
+  int32_t c = ResponseSerializer::serialize_alias_raw_post(
+      header.topic, header.type, header.tag, header.sender,
+      alias_header_buffer, buf_size, flags, header.trace);
+  if (cache && c > 0) {
+    cache->sender = header.sender;
+    cache->type = header.type;
+    cache->frame.assign(alias_header_buffer, alias_header_buffer + c);
+  }
+  return c;
+}
+
+bool Dispatcher::prepare_args_frame(PostArgs &args, uint32_t flags,
+                                    PostFrames &frames) {
+  if (frames.args != nullptr)
+    return true;
+  if (args.raw_flags == flags) {
+    frames.args = args.raw->data();
+    frames.args_size = args.raw->size();
+    return true;
+  }
+  // byte order different from sender, re-encode args
+  auto &caps = args.decoded();
+  int32_t c = caps ? caps->serialize(args_buffer, buf_size, flags) : -1;
+  if (c < 0 || c > buf_size)
+    return false;
+  frames.args = args_buffer;
+  frames.args_size = c;
+  return true;
+}
+
+bool Dispatcher::write_alias(uint32_t kind, uint32_t id, const char *name,
+                             unordered_set<uint32_t> &known,
+                             Adapter *adapter) {
+  if (known.find(id) != known.end())
+    return true;
+  int32_t c = ResponseSerializer::serialize_alias(
+      kind, id, name, alias_resp_buffer, buf_size, adapter->serialize_flags);
+  // id known once accepted, frame never dropped later
+  if (c < 0 || adapter->write_pinned(alias_resp_buffer, c) < 0)
+    return false;
+  known.insert(id);
+  return true;
+}
+
+shared_ptr<RawFrame> &PostArgs::loaded() {
+#ifdef HAVE_SHM
+  if (raw == nullptr && fd != nullptr) {
+    void *p = mmap(nullptr, fd_size, PROT_READ, MAP_SHARED, fd->fd, 0);
+    if (p == MAP_FAILED) {
+      KLOGE(TAG, "mmap post args memfd failed: %s", strerror(errno));
+      return raw;
+    }
+    raw = make_shared<RawFrame>((const int8_t *)p, (const int8_t *)p + fd_size);
+    munmap(p, fd_size);
   }
+#endif
+  return raw;
+}
+
+PostFields &PostArgs::leading_fields() {
+  if (fields == nullptr) {
+    shared_ptr<Caps> c = caps;
+    if (c == nullptr && loaded() != nullptr &&
+        Caps::parse(raw->data(), raw->size(), c, false) != CAPS_SUCCESS)
+      c.reset();
+    // 'raw' referenced by 'c' parsed without copy
+    fields = make_shared<PostFields>(c, c == caps ? nullptr : raw);
+  }
+  return *fields;
+}
+
+shared_ptr<Caps> &PostArgs::decoded() {
+  if (caps == nullptr && loaded() != nullptr) {
+    if (Caps::parse(raw->data(), raw->size(), caps) != CAPS_SUCCESS) {
+      KLOGE(TAG, "post args parse failed");
+      caps.reset();
+    }
+  }
+  return caps;
 }
 
 void Dispatcher::add_pending_call(int32_t svrid, int32_t cliid,
                                   shared_ptr<Adapter> &sender,
                                   shared_ptr<Adapter> &target,
-                                  uint32_t timeout) {
+                                  uint32_t timeout, CallStats *stats) {
   if (timeout == 0)
     timeout = DEFAULT_CALL_TIMEOUT;
-  steady_clock::time_point tp = steady_clock::now() + milliseconds(timeout);
-  PendingCallList::iterator it;
-  // pending_calls is sorted by discard_tp
-  for (it = pending_calls.begin(); it != pending_calls.end(); ++it) {
-    if ((*it).discard_tp >= tp) {
-      break;
-    }
+  steady_clock::time_point now = steady_clock::now();
+  PendingCall *pc = pending_calls.add(svrid, cliid, sender, target,
+                                      now + milliseconds(timeout));
+  if (pc == nullptr) {
+    KLOGW(TAG, "pending call %d already existed", svrid);
+    return;
   }
-  it = pending_calls.emplace(it);
-  (*it).svrid = svrid;
-  (*it).cliid = cliid;
-  (*it).sender = sender;
-  (*it).target = target;
-  (*it).discard_tp = tp;
+  pc->call_tp = now;
+  pc->stats = stats;
 }
 
 bool Dispatcher::handle_call_req(shared_ptr<Caps> &msg_caps,
                                  shared_ptr<Adapter> &sender) {
-  string name;
-  string target;
+  const char *name;
+  const char *target;
   shared_ptr<Caps> args;
   int32_t cliid;
   uint32_t timeout;
@@ -490,36 +1105,53 @@ bool Dispatcher::handle_call_req(shared_ptr<Caps> &msg_caps,
   if (RequestParser::parse_call(msg_caps, name, args, target, cliid, timeout) !=
       0)
     return false;
-  KLOGI(TAG, "%s <<< %s: call %d/%s, timeout %u", target.c_str(),
-        sender->info->name.c_str(), cliid, name.c_str(), timeout);
-  NamedAdapterMap::iterator it = named_adapters.find(target);
+  if (target == nullptr)
+    target = "";
+  KLOGI(TAG, "%s <<< %s: call %d/%s, timeout %u", target,
+        sender->info->name.c_str(), cliid, name, timeout);
+  // built-in methods of dispatcher
+  if (target[0] == '\0' && strcmp(name, FLORA_STATS_METHOD) == 0)
+    return reply_stats(cliid, sender);
+  name_key.assign(target);
+  NamedAdapterMap::iterator it = named_adapters.find(name_key);
   int32_t c;
-  if (it == named_adapters.end() || !it->second->info->has_method(name)) {
+  if (it != named_adapters.end())
+    name_key.assign(name);
+  if (it == named_adapters.end() ||
+      !it->second->info->has_method(name_key)) {
     c = ResponseSerializer::serialize_reply(cliid, FLORA_CLI_ENEXISTS, nullptr,
                                             0, buffer, buf_size,
                                             sender->serialize_flags);
     if (c < 0)
       return false;
     KLOGI(TAG, ">>> %s: call %d/%s failed. target %s not existed",
-          sender->info->name.c_str(), cliid, name.c_str(), target.c_str());
+          sender->info->name.c_str(), cliid, name, target);
     if (sender->write(buffer, c) == -2) {
-      KLOGW(FILE_TAG, "write timeout: call but target not existed, [0x%llx]%s >>> %s",
+      KLOGW(FILE_TAG, "write dropped: call but target not existed, [0x%llx]%s >>> %s",
           sender->tag, sender->info ? sender->info->name.c_str() : "",
-          target.c_str());
+          target);
     }
     return true;
   }
+  auto sit = call_stats.find(name_key);
+  if (sit == call_stats.end()) {
+    lock_guard<mutex> locker(stats_mutex);
+    sit = call_stats
+              .emplace(piecewise_construct, forward_as_tuple(name_key),
+                       forward_as_tuple())
+              .first;
+  }
   int32_t svrid = ++reqseq;
-  add_pending_call(svrid, cliid, sender, it->second, timeout);
+  add_pending_call(svrid, cliid, sender, it->second, timeout, &sit->second);
   c = ResponseSerializer::serialize_call(
-      name.c_str(), args, svrid, sender->tag, sender->info->name.c_str(),
-      buffer, buf_size, it->second->serialize_flags);
+      name, args, svrid, sender->tag, sender->info->name.c_str(), buffer,
+      buf_size, it->second->serialize_flags);
   if (c < 0)
     return false;
-  KLOGI(TAG, "%s >>> %s: call %d/%s", sender->info->name.c_str(),
-        target.c_str(), svrid, name.c_str());
+  KLOGI(TAG, "%s >>> %s: call %d/%s", sender->info->name.c_str(), target,
+        svrid, name);
   if (it->second->write(buffer, c) == -2) {
-    KLOGW(FILE_TAG, "write timeout: call, [0x%llx]%s >>> [0x%llx]%s",
+    KLOGW(FILE_TAG, "write dropped: call, [0x%llx]%s >>> [0x%llx]%s",
         sender->tag, sender->info ? sender->info->name.c_str() : "",
         it->second->tag, it->second->info ? it->second->info->name.c_str() : "");
   }
@@ -538,39 +1170,38 @@ bool Dispatcher::handle_reply_req(shared_ptr<Caps> &msg_caps,
   if (RequestParser::parse_reply(msg_caps, svrid, ret_code, data) != 0)
     return false;
   KLOGI(TAG, "<<< %s: reply %d", sender->info->name.c_str(), svrid);
-  PendingCallList::iterator it;
-  for (it = pending_calls.begin(); it != pending_calls.end(); ++it) {
-    if ((*it).svrid == svrid && (*it).target == sender) {
-      break;
-    }
-  }
-  if (it == pending_calls.end()) {
+  PendingCall *pc = pending_calls.find(svrid);
+  if (pc == nullptr || pc->target != sender) {
     KLOGW(TAG, "<<< %s: reply %d failed. not found pending call",
           sender->info->name.c_str(), svrid);
     return true;
   }
-  if (it->sender->closed()) {
+  if (pc->sender->closed()) {
     KLOGI(TAG, "<<< %s: reply %d failed. caller disconnected",
         sender->info->name.c_str(), svrid);
     return true;
   }
+  if (pc->stats)
+    pc->stats->record(
+        duration_cast<microseconds>(steady_clock::now() - pc->call_tp)
+            .count());
   Response resp;
   resp.ret_code = ret_code;
   resp.data = data;
   resp.extra = sender->info->name;
   int32_t c = ResponseSerializer::serialize_reply(
-      (*it).cliid, FLORA_CLI_SUCCESS, &resp, sender->tag, buffer, buf_size,
-      (*it).sender->serialize_flags);
+      pc->cliid, FLORA_CLI_SUCCESS, &resp, sender->tag, buffer, buf_size,
+      pc->sender->serialize_flags);
   if (c < 0)
     return false;
   KLOGI(TAG, "%s >>> %s: reply %d", sender->info->name.c_str(),
-        (*it).sender->info->name.c_str(), (*it).cliid);
-  if ((*it).sender->write(buffer, c) == -2) {
-    KLOGW(FILE_TAG, "write timeout: call return, [0x%llx]%s >>> [0x%llx]%s",
+        pc->sender->info->name.c_str(), pc->cliid);
+  if (pc->sender->write(buffer, c) == -2) {
+    KLOGW(FILE_TAG, "write dropped: call return, [0x%llx]%s >>> [0x%llx]%s",
         sender->tag, sender->info ? sender->info->name.c_str() : "",
-        (*it).sender->tag, (*it).sender->info ? (*it).sender->info->name.c_str() : "");
+        pc->sender->tag, pc->sender->info ? pc->sender->info->name.c_str() : "");
   }
-  pending_calls.erase(it);
+  pending_calls.erase(svrid);
   return true;
 }
 
@@ -585,7 +1216,7 @@ bool Dispatcher::handle_ping_req(shared_ptr<Caps> &msg_caps,
     return false;
   KLOGD(TAG, ">>> %s: pong", sender->info->name.c_str());
   if (sender->write(buffer, c) == -2) {
-    KLOGW(FILE_TAG, "write timeout: ping/pong, >>> [0x%llx]%s",
+    KLOGW(FILE_TAG, "write dropped: ping/pong, >>> [0x%llx]%s",
         sender->tag, sender->info ? sender->info->name.c_str() : "");
   }
   return true;
@@ -600,14 +1231,15 @@ bool Dispatcher::add_adapter(const string &name, uint32_t flags, int32_t pid,
   }
 
   AdapterInfo info;
+  info.name = name;
+  info.flags = flags;
+  info.pid = pid;
+  info.stats = adapter->stats;
+  lock_guard<mutex> locker(stats_mutex);
   auto r1 = adapter_infos.insert(
       make_pair(reinterpret_cast<intptr_t>(adapter.get()), info));
-  if (r1.second) {
-    r1.first->second.name = name;
-    r1.first->second.flags = flags;
-    r1.first->second.pid = pid;
+  if (r1.second)
     adapter->info = &r1.first->second;
-  }
   return true;
 }
 
@@ -623,6 +1255,100 @@ void Dispatcher::add_monitor(const string &name, uint32_t flags,
   }
 }
 
+bool Dispatcher::reply_stats(int32_t cliid, shared_ptr<Adapter> &sender) {
+  Response resp;
+  resp.ret_code = FLORA_CLI_SUCCESS;
+  resp.data = stats();
+  int32_t c = ResponseSerializer::serialize_reply(
+      cliid, FLORA_CLI_SUCCESS, &resp, 0, buffer, buf_size,
+      sender->serialize_flags);
+  if (c < 0) {
+    KLOGW(TAG, ">>> %s: call %d/%s failed. stats larger than %u bytes",
+          sender->info->name.c_str(), cliid, FLORA_STATS_METHOD, buf_size);
+    c = ResponseSerializer::serialize_reply(cliid, FLORA_CLI_EINSUFF_BUF,
+                                            nullptr, 0, buffer, buf_size,
+                                            sender->serialize_flags);
+  }
+  if (c < 0)
+    return false;
+  if (sender->write(buffer, c) == -2) {
+    KLOGW(FILE_TAG, "write dropped: stats, >>> [0x%llx]%s", sender->tag,
+          sender->info->name.c_str());
+  }
+  return true;
+}
+
+// count, p50, p99, p999 of 'h', zeros if nullptr
+static void write_latency(shared_ptr<Caps> &item, LatencyHistogram *h) {
+  item->write(h ? h->count() : (uint64_t)0);
+  item->write(h ? h->value_at(0.5) : (uint64_t)0);
+  item->write(h ? h->value_at(0.99) : (uint64_t)0);
+  item->write(h ? h->value_at(0.999) : (uint64_t)0);
+}
+
+shared_ptr<Caps> Dispatcher::stats() {
+  shared_ptr<Caps> adapters = Caps::new_instance();
+  shared_ptr<Caps> topic_list = Caps::new_instance();
+  shared_ptr<Caps> calls = Caps::new_instance();
+  lock_guard<mutex> locker(stats_mutex);
+
+  adapters->write((uint32_t)adapter_infos.size());
+  for (auto &it : adapter_infos) {
+    AdapterInfo &info = it.second;
+    AdapterStats &s = *info.stats;
+    shared_ptr<Caps> item = Caps::new_instance();
+    item->write(info.name);
+    item->write(info.id);
+    item->write(info.pid);
+    item->write(s.frames_in.load(memory_order_relaxed));
+    item->write(s.bytes_in.load(memory_order_relaxed));
+    item->write(s.frames_out.load(memory_order_relaxed));
+    item->write(s.bytes_out.load(memory_order_relaxed));
+    item->write(s.write_stalls.load(memory_order_relaxed));
+    item->write(s.write_drops.load(memory_order_relaxed));
+    item->write(s.queued_bytes.load(memory_order_relaxed));
+    item->write(s.conflated.load(memory_order_relaxed));
+    adapters->write(item);
+  }
+
+  vector<shared_ptr<Caps>> items;
+  topics.for_each([&items](Topic &topic) {
+    shared_ptr<Caps> item = Caps::new_instance();
+    item->write(*topic.name);
+    item->write(topic.stats.subscribers.load(memory_order_relaxed));
+    item->write(topic.stats.posts.load(memory_order_relaxed));
+    item->write(topic.stats.fanout.load(memory_order_relaxed));
+    item->write(topic.stats.bytes.load(memory_order_relaxed));
+    TopicTrace *trace = topic.trace.load(memory_order_acquire);
+    write_latency(item, trace ? &trace->to_svc : nullptr);
+    write_latency(item, trace ? &trace->in_svc : nullptr);
+    items.push_back(item);
+  });
+  topic_list->write((uint32_t)items.size());
+  for (auto &item : items)
+    topic_list->write(item);
+
+  calls->write((uint32_t)call_stats.size());
+  for (auto &it : call_stats) {
+    CallStats &s = it.second;
+    shared_ptr<Caps> item = Caps::new_instance();
+    item->write(it.first);
+    item->write(s.replies.load(memory_order_relaxed));
+    item->write(s.timeouts.load(memory_order_relaxed));
+    item->write(s.total_us.load(memory_order_relaxed));
+    item->write((uint32_t)STATS_LATENCY_BUCKETS);
+    for (auto &b : s.buckets)
+      item->write(b.load(memory_order_relaxed));
+    calls->write(item);
+  }
+
+  shared_ptr<Caps> result = Caps::new_instance();
+  result->write(adapters);
+  result->write(topic_list);
+  result->write(calls);
+  return result;
+}
+
 void Dispatcher::write_monitor_data(uint32_t flags,
                                     shared_ptr<Adapter> &adapter) {
   if (flags & FLORA_CLI_FLAG_MONITOR) {
@@ -708,3 +1434,10 @@ void flora_dispatcher_close(flora_dispatcher_t handle) {
     reinterpret_cast<flora::Dispatcher *>(handle)->close();
   }
 }
+
+caps_t flora_dispatcher_stats(flora_dispatcher_t handle) {
+  if (handle == 0)
+    return 0;
+  shared_ptr<Caps> r = reinterpret_cast<flora::Dispatcher *>(handle)->stats();
+  return Caps::convert(r);
+}
@@ -3,7 +3,13 @@
 #include "adap.h"
 #include "caps.h"
 #include "defs.h"
+#include "doorbell.h"
 #include "flora-svc.h"
+#include "mpsc-ring.h"
+#include "pending-calls.h"
+#include "post-filter.h"
+#include "topic-table.h"
+#include <atomic>
 #include <chrono>
 #include <condition_variable>
 #include <list>
@@ -12,27 +18,115 @@
 #include <mutex>
 #include <string>
 #include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
 
 namespace flora {
 namespace internal {
 
-typedef std::list<std::weak_ptr<Adapter>> AdapterList;
-typedef std::map<std::string, AdapterList> SubscriptionMap;
+typedef std::vector<int8_t> RawFrame;
+// args of post msg
+// decoded Caps, or frame serialized by sender and forwarded untouched
+class PostArgs {
+public:
+  std::shared_ptr<Caps> caps;
+  std::shared_ptr<RawFrame> raw;
+  // serialize flags of 'raw' and 'fd'
+  uint32_t raw_flags = 0;
+  // sealed memfd of CMD_FD_POST_REQ, 'fd_size' bytes serialized args
+  std::shared_ptr<SharedFd> fd;
+  uint32_t fd_size = 0;
+  // read by filters of subscribers, see leading_fields
+  std::shared_ptr<PostFields> fields;
+
+  // copy 'fd' content to 'raw' if necessary
+  // return: nullptr if failed
+  std::shared_ptr<RawFrame> &loaded();
+
+  // decode 'raw' if necessary
+  // return: nullptr if decode failed
+  std::shared_ptr<Caps> &decoded();
+
+  // leading fields of 'caps' or 'raw', created on first use
+  PostFields &leading_fields();
+};
+// frames of a post msg serialized for one byte order, built lazily
+class PostFrames {
+public:
+  // CMD_POST_RESP in Dispatcher::buffer
+  int32_t full = 0;
+  // CMD_RAW_POST_RESP in Dispatcher::header_buffer
+  int32_t header = 0;
+  // args frame followed CMD_RAW_POST_RESP
+  const void *args = nullptr;
+  uint32_t args_size = 0;
+  // CMD_FD_POST_RESP in Dispatcher::fd_header_buffer
+  int32_t fd_header = 0;
+  // CMD_ALIAS_POST_RESP in Dispatcher::alias_buffer
+  int32_t alias_full = 0;
+  // CMD_ALIAS_RAW_POST_RESP in Dispatcher::alias_header_buffer
+  int32_t alias_header = 0;
+};
+// identity of a post msg written to subscribers
+class PostHeader {
+public:
+  const std::string *name = nullptr;
+  uint32_t type = 0;
+  // topic id, 0 if not interned
+  uint32_t topic = 0;
+  uint64_t tag = 0;
+  const char *sender_name = "";
+  // AdapterInfo id of sender, 0 if no sender
+  uint32_t sender = 0;
+  // header frames cached by topic, nullptr if not cached
+  Topic *owner = nullptr;
+  // bytes written by 'write_post_msg'
+  uint64_t bytes = 0;
+  // timestamps FLORA_TRACE_SEND ~ FLORA_TRACE_SVC_DISPATCH,
+  // nullptr if sender not traced
+  const uint64_t *trace = nullptr;
+};
+// newest post held by rate limit of a subscription, see
+// SubscribeFilter::min_interval
+class HeldPost {
+public:
+  std::weak_ptr<Adapter> adapter;
+  uint32_t type = 0;
+  uint64_t tag = 0;
+  std::string sender_name;
+  uint32_t sender = 0;
+  PostArgs args;
+};
+// indexed by subscriber and topic id
+typedef std::pair<Adapter *, uint32_t> HeldPostKey;
+typedef std::map<HeldPostKey, HeldPost> HeldPostMap;
+typedef std::multimap<std::chrono::steady_clock::time_point, HeldPostKey>
+    HeldDeadlineMap;
 typedef struct {
-  std::shared_ptr<Caps> data;
+  PostArgs data;
 } PersistMsg;
-typedef std::map<std::string, PersistMsg> PersistMsgMap;
+typedef std::unordered_map<std::string, PersistMsg> PersistMsgMap;
 typedef std::map<std::string, std::shared_ptr<Adapter>> NamedAdapterMap;
-typedef std::pair<std::shared_ptr<Caps>, std::shared_ptr<Adapter>> CmdPacket;
-typedef std::list<CmdPacket> CmdPacketList;
-typedef struct {
-  int32_t svrid;
-  int32_t cliid;
+class CmdPacket {
+public:
+  CmdPacket() = default;
+
+  CmdPacket(std::shared_ptr<Caps> &c, std::shared_ptr<Adapter> &s)
+      : caps(c), sender(s) {}
+
+  int32_t cmd = 0;
+  // empty caps: erase sender
+  std::shared_ptr<Caps> caps;
   std::shared_ptr<Adapter> sender;
-  std::shared_ptr<Adapter> target;
-  std::chrono::steady_clock::time_point discard_tp;
-} PendingCall;
-typedef std::list<PendingCall> PendingCallList;
+  // args frame of CMD_RAW_POST_REQ or CMD_ALIAS_RAW_POST_REQ
+  std::shared_ptr<RawFrame> raw;
+  // memfd of CMD_FD_POST_REQ
+  std::shared_ptr<SharedFd> fd;
+  // FLORA_TRACE_SVC_RECV timestamp
+  uint64_t recv_time = 0;
+};
+typedef MpscRing<CmdPacket> CmdPacketQueue;
 typedef std::map<intptr_t, AdapterInfo> AdapterInfoMap;
 
 class Dispatcher : public flora::Dispatcher {
@@ -47,6 +141,8 @@ public:
 
   void close();
 
+  std::shared_ptr<Caps> stats();
+
   inline uint32_t max_msg_size() const { return buf_size; }
 
   void erase_adapter(std::shared_ptr<Adapter> &adapter);
@@ -61,6 +157,21 @@ private:
   bool handle_unsubscribe_req(std::shared_ptr<Caps> &msg_caps,
                               std::shared_ptr<Adapter> &sender);
 
+  // 'name' with wildcard levels, see TopicMatcher
+  void subscribe_pattern(const std::string &name,
+                         std::shared_ptr<Adapter> &sender);
+
+  void unsubscribe_pattern(const std::string &name,
+                           std::shared_ptr<Adapter> &sender);
+
+  // return: true if 'name' matched by any pattern subscribed by 'info'
+  //         except pattern of id 'except'
+  bool pattern_subscribed(AdapterInfo *info, const std::string &name,
+                          uint32_t except);
+
+  // write persist msg 'data' of 'topic' to subscriber 'adapter'
+  void write_persist_msg(Topic *topic, PostArgs &data, Adapter *adapter);
+
   bool handle_declare_method(std::shared_ptr<Caps> &msg_caps,
                              std::shared_ptr<Adapter> &sender);
 
@@ -70,6 +181,22 @@ private:
   bool handle_post_req(std::shared_ptr<Caps> &msg_caps,
                        std::shared_ptr<Adapter> &sender);
 
+  bool handle_alias_req(std::shared_ptr<Caps> &msg_caps,
+                        std::shared_ptr<Adapter> &sender);
+
+  bool handle_alias_post_req(std::shared_ptr<Caps> &msg_caps,
+                             std::shared_ptr<Adapter> &sender);
+
+  bool handle_unknown_alias_req(std::shared_ptr<Caps> &msg_caps,
+                                std::shared_ptr<Adapter> &sender);
+
+  // CMD_RAW_POST_REQ or CMD_ALIAS_RAW_POST_REQ
+  bool handle_raw_post_req(CmdPacket &packet);
+
+  bool handle_fd_post_req(CmdPacket &packet);
+
+  bool handle_batch_req(CmdPacket &packet);
+
   bool handle_call_req(std::shared_ptr<Caps> &msg_caps,
                        std::shared_ptr<Adapter> &sender);
 
@@ -79,6 +206,9 @@ private:
   bool handle_ping_req(std::shared_ptr<Caps> &msg_caps,
                        std::shared_ptr<Adapter> &sender);
 
+  // reply FLORA_STATS_METHOD call 'cliid' of 'sender'
+  bool reply_stats(int32_t cliid, std::shared_ptr<Adapter> &sender);
+
   bool add_adapter(const std::string &name, uint32_t flags, int32_t pid,
                    std::shared_ptr<Adapter> &adapter);
 
@@ -87,24 +217,69 @@ private:
 
   void handle_cmds();
 
-  void handle_cmd(std::shared_ptr<Caps> &caps,
-                  std::shared_ptr<Adapter> &sender);
+  // invoked by poll threads
+  bool push_cmd(CmdPacket &packet);
+
+  // block until commands arrived or the first pending call timeout
+  void park();
+
+  void handle_cmd(CmdPacket &packet);
 
   void add_pending_call(int32_t svrid, int32_t cliid,
                         std::shared_ptr<Adapter> &sender,
-                        std::shared_ptr<Adapter> &target, uint32_t timeout);
+                        std::shared_ptr<Adapter> &target, uint32_t timeout,
+                        CallStats *stats);
 
   void pending_call_timeout(PendingCall &pc);
 
   void discard_pending_calls();
 
-  bool post_msg(const std::string &name, uint32_t type,
-                std::shared_ptr<Caps> &args, Adapter *sender);
+  // write frames buffered by subscribers during a batch of commands
+  void uncork_adapters();
+
+  // return: topic bound to 'alias' by CMD_ALIAS_REQ, nullptr if not bound
+  Topic *alias_topic(AdapterInfo *info, uint32_t alias);
 
+  // topic: topic of 'name' if known, nullptr to find by name
+  // send_time: FLORA_TRACE_SEND timestamp, 0 if not traced
+  bool post_msg(const std::string &name, Topic *topic, uint32_t type,
+                PostArgs &args, Adapter *sender, uint64_t send_time);
+
+  // 'frames' serialized with flags of 'adapters' and reused
+  // options: options of 'adapters', nullptr if none
   void write_post_msg_to_adapters(
-      const std::string &name, uint32_t type, std::shared_ptr<Caps> &args,
-      uint64_t tag, uint32_t flags, AdapterList &adapters,
-      const char *sender_name);
+      PostHeader &header, PostArgs &args, SubscriberVector &adapters,
+      PostFrames &frames,
+      std::unordered_map<Adapter *, SubscriberOptions> *options);
+
+  // keep 'args' as newest post of 'header.owner' for 'adapter',
+  // written when 'opts.next_write' reached
+  void hold_post(PostHeader &header, PostArgs &args,
+                 std::shared_ptr<Adapter> &adapter, SubscriberOptions &opts);
+
+  // write held posts reached 'next_write'
+  void write_held_posts();
+
+  // write CMD_RAW_POST_RESP if adapter supported and args not decoded,
+  // otherwise CMD_POST_RESP
+  // CMD_ALIAS_* instead if adapter supported
+  // 'frames' serialized with 'adapter->serialize_flags' and reused
+  // latest: key of Adapter::writev_latest, 0 if not latest-value
+  int32_t write_post_msg(PostHeader &header, PostArgs &args, Adapter *adapter,
+                         PostFrames &frames, uint32_t latest = 0);
+
+  // CMD_ALIAS_RAW_POST_RESP in alias_header_buffer, reused from cache of
+  // 'header.owner' if possible
+  int32_t serialize_alias_raw_header(PostHeader &header, uint32_t flags);
+
+  // args frame followed raw post header, reused by 'frames'
+  // return: false if args could not be serialized
+  bool prepare_args_frame(PostArgs &args, uint32_t flags, PostFrames &frames);
+
+  // write CMD_ALIAS_RESP if 'id' not in 'known'
+  // return: false if write failed
+  bool write_alias(uint32_t kind, uint32_t id, const char *name,
+                   std::unordered_set<uint32_t> &known, Adapter *adapter);
 
   void do_erase_adapter(std::shared_ptr<Adapter> &sender);
 
@@ -121,33 +296,52 @@ private:
 
   void write_monitor_list_remove(uint32_t id);
 
-  void check_subscriptions();
-
-  void clear_sub_gabages();
+  // remove 'sender' from all topics and patterns it subscribed or aliased
+  void clear_subscriptions(std::shared_ptr<Adapter> &sender);
 
 private:
-  SubscriptionMap subscriptions;
+  TopicTable topics;
+  // names parsed as 'const char *' copied here for map lookup,
+  // reused to avoid allocation per msg
+  std::string name_key;
+  // 'recv_time' of command handling
+  uint64_t cmd_recv_time = 0;
   PersistMsgMap persist_msgs;
+  HeldPostMap held_posts;
+  HeldDeadlineMap held_deadlines;
   NamedAdapterMap named_adapters;
   int8_t *buffer;
+  // header of CMD_RAW_POST_RESP
+  int8_t *header_buffer;
+  // args re-encoded for byte order of subscribers
+  int8_t *args_buffer;
+  // header of CMD_FD_POST_RESP
+  int8_t *fd_header_buffer;
+  // CMD_ALIAS_POST_RESP
+  int8_t *alias_buffer;
+  // header of CMD_ALIAS_RAW_POST_RESP
+  int8_t *alias_header_buffer;
+  // CMD_ALIAS_RESP
+  int8_t *alias_resp_buffer;
   uint32_t buf_size;
-  CmdPacketList cmd_packets;
-  std::mutex cmd_mutex;
-  std::condition_variable cmd_cond;
+  CmdPacketQueue cmd_packets{CMD_QUEUE_CAPACITY};
+  // wake up dispatcher thread, rung only if 'parked'
+  Doorbell cmd_doorbell;
+  std::atomic<bool> parked{false};
   std::thread run_thread;
-  PendingCallList pending_calls;
+  PendingCallTable pending_calls;
+  // adapters written by post fan-out in current batch of commands
+  std::vector<std::shared_ptr<Adapter>> corked_adapters;
   int32_t reqseq = 0;
   AdapterInfoMap adapter_infos;
   AdapterInfoMap monitors;
+  // latency of calls indexed by method name, entries never erased
+  std::map<std::string, CallStats> call_stats;
+  // held by dispatcher thread while inserting or erasing 'adapter_infos'
+  // and 'call_stats', and by 'stats' reading them
+  std::mutex stats_mutex;
   uint32_t flags;
-  // if now timepoint more than handle_cmd_tp 10 seconds when erase adapter
-  // traversal map of subscriptions, clear gabages
-  std::chrono::steady_clock::time_point handle_cmd_tp;
-  // the variable +1 for each erased adapter
-  // if the variable >= CLEAR_SUBSCRIPTION_THRESHOLD,
-  // traversal map of subscriptions, clear gabages
-  uint32_t clear_sub_prio{0};
-  bool working = false;
+  std::atomic<bool> working{false};
 
   static bool (Dispatcher::*msg_handlers[MSG_HANDLER_COUNT])(
       std::shared_ptr<Caps> &, std::shared_ptr<Adapter> &);
@@ -0,0 +1,89 @@
+#include "doorbell.h"
+#include "rlog.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#ifdef HAVE_EVENTFD
+#include <sys/eventfd.h>
+#endif
+
+namespace flora {
+namespace internal {
+
+Doorbell::~Doorbell() { close(); }
+
+bool Doorbell::init() {
+  if (rfd >= 0)
+    return true;
+#ifdef HAVE_EVENTFD
+  rfd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+  if (rfd < 0) {
+    KLOGE(TAG, "eventfd failed: %s", strerror(errno));
+    return false;
+  }
+  wfd = rfd;
+#else
+  int fds[2];
+  if (pipe(fds) < 0) {
+    KLOGE(TAG, "pipe failed: %s", strerror(errno));
+    return false;
+  }
+  for (int i = 0; i < 2; ++i) {
+    fcntl(fds[i], F_SETFD, fcntl(fds[i], F_GETFD) | FD_CLOEXEC);
+    fcntl(fds[i], F_SETFL, fcntl(fds[i], F_GETFL) | O_NONBLOCK);
+  }
+  rfd = fds[0];
+  wfd = fds[1];
+#endif
+  return true;
+}
+
+void Doorbell::close() {
+  if (rfd >= 0)
+    ::close(rfd);
+  if (wfd >= 0 && wfd != rfd)
+    ::close(wfd);
+  rfd = -1;
+  wfd = -1;
+}
+
+void Doorbell::ring() {
+#ifdef HAVE_EVENTFD
+  uint64_t v = 1;
+#else
+  uint8_t v = 1;
+#endif
+  // EAGAIN: doorbell already rung, reader not waked yet
+  while (::write(wfd, &v, sizeof(v)) < 0 && errno == EINTR)
+    ;
+}
+
+void Doorbell::wait(int32_t timeout) {
+  struct pollfd pfd;
+  pfd.fd = rfd;
+  pfd.events = POLLIN;
+  pfd.revents = 0;
+  if (::poll(&pfd, 1, timeout) < 0 && errno != EINTR)
+    KLOGE(TAG, "poll doorbell failed: %s", strerror(errno));
+}
+
+void Doorbell::reset() {
+  uint64_t v[16];
+  while (true) {
+    ssize_t c = ::read(rfd, v, sizeof(v));
+    if (c < 0 && errno == EINTR)
+      continue;
+#ifdef HAVE_EVENTFD
+    break;
+#else
+    if (c < (ssize_t)sizeof(v))
+      break;
+#endif
+  }
+}
+
+} // namespace internal
+} // namespace flora
@@ -0,0 +1,37 @@
+#pragma once
+
+#include "defs.h"
+#include <stdint.h>
+
+namespace flora {
+namespace internal {
+
+// wake up a thread blocked in select/epoll/read
+// eventfd on linux, pipe on other platforms
+class Doorbell {
+public:
+  ~Doorbell();
+
+  bool init();
+
+  void close();
+
+  // fd readable after 'ring'
+  int fd() const { return rfd; }
+
+  void ring();
+
+  // block until rung or timeout
+  // timeout: milliseconds, < 0 wait forever
+  void wait(int32_t timeout);
+
+  // consume all pending rings
+  void reset();
+
+private:
+  int rfd = -1;
+  int wfd = -1;
+};
+
+} // namespace internal
+} // namespace flora
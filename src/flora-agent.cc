@@ -1,11 +1,13 @@
 #include "flora-agent.h"
 #include "cli.h"
 #include "rlog.h"
+#include "topic-match.h"
 #include <string.h>
 #include <thread>
 
 using namespace std;
 using namespace std::chrono;
+using flora::internal::TopicMatcher;
 
 namespace flora {
 
@@ -39,21 +41,74 @@ void Agent::config(uint32_t key, va_list ap) {
     options.beep_interval = va_arg(ap, uint32_t);
     options.noresp_timeout = va_arg(ap, uint32_t);
     break;
+  case FLORA_AGENT_CONFIG_BATCH:
+    options.batch_bytes = va_arg(ap, uint32_t);
+    options.batch_interval = va_arg(ap, uint32_t);
+    break;
+  case FLORA_AGENT_CONFIG_TRACE:
+    if (va_arg(ap, uint32_t))
+      options.flags |= FLORA_CLI_FLAG_TRACE;
+    else
+      options.flags &= ~FLORA_CLI_FLAG_TRACE;
+    break;
   }
 }
 
-void Agent::subscribe(const char *name, PostHandler &&cb) {
-  subscribe(name, cb);
+int32_t Agent::subscribe(const char *name, PostHandler &&cb) {
+  return subscribe(name, cb);
+}
+
+int32_t Agent::subscribe(const char *name, PostHandler &cb) {
+  SubscribeFilter filter;
+  return subscribe(name, filter, cb);
 }
 
-void Agent::subscribe(const char *name, PostHandler &cb) {
+int32_t Agent::subscribe(const char *name, const SubscribeFilter &filter,
+                         PostHandler &&cb) {
+  return subscribe(name, filter, cb);
+}
+
+int32_t Agent::subscribe(const char *name, const SubscribeFilter &filter,
+                         PostHandler &cb) {
+  if (name == nullptr ||
+      !flora::internal::Client::valid_filter(name, filter))
+    return FLORA_CLI_EINVAL;
   shared_ptr<Client> cli;
+  SubscribeFilter prev;
   conn_mutex.lock();
   auto r = post_handlers.insert(make_pair(name, cb));
+  auto fit = post_filters.find(name);
+  if (fit != post_filters.end())
+    prev = fit->second;
+  if (r.second && TopicMatcher::is_pattern(name))
+    ++pattern_handlers;
+  // filter of existing subscription replaced by Client::subscribe too
+  set_filter(name, filter);
   cli = flora_cli;
   conn_mutex.unlock();
-  if (r.second && cli.get())
-    cli->subscribe(name);
+  if (cli.get() == nullptr)
+    return FLORA_CLI_SUCCESS;
+  int32_t ret = cli->subscribe(name, filter);
+  // subscribed again after reconnected
+  if (ret == FLORA_CLI_SUCCESS || ret == FLORA_CLI_ECONN)
+    return FLORA_CLI_SUCCESS;
+  // rejected by client, e.g. filter not supported by service
+  conn_mutex.lock();
+  if (r.second) {
+    if (TopicMatcher::is_pattern(name))
+      --pattern_handlers;
+    post_handlers.erase(name);
+  }
+  set_filter(name, prev);
+  conn_mutex.unlock();
+  return ret;
+}
+
+void Agent::set_filter(const string &name, const SubscribeFilter &filter) {
+  if (filter.empty())
+    post_filters.erase(name);
+  else
+    post_filters[name] = filter;
 }
 
 void Agent::unsubscribe(const char *name) {
@@ -63,6 +118,9 @@ void Agent::unsubscribe(const char *name) {
   conn_mutex.lock();
   it = post_handlers.find(name);
   if (it != post_handlers.end()) {
+    if (TopicMatcher::is_pattern(name))
+      --pattern_handlers;
+    post_filters.erase(it->first);
     post_handlers.erase(it);
     cli = flora_cli;
   }
@@ -173,11 +231,24 @@ void Agent::init_cli(shared_ptr<Client> &cli) {
   CallHandlerMap::iterator cit;
 
   for (pit = post_handlers.begin(); pit != post_handlers.end(); ++pit) {
-    cli->subscribe((*pit).first.c_str());
+    auto fit = post_filters.find((*pit).first);
+    if (fit == post_filters.end())
+      cli->subscribe((*pit).first.c_str());
+    else
+      cli->subscribe((*pit).first.c_str(), fit->second);
   }
   for (cit = call_handlers.begin(); cit != call_handlers.end(); ++cit) {
     cli->declare_method((*cit).first.c_str());
   }
+  // alias table of service is per connection
+  conn_mutex.lock();
+  AliasSet names = aliases;
+  conn_mutex.unlock();
+  for (auto &name : names) {
+    cli->alias(name.c_str());
+  }
+  if (options.batch_bytes)
+    cli->set_batch(options.batch_bytes, options.batch_interval);
 }
 
 void Agent::close() {
@@ -190,6 +261,7 @@ void Agent::close() {
     flora_cli.reset();
     post_handlers.clear();
     call_handlers.clear();
+    aliases.clear();
     locker.unlock();
     cg_mutex.lock();
     if (cli != nullptr && cli->close(false) == FLORA_CLI_EDEADLOCK) {
@@ -219,6 +291,54 @@ int32_t Agent::post(const char *name, shared_ptr<Caps> &msg, uint32_t msgtype) {
   return r;
 }
 
+int32_t Agent::flush() {
+  shared_ptr<Client> cli;
+
+  conn_mutex.lock();
+  cli = flora_cli;
+  conn_mutex.unlock();
+
+  if (cli.get() == nullptr) {
+    return FLORA_CLI_ECONN;
+  }
+  int32_t r = cli->flush();
+  if (r == FLORA_CLI_ECONN) {
+    destroy_client();
+  }
+  return r;
+}
+
+shared_ptr<Caps> Agent::trace_stats() {
+  shared_ptr<Client> cli;
+
+  conn_mutex.lock();
+  cli = flora_cli;
+  conn_mutex.unlock();
+
+  if (cli.get() == nullptr)
+    return nullptr;
+  return cli->trace_stats();
+}
+
+int32_t Agent::alias(const char *name) {
+  shared_ptr<Client> cli;
+
+  if (name == nullptr)
+    return FLORA_CLI_EINVAL;
+  conn_mutex.lock();
+  auto r = aliases.insert(name);
+  cli = flora_cli;
+  conn_mutex.unlock();
+
+  if (!r.second || cli.get() == nullptr)
+    return FLORA_CLI_SUCCESS;
+  int32_t ret = cli->alias(name);
+  if (ret == FLORA_CLI_ECONN) {
+    destroy_client();
+  }
+  return ret;
+}
+
 int32_t Agent::call(const char *name, shared_ptr<Caps> &msg, const char *target,
                     Response &response, uint32_t timeout) {
   shared_ptr<Client> cli;
@@ -269,19 +389,60 @@ void Agent::destroy_client() {
 
 void Agent::recv_post(const char *name, uint32_t msgtype,
                       shared_ptr<Caps> &msg) {
+  // reused by recv thread, avoid string allocation per message
+  static thread_local string key;
+  key.assign(name);
   unique_lock<mutex> locker(conn_mutex);
-  PostHandlerMap::iterator it = post_handlers.find(name);
-  if (it != post_handlers.end()) {
-    auto cb = it->second;
-    locker.unlock();
-    cb(name, msg, msgtype);
+  PostHandlerMap::iterator it = post_handlers.find(key);
+  if (pattern_handlers == 0) {
+    if (it != post_handlers.end()) {
+      auto cb = it->second;
+      locker.unlock();
+      cb(name, msg, msgtype);
+    }
+    return;
+  }
+  // service posts once to handlers of topic and all matching patterns
+  vector<PostHandler> cbs;
+  if (it != post_handlers.end())
+    cbs.push_back(it->second);
+  for (auto &h : post_handlers) {
+    if (h.first != key && TopicMatcher::is_pattern(h.first.c_str()) &&
+        TopicMatcher::match(h.first.c_str(), name))
+      cbs.push_back(h.second);
+  }
+  locker.unlock();
+  if (cbs.size() <= 1) {
+    for (auto &cb : cbs)
+      cb(name, msg, msgtype);
+    return;
+  }
+  // each handler reads 'msg' from beginning, copied before any read
+  vector<int8_t> data;
+  if (msg != nullptr) {
+    int32_t c = msg->serialize(nullptr, 0);
+    if (c > 0) {
+      data.resize(c);
+      msg->serialize(data.data(), c);
+    }
+  }
+  size_t i;
+  for (i = 0; i < cbs.size(); ++i) {
+    shared_ptr<Caps> copy;
+    if (i == 0 || data.empty())
+      copy = msg;
+    else if (Caps::parse(data.data(), data.size(), copy) != CAPS_SUCCESS)
+      continue;
+    cbs[i](name, copy, msgtype);
   }
 }
 
 void Agent::recv_call(const char *name, shared_ptr<Caps> &msg,
                       shared_ptr<Reply> &reply) {
+  static thread_local string key;
+  key.assign(name);
   unique_lock<mutex> locker(conn_mutex);
-  CallHandlerMap::iterator it = call_handlers.find(name);
+  CallHandlerMap::iterator it = call_handlers.find(key);
   if (it != call_handlers.end()) {
     auto cb = it->second;
     locker.unlock();
@@ -361,6 +522,16 @@ int32_t flora_agent_post(flora_agent_t agent, const char *name, caps_t msg,
   return cxxagent->post(name, cxxmsg, msgtype);
 }
 
+int32_t flora_agent_flush(flora_agent_t agent) {
+  Agent *cxxagent = reinterpret_cast<Agent *>(agent);
+  return cxxagent->flush();
+}
+
+int32_t flora_agent_alias(flora_agent_t agent, const char *name) {
+  Agent *cxxagent = reinterpret_cast<Agent *>(agent);
+  return cxxagent->alias(name);
+}
+
 void cxxresp_to_cresp(Response &resp, flora_call_result &result);
 int32_t flora_agent_call(flora_agent_t agent, const char *name, caps_t msg,
                          const char *target, flora_call_result *result,
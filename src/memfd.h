@@ -0,0 +1,37 @@
+#pragma once
+
+#include "defs.h"
+
+#ifdef HAVE_SHM
+#include <fcntl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// may be missing in headers of old libc
+#ifndef MFD_CLOEXEC
+#define MFD_CLOEXEC 0x0001U
+#endif
+#ifndef MFD_ALLOW_SEALING
+#define MFD_ALLOW_SEALING 0x0002U
+#endif
+#ifndef F_ADD_SEALS
+#define F_ADD_SEALS 1033
+#define F_GET_SEALS 1034
+#define F_SEAL_SEAL 0x0001
+#define F_SEAL_SHRINK 0x0002
+#define F_SEAL_GROW 0x0004
+#define F_SEAL_WRITE 0x0008
+#endif
+
+// seals of memfd of CMD_FD_POST_*, content never changed after sent
+#define FD_POST_SEALS                                                          \
+  (F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL)
+
+// seals of shared memory of "shm:" connection, size never changed after
+// mapped by service
+#define SHM_MEM_SEALS (F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL)
+
+static inline int memfd_open(const char *name, unsigned int flags) {
+  return syscall(SYS_memfd_create, name, flags);
+}
+#endif // HAVE_SHM
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+#include <utility>
+
+namespace flora {
+namespace internal {
+
+// bounded lock-free queue, multiple producers and single consumer
+// capacity must be power of 2
+template <typename T> class MpscRing {
+public:
+  explicit MpscRing(uint32_t capacity) : mask(capacity - 1) {
+    cells = new Cell[capacity];
+    for (uint32_t i = 0; i < capacity; ++i)
+      cells[i].seq.store(i, std::memory_order_relaxed);
+  }
+
+  ~MpscRing() { delete[] cells; }
+
+  MpscRing(const MpscRing &) = delete;
+
+  MpscRing &operator=(const MpscRing &) = delete;
+
+  // 'v' moved into ring if success
+  // return: false if ring full
+  bool push(T &v) {
+    Cell *cell;
+    size_t pos = tail.load(std::memory_order_relaxed);
+    while (true) {
+      cell = cells + (pos & mask);
+      size_t seq = cell->seq.load(std::memory_order_acquire);
+      intptr_t dif = (intptr_t)seq - (intptr_t)pos;
+      if (dif == 0) {
+        if (tail.compare_exchange_weak(pos, pos + 1,
+                                       std::memory_order_relaxed))
+          break;
+      } else if (dif < 0) {
+        return false;
+      } else {
+        pos = tail.load(std::memory_order_relaxed);
+      }
+    }
+    cell->data = std::move(v);
+    cell->seq.store(pos + 1, std::memory_order_release);
+    return true;
+  }
+
+  // only invoked by consumer thread
+  bool pop(T &v) {
+    Cell *cell = cells + (head & mask);
+    size_t seq = cell->seq.load(std::memory_order_acquire);
+    if (seq != head + 1)
+      return false;
+    v = std::move(cell->data);
+    cell->seq.store(head + mask + 1, std::memory_order_release);
+    ++head;
+    return true;
+  }
+
+  // only invoked by consumer thread
+  // a producer may have reserved the head cell but not yet published it
+  bool empty() const {
+    return cells[head & mask].seq.load(std::memory_order_acquire) != head + 1;
+  }
+
+private:
+  class Cell {
+  public:
+    std::atomic<size_t> seq;
+    T data;
+  };
+
+  Cell *cells;
+  const size_t mask;
+  // separate cache lines of producers and consumer
+  char pad0[64];
+  std::atomic<size_t> tail{0};
+  char pad1[64];
+  size_t head = 0;
+};
+
+} // namespace internal
+} // namespace flora
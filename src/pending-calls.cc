@@ -0,0 +1,90 @@
+#include "pending-calls.h"
+#include <algorithm>
+#include <functional>
+
+using namespace std;
+
+// rebuild heap if erased entries more than live entries plus this
+#define PENDING_CALL_HEAP_SLACK 64
+
+namespace flora {
+namespace internal {
+
+PendingCall *PendingCallTable::add(int32_t svrid, int32_t cliid,
+                                   shared_ptr<Adapter> &sender,
+                                   shared_ptr<Adapter> &target,
+                                   TimePoint discard_tp) {
+  auto r = calls.emplace(svrid, PendingCall());
+  if (!r.second)
+    return nullptr;
+  PendingCall &pc = r.first->second;
+  pc.svrid = svrid;
+  pc.cliid = cliid;
+  pc.sender = sender;
+  pc.target = target;
+  pc.discard_tp = discard_tp;
+  if (deadlines.size() >= calls.size() * 2 + PENDING_CALL_HEAP_SLACK)
+    compact();
+  deadlines.emplace_back(discard_tp, svrid);
+  push_heap(deadlines.begin(), deadlines.end(), greater<Deadline>());
+  return &pc;
+}
+
+PendingCall *PendingCallTable::find(int32_t svrid) {
+  auto it = calls.find(svrid);
+  if (it == calls.end())
+    return nullptr;
+  return &it->second;
+}
+
+void PendingCallTable::erase(int32_t svrid) { calls.erase(svrid); }
+
+bool PendingCallTable::next_deadline(TimePoint &tp) {
+  skip_erased();
+  if (deadlines.empty())
+    return false;
+  tp = deadlines.front().first;
+  return true;
+}
+
+bool PendingCallTable::pop_expired(TimePoint now, PendingCall &pc) {
+  skip_erased();
+  if (deadlines.empty() || deadlines.front().first > now)
+    return false;
+  auto it = calls.find(deadlines.front().second);
+  pop_heap(deadlines.begin(), deadlines.end(), greater<Deadline>());
+  deadlines.pop_back();
+  pc = std::move(it->second);
+  calls.erase(it);
+  return true;
+}
+
+void PendingCallTable::clear() {
+  calls.clear();
+  deadlines.clear();
+}
+
+void PendingCallTable::skip_erased() {
+  while (!deadlines.empty()) {
+    auto it = calls.find(deadlines.front().second);
+    // svrid may be reused after wrap around, check discard_tp as well
+    if (it != calls.end() && it->second.discard_tp == deadlines.front().first)
+      break;
+    pop_heap(deadlines.begin(), deadlines.end(), greater<Deadline>());
+    deadlines.pop_back();
+  }
+}
+
+void PendingCallTable::compact() {
+  auto it = remove_if(deadlines.begin(), deadlines.end(),
+                      [this](const Deadline &d) {
+                        auto cit = calls.find(d.second);
+                        return cit == calls.end() ||
+                               cit->second.discard_tp != d.first;
+                      });
+  deadlines.erase(it, deadlines.end());
+  make_heap(deadlines.begin(), deadlines.end(), greater<Deadline>());
+}
+
+} // namespace internal
+} // namespace flora
@@ -0,0 +1,69 @@
+#pragma once
+
+#include "adap.h"
+#include "stats.h"
+#include <chrono>
+#include <memory>
+#include <stdint.h>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace flora {
+namespace internal {
+
+typedef struct {
+  int32_t svrid;
+  int32_t cliid;
+  std::shared_ptr<Adapter> sender;
+  std::shared_ptr<Adapter> target;
+  std::chrono::steady_clock::time_point discard_tp;
+  // time forwarded to target, for latency of 'stats'
+  std::chrono::steady_clock::time_point call_tp;
+  CallStats *stats;
+} PendingCall;
+
+// pending calls indexed by svrid, ordered by discard_tp in a min-heap
+// entries erased by reply stay in heap and skipped when reach top
+class PendingCallTable {
+public:
+  typedef std::chrono::steady_clock::time_point TimePoint;
+
+  // return: nullptr if 'svrid' already existed
+  PendingCall *add(int32_t svrid, int32_t cliid,
+                   std::shared_ptr<Adapter> &sender,
+                   std::shared_ptr<Adapter> &target, TimePoint discard_tp);
+
+  // return: nullptr if not existed
+  PendingCall *find(int32_t svrid);
+
+  void erase(int32_t svrid);
+
+  bool empty() const { return calls.empty(); }
+
+  size_t size() const { return calls.size(); }
+
+  // return: false if no pending call
+  bool next_deadline(TimePoint &tp);
+
+  // move out a pending call discard_tp <= 'now'
+  // return: false if no such call
+  bool pop_expired(TimePoint now, PendingCall &pc);
+
+  void clear();
+
+private:
+  // drop heap top entries already erased
+  void skip_erased();
+
+  void compact();
+
+private:
+  typedef std::pair<TimePoint, int32_t> Deadline;
+  std::unordered_map<int32_t, PendingCall> calls;
+  // min-heap, std::greater
+  std::vector<Deadline> deadlines;
+};
+
+} // namespace internal
+} // namespace flora
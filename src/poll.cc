@@ -9,7 +9,8 @@ shared_ptr<flora::Poll> flora::Poll::new_instance(const char *uri) {
   Uri urip;
   if (!urip.parse(uri))
     return nullptr;
-  if (urip.scheme == "unix") {
+  // clients of "shm:" connect to unix socket then upgrade to shared memory
+  if (urip.scheme == "unix" || urip.scheme == "shm") {
     return static_pointer_cast<flora::Poll>(
         make_shared<flora::internal::SocketPoll>(urip.path));
   } else if (urip.scheme == "tcp") {
@@ -25,7 +26,8 @@ int32_t flora_poll_new(const char *uri, flora_poll_t *result) {
   Uri urip;
   if (!urip.parse(uri))
     return FLORA_POLL_INVAL;
-  if (urip.scheme == "unix") {
+  // clients of "shm:" connect to unix socket then upgrade to shared memory
+  if (urip.scheme == "unix" || urip.scheme == "shm") {
     *result = reinterpret_cast<flora_poll_t>(
         new flora::internal::SocketPoll(urip.path));
     return FLORA_POLL_SUCCESS;
@@ -0,0 +1,84 @@
+#include "post-filter.h"
+
+using namespace std;
+
+namespace flora {
+namespace internal {
+
+// read next field of 'caps' whatever its type
+// return: false if no more field
+static bool read_field(Caps *caps, FieldValue &value) {
+  int32_t i32;
+  int64_t i64;
+  const char *str;
+  int32_t r;
+
+  r = caps->read(i32);
+  if (r == CAPS_SUCCESS) {
+    value.type = FIELD_TYPE_INT;
+    value.num = i32;
+    return true;
+  }
+  if (r != CAPS_ERR_INCORRECT_TYPE)
+    return false;
+  if (caps->read(i64) == CAPS_SUCCESS) {
+    value.type = FIELD_TYPE_INT;
+    value.num = i64;
+    return true;
+  }
+  if (caps->read(str) == CAPS_SUCCESS) {
+    value.type = FIELD_TYPE_STRING;
+    value.str = str;
+    return true;
+  }
+  // skip fields never compared
+  float f;
+  double d;
+  const void *bin;
+  uint32_t len;
+  shared_ptr<Caps> obj;
+  value.type = FIELD_TYPE_OTHER;
+  return caps->read(f) == CAPS_SUCCESS || caps->read(d) == CAPS_SUCCESS ||
+         caps->read(bin, len) == CAPS_SUCCESS ||
+         caps->read(obj) == CAPS_SUCCESS || caps->read() == CAPS_SUCCESS;
+}
+
+const FieldValue *PostFields::get(uint32_t i) {
+  while (values.size() <= i && !end) {
+    values.emplace_back();
+    if (caps == nullptr || !read_field(caps.get(), values.back())) {
+      values.pop_back();
+      end = true;
+    }
+  }
+  return i < values.size() ? &values[i] : nullptr;
+}
+
+bool PostFilter::match(const SubscribeFilter &filter, PostFields &fields) {
+  uint32_t i;
+  for (i = 0; i < filter.conditions.size(); ++i) {
+    auto &cond = filter.conditions[i];
+    const FieldValue *v = fields.get(i);
+    if (v == nullptr)
+      return false;
+    switch (cond.kind) {
+    case FLORA_FILTER_INT_EQ:
+      if (v->type != FIELD_TYPE_INT || v->num != cond.min)
+        return false;
+      break;
+    case FLORA_FILTER_INT_RANGE:
+      if (v->type != FIELD_TYPE_INT || v->num < cond.min || v->num > cond.max)
+        return false;
+      break;
+    case FLORA_FILTER_STR_PREFIX:
+      if (v->type != FIELD_TYPE_STRING ||
+          v->str.compare(0, cond.str.length(), cond.str) != 0)
+        return false;
+      break;
+    }
+  }
+  return true;
+}
+
+} // namespace internal
+} // namespace flora
@@ -0,0 +1,52 @@
+#pragma once
+
+#include "caps.h"
+#include "flora-cli.h"
+#include <memory>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// FieldValue::type
+#define FIELD_TYPE_INT 0
+#define FIELD_TYPE_STRING 1
+// float, binary, object or void
+#define FIELD_TYPE_OTHER 2
+
+namespace flora {
+namespace internal {
+
+class FieldValue {
+public:
+  uint32_t type = FIELD_TYPE_OTHER;
+  int64_t num = 0;
+  std::string str;
+};
+
+// leading fields of post args, read on demand by filters of subscribers
+// and shared by them, so args read once per post
+class PostFields {
+public:
+  // data: buffer 'caps' parsed from without copy, nullptr if none
+  PostFields(std::shared_ptr<Caps> &c, std::shared_ptr<void> d)
+      : caps(c), data(d) {}
+
+  // return: nullptr if args have no field 'i'
+  const FieldValue *get(uint32_t i);
+
+private:
+  std::shared_ptr<Caps> caps;
+  std::shared_ptr<void> data;
+  std::vector<FieldValue> values;
+  // all fields read, or read failed
+  bool end = false;
+};
+
+class PostFilter {
+public:
+  // return: true if 'fields' satisfy all conditions of 'filter'
+  static bool match(const SubscribeFilter &filter, PostFields &fields);
+};
+
+} // namespace internal
+} // namespace flora
@@ -0,0 +1,155 @@
+#include "selector.h"
+#include "flora-svc.h"
+#include "rlog.h"
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+#define EPOLL_MAX_EVENTS 256
+
+namespace flora {
+namespace internal {
+
+Selector *Selector::new_instance(uint32_t type) {
+#ifdef HAVE_EPOLL
+  if (type == FLORA_POLL_SELECTOR_EPOLL)
+    return new EpollSelector();
+#else
+  if (type == FLORA_POLL_SELECTOR_EPOLL)
+    KLOGW(TAG, "epoll not supported on this platform, use select");
+#endif
+  return new SelectSelector();
+}
+
+bool SelectSelector::init() {
+  FD_ZERO(&all_fds);
+  FD_ZERO(&write_fds);
+  max_fd = 0;
+  return true;
+}
+
+bool SelectSelector::add(int fd) {
+  if (fd < 0 || fd >= FD_SETSIZE) {
+    KLOGE(TAG, "select: fd %d out of range, FD_SETSIZE = %d", fd, FD_SETSIZE);
+    return false;
+  }
+  FD_SET(fd, &all_fds);
+  if (fd >= max_fd)
+    max_fd = fd + 1;
+  return true;
+}
+
+bool SelectSelector::modify(int fd, uint32_t events) {
+  if (fd < 0 || fd >= FD_SETSIZE)
+    return false;
+  if (events & SELECTOR_EV_WRITE)
+    FD_SET(fd, &write_fds);
+  else
+    FD_CLR(fd, &write_fds);
+  return true;
+}
+
+void SelectSelector::remove(int fd) {
+  if (fd < 0 || fd >= FD_SETSIZE)
+    return;
+  FD_CLR(fd, &all_fds);
+  FD_CLR(fd, &write_fds);
+}
+
+int32_t SelectSelector::wait(SelectorEventList &events, int32_t timeout) {
+  fd_set rfds = all_fds;
+  fd_set wfds = write_fds;
+  struct timeval tv;
+  struct timeval *ptv = nullptr;
+  int ifd;
+
+  events.clear();
+  if (timeout >= 0) {
+    tv.tv_sec = timeout / 1000;
+    tv.tv_usec = (timeout % 1000) * 1000;
+    ptv = &tv;
+  }
+  int r = select(max_fd, &rfds, &wfds, nullptr, ptv);
+  if (r <= 0)
+    return r;
+  for (ifd = 0; ifd < max_fd; ++ifd) {
+    uint32_t ev = 0;
+    if (FD_ISSET(ifd, &rfds))
+      ev |= SELECTOR_EV_READ;
+    if (FD_ISSET(ifd, &wfds))
+      ev |= SELECTOR_EV_WRITE;
+    if (ev)
+      events.push_back({ifd, ev});
+  }
+  return events.size();
+}
+
+#ifdef HAVE_EPOLL
+EpollSelector::~EpollSelector() {
+  if (epfd >= 0)
+    ::close(epfd);
+}
+
+bool EpollSelector::init() {
+  epfd = epoll_create1(EPOLL_CLOEXEC);
+  if (epfd < 0) {
+    KLOGE(TAG, "epoll_create1 failed: %s", strerror(errno));
+    return false;
+  }
+  ready_events.resize(EPOLL_MAX_EVENTS);
+  return true;
+}
+
+bool EpollSelector::add(int fd) {
+  struct epoll_event ev;
+  ev.events = EPOLLIN;
+  ev.data.fd = fd;
+  if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+    KLOGE(TAG, "epoll_ctl add fd %d failed: %s", fd, strerror(errno));
+    return false;
+  }
+  return true;
+}
+
+bool EpollSelector::modify(int fd, uint32_t events) {
+  struct epoll_event ev;
+  ev.events = EPOLLIN;
+  if (events & SELECTOR_EV_WRITE)
+    ev.events |= EPOLLOUT;
+  ev.data.fd = fd;
+  if (epoll_ctl(epfd, EPOLL_CTL_MOD, fd, &ev) < 0) {
+    KLOGE(TAG, "epoll_ctl mod fd %d failed: %s", fd, strerror(errno));
+    return false;
+  }
+  return true;
+}
+
+void EpollSelector::remove(int fd) {
+  // kernel before 2.6.9 requires non-null event
+  struct epoll_event ev;
+  epoll_ctl(epfd, EPOLL_CTL_DEL, fd, &ev);
+}
+
+int32_t EpollSelector::wait(SelectorEventList &events, int32_t timeout) {
+  int i;
+
+  events.clear();
+  int r = epoll_wait(epfd, ready_events.data(), ready_events.size(),
+                     timeout < 0 ? -1 : timeout);
+  if (r <= 0)
+    return r;
+  for (i = 0; i < r; ++i) {
+    uint32_t ev = 0;
+    // EPOLLHUP/EPOLLERR report as readable, read() will get the error
+    if (ready_events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+      ev |= SELECTOR_EV_READ;
+    if (ready_events[i].events & EPOLLOUT)
+      ev |= SELECTOR_EV_WRITE;
+    events.push_back({ready_events[i].data.fd, ev});
+  }
+  return r;
+}
+#endif
+
+} // namespace internal
+} // namespace flora
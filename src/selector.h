@@ -0,0 +1,93 @@
+#pragma once
+
+#include "defs.h"
+#include <stdint.h>
+#include <sys/select.h>
+#include <vector>
+#ifdef HAVE_EPOLL
+#include <sys/epoll.h>
+#endif
+
+#define SELECTOR_EV_READ 1
+#define SELECTOR_EV_WRITE 2
+
+namespace flora {
+namespace internal {
+
+typedef struct {
+  int fd;
+  uint32_t events;
+} SelectorEvent;
+typedef std::vector<SelectorEvent> SelectorEventList;
+
+// readiness notification of socket fds, used by SocketPoll
+class Selector {
+public:
+  virtual ~Selector() = default;
+
+  virtual bool init() = 0;
+
+  // watch fd readable
+  virtual bool add(int fd) = 0;
+
+  // events: SELECTOR_EV_*
+  virtual bool modify(int fd, uint32_t events) = 0;
+
+  virtual void remove(int fd) = 0;
+
+  // timeout: milliseconds, < 0 wait forever
+  // return: < 0  system call error, see errno
+  //         >= 0 number of ready fds, stored in 'events'
+  virtual int32_t wait(SelectorEventList &events, int32_t timeout) = 0;
+
+  virtual const char *name() const = 0;
+
+  // type: FLORA_POLL_SELECTOR_*  (see flora-svc.h)
+  static Selector *new_instance(uint32_t type);
+};
+
+class SelectSelector : public Selector {
+public:
+  bool init() override;
+
+  bool add(int fd) override;
+
+  bool modify(int fd, uint32_t events) override;
+
+  void remove(int fd) override;
+
+  int32_t wait(SelectorEventList &events, int32_t timeout) override;
+
+  const char *name() const override { return "select"; }
+
+private:
+  fd_set all_fds;
+  fd_set write_fds;
+  int max_fd = 0;
+};
+
+#ifdef HAVE_EPOLL
+class EpollSelector : public Selector {
+public:
+  ~EpollSelector();
+
+  bool init() override;
+
+  bool add(int fd) override;
+
+  bool modify(int fd, uint32_t events) override;
+
+  void remove(int fd) override;
+
+  int32_t wait(SelectorEventList &events, int32_t timeout) override;
+
+  const char *name() const override { return "epoll"; }
+
+private:
+  int epfd = -1;
+  std::vector<struct epoll_event> ready_events;
+};
+#endif
+
+} // namespace internal
+} // namespace flora
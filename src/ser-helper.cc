@@ -1,11 +1,45 @@
 #include "ser-helper.h"
 #include "defs.h"
+#include <string.h>
+
+#define CONST_FRAME_SIZE 64
 
 using namespace std;
 
 namespace flora {
 namespace internal {
 
+// frame of constant content, serialized once for each byte order
+class ConstFrame {
+public:
+  explicit ConstFrame(int32_t cmd) {
+    shared_ptr<Caps> caps = Caps::new_instance();
+    caps->write(cmd);
+    sizes[0] = caps->serialize(frames[0], CONST_FRAME_SIZE, 0);
+    sizes[1] = caps->serialize(frames[1], CONST_FRAME_SIZE,
+                               CAPS_FLAG_NET_BYTEORDER);
+  }
+
+  // return: -1 if not built for 'flags'
+  int32_t copy(void *data, uint32_t size, uint32_t flags) const {
+    uint32_t i;
+    if (flags == 0)
+      i = 0;
+    else if (flags == CAPS_FLAG_NET_BYTEORDER)
+      i = 1;
+    else
+      return -1;
+    if (sizes[i] <= 0 || sizes[i] > CONST_FRAME_SIZE || sizes[i] > size)
+      return -1;
+    memcpy(data, frames[i], sizes[i]);
+    return sizes[i];
+  }
+
+private:
+  int8_t frames[2][CONST_FRAME_SIZE];
+  int32_t sizes[2];
+};
+
 int32_t RequestSerializer::serialize_auth(uint32_t version, const char *extra,
                                           int32_t pid, uint32_t flags,
                                           void *data, uint32_t size,
@@ -25,10 +59,30 @@ int32_t RequestSerializer::serialize_auth(uint32_t version, const char *extra,
 }
 
 int32_t RequestSerializer::serialize_subscribe(const char *name, void *data,
-                                               uint32_t size, uint32_t flags) {
+                                               uint32_t size, uint32_t flags,
+                                               const SubscribeFilter *filter) {
   shared_ptr<Caps> caps = Caps::new_instance();
   caps->write(CMD_SUBSCRIBE_REQ);
   caps->write(name);
+  if (filter && !filter->empty()) {
+    shared_ptr<Caps> fcaps = Caps::new_instance();
+    for (auto &cond : filter->conditions) {
+      fcaps->write(cond.kind);
+      if (cond.kind == FLORA_FILTER_INT_EQ) {
+        fcaps->write(cond.min);
+      } else if (cond.kind == FLORA_FILTER_INT_RANGE) {
+        fcaps->write(cond.min);
+        fcaps->write(cond.max);
+      } else if (cond.kind == FLORA_FILTER_STR_PREFIX) {
+        fcaps->write(cond.str);
+      }
+    }
+    caps->write(fcaps);
+    if (filter->flags || filter->min_interval) {
+      caps->write(filter->flags);
+      caps->write(filter->min_interval);
+    }
+  }
   int32_t r = caps->serialize(data, size, flags);
   if (r < 0)
     return -1;
@@ -81,12 +135,15 @@ int32_t RequestSerializer::serialize_remove_method(const char *name, void *data,
 
 int32_t RequestSerializer::serialize_post(const char *name, uint32_t msgtype,
                                           shared_ptr<Caps> &args, void *data,
-                                          uint32_t size, uint32_t flags) {
+                                          uint32_t size, uint32_t flags,
+                                          uint64_t send_time) {
   shared_ptr<Caps> caps = Caps::new_instance();
   caps->write(CMD_POST_REQ);
   caps->write(msgtype);
   caps->write(name);
   caps->write(args);
+  if (send_time)
+    caps->write(send_time);
   int32_t r = caps->serialize(data, size, flags);
   if (r < 0)
     return -1;
@@ -95,6 +152,139 @@ int32_t RequestSerializer::serialize_post(const char *name, uint32_t msgtype,
   return r;
 }
 
+int32_t RequestSerializer::serialize_raw_post(const char *name,
+                                              uint32_t msgtype,
+                                              shared_ptr<Caps> &args,
+                                              void *data, uint32_t size,
+                                              uint32_t flags,
+                                              uint64_t send_time) {
+  shared_ptr<Caps> caps = Caps::new_instance();
+  caps->write(CMD_RAW_POST_REQ);
+  caps->write(msgtype);
+  caps->write(name);
+  if (send_time)
+    caps->write(send_time);
+  int32_t r = caps->serialize(data, size, flags);
+  if (r < 0 || r > size)
+    return -1;
+  int32_t r2 = args->serialize((int8_t *)data + r, size - r, flags);
+  if (r2 < 0 || r2 > size - r)
+    return -1;
+  return r + r2;
+}
+
+int32_t RequestSerializer::serialize_fd_post(const char *name,
+                                             uint32_t msgtype,
+                                             uint32_t args_size, void *data,
+                                             uint32_t size, uint32_t flags,
+                                             uint64_t send_time) {
+  shared_ptr<Caps> caps = Caps::new_instance();
+  caps->write(CMD_FD_POST_REQ);
+  caps->write(msgtype);
+  caps->write(name);
+  caps->write(args_size);
+  if (send_time)
+    caps->write(send_time);
+  int32_t r = caps->serialize(data, size, flags);
+  if (r < 0 || r > size)
+    return -1;
+  return r;
+}
+
+int32_t RequestSerializer::serialize_alias(const char *name, uint32_t alias,
+                                           void *data, uint32_t size,
+                                           uint32_t flags) {
+  shared_ptr<Caps> caps = Caps::new_instance();
+  caps->write(CMD_ALIAS_REQ);
+  caps->write(name);
+  caps->write(alias);
+  int32_t r = caps->serialize(data, size, flags);
+  if (r < 0 || r > size)
+    return -1;
+  return r;
+}
+
+int32_t RequestSerializer::serialize_alias_post(uint32_t alias,
+                                                uint32_t msgtype,
+                                                shared_ptr<Caps> &args,
+                                                void *data, uint32_t size,
+                                                uint32_t flags,
+                                                uint64_t send_time) {
+  shared_ptr<Caps> caps = Caps::new_instance();
+  caps->write(CMD_ALIAS_POST_REQ);
+  caps->write(msgtype);
+  caps->write(alias);
+  caps->write(args);
+  if (send_time)
+    caps->write(send_time);
+  int32_t r = caps->serialize(data, size, flags);
+  if (r < 0 || r > size)
+    return -1;
+  return r;
+}
+
+int32_t RequestSerializer::serialize_unknown_alias(uint32_t kind, uint32_t id,
+                                                   void *data, uint32_t size,
+                                                   uint32_t flags) {
+  shared_ptr<Caps> caps = Caps::new_instance();
+  caps->write(CMD_UNKNOWN_ALIAS_REQ);
+  caps->write(kind);
+  caps->write(id);
+  int32_t r = caps->serialize(data, size, flags);
+  if (r < 0 || r > size)
+    return -1;
+  return r;
+}
+
+int32_t RequestSerializer::serialize_alias_raw_post(uint32_t alias,
+                                                    uint32_t msgtype,
+                                                    shared_ptr<Caps> &args,
+                                                    void *data, uint32_t size,
+                                                    uint32_t flags,
+                                                    uint64_t send_time) {
+  int32_t r = serialize_alias_raw_post_header(alias, msgtype, data, size,
+                                              flags, send_time);
+  if (r < 0)
+    return -1;
+  int32_t r2 = args->serialize((int8_t *)data + r, size - r, flags);
+  if (r2 < 0 || r2 > size - r)
+    return -1;
+  return r + r2;
+}
+
+int32_t RequestSerializer::serialize_alias_raw_post_header(uint32_t alias,
+                                                           uint32_t msgtype,
+                                                           void *data,
+                                                           uint32_t size,
+                                                           uint32_t flags,
+                                                           uint64_t send_time) {
+  shared_ptr<Caps> caps = Caps::new_instance();
+  caps->write(CMD_ALIAS_RAW_POST_REQ);
+  caps->write(msgtype);
+  caps->write(alias);
+  if (send_time)
+    caps->write(send_time);
+  int32_t r = caps->serialize(data, size, flags);
+  if (r < 0 || r > size)
+    return -1;
+  return r;
+}
+
+int32_t RequestSerializer::serialize_cached_raw_post(const void *header,
+                                                     uint32_t header_size,
+                                                     shared_ptr<Caps> &args,
+                                                     void *data, uint32_t size,
+                                                     uint32_t flags) {
+  if (header_size > size)
+    return -1;
+  memcpy(data, header, header_size);
+  int32_t r = args->serialize((int8_t *)data + header_size,
+                              size - header_size, flags);
+  if (r < 0 || r > size - header_size)
+    return -1;
+  return header_size + r;
+}
+
 int32_t RequestSerializer::serialize_call(const char *name,
                                           shared_ptr<Caps> &args,
                                           const char *target, int32_t id,
@@ -133,6 +323,10 @@ int32_t RequestSerializer::serialize_reply(int32_t id, int32_t code,
 
 int32_t RequestSerializer::serialize_ping(void *data, uint32_t size,
                                           uint32_t flags) {
+  static const ConstFrame frame(CMD_PING_REQ);
+  int32_t c = frame.copy(data, size, flags);
+  if (c > 0)
+    return c;
   shared_ptr<Caps> caps = Caps::new_instance();
   caps->write(CMD_PING_REQ);
   int32_t r = caps->serialize(data, size, flags);
@@ -141,13 +335,33 @@ int32_t RequestSerializer::serialize_ping(void *data, uint32_t size,
   return r;
 }
 
+int32_t RequestSerializer::serialize_batch(const void *frames,
+                                           uint32_t frames_size, void *data,
+                                           uint32_t size, uint32_t flags) {
+  shared_ptr<Caps> caps = Caps::new_instance();
+  caps->write(CMD_BATCH_REQ);
+  caps->write(frames, frames_size);
+  int32_t r = caps->serialize(data, size, flags);
+  if (r < 0 || r > size)
+    return -1;
+  return r;
+}
+
+static void write_trace(shared_ptr<Caps> &caps, const uint64_t *trace) {
+  if (trace == nullptr)
+    return;
+  for (uint32_t i = FLORA_TRACE_SEND; i <= FLORA_TRACE_SVC_DISPATCH; ++i)
+    caps->write(trace[i]);
+}
+
 int32_t ResponseSerializer::serialize_auth(int32_t result, uint32_t version,
-                                           void *data, uint32_t size,
-                                           uint32_t flags) {
+                                           uint32_t max_msg_size, void *data,
+                                           uint32_t size, uint32_t flags) {
   shared_ptr<Caps> caps = Caps::new_instance();
   caps->write(CMD_AUTH_RESP);
   caps->write(result);
   caps->write(version);
+  caps->write(max_msg_size);
   int32_t r = caps->serialize(data, size, flags);
   if (r < 0)
     return -1;
@@ -159,7 +373,8 @@ int32_t ResponseSerializer::serialize_auth(int32_t result, uint32_t version,
 int32_t ResponseSerializer::serialize_post(const char *name, uint32_t msgtype,
                                            shared_ptr<Caps> &args, uint64_t tag,
                                            const char* cliname, void *data,
-                                           uint32_t size, uint32_t flags) {
+                                           uint32_t size, uint32_t flags,
+                                           const uint64_t *trace) {
   shared_ptr<Caps> caps = Caps::new_instance();
   caps->write(CMD_POST_RESP);
   caps->write(msgtype);
@@ -167,6 +382,7 @@ int32_t ResponseSerializer::serialize_post(const char *name, uint32_t msgtype,
   caps->write(args);
   caps->write(tag);
   caps->write(cliname);
+  write_trace(caps, trace);
   int32_t r = caps->serialize(data, size, flags);
   if (r < 0)
     return -1;
@@ -175,6 +391,100 @@ int32_t ResponseSerializer::serialize_post(const char *name, uint32_t msgtype,
   return r;
 }
 
+int32_t ResponseSerializer::serialize_raw_post(const char *name,
+                                               uint32_t msgtype, uint64_t tag,
+                                               const char *cliname,
+                                               void *data, uint32_t size,
+                                               uint32_t flags,
+                                               const uint64_t *trace) {
+  shared_ptr<Caps> caps = Caps::new_instance();
+  caps->write(CMD_RAW_POST_RESP);
+  caps->write(msgtype);
+  caps->write(name);
+  caps->write(tag);
+  caps->write(cliname);
+  write_trace(caps, trace);
+  int32_t r = caps->serialize(data, size, flags);
+  if (r < 0 || r > size)
+    return -1;
+  return r;
+}
+
+int32_t ResponseSerializer::serialize_fd_post(const char *name,
+                                              uint32_t msgtype,
+                                              uint32_t args_size, uint64_t tag,
+                                              const char *cliname, void *data,
+                                              uint32_t size, uint32_t flags,
+                                              const uint64_t *trace) {
+  shared_ptr<Caps> caps = Caps::new_instance();
+  caps->write(CMD_FD_POST_RESP);
+  caps->write(msgtype);
+  caps->write(name);
+  caps->write(args_size);
+  caps->write(tag);
+  caps->write(cliname);
+  write_trace(caps, trace);
+  int32_t r = caps->serialize(data, size, flags);
+  if (r < 0 || r > size)
+    return -1;
+  return r;
+}
+
+int32_t ResponseSerializer::serialize_alias(uint32_t kind, uint32_t id,
+                                            const char *name, void *data,
+                                            uint32_t size, uint32_t flags) {
+  shared_ptr<Caps> caps = Caps::new_instance();
+  caps->write(CMD_ALIAS_RESP);
+  caps->write(kind);
+  caps->write(id);
+  caps->write(name);
+  int32_t r = caps->serialize(data, size, flags);
+  if (r < 0 || r > size)
+    return -1;
+  return r;
+}
+
+int32_t ResponseSerializer::serialize_alias_post(uint32_t topic,
+                                                 uint32_t msgtype,
+                                                 shared_ptr<Caps> &args,
+                                                 uint64_t tag, uint32_t sender,
+                                                 void *data, uint32_t size,
+                                                 uint32_t flags,
+                                                 const uint64_t *trace) {
+  shared_ptr<Caps> caps = Caps::new_instance();
+  caps->write(CMD_ALIAS_POST_RESP);
+  caps->write(msgtype);
+  caps->write(topic);
+  caps->write(args);
+  caps->write(tag);
+  caps->write(sender);
+  write_trace(caps, trace);
+  int32_t r = caps->serialize(data, size, flags);
+  if (r < 0 || r > size)
+    return -1;
+  return r;
+}
+
+int32_t ResponseSerializer::serialize_alias_raw_post(uint32_t topic,
+                                                     uint32_t msgtype,
+                                                     uint64_t tag,
+                                                     uint32_t sender,
+                                                     void *data, uint32_t size,
+                                                     uint32_t flags,
+                                                     const uint64_t *trace) {
+  shared_ptr<Caps> caps = Caps::new_instance();
+  caps->write(CMD_ALIAS_RAW_POST_RESP);
+  caps->write(msgtype);
+  caps->write(topic);
+  caps->write(tag);
+  caps->write(sender);
+  write_trace(caps, trace);
+  int32_t r = caps->serialize(data, size, flags);
+  if (r < 0 || r > size)
+    return -1;
+  return r;
+}
+
 int32_t ResponseSerializer::serialize_call(const char *name,
                                            shared_ptr<Caps> &args, int32_t id,
                                            uint64_t tag, const char *cliname,
@@ -344,6 +654,10 @@ int32_t ResponseSerializer::serialize_monitor_call(
 
 int32_t ResponseSerializer::serialize_pong(void *data, uint32_t size,
                                            uint32_t flags) {
+  static const ConstFrame frame(CMD_PONG_RESP);
+  int32_t c = frame.copy(data, size, flags);
+  if (c > 0)
+    return c;
   shared_ptr<Caps> p = Caps::new_instance();
   p->write(CMD_PONG_RESP);
   int32_t r = p->serialize(data, size, flags);
@@ -366,9 +680,40 @@ int32_t RequestParser::parse_auth(shared_ptr<Caps> &caps, uint32_t &version,
   return 0;
 }
 
-int32_t RequestParser::parse_subscribe(shared_ptr<Caps> &caps, string &name) {
+int32_t RequestParser::parse_subscribe(shared_ptr<Caps> &caps, string &name,
+                                       SubscribeFilter &filter) {
   if (caps->read(name) != CAPS_SUCCESS)
     return -1;
+  filter.conditions.clear();
+  filter.flags = 0;
+  filter.min_interval = 0;
+  shared_ptr<Caps> fcaps;
+  if (caps->read(fcaps) != CAPS_SUCCESS || fcaps == nullptr)
+    return 0;
+  if (caps->read(filter.flags) == CAPS_SUCCESS &&
+      caps->read(filter.min_interval) != CAPS_SUCCESS)
+    return -1;
+  uint32_t kind;
+  while (fcaps->read(kind) == CAPS_SUCCESS) {
+    if (filter.conditions.size() >= FLORA_FILTER_MAX_FIELDS)
+      return -1;
+    filter.conditions.emplace_back();
+    SubscribeFilter::Condition &cond = filter.conditions.back();
+    cond.kind = kind;
+    if (kind == FLORA_FILTER_INT_EQ) {
+      if (fcaps->read(cond.min) != CAPS_SUCCESS)
+        return -1;
+    } else if (kind == FLORA_FILTER_INT_RANGE) {
+      if (fcaps->read(cond.min) != CAPS_SUCCESS ||
+          fcaps->read(cond.max) != CAPS_SUCCESS)
+        return -1;
+    } else if (kind == FLORA_FILTER_STR_PREFIX) {
+      if (fcaps->read(cond.str) != CAPS_SUCCESS)
+        return -1;
+    } else if (kind != FLORA_FILTER_ANY) {
+      return -1;
+    }
+  }
   return 0;
 }
 
@@ -392,7 +737,7 @@ int32_t RequestParser::parse_remove_method(shared_ptr<Caps> &caps,
   return 0;
 }
 
-int32_t RequestParser::parse_post(shared_ptr<Caps> &caps, string &name,
+int32_t RequestParser::parse_post(shared_ptr<Caps> &caps, const char *&name,
                                   uint32_t &msgtype, shared_ptr<Caps> &args) {
   if (caps->read(msgtype) != CAPS_SUCCESS)
     return -1;
@@ -403,8 +748,75 @@ int32_t RequestParser::parse_post(shared_ptr<Caps> &caps, string &name,
   return 0;
 }
 
-int32_t RequestParser::parse_call(shared_ptr<Caps> &caps, string &name,
-                                  shared_ptr<Caps> &args, string &target,
+int32_t RequestParser::parse_raw_post(shared_ptr<Caps> &caps, const char *&name,
+                                      uint32_t &msgtype) {
+  if (caps->read(msgtype) != CAPS_SUCCESS)
+    return -1;
+  if (caps->read(name) != CAPS_SUCCESS)
+    return -1;
+  return 0;
+}
+
+int32_t RequestParser::parse_fd_post(shared_ptr<Caps> &caps, const char *&name,
+                                     uint32_t &msgtype, uint32_t &args_size) {
+  if (caps->read(msgtype) != CAPS_SUCCESS)
+    return -1;
+  if (caps->read(name) != CAPS_SUCCESS)
+    return -1;
+  if (caps->read(args_size) != CAPS_SUCCESS)
+    return -1;
+  return 0;
+}
+
+int32_t RequestParser::parse_alias(shared_ptr<Caps> &caps, string &name,
+                                   uint32_t &alias) {
+  if (caps->read(name) != CAPS_SUCCESS)
+    return -1;
+  if (caps->read(alias) != CAPS_SUCCESS)
+    return -1;
+  return 0;
+}
+
+int32_t RequestParser::parse_alias_post(shared_ptr<Caps> &caps,
+                                        uint32_t &alias, uint32_t &msgtype,
+                                        shared_ptr<Caps> &args) {
+  if (caps->read(msgtype) != CAPS_SUCCESS)
+    return -1;
+  if (caps->read(alias) != CAPS_SUCCESS)
+    return -1;
+  if (caps->read(args) != CAPS_SUCCESS)
+    return -1;
+  return 0;
+}
+
+int32_t RequestParser::parse_alias_raw_post(shared_ptr<Caps> &caps,
+                                            uint32_t &alias,
+                                            uint32_t &msgtype) {
+  if (caps->read(msgtype) != CAPS_SUCCESS)
+    return -1;
+  if (caps->read(alias) != CAPS_SUCCESS)
+    return -1;
+  return 0;
+}
+
+int32_t RequestParser::parse_unknown_alias(shared_ptr<Caps> &caps,
+                                           uint32_t &kind, uint32_t &id) {
+  if (caps->read(kind) != CAPS_SUCCESS)
+    return -1;
+  if (caps->read(id) != CAPS_SUCCESS)
+    return -1;
+  return 0;
+}
+
+int32_t RequestParser::parse_batch(shared_ptr<Caps> &caps, const void *&frames,
+                                   uint32_t &size) {
+  if (caps->read(frames, size) != CAPS_SUCCESS)
+    return -1;
+  return 0;
+}
+
+int32_t RequestParser::parse_call(shared_ptr<Caps> &caps, const char *&name,
+                                  shared_ptr<Caps> &args, const char *&target,
                                   int32_t &id, uint32_t &timeout) {
   if (caps->read(name) != CAPS_SUCCESS)
     return -1;
@@ -430,18 +842,27 @@ int32_t RequestParser::parse_reply(shared_ptr<Caps> &caps, int32_t &id,
   return 0;
 }
 
+uint64_t RequestParser::parse_trace(shared_ptr<Caps> &caps) {
+  uint64_t send_time;
+  if (caps->read(send_time) != CAPS_SUCCESS)
+    return 0;
+  return send_time;
+}
+
 int32_t ResponseParser::parse_auth(shared_ptr<Caps> &caps, int32_t &result,
-                                   uint32_t &version) {
+                                   uint32_t &version, uint32_t &max_msg_size) {
   if (caps->read(result) != CAPS_SUCCESS)
     return -1;
   if (caps->read(version) != CAPS_SUCCESS)
     return -1;
+  if (caps->read(max_msg_size) != CAPS_SUCCESS)
+    max_msg_size = 0;
   return 0;
 }
 
-int32_t ResponseParser::parse_post(shared_ptr<Caps> &caps, string &name,
+int32_t ResponseParser::parse_post(shared_ptr<Caps> &caps, const char *&name,
                                    uint32_t &msgtype, shared_ptr<Caps> &args,
-                                   uint64_t &tag, string &cliname) {
+                                   uint64_t &tag, const char *&cliname) {
   if (caps->read(msgtype) != CAPS_SUCCESS)
     return -1;
   if (caps->read(name) != CAPS_SUCCESS)
@@ -455,9 +876,82 @@ int32_t ResponseParser::parse_post(shared_ptr<Caps> &caps, string &name,
   return 0;
 }
 
-int32_t ResponseParser::parse_call(shared_ptr<Caps> &caps, string &name,
+int32_t ResponseParser::parse_raw_post(shared_ptr<Caps> &caps,
+                                       const char *&name, uint32_t &msgtype,
+                                       uint64_t &tag, const char *&cliname) {
+  if (caps->read(msgtype) != CAPS_SUCCESS)
+    return -1;
+  if (caps->read(name) != CAPS_SUCCESS)
+    return -1;
+  if (caps->read(tag) != CAPS_SUCCESS)
+    return -1;
+  if (caps->read(cliname) != CAPS_SUCCESS)
+    return -1;
+  return 0;
+}
+
+int32_t ResponseParser::parse_fd_post(shared_ptr<Caps> &caps, const char *&name,
+                                      uint32_t &msgtype, uint32_t &args_size,
+                                      uint64_t &tag, const char *&cliname) {
+  if (caps->read(msgtype) != CAPS_SUCCESS)
+    return -1;
+  if (caps->read(name) != CAPS_SUCCESS)
+    return -1;
+  if (caps->read(args_size) != CAPS_SUCCESS)
+    return -1;
+  if (caps->read(tag) != CAPS_SUCCESS)
+    return -1;
+  if (caps->read(cliname) != CAPS_SUCCESS)
+    return -1;
+  return 0;
+}
+
+int32_t ResponseParser::parse_alias(shared_ptr<Caps> &caps, uint32_t &kind,
+                                    uint32_t &id, string &name) {
+  if (caps->read(kind) != CAPS_SUCCESS)
+    return -1;
+  if (caps->read(id) != CAPS_SUCCESS)
+    return -1;
+  if (caps->read(name) != CAPS_SUCCESS)
+    return -1;
+  return 0;
+}
+
+int32_t ResponseParser::parse_alias_post(shared_ptr<Caps> &caps,
+                                         uint32_t &topic, uint32_t &msgtype,
+                                         shared_ptr<Caps> &args, uint64_t &tag,
+                                         uint32_t &sender) {
+  if (caps->read(msgtype) != CAPS_SUCCESS)
+    return -1;
+  if (caps->read(topic) != CAPS_SUCCESS)
+    return -1;
+  if (caps->read(args) != CAPS_SUCCESS)
+    return -1;
+  if (caps->read(tag) != CAPS_SUCCESS)
+    return -1;
+  if (caps->read(sender) != CAPS_SUCCESS)
+    return -1;
+  return 0;
+}
+
+int32_t ResponseParser::parse_alias_raw_post(shared_ptr<Caps> &caps,
+                                             uint32_t &topic,
+                                             uint32_t &msgtype, uint64_t &tag,
+                                             uint32_t &sender) {
+  if (caps->read(msgtype) != CAPS_SUCCESS)
+    return -1;
+  if (caps->read(topic) != CAPS_SUCCESS)
+    return -1;
+  if (caps->read(tag) != CAPS_SUCCESS)
+    return -1;
+  if (caps->read(sender) != CAPS_SUCCESS)
+    return -1;
+  return 0;
+}
+
+int32_t ResponseParser::parse_call(shared_ptr<Caps> &caps, const char *&name,
                                    shared_ptr<Caps> &args, int32_t &id,
-                                   uint64_t &tag, string &cliname) {
+                                   uint64_t &tag, const char *&cliname) {
   if (caps->read(id) != CAPS_SUCCESS)
     return -1;
   if (caps->read(name) != CAPS_SUCCESS)
@@ -491,6 +985,16 @@ int32_t ResponseParser::parse_reply(shared_ptr<Caps> &caps, int32_t &id,
   return 0;
 }
 
+void ResponseParser::parse_trace(shared_ptr<Caps> &caps, uint64_t *trace) {
+  uint32_t i;
+  for (i = FLORA_TRACE_SEND; i <= FLORA_TRACE_SVC_DISPATCH; ++i) {
+    if (caps->read(trace[i]) != CAPS_SUCCESS)
+      break;
+  }
+  if (i <= FLORA_TRACE_SVC_DISPATCH)
+    memset(trace, 0, sizeof(uint64_t) * (FLORA_TRACE_SVC_DISPATCH + 1));
+}
+
 int32_t ResponseParser::parse_monitor_list_all(shared_ptr<Caps> &caps,
                                                vector<MonitorListItem> &infos) {
   uint32_t size;
@@ -6,19 +6,23 @@
 #include "flora-cli.h"
 #include <arpa/inet.h>
 #include <stdint.h>
+#include <time.h>
 #include <vector>
 
 namespace flora {
 namespace internal {
 
+// send_time: FLORA_TRACE_SEND timestamp of post, 0 if not traced
 class RequestSerializer {
 public:
   static int32_t serialize_auth(uint32_t version, const char *extra,
                                 int32_t pid, uint32_t flags, void *data,
                                 uint32_t size, uint32_t ser_flags);
 
+  // filter: nullptr or empty if not filtered
   static int32_t serialize_subscribe(const char *name, void *data,
-                                     uint32_t size, uint32_t flags);
+                                     uint32_t size, uint32_t flags,
+                                     const SubscribeFilter *filter = nullptr);
 
   static int32_t serialize_unsubscribe(const char *name, void *data,
                                        uint32_t size, uint32_t flags);
@@ -31,7 +35,55 @@ public:
 
   static int32_t serialize_post(const char *name, uint32_t msgtype,
                                 std::shared_ptr<Caps> &args, void *data,
-                                uint32_t size, uint32_t flags);
+                                uint32_t size, uint32_t flags,
+                                uint64_t send_time = 0);
+
+  // header frame and args frame
+  static int32_t serialize_raw_post(const char *name, uint32_t msgtype,
+                                    std::shared_ptr<Caps> &args, void *data,
+                                    uint32_t size, uint32_t flags,
+                                    uint64_t send_time = 0);
+
+  // header frame only, 'args_size' bytes of args in memfd
+  static int32_t serialize_fd_post(const char *name, uint32_t msgtype,
+                                   uint32_t args_size, void *data,
+                                   uint32_t size, uint32_t flags,
+                                   uint64_t send_time = 0);
+
+  // alias: id chosen by client, 1 ~ MAX_TOPIC_ALIASES
+  static int32_t serialize_alias(const char *name, uint32_t alias, void *data,
+                                 uint32_t size, uint32_t flags);
+
+  static int32_t serialize_alias_post(uint32_t alias, uint32_t msgtype,
+                                      std::shared_ptr<Caps> &args, void *data,
+                                      uint32_t size, uint32_t flags,
+                                      uint64_t send_time = 0);
+
+  // kind: ALIAS_KIND_*, id of CMD_ALIAS_RESP not received
+  static int32_t serialize_unknown_alias(uint32_t kind, uint32_t id,
+                                         void *data, uint32_t size,
+                                         uint32_t flags);
+
+  // header frame and args frame
+  static int32_t serialize_alias_raw_post(uint32_t alias, uint32_t msgtype,
+                                          std::shared_ptr<Caps> &args,
+                                          void *data, uint32_t size,
+                                          uint32_t flags,
+                                          uint64_t send_time = 0);
+
+  // header frame of CMD_ALIAS_RAW_POST_REQ only
+  // same for all posts of 'alias' and 'msgtype', could be reused
+  static int32_t serialize_alias_raw_post_header(uint32_t alias,
+                                                 uint32_t msgtype, void *data,
+                                                 uint32_t size, uint32_t flags,
+                                                 uint64_t send_time = 0);
+
+  // 'header' serialized before and copied, followed by args frame
+  static int32_t serialize_cached_raw_post(const void *header,
+                                           uint32_t header_size,
+                                           std::shared_ptr<Caps> &args,
+                                           void *data, uint32_t size,
+                                           uint32_t flags);
 
   static int32_t serialize_call(const char *name, std::shared_ptr<Caps> &args,
                                 const char *target, int32_t id,
@@ -43,17 +95,57 @@ public:
                                  uint32_t size, uint32_t flags);
 
   static int32_t serialize_ping(void *data, uint32_t size, uint32_t flags);
+
+  // 'frames': serialized request frames, raw post as header and args frames
+  static int32_t serialize_batch(const void *frames, uint32_t frames_size,
+                                 void *data, uint32_t size, uint32_t flags);
 };
 
+// trace: FLORA_TRACE_SEND ~ FLORA_TRACE_SVC_DISPATCH timestamps of post,
+//        nullptr if not traced
 class ResponseSerializer {
 public:
-  static int32_t serialize_auth(int32_t result, uint32_t version, void *data,
+  // max_msg_size: max frame size service accepted
+  static int32_t serialize_auth(int32_t result, uint32_t version,
+                                uint32_t max_msg_size, void *data,
                                 uint32_t size, uint32_t flags);
 
   static int32_t serialize_post(const char *name, uint32_t msgtype,
                                 std::shared_ptr<Caps> &args, uint64_t tag,
                                 const char *cliname, void *data, uint32_t size,
-                                uint32_t flags);
+                                uint32_t flags,
+                                const uint64_t *trace = nullptr);
+
+  // header frame only, args frame written separately
+  static int32_t serialize_raw_post(const char *name, uint32_t msgtype,
+                                    uint64_t tag, const char *cliname,
+                                    void *data, uint32_t size, uint32_t flags,
+                                    const uint64_t *trace = nullptr);
+
+  // header frame only, 'args_size' bytes of args in memfd
+  static int32_t serialize_fd_post(const char *name, uint32_t msgtype,
+                                   uint32_t args_size, uint64_t tag,
+                                   const char *cliname, void *data,
+                                   uint32_t size, uint32_t flags,
+                                   const uint64_t *trace = nullptr);
+
+  // kind: ALIAS_KIND_*
+  static int32_t serialize_alias(uint32_t kind, uint32_t id, const char *name,
+                                 void *data, uint32_t size, uint32_t flags);
+
+  // topic: topic id, sender: AdapterInfo id of sender, 0 if no sender
+  static int32_t serialize_alias_post(uint32_t topic, uint32_t msgtype,
+                                      std::shared_ptr<Caps> &args, uint64_t tag,
+                                      uint32_t sender, void *data,
+                                      uint32_t size, uint32_t flags,
+                                      const uint64_t *trace = nullptr);
+
+  // header frame only, args frame written separately
+  static int32_t serialize_alias_raw_post(uint32_t topic, uint32_t msgtype,
+                                          uint64_t tag, uint32_t sender,
+                                          void *data, uint32_t size,
+                                          uint32_t flags,
+                                          const uint64_t *trace = nullptr);
 
   static int32_t serialize_call(const char *name, std::shared_ptr<Caps> &args,
                                 int32_t id, uint64_t tag, const char *cliname,
@@ -108,13 +200,15 @@ public:
   static int32_t serialize_pong(void *data, uint32_t size, uint32_t flags);
 };
 
+// 'const char *&' outputs point into data of 'caps', valid while 'caps' alive
 class RequestParser {
 public:
   static int32_t parse_auth(std::shared_ptr<Caps> &caps, uint32_t &version,
                             std::string &extra, int32_t &pid, uint32_t &flags);
 
+  // filter: empty if not filtered
   static int32_t parse_subscribe(std::shared_ptr<Caps> &caps,
-                                 std::string &name);
+                                 std::string &name, SubscribeFilter &filter);
 
   static int32_t parse_unsubscribe(std::shared_ptr<Caps> &caps,
                                    std::string &name);
@@ -125,33 +219,85 @@ public:
   static int32_t parse_remove_method(std::shared_ptr<Caps> &caps,
                                      std::string &name);
 
-  static int32_t parse_post(std::shared_ptr<Caps> &caps, std::string &name,
+  static int32_t parse_post(std::shared_ptr<Caps> &caps, const char *&name,
                             uint32_t &msgtype, std::shared_ptr<Caps> &args);
 
-  static int32_t parse_call(std::shared_ptr<Caps> &caps, std::string &name,
-                            std::shared_ptr<Caps> &args, std::string &target,
+  static int32_t parse_raw_post(std::shared_ptr<Caps> &caps, const char *&name,
+                                uint32_t &msgtype);
+
+  static int32_t parse_fd_post(std::shared_ptr<Caps> &caps, const char *&name,
+                               uint32_t &msgtype, uint32_t &args_size);
+
+  static int32_t parse_alias(std::shared_ptr<Caps> &caps, std::string &name,
+                             uint32_t &alias);
+
+  static int32_t parse_alias_post(std::shared_ptr<Caps> &caps, uint32_t &alias,
+                                  uint32_t &msgtype,
+                                  std::shared_ptr<Caps> &args);
+
+  static int32_t parse_alias_raw_post(std::shared_ptr<Caps> &caps,
+                                      uint32_t &alias, uint32_t &msgtype);
+
+  static int32_t parse_unknown_alias(std::shared_ptr<Caps> &caps,
+                                     uint32_t &kind, uint32_t &id);
+
+  // 'frames' point to data of 'caps'
+  static int32_t parse_batch(std::shared_ptr<Caps> &caps, const void *&frames,
+                             uint32_t &size);
+
+  static int32_t parse_call(std::shared_ptr<Caps> &caps, const char *&name,
+                            std::shared_ptr<Caps> &args, const char *&target,
                             int32_t &id, uint32_t &timeout);
 
   static int32_t parse_reply(std::shared_ptr<Caps> &caps, int32_t &id,
                              int32_t &code, std::shared_ptr<Caps> &values);
+
+  // FLORA_TRACE_SEND timestamp following fields of post request parsed
+  // return: 0 if post not traced
+  static uint64_t parse_trace(std::shared_ptr<Caps> &caps);
 };
 
 class ResponseParser {
 public:
+  // max_msg_size: 0 if service not told
   static int32_t parse_auth(std::shared_ptr<Caps> &caps, int32_t &result,
-                            uint32_t &version);
+                            uint32_t &version, uint32_t &max_msg_size);
 
-  static int32_t parse_post(std::shared_ptr<Caps> &caps, std::string &name,
+  static int32_t parse_post(std::shared_ptr<Caps> &caps, const char *&name,
                             uint32_t &msgtype, std::shared_ptr<Caps> &args,
-                            uint64_t &tag, std::string &cliname);
+                            uint64_t &tag, const char *&cliname);
+
+  static int32_t parse_raw_post(std::shared_ptr<Caps> &caps, const char *&name,
+                                uint32_t &msgtype, uint64_t &tag,
+                                const char *&cliname);
+
+  static int32_t parse_fd_post(std::shared_ptr<Caps> &caps, const char *&name,
+                               uint32_t &msgtype, uint32_t &args_size,
+                               uint64_t &tag, const char *&cliname);
+
+  static int32_t parse_alias(std::shared_ptr<Caps> &caps, uint32_t &kind,
+                             uint32_t &id, std::string &name);
+
+  static int32_t parse_alias_post(std::shared_ptr<Caps> &caps, uint32_t &topic,
+                                  uint32_t &msgtype,
+                                  std::shared_ptr<Caps> &args, uint64_t &tag,
+                                  uint32_t &sender);
 
-  static int32_t parse_call(std::shared_ptr<Caps> &caps, std::string &name,
+  static int32_t parse_alias_raw_post(std::shared_ptr<Caps> &caps,
+                                      uint32_t &topic, uint32_t &msgtype,
+                                      uint64_t &tag, uint32_t &sender);
+
+  static int32_t parse_call(std::shared_ptr<Caps> &caps, const char *&name,
                             std::shared_ptr<Caps> &args, int32_t &id,
-                            uint64_t &tag, std::string &cliname);
+                            uint64_t &tag, const char *&cliname);
 
   static int32_t parse_reply(std::shared_ptr<Caps> &caps, int32_t &id,
                              int32_t &rescode, Response &reply, uint64_t &tag);
 
+  // 'trace': FLORA_TRACE_SEND ~ FLORA_TRACE_SVC_DISPATCH timestamps
+  //          following fields of post response parsed, zeroed if not traced
+  static void parse_trace(std::shared_ptr<Caps> &caps, uint64_t *trace);
+
   static int32_t parse_monitor_list_all(std::shared_ptr<Caps> &caps,
                                         std::vector<MonitorListItem> &infos);
 
@@ -190,6 +336,16 @@ public:
 
 bool is_valid_msgtype(uint32_t msgtype);
 
+class TraceHelper {
+public:
+  // CLOCK_MONOTONIC nanoseconds, comparable between processes of one host
+  static uint64_t now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+  }
+};
+
 class TagHelper {
 public:
   static uint64_t create(struct sockaddr_in& addr) {
@@ -0,0 +1,234 @@
+#include "shm-adap.h"
+#include "defs.h"
+#include "memfd.h"
+#include "rlog.h"
+
+#ifdef HAVE_SHM
+#include <errno.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace flora {
+namespace internal {
+
+// max datagrams consumed by reset_doorbell, the rest polled next time
+#define DOORBELL_DRAIN_MAX 16
+
+// doorbells shared with client, O_NONBLOCK could be cleared by client
+// MSG_DONTWAIT never blocks whatever flags of the fd
+static void ring_doorbell(int fd) {
+  char c = 1;
+  ssize_t r = ::send(fd, &c, sizeof(c), MSG_DONTWAIT | MSG_NOSIGNAL);
+  // EAGAIN: peer queue full, already rung
+  (void)r;
+}
+
+static void reset_doorbell(int fd) {
+  char buf[8];
+  int i;
+  for (i = 0; i < DOORBELL_DRAIN_MAX; ++i) {
+    if (::recv(fd, buf, sizeof(buf), MSG_DONTWAIT) <= 0)
+      break;
+  }
+}
+
+static bool is_doorbell(int fd) {
+  struct stat st;
+  int type;
+  socklen_t len = sizeof(type);
+  return fstat(fd, &st) == 0 && S_ISSOCK(st.st_mode) &&
+         getsockopt(fd, SOL_SOCKET, SO_TYPE, &type, &len) == 0 &&
+         type == SOCK_DGRAM;
+}
+
+ShmAdapter::ShmAdapter(int sock, uint32_t bufsize, uint32_t flags,
+                       const WriteQueueOptions &wqopts)
+    : SocketAdapter(sock, bufsize, flags, wqopts) {
+  int i;
+  for (i = 0; i < SHM_FD_COUNT; ++i)
+    fds[i] = -1;
+}
+
+ShmAdapter::~ShmAdapter() {
+  int i;
+  close();
+  if (control)
+    munmap(control, mem_size);
+  // doorbell fd removed from poll before adapter released
+  for (i = 0; i < SHM_FD_COUNT; ++i) {
+    if (fds[i] >= 0)
+      ::close(fds[i]);
+  }
+}
+
+int32_t ShmAdapter::read() {
+  // client freed space of s2c ring
+  if (attached.load(memory_order_relaxed) && flush() < 0)
+    return SOCK_ADAPTER_ECLOSED;
+  return SocketAdapter::read();
+}
+
+bool ShmAdapter::poll_writable() { return !attached.load(); }
+
+// data transfered by rings if attached, can not pass fds with it
+bool ShmAdapter::fd_passing() { return !attached.load(); }
+
+ssize_t ShmAdapter::read_some(void *data, uint32_t size) {
+  if (!attached.load(memory_order_relaxed))
+    return recv_fds(data, size);
+  ssize_t r = read_ring(data, size);
+  if (r != 0)
+    return r;
+  // rings empty, check whether client closed socket
+  char c;
+  r = ::recv(socketfd, &c, sizeof(c), MSG_DONTWAIT);
+  if (r > 0) {
+    KLOGE(TAG, "shm adapter: unexpected data from socket");
+    errno = EPROTO;
+    return -1;
+  }
+  return r;
+}
+
+ssize_t ShmAdapter::read_ring(void *data, uint32_t size) {
+  reset_doorbell(fds[SHM_FD_SVC_DOORBELL]);
+  int32_t r = c2s.read(data, size);
+  if (r < 0) {
+    KLOGE(TAG, "shm adapter: c2s ring corrupted");
+    errno = EPROTO;
+    return -1;
+  }
+  if (r > 0 && c2s.wake_writer())
+    ring_doorbell(fds[SHM_FD_CLI_SPACE]);
+  // level triggered: data remained or arrived before waiting flag set,
+  // poll again
+  if (c2s.readable() || !c2s.prepare_wait_data())
+    ring_doorbell(fds[SHM_FD_SVC_RING]);
+  return r;
+}
+
+ssize_t ShmAdapter::recv_fds(void *data, uint32_t size) {
+  struct iovec iov;
+  struct msghdr msg;
+  union {
+    struct cmsghdr align;
+    char buf[CMSG_SPACE(sizeof(int) * SHM_FD_COUNT)];
+  } cbuf;
+
+  iov.iov_base = data;
+  iov.iov_len = size;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = cbuf.buf;
+  msg.msg_controllen = sizeof(cbuf.buf);
+  ssize_t r = recvmsg(socketfd, &msg, MSG_CMSG_CLOEXEC);
+  if (r <= 0)
+    return r;
+  bool first = first_msg;
+  first_msg = false;
+  struct cmsghdr *cmsg;
+  for (cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+    if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+      continue;
+    int nfds = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+    int rfds[SHM_FD_COUNT];
+    int i;
+    if (nfds > SHM_FD_COUNT)
+      nfds = SHM_FD_COUNT;
+    memcpy(rfds, CMSG_DATA(cmsg), sizeof(int) * nfds);
+    if (first) {
+      if (!attach(rfds, nfds)) {
+        for (i = 0; i < nfds; ++i)
+          ::close(rfds[i]);
+      }
+      continue;
+    }
+    // fds of CMD_FD_POST_REQ
+    for (i = 0; i < nfds; ++i) {
+      if (!push_fd(rfds[i])) {
+        errno = EPROTO;
+        return -1;
+      }
+    }
+  }
+  return r;
+}
+
+bool ShmAdapter::attach(int *rfds, int nfds) {
+  if (nfds != SHM_FD_COUNT || control) {
+    KLOGW(TAG, "shm adapter: unexpected %d fds received", nfds);
+    return false;
+  }
+  int i;
+  for (i = SHM_FD_SVC_DOORBELL; i < SHM_FD_COUNT; ++i) {
+    if (!is_doorbell(rfds[i])) {
+      KLOGW(TAG, "shm adapter: doorbell %d not datagram socket", i);
+      return false;
+    }
+  }
+  // client truncating mapped memory would crash service by SIGBUS
+  int seals = fcntl(rfds[SHM_FD_MEM], F_GET_SEALS);
+  if (seals < 0 || (seals & SHM_MEM_SEALS) != SHM_MEM_SEALS) {
+    KLOGW(TAG, "shm adapter: shared memory not sealed");
+    return false;
+  }
+  struct stat st;
+  if (fstat(rfds[SHM_FD_MEM], &st) < 0 ||
+      st.st_size != ShmControl::mem_size(SHM_RING_CAPACITY)) {
+    KLOGW(TAG, "shm adapter: shared memory size mismatch");
+    return false;
+  }
+  mem_size = st.st_size;
+  void *p = mmap(nullptr, mem_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                 rfds[SHM_FD_MEM], 0);
+  if (p == MAP_FAILED) {
+    KLOGW(TAG, "shm adapter: mmap failed: %s", strerror(errno));
+    return false;
+  }
+  control = reinterpret_cast<ShmControl *>(p);
+  if (control->magic != SHM_MAGIC || control->capacity != SHM_RING_CAPACITY) {
+    KLOGW(TAG, "shm adapter: invalid shared memory");
+    munmap(control, mem_size);
+    control = nullptr;
+    return false;
+  }
+  c2s.attach(control, SHM_RING_C2S);
+  s2c.attach(control, SHM_RING_S2C);
+  memcpy(fds, rfds, sizeof(fds));
+  lock_guard<mutex> locker(write_mutex);
+  attached.store(true);
+  KLOGI(TAG, "shm adapter: socket %d upgraded to shared memory", socketfd);
+  return true;
+}
+
+ssize_t ShmAdapter::writev_some(const struct iovec *iov, int iovcnt) {
+  if (!attached.load(memory_order_relaxed))
+    return SocketAdapter::writev_some(iov, iovcnt);
+  uint32_t size = 0;
+  int i;
+  for (i = 0; i < iovcnt; ++i)
+    size += iov[i].iov_len;
+  int32_t r = s2c.write(iov, iovcnt);
+  if (r >= 0 && (uint32_t)r < size && !s2c.prepare_wait_space()) {
+    // client freed space meanwhile
+    int32_t r2 = s2c.write(iov, iovcnt, r);
+    r = r2 < 0 ? r2 : r + r2;
+  }
+  if (r < 0) {
+    KLOGE(TAG, "shm adapter: s2c ring corrupted");
+    return -1;
+  }
+  if (r > 0 && s2c.wake_reader())
+    ring_doorbell(fds[SHM_FD_CLI_DOORBELL]);
+  return r;
+}
+
+} // namespace internal
+} // namespace flora
+#endif // HAVE_SHM
@@ -0,0 +1,57 @@
+#pragma once
+
+#include "shm-ring.h"
+#include "sock-adap.h"
+
+namespace flora {
+namespace internal {
+
+// unix socket adapter, upgraded to shared memory rings if client sends
+// memfd and doorbell sockets with auth request, see ShmConn
+// the socket is kept to detect client exit
+class ShmAdapter : public SocketAdapter {
+public:
+  ShmAdapter(int sock, uint32_t bufsize, uint32_t flags,
+             const WriteQueueOptions &wqopts);
+
+  ~ShmAdapter();
+
+  int32_t read() override;
+
+  bool poll_writable() override;
+
+  bool fd_passing() override;
+
+  // return: doorbell poll thread should watch, -1 if not upgraded
+  int doorbell_fd() const { return fds[SHM_FD_SVC_DOORBELL]; }
+
+public:
+  // doorbell_fd added to poll
+  bool doorbell_polled = false;
+
+protected:
+  ssize_t read_some(void *data, uint32_t size) override;
+
+  ssize_t writev_some(const struct iovec *iov, int iovcnt) override;
+
+private:
+  // receive fds sent with auth request
+  ssize_t recv_fds(void *data, uint32_t size);
+
+  bool attach(int *rfds, int nfds);
+
+  ssize_t read_ring(void *data, uint32_t size);
+
+private:
+  int fds[SHM_FD_COUNT];
+  ShmControl *control = nullptr;
+  uint32_t mem_size = 0;
+  ShmRing c2s;
+  ShmRing s2c;
+  std::atomic<bool> attached{false};
+  // fds of first message (auth request) are shared memory
+  bool first_msg = true;
+};
+
+} // namespace internal
+} // namespace flora
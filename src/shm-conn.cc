@@ -0,0 +1,268 @@
+#include "shm-conn.h"
+#include "memfd.h"
+#include "rlog.h"
+
+#ifdef HAVE_SHM
+#include <errno.h>
+#include <new>
+#include <poll.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+
+// fds sent, waiting first data from service
+#define SHM_STATE_PENDING 0
+// service upgraded connection, data transfered by rings
+#define SHM_STATE_RINGS 1
+// service not support shared memory
+#define SHM_STATE_SOCKET 2
+
+using namespace std;
+using flora::internal::ShmControl;
+
+static void ring_doorbell(int fd) {
+  char c = 1;
+  ssize_t r = ::send(fd, &c, sizeof(c), MSG_DONTWAIT | MSG_NOSIGNAL);
+  (void)r;
+}
+
+static void reset_doorbell(int fd) {
+  char buf[8];
+  while (::recv(fd, buf, sizeof(buf), MSG_DONTWAIT) > 0)
+    ;
+}
+
+ShmConn::ShmConn() : SocketConn(0) {
+  int i;
+  for (i = 0; i < SHM_FD_COUNT; ++i)
+    fds[i] = -1;
+}
+
+ShmConn::~ShmConn() {
+  int i;
+  if (control)
+    munmap(control, mem_size);
+  for (i = 0; i < SHM_FD_COUNT; ++i) {
+    if (fds[i] >= 0)
+      ::close(fds[i]);
+  }
+  if (cli_doorbell >= 0)
+    ::close(cli_doorbell);
+  if (cli_space >= 0)
+    ::close(cli_space);
+}
+
+bool ShmConn::connect(const string &name) {
+  if (!init_rings())
+    return false;
+  return SocketConn::connect(name);
+}
+
+bool ShmConn::init_rings() {
+  int fd = memfd_open("flora-shm", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+  if (fd < 0) {
+    KLOGE(TAG, "memfd_create failed: %s", strerror(errno));
+    return false;
+  }
+  fds[SHM_FD_MEM] = fd;
+  mem_size = ShmControl::mem_size(SHM_RING_CAPACITY);
+  if (ftruncate(fd, mem_size) < 0) {
+    KLOGE(TAG, "ftruncate memfd failed: %s", strerror(errno));
+    return false;
+  }
+  if (fcntl(fd, F_ADD_SEALS, SHM_MEM_SEALS) < 0) {
+    KLOGE(TAG, "seal memfd failed: %s", strerror(errno));
+    return false;
+  }
+  void *p =
+      mmap(nullptr, mem_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (p == MAP_FAILED) {
+    KLOGE(TAG, "mmap memfd failed: %s", strerror(errno));
+    return false;
+  }
+  // memfd initialized with zero
+  control = new (p) ShmControl();
+  control->magic = SHM_MAGIC;
+  control->capacity = SHM_RING_CAPACITY;
+  // service waits c2s ring by poll thread
+  control->rings[SHM_RING_C2S].reader_waiting.store(1);
+  c2s.attach(control, SHM_RING_C2S);
+  s2c.attach(control, SHM_RING_S2C);
+  return new_doorbell(fds[SHM_FD_SVC_RING], fds[SHM_FD_SVC_DOORBELL]) &&
+         new_doorbell(cli_doorbell, fds[SHM_FD_CLI_DOORBELL]) &&
+         new_doorbell(cli_space, fds[SHM_FD_CLI_SPACE]);
+}
+
+bool ShmConn::new_doorbell(int &local, int &remote) {
+  int sv[2];
+  if (socketpair(AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0,
+                 sv) < 0) {
+    KLOGE(TAG, "doorbell socketpair failed: %s", strerror(errno));
+    return false;
+  }
+  local = sv[0];
+  remote = sv[1];
+  return true;
+}
+
+bool ShmConn::send(const void *data, uint32_t size) {
+  lock_guard<mutex> locker(send_mutex);
+  if (!fds_sent) {
+    fds_sent = true;
+    bool r = send_with_fds(data, size);
+    close_sent_fds();
+    return r;
+  }
+  if (state.load() != SHM_STATE_RINGS)
+    return SocketConn::send(data, size);
+
+  struct iovec iov;
+  uint32_t off = 0;
+  iov.iov_base = const_cast<void *>(data);
+  iov.iov_len = size;
+  while (true) {
+    if (closed())
+      return false;
+    int32_t r = c2s.write(&iov, 1, off);
+    if (r < 0) {
+      KLOGE(TAG, "shm conn: c2s ring corrupted");
+      return false;
+    }
+    off += r;
+    if (r > 0 && c2s.wake_reader())
+      ring_doorbell(fds[SHM_FD_SVC_RING]);
+    if (off == size)
+      break;
+    if (c2s.prepare_wait_space() && !wait(cli_space))
+      return false;
+  }
+  return true;
+}
+
+bool ShmConn::fd_passing() const {
+  return state.load() == SHM_STATE_SOCKET && SocketConn::fd_passing();
+}
+
+bool ShmConn::send_fd(const void *data, uint32_t size, int fd) {
+  lock_guard<mutex> locker(send_mutex);
+  if (state.load() != SHM_STATE_SOCKET)
+    return false;
+  return SocketConn::send_fd(data, size, fd);
+}
+
+bool ShmConn::send_with_fds(const void *data, uint32_t size) {
+  struct iovec iov;
+  struct msghdr msg;
+  union {
+    struct cmsghdr align;
+    char buf[CMSG_SPACE(sizeof(fds))];
+  } cbuf;
+
+  iov.iov_base = const_cast<void *>(data);
+  iov.iov_len = size;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = cbuf.buf;
+  msg.msg_controllen = sizeof(cbuf.buf);
+  struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+  memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+  ssize_t r;
+  do {
+    r = sendmsg(get_socket(), &msg, MSG_NOSIGNAL);
+  } while (r < 0 && errno == EINTR);
+  if (r < 0) {
+    KLOGE(TAG, "send shared memory fds failed: %s", strerror(errno));
+    return false;
+  }
+  // the remain sent without fds
+  if ((uint32_t)r < size)
+    return SocketConn::send((const int8_t *)data + r, size - r);
+  return true;
+}
+
+void ShmConn::close_sent_fds() {
+  int i;
+  for (i = SHM_FD_SVC_DOORBELL; i < SHM_FD_COUNT; ++i) {
+    // client rings service by SHM_FD_SVC_RING
+    if (i == SHM_FD_SVC_RING || fds[i] < 0)
+      continue;
+    ::close(fds[i]);
+    fds[i] = -1;
+  }
+}
+
+int32_t ShmConn::recv(void *data, uint32_t size) {
+  struct pollfd pfds[2];
+  uint32_t st;
+
+  while (true) {
+    if (closed())
+      return -1;
+    st = state.load();
+    if (st == SHM_STATE_SOCKET)
+      return SocketConn::recv(data, size);
+    int32_t r = s2c.read(data, size);
+    if (r < 0) {
+      KLOGE(TAG, "shm conn: s2c ring corrupted");
+      return -1;
+    }
+    if (r > 0) {
+      if (st == SHM_STATE_PENDING)
+        state.store(SHM_STATE_RINGS);
+      if (s2c.wake_writer())
+        ring_doorbell(fds[SHM_FD_SVC_RING]);
+      return r;
+    }
+    if (!s2c.prepare_wait_data())
+      continue;
+    pfds[0].fd = cli_doorbell;
+    pfds[0].events = POLLIN;
+    pfds[1].fd = get_socket();
+    pfds[1].events = POLLIN;
+    if (poll(pfds, 2, -1) < 0) {
+      if (errno == EINTR)
+        continue;
+      KLOGE(TAG, "shm conn: poll failed: %s", strerror(errno));
+      return -1;
+    }
+    if (pfds[0].revents & POLLIN)
+      reset_doorbell(cli_doorbell);
+    if (pfds[1].revents == 0)
+      continue;
+    if (st == SHM_STATE_PENDING && !s2c.readable()) {
+      // response from socket, service not support shared memory
+      KLOGI(TAG, "shm conn: service not support shared memory, use socket");
+      state.store(SHM_STATE_SOCKET);
+      continue;
+    }
+    char c;
+    r = ::recv(get_socket(), &c, sizeof(c), MSG_DONTWAIT);
+    if (r < 0 && (errno == EAGAIN || errno == EINTR))
+      continue;
+    if (r > 0)
+      KLOGE(TAG, "shm conn: unexpected data from socket");
+    return r > 0 ? -1 : r;
+  }
+}
+
+bool ShmConn::wait(int fd) {
+  struct pollfd pfds[2];
+
+  pfds[0].fd = fd;
+  pfds[0].events = POLLIN;
+  pfds[1].fd = get_socket();
+  pfds[1].events = POLLIN;
+  while (poll(pfds, 2, -1) < 0) {
+    if (errno != EINTR)
+      return false;
+  }
+  if (pfds[1].revents)
+    return false;
+  reset_doorbell(fd);
+  return true;
+}
+#endif // HAVE_SHM
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "shm-ring.h"
+#include "sock-conn.h"
+
+// connect to unix socket, then transfer data by shared memory rings
+// memfd and doorbell sockets sent with first message (auth request)
+// fallback to socket if service not upgraded the connection
+class ShmConn : public SocketConn {
+public:
+  ShmConn();
+
+  ~ShmConn();
+
+  bool connect(const std::string &name);
+
+  bool send(const void *data, uint32_t size) override;
+
+  // return: -1  socket error or shared memory corrupted
+  int32_t recv(void *data, uint32_t size) override;
+
+  // fds could not be sent by rings
+  bool fd_passing() const override;
+
+  bool send_fd(const void *data, uint32_t size, int fd) override;
+
+private:
+  bool init_rings();
+
+  // socketpair, 'local' end used by client, 'remote' end sent to service
+  bool new_doorbell(int &local, int &remote);
+
+  // service ends of doorbells not needed after sent
+  void close_sent_fds();
+
+  bool send_with_fds(const void *data, uint32_t size);
+
+  // wait 'fd' readable or socket closed
+  // return: false if socket closed
+  bool wait(int fd);
+
+private:
+  // sent to service, see SHM_FD_*
+  int fds[SHM_FD_COUNT];
+  // peers of fds[SHM_FD_CLI_DOORBELL], fds[SHM_FD_CLI_SPACE]
+  int cli_doorbell = -1;
+  int cli_space = -1;
+  flora::internal::ShmControl *control = nullptr;
+  uint32_t mem_size = 0;
+  flora::internal::ShmRing c2s;
+  flora::internal::ShmRing s2c;
+  bool fds_sent = false;
+  // SHM_STATE_*
+  std::atomic<uint32_t> state{0};
+  std::mutex send_mutex;
+};
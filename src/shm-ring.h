@@ -0,0 +1,185 @@
+#pragma once
+
+#include <atomic>
+#include <stdint.h>
+#include <string.h>
+#include <sys/uio.h>
+
+// capacity of each direction, must be power of 2
+#define SHM_RING_CAPACITY (256 * 1024)
+#define SHM_MAGIC 0x666c7368
+// SHM_RING_*: index of rings in ShmControl
+// client --> server
+#define SHM_RING_C2S 0
+// server --> client
+#define SHM_RING_S2C 1
+// SHM_FD_*: order of fds sent with auth request (SCM_RIGHTS)
+// doorbells are ends of unix datagram socketpairs, service only uses
+// send/recv with MSG_DONTWAIT on them, client can not block it by fd flags
+#define SHM_FD_MEM 0
+// service end: data written to c2s ring, or space freed in s2c ring
+#define SHM_FD_SVC_DOORBELL 1
+// service end: data written to s2c ring
+#define SHM_FD_CLI_DOORBELL 2
+// service end: space freed in c2s ring
+#define SHM_FD_CLI_SPACE 3
+// peer of SHM_FD_SVC_DOORBELL: client rings service by it, service rings
+// itself to poll c2s ring again
+#define SHM_FD_SVC_RING 4
+#define SHM_FD_COUNT 5
+
+namespace flora {
+namespace internal {
+
+// shared by two processes, std::atomic<uint32_t> must be lock free
+class ShmRingHeader {
+public:
+  // bytes read by consumer
+  alignas(64) std::atomic<uint32_t> head;
+  // bytes written by producer
+  alignas(64) std::atomic<uint32_t> tail;
+  // consumer sleeping, producer should ring doorbell after write
+  alignas(64) std::atomic<uint32_t> reader_waiting;
+  // producer waiting space, consumer should ring doorbell after read
+  std::atomic<uint32_t> writer_waiting;
+};
+
+// beginning of shared memory, followed by data of rings
+class ShmControl {
+public:
+  uint32_t magic;
+  uint32_t capacity;
+  ShmRingHeader rings[2];
+
+  static uint32_t mem_size(uint32_t capacity) {
+    return sizeof(ShmControl) + capacity * 2;
+  }
+
+  int8_t *ring_data(uint32_t idx) {
+    return reinterpret_cast<int8_t *>(this) + sizeof(ShmControl) +
+           capacity * idx;
+  }
+};
+
+// single producer single consumer byte stream in shared memory
+// peer may be malicious, positions read from shared memory are checked
+class ShmRing {
+public:
+  void attach(ShmControl *ctl, uint32_t idx) {
+    header = ctl->rings + idx;
+    data = ctl->ring_data(idx);
+    capacity = ctl->capacity;
+  }
+
+  // producer, 'iov' data except first 'skip' bytes
+  // return: bytes copied from 'iov', -1 ring corrupted
+  int32_t write(const struct iovec *iov, int iovcnt, uint32_t skip = 0) {
+    uint32_t tail = header->tail.load(std::memory_order_relaxed);
+    uint32_t used = tail - header->head.load(std::memory_order_acquire);
+    if (used > capacity)
+      return -1;
+    uint32_t space = capacity - used;
+    uint32_t total = 0;
+    int i;
+    for (i = 0; i < iovcnt && space > 0; ++i) {
+      uint32_t len = iov[i].iov_len;
+      if (skip >= len) {
+        skip -= len;
+        continue;
+      }
+      len -= skip;
+      if (len > space)
+        len = space;
+      copy_in(tail + total, (const int8_t *)iov[i].iov_base + skip, len);
+      skip = 0;
+      total += len;
+      space -= len;
+    }
+    header->tail.store(tail + total, std::memory_order_release);
+    return total;
+  }
+
+  // consumer
+  // return: bytes copied to 'buf', -1 ring corrupted
+  int32_t read(void *buf, uint32_t size) {
+    uint32_t head = header->head.load(std::memory_order_relaxed);
+    uint32_t avail = header->tail.load(std::memory_order_acquire) - head;
+    if (avail > capacity)
+      return -1;
+    if (size > avail)
+      size = avail;
+    copy_out(head, (int8_t *)buf, size);
+    header->head.store(head + size, std::memory_order_release);
+    return size;
+  }
+
+  bool readable() const {
+    return header->tail.load(std::memory_order_acquire) !=
+           header->head.load(std::memory_order_relaxed);
+  }
+
+  bool writable() const {
+    return header->tail.load(std::memory_order_relaxed) -
+               header->head.load(std::memory_order_acquire) <
+           capacity;
+  }
+
+  // consumer going to sleep
+  // return: false if data arrived meanwhile, should not sleep
+  bool prepare_wait_data() {
+    header->reader_waiting.store(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    return !readable();
+  }
+
+  // producer going to sleep
+  // return: false if space freed meanwhile, should not sleep
+  bool prepare_wait_space() {
+    header->writer_waiting.store(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    return !writable();
+  }
+
+  // called by producer after write
+  // return: true if consumer should be woken up
+  bool wake_reader() {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    return header->reader_waiting.load(std::memory_order_relaxed) &&
+           header->reader_waiting.exchange(0);
+  }
+
+  // called by consumer after read
+  // return: true if producer should be woken up
+  bool wake_writer() {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    return header->writer_waiting.load(std::memory_order_relaxed) &&
+           header->writer_waiting.exchange(0);
+  }
+
+private:
+  void copy_in(uint32_t pos, const int8_t *src, uint32_t len) {
+    uint32_t off = pos & (capacity - 1);
+    uint32_t n = capacity - off;
+    if (n > len)
+      n = len;
+    memcpy(data + off, src, n);
+    memcpy(data, src + n, len - n);
+  }
+
+  void copy_out(uint32_t pos, int8_t *dst, uint32_t len) {
+    uint32_t off = pos & (capacity - 1);
+    uint32_t n = capacity - off;
+    if (n > len)
+      n = len;
+    memcpy(dst, data + off, n);
+    memcpy(dst + n, data, len - n);
+  }
+
+private:
+  ShmRingHeader *header = nullptr;
+  int8_t *data = nullptr;
+  uint32_t capacity = 0;
+};
+
+} // namespace internal
+} // namespace flora
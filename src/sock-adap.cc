@@ -4,36 +4,48 @@
 #include "rlog.h"
 #include <chrono>
 #include <errno.h>
+#include <fcntl.h>
 #include <string.h>
 #include <sys/mman.h>
 #include <unistd.h>
 #include <sys/socket.h>
 
+// not defined on macOS, SIGPIPE ignored by signal handler
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
 using namespace std;
 
-static void set_write_timeout(int sock, uint32_t timeout) {
+static void set_nonblock(int sock) {
   if (sock < 0)
     return;
-  struct timeval tv;
-  tv.tv_sec = timeout / 1000;
-  tv.tv_usec = (timeout % 1000) * 1000;
-  setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+  int f = fcntl(sock, F_GETFL);
+  fcntl(sock, F_SETFL, f | O_NONBLOCK);
 }
 
 SocketAdapter::SocketAdapter(int sock, uint32_t bufsize, uint32_t flags,
-    uint32_t wtimeout) : Adapter(flags), socketfd(sock) {
+    const WriteQueueOptions &wqopts)
+    : Adapter(flags), socketfd(sock), wq_options(wqopts) {
   buffer = (int8_t *)mmap(NULL, bufsize, PROT_READ | PROT_WRITE,
                           MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
   buf_size = bufsize;
-  set_write_timeout(sock, wtimeout);
+  set_nonblock(sock);
 }
 
-SocketAdapter::~SocketAdapter() { close(); }
+SocketAdapter::~SocketAdapter() {
+  close();
+  munmap(buffer, buf_size);
+  for (auto fd : received_fds)
+    ::close(fd);
+}
 
 int32_t SocketAdapter::read() {
-  if (buffer == nullptr)
+  if (sock_closed.load(memory_order_relaxed))
     return SOCK_ADAPTER_ECLOSED;
-  ssize_t c = ::read(socketfd, buffer + cur_size, buf_size - cur_size);
+  ssize_t c = read_some(buffer + cur_size, buf_size - cur_size);
+  if (c < 0 && (errno == EAGAIN || errno == EINTR))
+    return SOCK_ADAPTER_SUCCESS;
   if (c <= 0) {
     if (c == 0) {
       KLOGD(TAG, "socket closed by remote");
@@ -43,14 +55,11 @@ int32_t SocketAdapter::read() {
     return SOCK_ADAPTER_ECLOSED;
   }
   cur_size += c;
-#ifdef FLORA_DEBUG
-  recv_bytes += c;
-#endif
   return SOCK_ADAPTER_SUCCESS;
 }
 
 int32_t SocketAdapter::next_frame(Frame &frame) {
-  if (buffer == nullptr)
+  if (sock_closed.load(memory_order_relaxed))
     return SOCK_ADAPTER_ECLOSED;
   uint32_t sz = cur_size - frame_begin;
   if (sz < HEADER_SIZE)
@@ -67,9 +76,8 @@ int32_t SocketAdapter::next_frame(Frame &frame) {
   frame.data = buffer + frame_begin;
   frame.size = length;
   frame_begin += length;
-#ifdef FLORA_DEBUG
-  ++recv_times;
-#endif
+  stats->frames_in.fetch_add(1, memory_order_relaxed);
+  stats->bytes_in.fetch_add(length, memory_order_relaxed);
   return SOCK_ADAPTER_SUCCESS;
 
 nomore:
@@ -86,35 +94,433 @@ void SocketAdapter::close() {
   close_nolock();
 }
 
+// may be invoked by dispatcher thread while poll thread reading,
+// 'buffer' released by destructor
 void SocketAdapter::close_nolock() {
-  if (buffer) {
-    munmap(buffer, buf_size);
-    buffer = nullptr;
+  if (!sock_closed.load(memory_order_relaxed)) {
+    sock_closed.store(true, memory_order_relaxed);
     if (socketfd >= 0)
       ::shutdown(socketfd, SHUT_RDWR);
+    write_queue.clear();
+    latest_buffers.clear();
+    queued_bytes = 0;
+    stats->queued_bytes.store(0, memory_order_relaxed);
+    if (dropped_msgs)
+      KLOGW(TAG, "socket adapter %s: %u msgs dropped by outbound queue",
+            info ? info->name.c_str() : "", dropped_msgs);
 #ifdef FLORA_DEBUG
-    KLOGI(TAG, "socket adapter %s: recv times = %u, recv bytes = %u",
-          info ? info->name.c_str() : "", recv_times, recv_bytes);
+    KLOGI(TAG, "socket adapter %s: recv frames = %llu, recv bytes = %llu",
+          info ? info->name.c_str() : "",
+          stats->frames_in.load(memory_order_relaxed),
+          stats->bytes_in.load(memory_order_relaxed));
 #endif
   }
 }
 
 bool SocketAdapter::closed() {
   lock_guard<mutex> locker(write_mutex);
-  return buffer == nullptr;
+  return sock_closed.load(memory_order_relaxed);
 }
 
 int32_t SocketAdapter::write(const void *data, uint32_t size) {
+  struct iovec iov;
+  iov.iov_base = const_cast<void *>(data);
+  iov.iov_len = size;
+  return writev(&iov, 1);
+}
+
+int32_t SocketAdapter::writev(const struct iovec *iov, int iovcnt) {
+  return write_frame(iov, iovcnt, 0);
+}
+
+int32_t SocketAdapter::writev_latest(const struct iovec *iov, int iovcnt,
+                                     uint32_t key) {
+  return write_frame(iov, iovcnt, key);
+}
+
+int32_t SocketAdapter::write_frame(const struct iovec *iov, int iovcnt,
+                                   uint32_t key) {
+  uint32_t size = 0;
+  int i;
+  for (i = 0; i < iovcnt; ++i)
+    size += iov[i].iov_len;
+
+  lock_guard<mutex> locker(write_mutex);
+  if (sock_closed.load(memory_order_relaxed))
+    return -1;
+  stats->frames_out.fetch_add(1, memory_order_relaxed);
+  stats->bytes_out.fetch_add(size, memory_order_relaxed);
+  if (corked) {
+    // corked frames admitted as if none of them written, so flush_corked
+    // never drops them. write them first if the queue could not take more
+    uint32_t pending = cork_data.size();
+    if ((pending + size > CORK_BUFFER_SIZE ||
+         queued_bytes + pending + size > wq_options.limit) &&
+        flush_corked() < 0)
+      return -1;
+    if (size <= CORK_BUFFER_SIZE) {
+      int32_t r = admit(size, cork_data.size());
+      if (r < 0)
+        return r;
+      for (i = 0; i < iovcnt; ++i) {
+        const int8_t *b = (const int8_t *)iov[i].iov_base;
+        cork_data.insert(cork_data.end(), b, b + iov[i].iov_len);
+      }
+      cork_ends.push_back(cork_data.size());
+      cork_keys.push_back(key);
+      return 0;
+    }
+  }
+  ssize_t r = 0;
+  if (write_queue.empty()) {
+    r = writev_some(iov, iovcnt);
+    if (r < 0) {
+      close_nolock();
+      return -1;
+    }
+    if ((uint32_t)r == size)
+      return 0;
+  }
+  return enqueue(iov, iovcnt, r, size - r, nullptr, key);
+}
+
+int32_t SocketAdapter::write_pinned(const void *data, uint32_t size) {
+  struct iovec iov;
+  iov.iov_base = const_cast<void *>(data);
+  iov.iov_len = size;
+
+  lock_guard<mutex> locker(write_mutex);
+  if (sock_closed.load(memory_order_relaxed))
+    return -1;
+  if (flush_corked() < 0)
+    return -1;
+  stats->frames_out.fetch_add(1, memory_order_relaxed);
+  stats->bytes_out.fetch_add(size, memory_order_relaxed);
+  ssize_t r = 0;
+  if (write_queue.empty()) {
+    r = writev_some(&iov, 1);
+    if (r < 0) {
+      close_nolock();
+      return -1;
+    }
+    if ((uint32_t)r == size)
+      return 0;
+  }
+  return enqueue(&iov, 1, r, size - r, nullptr, 0, true);
+}
+
+int32_t SocketAdapter::write_fd(const void *data, uint32_t size,
+                                shared_ptr<SharedFd> &fd) {
+  struct iovec iov;
+  iov.iov_base = const_cast<void *>(data);
+  iov.iov_len = size;
+
+  lock_guard<mutex> locker(write_mutex);
+  if (sock_closed.load(memory_order_relaxed))
+    return -1;
+  if (flush_corked() < 0)
+    return -1;
+  stats->frames_out.fetch_add(1, memory_order_relaxed);
+  stats->bytes_out.fetch_add(size, memory_order_relaxed);
+  ssize_t r = 0;
+  if (write_queue.empty()) {
+    r = send_with_fd(data, size, fd->fd);
+    if (r < 0) {
+      close_nolock();
+      return -1;
+    }
+    if ((uint32_t)r == size)
+      return 0;
+  }
+  // fd already sent with head of data if r > 0
+  return enqueue(&iov, 1, r, size - r, r > 0 ? nullptr : fd);
+}
+
+bool SocketAdapter::cork() {
+  lock_guard<mutex> locker(write_mutex);
+  if (corked || sock_closed.load(memory_order_relaxed))
+    return false;
+  corked = true;
+  return true;
+}
+
+void SocketAdapter::uncork() {
+  lock_guard<mutex> locker(write_mutex);
+  corked = false;
+  flush_corked();
+}
+
+int32_t SocketAdapter::flush_corked() {
+  if (cork_ends.empty())
+    return 0;
+  if (sock_closed.load(memory_order_relaxed)) {
+    cork_data.clear();
+    cork_ends.clear();
+    cork_keys.clear();
+    return -1;
+  }
+  ssize_t r = 0;
+  if (write_queue.empty()) {
+    struct iovec iov;
+    iov.iov_base = cork_data.data();
+    iov.iov_len = cork_data.size();
+    r = writev_some(&iov, 1);
+    if (r < 0) {
+      close_nolock();
+      return -1;
+    }
+  }
+  // frames not written completely queued one by one, so later frames of
+  // same key replace them. all admitted by write_frame, queue limit holds
+  uint32_t begin = 0;
+  size_t i;
+  for (i = 0; i < cork_ends.size() && !sock_closed.load(memory_order_relaxed);
+       ++i) {
+    uint32_t end = cork_ends[i];
+    if (end > r) {
+      struct iovec iov;
+      iov.iov_base = cork_data.data() + begin;
+      iov.iov_len = end - begin;
+      uint32_t skip = r > begin ? r - begin : 0;
+      enqueue(&iov, 1, skip, end - begin - skip, nullptr, cork_keys[i]);
+    }
+    begin = end;
+  }
+  cork_data.clear();
+  cork_ends.clear();
+  cork_keys.clear();
+  return sock_closed.load(memory_order_relaxed) ? -1 : 0;
+}
+
+int SocketAdapter::take_fd() {
+  if (received_fds.empty())
+    return -1;
+  int fd = received_fds.front();
+  received_fds.pop_front();
+  return fd;
+}
+
+bool SocketAdapter::push_fd(int fd) {
+  if (received_fds.size() >= MAX_PENDING_FDS) {
+    KLOGE(TAG, "socket adapter %s: too many fds received",
+          info ? info->name.c_str() : "");
+    ::close(fd);
+    return false;
+  }
+  received_fds.push_back(fd);
+  return true;
+}
+
+int32_t SocketAdapter::flush() {
   lock_guard<mutex> locker(write_mutex);
-  if (buffer == nullptr)
+  if (sock_closed.load(memory_order_relaxed))
     return -1;
-  auto r = ::write(socketfd, data, size);
+  while (!write_queue.empty()) {
+    auto &buf = write_queue.front();
+    uint32_t remain = buf.data.size() - buf.offset;
+    int32_t r;
+    if (buf.fd != nullptr && buf.offset == 0)
+      r = send_with_fd(buf.data.data(), remain, buf.fd->fd);
+    else
+      r = write_some(buf.data.data() + buf.offset, remain);
+    if (r < 0) {
+      close_nolock();
+      return -1;
+    }
+    buf.offset += r;
+    queued_bytes -= r;
+    stats->queued_bytes.store(queued_bytes, memory_order_relaxed);
+    if ((uint32_t)r < remain)
+      return 1;
+    if (buf.key)
+      latest_buffers.erase(buf.key);
+    write_queue.pop_front();
+  }
+  return 0;
+}
+
+bool SocketAdapter::write_pending() {
+  lock_guard<mutex> locker(write_mutex);
+  return !write_queue.empty();
+}
+
+int32_t SocketAdapter::write_some(const void *data, uint32_t size) {
+  struct iovec iov;
+  iov.iov_base = const_cast<void *>(data);
+  iov.iov_len = size;
+  return writev_some(&iov, 1);
+}
+
+ssize_t SocketAdapter::send_with_fd(const void *data, uint32_t size, int fd) {
+  struct iovec iov;
+  struct msghdr msg;
+  union {
+    struct cmsghdr align;
+    char buf[CMSG_SPACE(sizeof(int))];
+  } cbuf;
+
+  iov.iov_base = const_cast<void *>(data);
+  iov.iov_len = size;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = cbuf.buf;
+  msg.msg_controllen = sizeof(cbuf.buf);
+  struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+  memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+  ssize_t r;
+  do {
+    r = sendmsg(socketfd, &msg, MSG_NOSIGNAL);
+  } while (r < 0 && errno == EINTR);
   if (r < 0) {
+    if (errno == EAGAIN || errno == EWOULDBLOCK)
+      return 0;
+    KLOGE(TAG, "sendmsg to socket failed: %s", strerror(errno));
+  }
+  return r;
+}
+
+ssize_t SocketAdapter::read_some(void *data, uint32_t size) {
+  return ::read(socketfd, data, size);
+}
+
+ssize_t SocketAdapter::writev_some(const struct iovec *iov, int iovcnt) {
+  ssize_t r;
+  do {
+    r = ::writev(socketfd, iov, iovcnt);
+  } while (r < 0 && errno == EINTR);
+  if (r < 0) {
+    if (errno == EAGAIN || errno == EWOULDBLOCK)
+      return 0;
     KLOGE(TAG, "write to socket failed: %s", strerror(errno));
-    close_nolock();
-    if (errno == EAGAIN)
-      return -2;
-    return -1;
   }
+  return r;
+}
+
+int32_t SocketAdapter::enqueue(const struct iovec *iov, int iovcnt,
+                               uint32_t skip, uint32_t size,
+                               shared_ptr<SharedFd> fd, uint32_t key,
+                               bool pinned) {
+  // head of the message already written to socket,
+  // the remain must not be dropped
+  bool partial = skip > 0;
+  OutboundBuffer *replaced = nullptr;
+  if (key && !partial) {
+    auto it = latest_buffers.find(key);
+    if (it != latest_buffers.end()) {
+      // writing by flush, not replaceable any more
+      if (it->second->offset == 0)
+        replaced = &*it->second;
+      else
+        latest_buffers.erase(it);
+    }
+  }
+  // replaced frame kept if this one not admitted
+  if (!partial && admit(size, 0, replaced) < 0)
+    return -2;
+  if (replaced) {
+    erase_queued(latest_buffers[key]);
+    stats->conflated.fetch_add(1, memory_order_relaxed);
+  }
+  bool was_empty = write_queue.empty();
+  write_queue.emplace_back();
+  auto &buf = write_queue.back();
+  buf.data.reserve(size);
+  buf.offset = 0;
+  buf.fd = fd;
+  buf.key = partial ? 0 : key;
+  // dropping the tail would corrupt the stream
+  buf.pinned = pinned || partial;
+  if (buf.key)
+    latest_buffers[key] = prev(write_queue.end());
+  int i;
+  for (i = 0; i < iovcnt; ++i) {
+    const int8_t *b = (const int8_t *)iov[i].iov_base;
+    uint32_t len = iov[i].iov_len;
+    if (skip >= len) {
+      skip -= len;
+      continue;
+    }
+    buf.data.insert(buf.data.end(), b + skip, b + len);
+    skip = 0;
+  }
+  queued_bytes += size;
+  stats->queued_bytes.store(queued_bytes, memory_order_relaxed);
+  stats->write_stalls.fetch_add(1, memory_order_relaxed);
+  if (was_empty && wq_options.on_pending)
+    wq_options.on_pending(socketfd);
   return 0;
 }
+
+int32_t SocketAdapter::admit(uint32_t size, uint32_t pending,
+                             const OutboundBuffer *replaced) {
+  // bytes freed by erasing 'replaced' if admitted
+  uint32_t freed = replaced ? replaced->data.size() : 0;
+  if (queued_bytes + pending + size <= wq_options.limit + freed)
+    return 0;
+  switch (wq_options.policy) {
+  case FLORA_POLL_WQ_DROP_OLDEST:
+  case FLORA_POLL_WQ_DROP_NEWEST:
+    if (pending + size > wq_options.limit) {
+      // never fits even if queue empty, queued messages kept
+      ++dropped_msgs;
+      stats->write_drops.fetch_add(1, memory_order_relaxed);
+      if (wq_options.counters)
+        ++wq_options.counters->dropped_oversized;
+      return -2;
+    }
+    if (wq_options.policy == FLORA_POLL_WQ_DROP_OLDEST) {
+      drop_oldest(pending + size, replaced);
+      if (queued_bytes + pending + size <= wq_options.limit + freed)
+        return 0;
+      // pinned messages remained
+    }
+    ++dropped_msgs;
+    stats->write_drops.fetch_add(1, memory_order_relaxed);
+    if (wq_options.counters)
+      ++wq_options.counters->dropped_newest;
+    return -2;
+  default:
+    KLOGW(TAG, "socket adapter %s: outbound queue over %u bytes, close",
+          info ? info->name.c_str() : "", wq_options.limit);
+    if (wq_options.counters)
+      ++wq_options.counters->disconnects;
+    stats->write_drops.fetch_add(1, memory_order_relaxed);
+    close_nolock();
+    return -2;
+  }
+}
+
+OutboundBufferList::iterator
+SocketAdapter::erase_queued(OutboundBufferList::iterator it) {
+  if (it->key)
+    latest_buffers.erase(it->key);
+  queued_bytes -= it->data.size();
+  stats->queued_bytes.store(queued_bytes, memory_order_relaxed);
+  return write_queue.erase(it);
+}
+
+void SocketAdapter::drop_oldest(uint32_t size,
+                                const OutboundBuffer *replaced) {
+  uint32_t freed = replaced ? replaced->data.size() : 0;
+  auto it = write_queue.begin();
+  // message partially written, keep it
+  if (it != write_queue.end() && it->offset > 0)
+    ++it;
+  while (it != write_queue.end() &&
+         queued_bytes + size > wq_options.limit + freed) {
+    if (it->pinned || &*it == replaced) {
+      ++it;
+      continue;
+    }
+    it = erase_queued(it);
+    ++dropped_msgs;
+    stats->write_drops.fetch_add(1, memory_order_relaxed);
+    if (wq_options.counters)
+      ++wq_options.counters->dropped_oldest;
+  }
+  stats->queued_bytes.store(queued_bytes, memory_order_relaxed);
+}
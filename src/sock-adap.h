@@ -1,7 +1,15 @@
 #pragma once
 
 #include "adap.h"
+#include "flora-svc.h"
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <list>
+#include <memory>
 #include <mutex>
+#include <unordered_map>
+#include <vector>
 
 #define HEADER_SIZE 8
 
@@ -15,9 +23,51 @@
 // buf空间不足
 #define SOCK_ADAPTER_ENOBUF -10004
 
+#define DEFAULT_WRITE_QUEUE_LIMIT (1024 * 1024)
+// max bytes buffered by SocketAdapter::cork, larger frames written directly
+#define CORK_BUFFER_SIZE (64 * 1024)
+
+// counters of backpressure policies, shared by adapters of a Poll
+class WriteQueueCounters {
+public:
+  // messages dropped by FLORA_POLL_WQ_DROP_OLDEST
+  std::atomic<uint64_t> dropped_oldest{0};
+  // messages dropped by FLORA_POLL_WQ_DROP_NEWEST
+  std::atomic<uint64_t> dropped_newest{0};
+  // messages larger than queue limit, dropped by FLORA_POLL_WQ_DROP_*
+  std::atomic<uint64_t> dropped_oversized{0};
+  // connections closed by FLORA_POLL_WQ_DISCONNECT
+  std::atomic<uint64_t> disconnects{0};
+};
+
+class WriteQueueOptions {
+public:
+  uint32_t limit = DEFAULT_WRITE_QUEUE_LIMIT;
+  uint32_t policy = FLORA_POLL_WQ_DISCONNECT;
+  std::shared_ptr<WriteQueueCounters> counters;
+  // invoked with socket fd when outbound queue becomes not empty
+  // the poll thread should watch the fd writable and invoke 'flush'
+  std::function<void(int)> on_pending;
+};
+
+typedef struct {
+  std::vector<int8_t> data;
+  // bytes already written
+  uint32_t offset;
+  // passed with first byte of 'data'
+  std::shared_ptr<SharedFd> fd;
+  // key of writev_latest, 0 if not replaceable
+  uint32_t key;
+  // never dropped: written by write_pinned, or tail of a frame partially
+  // written to socket
+  bool pinned;
+} OutboundBuffer;
+typedef std::list<OutboundBuffer> OutboundBufferList;
+
 class SocketAdapter : public Adapter {
 public:
-  SocketAdapter(int sock, uint32_t bufsize, uint32_t flags, uint32_t wto);
+  SocketAdapter(int sock, uint32_t bufsize, uint32_t flags,
+                const WriteQueueOptions &wqopts);
 
   ~SocketAdapter();
 
@@ -27,26 +77,126 @@ public:
 
   int32_t next_frame(Frame &frame) override;
 
+  // never block, data not written immediately is queued
   // return:
   //     0  success
   //     -1 socket error
-  //     -2 write timeout
+  //     -2 outbound queue full, message dropped or connection closed
+  //        according to backpressure policy
   int32_t write(const void *data, uint32_t size) override;
 
+  int32_t writev(const struct iovec *iov, int iovcnt) override;
+
+  // frame of same 'key' still in outbound queue removed
+  int32_t writev_latest(const struct iovec *iov, int iovcnt,
+                        uint32_t key) override;
+
+  int32_t write_pinned(const void *data, uint32_t size) override;
+
+  // unix socket only
+  int32_t write_fd(const void *data, uint32_t size,
+                   std::shared_ptr<SharedFd> &fd) override;
+
+  int take_fd() override;
+
+  // frames written while corked return -2 at once if the outbound queue
+  // could not take them, never dropped after written
+  bool cork() override;
+
+  // write corked frames, remained frames queued as written separately
+  void uncork() override;
+
+  // write queued data, invoked by poll thread when socket writable
+  // return:
+  //     0  outbound queue empty
+  //     1  socket not writable, data remained in queue
+  //     -1 socket error
+  int32_t flush();
+
+  bool write_pending();
+
+  // whether poll thread should watch socket writable to flush outbound queue
+  virtual bool poll_writable() { return true; }
+
   void close() override;
 
   bool closed() override;
 
   int socket() const { return socketfd; }
 
-private:
+protected:
+  // return: bytes read, 0 remote closed, -1 error (see errno)
+  virtual ssize_t read_some(void *data, uint32_t size);
+
+  // never block
+  // return: bytes written, -1 error
+  virtual ssize_t writev_some(const struct iovec *iov, int iovcnt);
+
+  // sendmsg with 'fd' as SCM_RIGHTS, never block
+  // return: bytes written, -1 error
+  ssize_t send_with_fd(const void *data, uint32_t size, int fd);
+
+  // keep fd received from peer for take_fd
+  // return: false if too many fds pending
+  bool push_fd(int fd);
+
   void close_nolock();
 
 private:
+  // return: bytes written, -1 socket error
+  int32_t write_some(const void *data, uint32_t size);
+
+  // key: see writev_latest, 0 if not replaceable
+  int32_t write_frame(const struct iovec *iov, int iovcnt, uint32_t key);
+
+  // queue 'iov' data except first 'skip' bytes
+  // 'fd' passed with data if not null
+  // key: replace queued frame of same key, 0 if not replaceable
+  // pinned: never dropped by drop_oldest, implied if 'skip' > 0
+  int32_t enqueue(const struct iovec *iov, int iovcnt, uint32_t skip,
+                  uint32_t size, std::shared_ptr<SharedFd> fd = nullptr,
+                  uint32_t key = 0, bool pinned = false);
+
+  // apply backpressure policy if outbound queue can not take 'size' more
+  // bytes besides 'pending' bytes buffered elsewhere (corked)
+  // replaced: queued frame erased by caller if admitted, never dropped here
+  // return: 0 admitted, -2 message dropped or connection closed
+  int32_t admit(uint32_t size, uint32_t pending,
+                const OutboundBuffer *replaced = nullptr);
+
+  // erase queued buffer 'it', not partially written
+  OutboundBufferList::iterator
+  erase_queued(OutboundBufferList::iterator it);
+
+  // replaced: see admit
+  void drop_oldest(uint32_t size, const OutboundBuffer *replaced);
+
+  // return: 0 success, -1 socket error
+  int32_t flush_corked();
+
+protected:
   int socketfd;
   int8_t *buffer = nullptr;
+  std::mutex write_mutex;
+
+private:
   uint32_t buf_size;
+  // set by close with write_mutex locked, read by poll thread without lock
+  std::atomic<bool> sock_closed{false};
   uint32_t cur_size = 0;
   uint32_t frame_begin = 0;
-  std::mutex write_mutex;
+  OutboundBufferList write_queue;
+  // queued buffers of writev_latest not written yet, indexed by key
+  std::unordered_map<uint32_t, OutboundBufferList::iterator> latest_buffers;
+  uint32_t queued_bytes = 0;
+  uint32_t dropped_msgs = 0;
+  WriteQueueOptions wq_options;
+  bool corked = false;
+  // frames written while corked, 'cork_ends': end offset of each frame
+  std::vector<int8_t> cork_data;
+  std::vector<uint32_t> cork_ends;
+  // key of each corked frame, see writev_latest
+  std::vector<uint32_t> cork_keys;
+  // fds received, consumed by frames in order
+  std::deque<int> received_fds;
 };
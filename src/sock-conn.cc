@@ -12,6 +12,11 @@
 #include <sys/un.h>
 #include <unistd.h>
 
+// not defined on macOS, SIGPIPE ignored by signal handler
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
 using namespace std;
 
 SocketConn::SocketConn(uint32_t rtmo) : recv_timeout(rtmo) {}
@@ -20,6 +25,8 @@ SocketConn::~SocketConn() {
   if (sock >= 0) {
     ::close(sock);
   }
+  for (int fd : received_fds)
+    ::close(fd);
 }
 
 bool SocketConn::connect(const std::string &name) {
@@ -55,6 +62,7 @@ bool SocketConn::connect(const std::string &name) {
   }
   sock = fd;
   sock_ready = true;
+  local = true;
   return true;
 }
 
@@ -127,7 +135,7 @@ int32_t SocketConn::recv(void *data, uint32_t size) {
 
   ssize_t c;
   do {
-    c = ::read(sock, data, size);
+    c = local ? recv_with_fds(data, size) : ::read(sock, data, size);
     if (c < 0) {
       if (errno == EAGAIN) {
         KLOGI(TAG, "read socket timeout");
@@ -146,6 +154,102 @@ int32_t SocketConn::recv(void *data, uint32_t size) {
   return c;
 }
 
+ssize_t SocketConn::recv_with_fds(void *data, uint32_t size) {
+  struct iovec iov;
+  struct msghdr msg;
+  union {
+    struct cmsghdr align;
+    char buf[CMSG_SPACE(sizeof(int) * MAX_PENDING_FDS)];
+  } cbuf;
+
+  iov.iov_base = data;
+  iov.iov_len = size;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = cbuf.buf;
+  msg.msg_controllen = sizeof(cbuf.buf);
+#ifdef MSG_CMSG_CLOEXEC
+  ssize_t c = ::recvmsg(sock, &msg, MSG_CMSG_CLOEXEC);
+#else
+  ssize_t c = ::recvmsg(sock, &msg, 0);
+#endif
+  if (c < 0)
+    return c;
+  struct cmsghdr *cmsg;
+  for (cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+    if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+      continue;
+    int n = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+    int i;
+    for (i = 0; i < n; ++i) {
+      int fd;
+      memcpy(&fd, CMSG_DATA(cmsg) + i * sizeof(int), sizeof(int));
+      if (received_fds.size() < MAX_PENDING_FDS)
+        received_fds.push_back(fd);
+      else
+        ::close(fd);
+    }
+  }
+  if (msg.msg_flags & MSG_CTRUNC)
+    KLOGW(TAG, "fds received from socket truncated");
+  return c;
+}
+
+bool SocketConn::send_fd(const void *data, uint32_t size, int fd) {
+  struct iovec iov;
+  struct msghdr msg;
+  union {
+    struct cmsghdr align;
+    char buf[CMSG_SPACE(sizeof(int))];
+  } cbuf;
+
+  lock_guard<mutex> locker(write_mutex);
+  if (!sock_ready || !local)
+    return false;
+  iov.iov_base = const_cast<void *>(data);
+  iov.iov_len = size;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = cbuf.buf;
+  msg.msg_controllen = sizeof(cbuf.buf);
+  struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+  memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+  ssize_t c;
+  do {
+    c = ::sendmsg(sock, &msg, MSG_NOSIGNAL);
+  } while (c < 0 && errno == EINTR);
+  if (c < 0) {
+    KLOGE(TAG, "sendmsg to socket failed: %s", strerror(errno));
+    return false;
+  }
+  // the remain sent without fd
+  while ((uint32_t)c < size) {
+    ssize_t r = ::write(sock, (const int8_t *)data + c, size - c);
+    if (r <= 0) {
+      if (r < 0 && errno == EINTR)
+        continue;
+      KLOGE(TAG, "write to socket failed: %s",
+            r < 0 ? strerror(errno) : "remote closed");
+      return false;
+    }
+    c += r;
+  }
+  return true;
+}
+
+int SocketConn::take_fd() {
+  if (received_fds.empty())
+    return -1;
+  int fd = received_fds.front();
+  received_fds.pop_front();
+  return fd;
+}
+
 void SocketConn::close() {
   lock_guard<mutex> locker(write_mutex);
   if (sock_ready) {
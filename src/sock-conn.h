@@ -1,7 +1,9 @@
 #pragma once
 
 #include "conn.h"
+#include <deque>
 #include <mutex>
+#include <sys/types.h>
 #include <string>
 
 class SocketConn : public Connection {
@@ -24,11 +26,24 @@ public:
 
   inline bool closed() const override { return !sock_ready; }
 
+  bool fd_passing() const override { return local; }
+
+  bool send_fd(const void *data, uint32_t size, int fd) override;
+
+  int take_fd() override;
+
   inline int get_socket() const { return sock; }
 
+private:
+  ssize_t recv_with_fds(void *data, uint32_t size);
+
 private:
   int sock = -1;
   uint32_t recv_timeout;
   bool sock_ready = false;
+  // unix domain socket
+  bool local = false;
   std::mutex write_mutex;
+  // fds received by recv thread, taken by recv thread
+  std::deque<int> received_fds;
 };
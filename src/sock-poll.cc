@@ -3,6 +3,7 @@
 #include "flora-svc.h"
 #include "rlog.h"
 #include <chrono>
+#include <errno.h>
 #include <netdb.h>
 #include <netinet/in.h>
 #include <fcntl.h>
@@ -17,8 +18,6 @@ using namespace std;
 
 #define POLL_TYPE_UNIX 0
 #define POLL_TYPE_TCP 1
-#define TCP_SOCK_WRITE_TIMEOUT 4000
-#define UNIX_SOCK_WRITE_TIMEOUT 800
 
 namespace flora {
 namespace internal {
@@ -41,53 +40,160 @@ int32_t SocketPoll::start(shared_ptr<flora::Dispatcher> &disp) {
   unique_lock<mutex> locker(start_mutex);
   if (dispatcher.get())
     return FLORA_POLL_ALREADY_START;
+  selector.reset(Selector::new_instance(selector_type));
+  if (!selector->init() || !doorbell.init()) {
+    selector.reset();
+    doorbell.close();
+    return FLORA_POLL_SYSERR;
+  }
   bool r;
   if (type == POLL_TYPE_TCP)
     r = init_tcp_socket();
   else
     r = init_unix_socket();
-  if (!r)
+  if (!r) {
+    selector.reset();
+    doorbell.close();
     return FLORA_POLL_SYSERR;
-  run_thread = thread([this]() { this->run(); });
+  }
+  if (wq_options.counters == nullptr)
+    wq_options.counters = make_shared<WriteQueueCounters>();
+  wq_options.on_pending = [this](int fd) { this->want_write(fd); };
   dispatcher = static_pointer_cast<Dispatcher>(disp);
   max_msg_size = dispatcher->max_msg_size();
+  if (!start_workers()) {
+    ::close(listen_fd);
+    listen_fd = -1;
+    selector.reset();
+    doorbell.close();
+    dispatcher.reset();
+    return FLORA_POLL_SYSERR;
+  }
+  run_thread = thread([this]() { this->run(); });
   // wait until thread running
   start_cond.wait(locker);
   return FLORA_POLL_SUCCESS;
 }
 
+bool SocketPoll::start_workers() {
+  uint32_t i;
+
+  if (threads <= 1)
+    return true;
+  for (i = 0; i < threads; ++i) {
+    unique_ptr<SocketPoll> worker(new_worker());
+    worker->selector_type = selector_type;
+    worker->wq_options.limit = wq_options.limit;
+    worker->wq_options.policy = wq_options.policy;
+    worker->wq_options.counters = wq_options.counters;
+    if (worker->start_worker(dispatcher) != FLORA_POLL_SUCCESS) {
+      for (auto &w : workers)
+        w->stop();
+      workers.clear();
+      return false;
+    }
+    workers.push_back(std::move(worker));
+  }
+  KLOGI(TAG, "%u poll worker threads started", threads);
+  return true;
+}
+
+int32_t SocketPoll::start_worker(shared_ptr<Dispatcher> &disp) {
+  unique_lock<mutex> locker(start_mutex);
+  selector.reset(Selector::new_instance(selector_type));
+  if (!selector->init() || !doorbell.init()) {
+    selector.reset();
+    doorbell.close();
+    return FLORA_POLL_SYSERR;
+  }
+  wq_options.on_pending = [this](int fd) { this->want_write(fd); };
+  dispatcher = disp;
+  max_msg_size = dispatcher->max_msg_size();
+  run_thread = thread([this]() { this->run(); });
+  start_cond.wait(locker);
+  return FLORA_POLL_SUCCESS;
+}
+
 void SocketPoll::stop() {
   unique_lock<mutex> locker(start_mutex);
   if (dispatcher.get() == nullptr)
     return;
-  int fd = listen_fd;
-  listen_fd = -1;
-  ::shutdown(fd, SHUT_RDWR);
+  closing = true;
+  if (listen_fd >= 0)
+    ::shutdown(listen_fd, SHUT_RDWR);
+  doorbell.ring();
   locker.unlock();
   run_thread.join();
-  ::close(fd);
+  // accept thread quit, no more sockets hand over to workers
+  for (auto &w : workers)
+    w->stop();
+  workers.clear();
+  for (auto &s : accepted_sockets)
+    ::close(s.fd);
+  accepted_sockets.clear();
+  write_wants.clear();
+  if (listen_fd >= 0) {
+    ::close(listen_fd);
+    KLOGI(TAG, "outbound queue: %llu dropped oldest, %llu dropped newest, "
+          "%llu dropped oversized, %llu disconnects",
+          wq_options.counters->dropped_oldest.load(),
+          wq_options.counters->dropped_newest.load(),
+          wq_options.counters->dropped_oversized.load(),
+          wq_options.counters->disconnects.load());
+  }
+  locker.lock();
+  listen_fd = -1;
+  closing = false;
+  locker.unlock();
+  doorbell.close();
+  selector.reset();
   dispatcher.reset();
 }
 
-int32_t SocketPoll::do_poll(fd_set *rfds, int max_fd) {
-  int r;
-#ifdef SELECT_BLOCK_IF_FD_CLOSED
-  struct timeval tv;
-  tv.tv_sec = 5;
-  tv.tv_usec = 0;
-#endif
-  while (true) {
+void SocketPoll::config(uint32_t opt, ...) {
+  va_list ap;
+  va_start(ap, opt);
+  vconfig(opt, ap);
+  va_end(ap);
+}
+
+void SocketPoll::vconfig(uint32_t opt, va_list ap) {
+  switch (opt) {
+  case FLORA_POLL_OPT_SELECTOR:
+    selector_type = va_arg(ap, uint32_t);
+    break;
+  case FLORA_POLL_OPT_THREADS:
+    threads = va_arg(ap, uint32_t);
+    break;
+  case FLORA_POLL_OPT_WRITE_QUEUE_LIMIT:
+    wq_options.limit = va_arg(ap, uint32_t);
+    break;
+  case FLORA_POLL_OPT_WRITE_QUEUE_POLICY:
+    wq_options.policy = va_arg(ap, uint32_t);
+    break;
+  }
+}
+
+int32_t SocketPoll::do_poll(SelectorEventList &events) {
 #ifdef SELECT_BLOCK_IF_FD_CLOSED
-    r = select(max_fd, rfds, nullptr, nullptr, &tv);
+  return wait_events(events, 5000);
 #else
-    r = select(max_fd, rfds, nullptr, nullptr, nullptr);
+  return wait_events(events, -1);
 #endif
+}
+
+int32_t SocketPoll::wait_events(SelectorEventList &events, int32_t timeout) {
+  int32_t r;
+  while (true) {
+    r = selector->wait(events, timeout);
     if (r < 0) {
       if (errno == EAGAIN) {
         sleep(1);
         continue;
       }
-      KLOGE(TAG, "select failed: %s", strerror(errno));
+      if (errno == EINTR)
+        continue;
+      KLOGE(TAG, "%s failed: %s", selector->name(), strerror(errno));
     }
     break;
   }
@@ -126,50 +232,63 @@ static int tcp_accept(int lfd, uint64_t& tag) {
 }
 
 void SocketPoll::run() {
-  fd_set rfds;
-  int ifd;
+  SelectorEventList events;
+  SelectorEventList::iterator eit;
 
   start_mutex.lock();
-  FD_ZERO(&all_fds);
-  FD_SET(listen_fd, &all_fds);
-  max_fd = listen_fd + 1;
+  if (listen_fd >= 0)
+    selector->add(listen_fd);
+  selector->add(doorbell.fd());
   start_cond.notify_one();
   start_mutex.unlock();
   while (true) {
-    rfds = all_fds;
-    int32_t r = do_poll(&rfds, max_fd);
+    int32_t r = do_poll(events);
     // system call error
     if (r < 0)
       break;
     // closed
-    int lfd = get_listen_fd();
-    if (lfd < 0) {
+    if (is_closing()) {
       KLOGI(TAG, "unix poll closed, quit");
       break;
     }
     // select timeout, this Poll not closed, continue
     if (r == 0)
       continue;
-    for (ifd = 0; ifd < max_fd; ++ifd) {
-      if (FD_ISSET(ifd, &rfds)) {
-        if (ifd == lfd) {
-          auto new_adap = do_accept(lfd);
-          if (new_adap == nullptr) {
-            KLOGE(TAG, "accept failed: %s", strerror(errno));
+    for (eit = events.begin(); eit != events.end(); ++eit) {
+      if (eit->fd == listen_fd) {
+        uint64_t tag = 0;
+        int new_fd = accept_socket(listen_fd, tag);
+        if (new_fd < 0) {
+          KLOGE(TAG, "accept failed: %s", strerror(errno));
+          continue;
+        }
+        if (workers.empty()) {
+          if (do_accept(new_fd, tag) == nullptr)
             continue;
-          }
-          KLOGI(TAG, "accept new connection %d",
-                static_pointer_cast<SocketAdapter>(new_adap)->socket());
         } else {
-          auto it = adapters.find(ifd);
-          if (it != adapters.end()) {
-            KLOGD(TAG, "read from fd %d", ifd);
-            if (!do_read(it->second)) {
-              KLOGD(TAG, "delete adapter %s",
-                  it->second->info ? it->second->info->name.c_str() : "");
-              delete_adapter(it->second);
-              adapters.erase(it);
-            }
+          workers[next_worker]->hand_over(new_fd, tag);
+          next_worker = (next_worker + 1) % workers.size();
+        }
+        KLOGI(TAG, "accept new connection %d", new_fd);
+      } else if (eit->fd == doorbell.fd()) {
+        take_over();
+      } else {
+        auto it = adapters.find(eit->fd);
+        if (it == adapters.end())
+          continue;
+        if (eit->events & SELECTOR_EV_WRITE) {
+          if (static_pointer_cast<SocketAdapter>(it->second)->flush() < 0) {
+            delete_adapter(it->second);
+            continue;
+          }
+          update_interest(it->second);
+        }
+        if (eit->events & SELECTOR_EV_READ) {
+          KLOGD(TAG, "read from fd %d", eit->fd);
+          if (!do_read(it->second)) {
+            KLOGD(TAG, "delete adapter %s",
+                it->second->info ? it->second->info->name.c_str() : "");
+            delete_adapter(it->second);
           }
         }
       }
@@ -177,30 +296,80 @@ void SocketPoll::run() {
   }
 
   // release resources
-  while (adapters.size() > 0) {
-    auto it = adapters.begin();
-    delete_adapter(it->second);
-    adapters.erase(it);
-  }
+  while (adapters.size() > 0)
+    delete_adapter(adapters.begin()->second);
   KLOGI(TAG, "unix poll: run thread quit");
 }
 
-shared_ptr<Adapter> SocketPoll::do_accept(int lfd) {
-  int new_fd = -1;
-  uint64_t tag = 0;
-
+int SocketPoll::accept_socket(int lfd, uint64_t &tag) {
   if (type == POLL_TYPE_TCP)
-    new_fd = tcp_accept(lfd, tag);
-  else
-    new_fd = unix_accept(lfd);
-  if (new_fd < 0)
+    return tcp_accept(lfd, tag);
+  return unix_accept(lfd);
+}
+
+shared_ptr<Adapter> SocketPoll::do_accept(int fd, uint64_t tag) {
+  auto adap = new_adapter(fd);
+  if (adap == nullptr) {
+    ::close(fd);
     return nullptr;
-  auto adap = new_adapter(new_fd);
+  }
   adap->tag = tag;
-  adapters.insert(make_pair(new_fd, adap));
+  adapters.insert(make_pair(fd, adap));
   return adap;
 }
 
+SocketPoll *SocketPoll::new_worker() {
+  if (type == POLL_TYPE_TCP)
+    return new SocketPoll(host, port);
+  return new SocketPoll(name);
+}
+
+void SocketPoll::hand_over(int fd, uint64_t tag) {
+  handover_mutex.lock();
+  bool ring = accepted_sockets.empty();
+  accepted_sockets.push_back({fd, tag});
+  handover_mutex.unlock();
+  if (ring)
+    doorbell.ring();
+}
+
+void SocketPoll::want_write(int fd) {
+  handover_mutex.lock();
+  bool ring = accepted_sockets.empty() && write_wants.empty();
+  write_wants.push_back(fd);
+  handover_mutex.unlock();
+  if (ring)
+    doorbell.ring();
+}
+
+void SocketPoll::take_over() {
+  AcceptedSocketList socks;
+  vector<int> fds;
+
+  doorbell.reset();
+  handover_mutex.lock();
+  socks.swap(accepted_sockets);
+  fds.swap(write_wants);
+  handover_mutex.unlock();
+  for (auto &s : socks) {
+    if (do_accept(s.fd, s.tag) == nullptr)
+      KLOGE(TAG, "add accepted socket %d failed", s.fd);
+  }
+  for (auto fd : fds) {
+    auto it = adapters.find(fd);
+    if (it != adapters.end())
+      update_interest(it->second);
+  }
+}
+
+void SocketPoll::update_interest(shared_ptr<Adapter> &adap) {
+  auto sadap = static_pointer_cast<SocketAdapter>(adap);
+  uint32_t events = SELECTOR_EV_READ;
+  if (sadap->poll_writable() && sadap->write_pending())
+    events |= SELECTOR_EV_WRITE;
+  selector->modify(sadap->socket(), events);
+}
+
 bool SocketPoll::init_unix_socket() {
 #ifdef __APPLE__
   int fd = socket(AF_UNIX, SOCK_STREAM, 0);
@@ -268,27 +437,60 @@ bool SocketPoll::init_tcp_socket() {
 }
 
 shared_ptr<Adapter> SocketPoll::new_adapter(int fd) {
-  shared_ptr<SocketAdapter> adap = make_shared<SocketAdapter>(
-      fd, max_msg_size, type == POLL_TYPE_TCP ? CAPS_FLAG_NET_BYTEORDER : 0,
-      type == POLL_TYPE_TCP ? TCP_SOCK_WRITE_TIMEOUT : UNIX_SOCK_WRITE_TIMEOUT);
-  if (fd >= max_fd)
-    max_fd = fd + 1;
-  FD_SET(fd, &all_fds);
+  if (!selector->add(fd))
+    return nullptr;
+  shared_ptr<SocketAdapter> adap;
+#ifdef HAVE_SHM
+  if (type == POLL_TYPE_UNIX)
+    adap = make_shared<ShmAdapter>(fd, max_msg_size, 0, wq_options);
+#endif
+  if (adap == nullptr)
+    adap = make_shared<SocketAdapter>(
+        fd, max_msg_size, type == POLL_TYPE_TCP ? CAPS_FLAG_NET_BYTEORDER : 0,
+        wq_options);
   return static_pointer_cast<Adapter>(adap);
 }
 
-void SocketPoll::delete_adapter(shared_ptr<Adapter> &adap) {
+void SocketPoll::delete_adapter(shared_ptr<Adapter> adap) {
   int fd = static_pointer_cast<SocketAdapter>(adap)->socket();
   adap->close();
-  FD_CLR(fd, &all_fds);
+#ifdef HAVE_SHM
+  if (type == POLL_TYPE_UNIX) {
+    auto shadap = static_pointer_cast<ShmAdapter>(adap);
+    if (shadap->doorbell_polled) {
+      selector->remove(shadap->doorbell_fd());
+      adapters.erase(shadap->doorbell_fd());
+    }
+  }
+#endif
+  selector->remove(fd);
+  adapters.erase(fd);
   ::close(fd);
+  on_adapter_deleted(adap);
   dispatcher->erase_adapter(adap);
 }
 
+void SocketPoll::poll_shm_doorbell(shared_ptr<Adapter> &adap) {
+#ifdef HAVE_SHM
+  auto shadap = static_pointer_cast<ShmAdapter>(adap);
+  int fd = shadap->doorbell_fd();
+  if (shadap->doorbell_polled || fd < 0)
+    return;
+  shadap->doorbell_polled = true;
+  if (!selector->add(fd)) {
+    adap->close();
+    return;
+  }
+  adapters.insert(make_pair(fd, adap));
+#endif
+}
+
 bool SocketPoll::do_read(shared_ptr<Adapter> &adap) {
   int32_t r = adap->read();
   if (r != SOCK_ADAPTER_SUCCESS)
     return false;
+  if (type == POLL_TYPE_UNIX)
+    poll_shm_doorbell(adap);
 
   Frame frame;
   while (true) {
@@ -308,9 +510,9 @@ bool SocketPoll::do_read(shared_ptr<Adapter> &adap) {
   return true;
 }
 
-int SocketPoll::get_listen_fd() {
+bool SocketPoll::is_closing() {
   lock_guard<mutex> locker(start_mutex);
-  return listen_fd;
+  return closing;
 }
 
 } // namespace internal
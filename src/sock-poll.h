@@ -1,20 +1,29 @@
 #pragma once
 
 #include "disp.h"
+#include "doorbell.h"
 #include "flora-svc.h"
+#include "selector.h"
+#include "shm-adap.h"
 #include "sock-adap.h"
 #include <condition_variable>
-#include <map>
 #include <memory>
 #include <mutex>
+#include <stdarg.h>
 #include <string>
-#include <sys/select.h>
 #include <thread>
+#include <unordered_map>
+#include <vector>
 
 namespace flora {
 namespace internal {
 
-typedef std::map<int, std::shared_ptr<Adapter>> AdapterMap;
+typedef std::unordered_map<int, std::shared_ptr<Adapter>> AdapterMap;
+typedef struct {
+  int fd;
+  uint64_t tag;
+} AcceptedSocket;
+typedef std::vector<AcceptedSocket> AcceptedSocketList;
 
 class SocketPoll : public flora::Poll {
 public:
@@ -28,38 +37,86 @@ public:
 
   void stop();
 
-  virtual void config(uint32_t opt, ...) {}
+  void config(uint32_t opt, ...);
 
 protected:
-  virtual int32_t do_poll(fd_set *rfds, int max_fd);
+  virtual void vconfig(uint32_t opt, va_list ap);
 
-  virtual std::shared_ptr<Adapter> do_accept(int lfd);
+  virtual int32_t do_poll(SelectorEventList &events);
+
+  // timeout: milliseconds, < 0 wait forever
+  int32_t wait_events(SelectorEventList &events, int32_t timeout);
+
+  // create adapter for accepted socket, in thread that reads the socket
+  virtual std::shared_ptr<Adapter> do_accept(int fd, uint64_t tag);
 
   virtual bool do_read(std::shared_ptr<Adapter> &adap);
 
+  // adapter closed and removed from poll, by read or write error or stop
+  virtual void on_adapter_deleted(std::shared_ptr<Adapter> &adap) {}
+
+  // create a reading thread poll of same type, see FLORA_POLL_OPT_THREADS
+  virtual SocketPoll *new_worker();
+
 private:
   void run();
 
+  int accept_socket(int lfd, uint64_t &tag);
+
+  bool start_workers();
+
+  int32_t start_worker(std::shared_ptr<Dispatcher> &disp);
+
+  // called by accept thread
+  void hand_over(int fd, uint64_t tag);
+
+  // called by thread writing adapters (dispatcher)
+  void want_write(int fd);
+
+  // handle doorbell: accepted sockets and write requests
+  void take_over();
+
+  void update_interest(std::shared_ptr<Adapter> &adap);
+
   bool init_unix_socket();
 
   bool init_tcp_socket();
 
-  int get_listen_fd();
+  bool is_closing();
 
   std::shared_ptr<Adapter> new_adapter(int fd);
 
-  void delete_adapter(std::shared_ptr<Adapter> &adap);
+  // close adapter and remove its fds from 'adapters'
+  void delete_adapter(std::shared_ptr<Adapter> adap);
+
+  // watch doorbell of adapter upgraded to shared memory
+  void poll_shm_doorbell(std::shared_ptr<Adapter> &adap);
 
 private:
   std::shared_ptr<Dispatcher> dispatcher;
   int listen_fd = -1;
-  int max_fd = 0;
-  fd_set all_fds;
+  bool closing = false;
+  std::unique_ptr<Selector> selector;
+#ifdef HAVE_EPOLL
+  uint32_t selector_type = FLORA_POLL_SELECTOR_EPOLL;
+#else
+  uint32_t selector_type = FLORA_POLL_SELECTOR_SELECT;
+#endif
   uint32_t max_msg_size = 0;
   std::thread run_thread;
   std::mutex start_mutex;
   std::condition_variable start_cond;
   AdapterMap adapters;
+  uint32_t threads = 1;
+  WriteQueueOptions wq_options;
+  std::vector<std::unique_ptr<SocketPoll>> workers;
+  uint32_t next_worker = 0;
+  Doorbell doorbell;
+  std::mutex handover_mutex;
+  // for worker: sockets accepted by accept thread
+  AcceptedSocketList accepted_sockets;
+  // fds of adapters has data to flush
+  std::vector<int> write_wants;
   uint32_t type;
   // for unix socket
   std::string name;
@@ -0,0 +1,146 @@
+#pragma once
+
+#include <atomic>
+#include <stdint.h>
+
+// buckets of call latency histogram
+// bucket 0: 0us, bucket i: [2^(i-1), 2^i) us, the last one: all longer
+#define STATS_LATENCY_BUCKETS 24
+// LatencyHistogram: each power of 2 range split into 2^HISTOGRAM_SUB_BITS
+// linear buckets, values error less than 1/8, up to 2^HISTOGRAM_MAX_BITS
+#define HISTOGRAM_SUB_BITS 3
+#define HISTOGRAM_MAX_BITS 36
+#define HISTOGRAM_BUCKETS                                                      \
+  ((HISTOGRAM_MAX_BITS - HISTOGRAM_SUB_BITS + 1) << HISTOGRAM_SUB_BITS)
+
+namespace flora {
+namespace internal {
+
+// always-on counters, updated by poll and dispatcher threads with relaxed
+// atomics, read by Dispatcher::stats without stopping them
+class AdapterStats {
+public:
+  std::atomic<uint64_t> frames_in{0};
+  std::atomic<uint64_t> bytes_in{0};
+  std::atomic<uint64_t> frames_out{0};
+  std::atomic<uint64_t> bytes_out{0};
+  // writes queued because socket not writable
+  std::atomic<uint64_t> write_stalls{0};
+  // messages dropped or connections closed by write queue limit
+  std::atomic<uint64_t> write_drops{0};
+  // bytes in outbound queue
+  std::atomic<uint32_t> queued_bytes{0};
+  // posts of latest-value subscriptions replaced by newer ones before written
+  std::atomic<uint64_t> conflated{0};
+};
+
+class TopicStats {
+public:
+  std::atomic<uint64_t> posts{0};
+  // post frames written to subscribers
+  std::atomic<uint64_t> fanout{0};
+  // bytes of post frames written to subscribers
+  std::atomic<uint64_t> bytes{0};
+  std::atomic<uint32_t> subscribers{0};
+};
+
+class CallStats {
+public:
+  CallStats() {
+    for (auto &b : buckets)
+      b.store(0, std::memory_order_relaxed);
+  }
+
+  // reply received 'us' microseconds after call forwarded
+  void record(uint64_t us) {
+    uint32_t i = us ? 64 - __builtin_clzll(us) : 0;
+    if (i >= STATS_LATENCY_BUCKETS)
+      i = STATS_LATENCY_BUCKETS - 1;
+    buckets[i].fetch_add(1, std::memory_order_relaxed);
+    replies.fetch_add(1, std::memory_order_relaxed);
+    total_us.fetch_add(us, std::memory_order_relaxed);
+  }
+
+public:
+  std::atomic<uint64_t> replies{0};
+  std::atomic<uint64_t> timeouts{0};
+  // sum of latency of replied calls
+  std::atomic<uint64_t> total_us{0};
+  std::atomic<uint64_t> buckets[STATS_LATENCY_BUCKETS];
+};
+
+// log-linear histogram like HdrHistogram, values in nanoseconds
+// recorded by one thread, read by others with relaxed atomics
+class LatencyHistogram {
+public:
+  LatencyHistogram() {
+    for (auto &b : buckets)
+      b.store(0, std::memory_order_relaxed);
+  }
+
+  void record(uint64_t v) {
+    buckets[index(v)].fetch_add(1, std::memory_order_relaxed);
+  }
+
+  uint64_t count() const {
+    uint64_t n = 0;
+    for (auto &b : buckets)
+      n += b.load(std::memory_order_relaxed);
+    return n;
+  }
+
+  // return: upper bound of bucket containing quantile 'q' (0 ~ 1),
+  //         0 if empty
+  uint64_t value_at(double q) const {
+    uint64_t total = count();
+    if (total == 0)
+      return 0;
+    uint64_t target = (uint64_t)(q * total);
+    if (target == 0)
+      target = 1;
+    uint64_t n = 0;
+    uint32_t i;
+    for (i = 0; i < HISTOGRAM_BUCKETS - 1; ++i) {
+      n += buckets[i].load(std::memory_order_relaxed);
+      if (n >= target)
+        break;
+    }
+    return upper_bound(i);
+  }
+
+private:
+  static uint32_t index(uint64_t v) {
+    if (v < (1 << HISTOGRAM_SUB_BITS))
+      return v;
+    uint32_t msb = 63 - __builtin_clzll(v);
+    if (msb >= HISTOGRAM_MAX_BITS)
+      return HISTOGRAM_BUCKETS - 1;
+    uint32_t shift = msb - HISTOGRAM_SUB_BITS;
+    return ((shift + 1) << HISTOGRAM_SUB_BITS) +
+           (v >> shift) - (1 << HISTOGRAM_SUB_BITS);
+  }
+
+  static uint64_t upper_bound(uint32_t i) {
+    if (i < (1 << HISTOGRAM_SUB_BITS))
+      return i;
+    uint32_t shift = (i >> HISTOGRAM_SUB_BITS) - 1;
+    uint64_t sub = (i & ((1 << HISTOGRAM_SUB_BITS) - 1)) +
+                   (1 << HISTOGRAM_SUB_BITS);
+    return ((sub + 1) << shift) - 1;
+  }
+
+private:
+  std::atomic<uint64_t> buckets[HISTOGRAM_BUCKETS];
+};
+
+// latency of traced posts, see FLORA_CLI_FLAG_TRACE
+class TopicTrace {
+public:
+  // FLORA_TRACE_SEND --> FLORA_TRACE_SVC_RECV
+  LatencyHistogram to_svc;
+  // FLORA_TRACE_SVC_RECV --> FLORA_TRACE_SVC_DISPATCH
+  LatencyHistogram in_svc;
+};
+
+} // namespace internal
+} // namespace flora
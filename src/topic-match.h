@@ -0,0 +1,58 @@
+#pragma once
+
+#include <string.h>
+
+namespace flora {
+namespace internal {
+
+// topic name levels separated by '.'
+// pattern level "*" matches exactly one level,
+// last level "#" matches zero or more levels (prefix)
+// "#" not at last level matches itself only
+#define TOPIC_LEVEL_SEPARATOR '.'
+
+class TopicMatcher {
+public:
+  static bool is_pattern(const char *name) {
+    const char *p = name;
+    while (true) {
+      const char *e = level_end(p);
+      if (e - p == 1 && (*p == '*' || (*p == '#' && *e == '\0')))
+        return true;
+      if (*e == '\0')
+        return false;
+      p = e + 1;
+    }
+  }
+
+  static bool match(const char *pattern, const char *name) {
+    while (true) {
+      const char *pe = level_end(pattern);
+      size_t plen = pe - pattern;
+      if (plen == 1 && *pattern == '#' && *pe == '\0')
+        return true;
+      const char *ne = level_end(name);
+      size_t nlen = ne - name;
+      if (!(plen == 1 && *pattern == '*') &&
+          (plen != nlen || memcmp(pattern, name, plen) != 0))
+        return false;
+      if (*ne == '\0') {
+        // "a.#" matches "a"
+        return *pe == '\0' || (pe[1] == '#' && pe[2] == '\0');
+      }
+      if (*pe == '\0')
+        return false;
+      pattern = pe + 1;
+      name = ne + 1;
+    }
+  }
+
+  static const char *level_end(const char *p) {
+    while (*p != '\0' && *p != TOPIC_LEVEL_SEPARATOR)
+      ++p;
+    return p;
+  }
+};
+
+} // namespace internal
+} // namespace flora
@@ -0,0 +1,319 @@
+#include "topic-table.h"
+#include "flora-cli.h"
+#include "topic-match.h"
+#include <tuple>
+
+using namespace std;
+
+namespace flora {
+namespace internal {
+
+// return: false if 'adapter' already in 'groups'
+static bool add_to_groups(SubscriberVector *groups,
+                          shared_ptr<Adapter> &adapter) {
+  auto &subs = groups[TOPIC_SUBSCRIBER_GROUP(adapter->serialize_flags)];
+  for (auto &sub : subs) {
+    if (sub.lock().get() == adapter.get())
+      return false;
+  }
+  subs.push_back(adapter);
+  return true;
+}
+
+// remove 'adapter' and expired subscribers from 'groups'
+static void remove_from_groups(SubscriberVector *groups, Adapter *adapter) {
+  uint32_t i;
+  size_t j;
+
+  for (i = 0; i < TOPIC_SUBSCRIBER_GROUPS; ++i) {
+    auto &subs = groups[i];
+    j = 0;
+    while (j < subs.size()) {
+      auto adap = subs[j].lock();
+      if (adap == nullptr || adap.get() == adapter) {
+        subs[j] = subs.back();
+        subs.pop_back();
+        continue;
+      }
+      ++j;
+    }
+  }
+}
+
+bool Topic::add_subscriber(shared_ptr<Adapter> &adapter) {
+  if (!add_to_groups(subscribers, adapter))
+    return false;
+  // adapter may be in 'pattern_subscribers'
+  pattern_gen = 0;
+  count_subscribers();
+  return true;
+}
+
+void Topic::remove_subscriber(Adapter *adapter) {
+  remove_from_groups(subscribers, adapter);
+  options.erase(adapter);
+  pattern_gen = 0;
+  count_subscribers();
+}
+
+void Topic::set_filter(Adapter *adapter, const SubscribeFilter &filter) {
+  if (filter.empty())
+    options.erase(adapter);
+  else
+    options[adapter].filter = filter;
+}
+
+void Topic::count_subscribers() {
+  uint32_t n = 0;
+  uint32_t i;
+  for (i = 0; i < TOPIC_SUBSCRIBER_GROUPS; ++i)
+    n += subscribers[i].size() + pattern_subscribers[i].size();
+  stats.subscribers.store(n, memory_order_relaxed);
+}
+
+void Topic::record_trace(const uint64_t *ts) {
+  TopicTrace *t = trace.load(memory_order_relaxed);
+  if (t == nullptr) {
+    t = new TopicTrace();
+    trace.store(t, memory_order_release);
+  }
+  // timestamps of other hosts not comparable
+  if (ts[FLORA_TRACE_SVC_RECV] >= ts[FLORA_TRACE_SEND])
+    t->to_svc.record(ts[FLORA_TRACE_SVC_RECV] - ts[FLORA_TRACE_SEND]);
+  t->in_svc.record(ts[FLORA_TRACE_SVC_DISPATCH] - ts[FLORA_TRACE_SVC_RECV]);
+}
+
+bool TopicPattern::add_subscriber(shared_ptr<Adapter> &adapter) {
+  return add_to_groups(subscribers, adapter);
+}
+
+void TopicPattern::remove_subscriber(Adapter *adapter) {
+  remove_from_groups(subscribers, adapter);
+}
+
+Topic *TopicTable::intern(const string &name) {
+  Topic *topic = find(name);
+  if (topic)
+    return topic;
+  lock_guard<mutex> locker(table_mutex);
+  auto r = topics.emplace(piecewise_construct, forward_as_tuple(name),
+                          forward_as_tuple());
+  topic = &r.first->second;
+  if (r.second) {
+    topic->id = ++idseq;
+    topic->name = &r.first->first;
+    topic_ids.emplace(topic->id, topic);
+  }
+  return topic;
+}
+
+Topic *TopicTable::find(const string &name) {
+  auto it = topics.find(name);
+  if (it == topics.end())
+    return nullptr;
+  return &it->second;
+}
+
+Topic *TopicTable::get(uint32_t id) {
+  auto it = topic_ids.find(id);
+  if (it == topic_ids.end())
+    return nullptr;
+  return it->second;
+}
+
+void TopicTable::release_if_empty(Topic *topic) {
+  if (!topic->empty())
+    return;
+  auto it = topics.find(*topic->name);
+  lock_guard<mutex> locker(table_mutex);
+  topic_ids.erase(topic->id);
+  topics.erase(it);
+}
+
+void TopicTable::clear() {
+  lock_guard<mutex> locker(table_mutex);
+  topic_ids.clear();
+  topics.clear();
+  pattern_root = PatternNode();
+  pattern_ids.clear();
+  patterns.clear();
+}
+
+void TopicTable::for_each(const function<void(Topic &)> &fn) {
+  lock_guard<mutex> locker(table_mutex);
+  for (auto &it : topics)
+    fn(it.second);
+}
+
+TopicPattern *TopicTable::intern_pattern(const string &name) {
+  auto r = patterns.emplace(piecewise_construct, forward_as_tuple(name),
+                            forward_as_tuple());
+  TopicPattern *pattern = &r.first->second;
+  if (!r.second)
+    return pattern;
+  pattern->id = ++pattern_idseq;
+  pattern->name = &r.first->first;
+  pattern_ids.emplace(pattern->id, pattern);
+
+  PatternNode *node = &pattern_root;
+  const char *p = name.c_str();
+  while (true) {
+    const char *e = TopicMatcher::level_end(p);
+    if (e - p == 1 && *p == '#' && *e == '\0') {
+      node->rest = pattern;
+      break;
+    }
+    unique_ptr<PatternNode> *child;
+    if (e - p == 1 && *p == '*')
+      child = &node->any;
+    else
+      child = &node->children[string(p, e - p)];
+    if (*child == nullptr)
+      child->reset(new PatternNode());
+    node = child->get();
+    if (*e == '\0') {
+      node->pattern = pattern;
+      break;
+    }
+    p = e + 1;
+  }
+  return pattern;
+}
+
+TopicPattern *TopicTable::find_pattern(const string &name) {
+  auto it = patterns.find(name);
+  if (it == patterns.end())
+    return nullptr;
+  return &it->second;
+}
+
+TopicPattern *TopicTable::get_pattern(uint32_t id) {
+  auto it = pattern_ids.find(id);
+  if (it == pattern_ids.end())
+    return nullptr;
+  return it->second;
+}
+
+// remove 'pattern' from subtree of 'node', prune empty nodes
+// return: true if 'node' empty
+static bool erase_pattern(PatternNode *node, const char *p) {
+  const char *e = TopicMatcher::level_end(p);
+  if (e - p == 1 && *p == '#' && *e == '\0') {
+    node->rest = nullptr;
+    return node->empty();
+  }
+  unique_ptr<PatternNode> *child;
+  if (e - p == 1 && *p == '*') {
+    child = &node->any;
+  } else {
+    auto it = node->children.find(string(p, e - p));
+    if (it == node->children.end())
+      return false;
+    child = &it->second;
+  }
+  if (*child == nullptr)
+    return false;
+  bool empty;
+  if (*e == '\0') {
+    (*child)->pattern = nullptr;
+    empty = (*child)->empty();
+  } else {
+    empty = erase_pattern(child->get(), e + 1);
+  }
+  if (empty) {
+    if (child == &node->any)
+      node->any.reset();
+    else
+      node->children.erase(string(p, e - p));
+  }
+  return node->empty();
+}
+
+void TopicTable::release_pattern_if_empty(TopicPattern *pattern) {
+  patterns_changed();
+  if (!pattern->empty())
+    return;
+  erase_pattern(&pattern_root, pattern->name->c_str());
+  pattern_ids.erase(pattern->id);
+  patterns.erase(*pattern->name);
+
+  // topics kept by removed pattern only
+  vector<Topic *> kept;
+  for (auto &it : topics) {
+    if (!it.second.pattern_subscribers[0].empty() ||
+        !it.second.pattern_subscribers[1].empty())
+      kept.push_back(&it.second);
+  }
+  for (auto topic : kept) {
+    match_patterns(topic);
+    release_if_empty(topic);
+  }
+}
+
+void TopicTable::patterns_changed() {
+  if (++pattern_gen == 0)
+    pattern_gen = 1;
+}
+
+Topic *TopicTable::find_or_match(const string &name) {
+  Topic *topic = find(name);
+  if (topic || patterns.empty())
+    return topic;
+  matched.clear();
+  collect_patterns(&pattern_root, name.c_str());
+  if (matched.empty())
+    return nullptr;
+  topic = intern(name);
+  match_patterns(topic);
+  return topic;
+}
+
+void TopicTable::match_patterns(Topic *topic) {
+  if (topic->pattern_gen == pattern_gen)
+    return;
+  topic->pattern_gen = pattern_gen;
+  uint32_t i;
+  for (i = 0; i < TOPIC_SUBSCRIBER_GROUPS; ++i)
+    topic->pattern_subscribers[i].clear();
+  if (!patterns.empty()) {
+    matched.clear();
+    collect_patterns(&pattern_root, topic->name->c_str());
+    for (i = 0; i < TOPIC_SUBSCRIBER_GROUPS; ++i) {
+      // adapter subscribed topic or multiple patterns receive post once
+      matched_adapters.clear();
+      for (auto &sub : topic->subscribers[i])
+        matched_adapters.insert(sub.lock().get());
+      for (auto pattern : matched) {
+        for (auto &sub : pattern->subscribers[i]) {
+          auto adap = sub.lock();
+          if (adap && matched_adapters.insert(adap.get()).second)
+            topic->pattern_subscribers[i].push_back(sub);
+        }
+      }
+    }
+  }
+  topic->count_subscribers();
+}
+
+void TopicTable::collect_patterns(PatternNode *node, const char *name) {
+  if (node->rest)
+    matched.push_back(node->rest);
+  if (name == nullptr) {
+    if (node->pattern)
+      matched.push_back(node->pattern);
+    return;
+  }
+  const char *e = TopicMatcher::level_end(name);
+  const char *next = *e == '\0' ? nullptr : e + 1;
+  if (!node->children.empty()) {
+    level.assign(name, e - name);
+    auto it = node->children.find(level);
+    if (it != node->children.end())
+      collect_patterns(it->second.get(), next);
+  }
+  if (node->any)
+    collect_patterns(node->any.get(), next);
+}
+
+} // namespace internal
+} // namespace flora
@@ -0,0 +1,195 @@
+#pragma once
+
+#include "adap.h"
+#include "flora-cli.h"
+#include "stats.h"
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace flora {
+namespace internal {
+
+typedef std::vector<std::weak_ptr<Adapter>> SubscriberVector;
+
+// subscribers of 'subscribers[i]' serialized with TOPIC_SERIALIZE_FLAGS(i)
+#define TOPIC_SUBSCRIBER_GROUPS 2
+#define TOPIC_SUBSCRIBER_GROUP(flags)                                          \
+  ((flags) == CAPS_FLAG_NET_BYTEORDER ? 1 : 0)
+#define TOPIC_SERIALIZE_FLAGS(group) ((group) ? CAPS_FLAG_NET_BYTEORDER : 0)
+
+// header of CMD_ALIAS_RAW_POST_RESP, same for posts of same sender and msgtype
+class PostHeaderCache {
+public:
+  uint32_t sender = 0;
+  uint32_t type = 0;
+  std::vector<int8_t> frame;
+};
+
+// options and delivery state of a subscriber subscribed with SubscribeFilter
+class SubscriberOptions {
+public:
+  SubscribeFilter filter;
+  // posts before this time held, see SubscribeFilter::min_interval
+  std::chrono::steady_clock::time_point next_write;
+  // a post held until 'next_write', see Dispatcher::held_posts
+  bool held = false;
+};
+
+class Topic {
+public:
+  uint32_t id = 0;
+  const std::string *name = nullptr;
+  // partitioned by serialize flags of adapters
+  SubscriberVector subscribers[TOPIC_SUBSCRIBER_GROUPS];
+  // options of 'subscribers' subscribed with SubscribeFilter
+  std::unordered_map<Adapter *, SubscriberOptions> options;
+  // number of adapters bound alias id to this topic, see CMD_ALIAS_REQ
+  uint32_t alias_refs = 0;
+  // header of last post, indexed by subscriber group
+  PostHeaderCache alias_headers[TOPIC_SUBSCRIBER_GROUPS];
+  // subscribers of patterns matching this topic and not in 'subscribers',
+  // valid if 'pattern_gen' equals that of TopicTable, see match_patterns
+  SubscriberVector pattern_subscribers[TOPIC_SUBSCRIBER_GROUPS];
+  uint32_t pattern_gen = 0;
+  TopicStats stats;
+  // created by the first traced post, read by Dispatcher::stats
+  std::atomic<TopicTrace *> trace{nullptr};
+
+  ~Topic() { delete trace.load(std::memory_order_relaxed); }
+
+  bool empty() const {
+    return subscribers[0].empty() && subscribers[1].empty() &&
+           pattern_subscribers[0].empty() && pattern_subscribers[1].empty() &&
+           alias_refs == 0;
+  }
+
+  // return: false if already subscribed
+  bool add_subscriber(std::shared_ptr<Adapter> &adapter);
+
+  // remove 'adapter' and expired subscribers
+  void remove_subscriber(Adapter *adapter);
+
+  // replace filter of subscriber 'adapter', remove if empty
+  void set_filter(Adapter *adapter, const SubscribeFilter &filter);
+
+  // update 'stats.subscribers' after 'subscribers' changed
+  void count_subscribers();
+
+  // record timestamps FLORA_TRACE_SEND ~ FLORA_TRACE_SVC_DISPATCH of a post
+  void record_trace(const uint64_t *ts);
+};
+
+// subscribers of a topic pattern, see TopicMatcher
+class TopicPattern {
+public:
+  uint32_t id = 0;
+  const std::string *name = nullptr;
+  SubscriberVector subscribers[TOPIC_SUBSCRIBER_GROUPS];
+
+  bool empty() const {
+    return subscribers[0].empty() && subscribers[1].empty();
+  }
+
+  // return: false if already subscribed
+  bool add_subscriber(std::shared_ptr<Adapter> &adapter);
+
+  // remove 'adapter' and expired subscribers
+  void remove_subscriber(Adapter *adapter);
+};
+
+// trie of patterns, one level per node
+class PatternNode {
+public:
+  std::unordered_map<std::string, std::unique_ptr<PatternNode>> children;
+  // child of level "*"
+  std::unique_ptr<PatternNode> any;
+  // pattern ends at this node
+  TopicPattern *pattern = nullptr;
+  // pattern ends with level "#" after this node
+  TopicPattern *rest = nullptr;
+
+  bool empty() const {
+    return children.empty() && any == nullptr && pattern == nullptr &&
+           rest == nullptr;
+  }
+};
+
+// topic names interned to integer ids
+// id of a name never reused by other names
+// modified by dispatcher thread only, 'for_each' may be invoked by others
+class TopicTable {
+public:
+  // return: topic of 'name', create if not existed
+  Topic *intern(const std::string &name);
+
+  // return: nullptr if not existed
+  Topic *find(const std::string &name);
+
+  // return: nullptr if not existed
+  Topic *get(uint32_t id);
+
+  // release topic if no subscriber and alias
+  void release_if_empty(Topic *topic);
+
+  void clear();
+
+  // 'fn' invoked with topics locked, should not modify the table
+  void for_each(const std::function<void(Topic &)> &fn);
+
+  // return: pattern of 'name', create if not existed
+  TopicPattern *intern_pattern(const std::string &name);
+
+  // return: nullptr if not existed
+  TopicPattern *find_pattern(const std::string &name);
+
+  // return: nullptr if not existed
+  TopicPattern *get_pattern(uint32_t id);
+
+  // release pattern if no subscriber, and topics kept by it only
+  void release_pattern_if_empty(TopicPattern *pattern);
+
+  // invalidate 'pattern_subscribers' of all topics
+  // invoked after subscribers of any pattern changed
+  void patterns_changed();
+
+  // return: topic of 'name', created if matched by any pattern,
+  //         nullptr if neither existed nor matched
+  Topic *find_or_match(const std::string &name);
+
+  // rebuild 'topic->pattern_subscribers' if patterns changed since last
+  void match_patterns(Topic *topic);
+
+private:
+  // append patterns matching levels 'name' to 'matched'
+  // name: remaining levels of topic name, nullptr if no level left
+  void collect_patterns(PatternNode *node, const char *name);
+
+private:
+  // held while inserting, erasing or 'for_each'
+  std::mutex table_mutex;
+  std::unordered_map<std::string, Topic> topics;
+  std::unordered_map<uint32_t, Topic *> topic_ids;
+  uint32_t idseq = 0;
+  // accessed by dispatcher thread only
+  std::unordered_map<std::string, TopicPattern> patterns;
+  std::unordered_map<uint32_t, TopicPattern *> pattern_ids;
+  PatternNode pattern_root;
+  uint32_t pattern_idseq = 0;
+  // 0 never used, see Topic::pattern_gen
+  uint32_t pattern_gen = 1;
+  // temporary of collect_patterns and match_patterns
+  std::vector<TopicPattern *> matched;
+  std::string level;
+  std::unordered_set<Adapter *> matched_adapters;
+};
+
+} // namespace internal
+} // namespace flora
@@ -0,0 +1,225 @@
+#include <unistd.h>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "gtest/gtest.h"
+#include "fake-svc.h"
+#include "flora-agent.h"
+#include "raw-cli.h"
+#include "svc.h"
+
+using namespace std;
+using namespace flora;
+using namespace flora::internal;
+
+#define ALIAS_TEST_SOCK "unix:/tmp/flora-test-alias.sock"
+// subscribers of network byte order
+#define ALIAS_TEST_TCP "tcp://127.0.0.1:37814/"
+#define ALIAS_FAKE_PATH "/tmp/flora-test-alias-fake.sock"
+#define ALIAS_FAKE_SOCK "unix:" ALIAS_FAKE_PATH
+
+namespace {
+
+// 'cli' subscribed 'name' by RawClient
+void subscribeRaw(RawClient& cli, const char* uri, const char* name,
+                  const char* id) {
+  ASSERT_TRUE(cli.connect(uri));
+  ASSERT_TRUE(cli.auth(id));
+  int8_t buf[256];
+  int32_t c = RequestSerializer::serialize_subscribe(name, buf, sizeof(buf),
+                                                     cli.flags);
+  ASSERT_GT(c, 0);
+  ASSERT_TRUE(cli.send(buf, c));
+  ASSERT_TRUE(cli.sync());
+}
+
+// topic alias id of CMD_ALIAS_RESP received by 'cli'
+// return: 0 if not received
+uint32_t recvTopicAlias(RawClient& cli, const char* name) {
+  auto resp = cli.recv(CMD_ALIAS_RESP);
+  uint32_t kind;
+  uint32_t id;
+  string alias;
+  if (resp == nullptr ||
+      ResponseParser::parse_alias(resp, kind, id, alias) != 0 ||
+      kind != ALIAS_KIND_TOPIC || alias != name)
+    return 0;
+  return id;
+}
+
+void postValue(Agent& pub, const char* name, int32_t v) {
+  auto msg = Caps::new_instance();
+  msg->write(v);
+  EXPECT_EQ(pub.post(name, msg), FLORA_CLI_SUCCESS);
+}
+
+} // namespace
+
+// posts by alias of publishers on both byte orders received by
+// subscribers on both byte orders
+TEST(AliasTest, byteOrders) {
+  LocalService svc{{ALIAS_TEST_SOCK, ALIAS_TEST_TCP}};
+  Agent unixSub;
+  Agent tcpSub;
+  RecvValues unixRecvs;
+  RecvValues tcpRecvs;
+  unixSub.config(FLORA_AGENT_CONFIG_URI, ALIAS_TEST_SOCK "#alias-unix-sub");
+  subscribeValues(unixSub, "alias.order", unixRecvs);
+  unixSub.start();
+  roundTrip(unixSub);
+  tcpSub.config(FLORA_AGENT_CONFIG_URI, ALIAS_TEST_TCP "#alias-tcp-sub");
+  subscribeValues(tcpSub, "alias.order", tcpRecvs);
+  tcpSub.start();
+  roundTrip(tcpSub);
+  RawClient rawSub;
+  subscribeRaw(rawSub, ALIAS_TEST_TCP, "alias.order", "alias-raw-sub");
+
+  Agent unixPub;
+  Agent tcpPub;
+  unixPub.config(FLORA_AGENT_CONFIG_URI, ALIAS_TEST_SOCK "#alias-unix-pub");
+  unixPub.start();
+  EXPECT_EQ(unixPub.alias("alias.order"), FLORA_CLI_SUCCESS);
+  tcpPub.config(FLORA_AGENT_CONFIG_URI, ALIAS_TEST_TCP "#alias-tcp-pub");
+  tcpPub.start();
+  EXPECT_EQ(tcpPub.alias("alias.order"), FLORA_CLI_SUCCESS);
+  postValue(unixPub, "alias.order", 1);
+  roundTrip(unixPub);
+  postValue(tcpPub, "alias.order", 2);
+  roundTrip(tcpPub);
+
+  vector<int32_t> expected{1, 2};
+  EXPECT_TRUE(waitFor([&]() {
+    return unixRecvs.size() >= 2 && tcpRecvs.size() >= 2;
+  }));
+  EXPECT_EQ(unixRecvs.get(), expected);
+  EXPECT_EQ(tcpRecvs.get(), expected);
+  // forwarded by alias, topic alias sent once before the first post
+  EXPECT_NE(recvTopicAlias(rawSub, "alias.order"), 0);
+  EXPECT_TRUE(rawSub.recvPost());
+  EXPECT_EQ(rawSub.lastCmd, CMD_ALIAS_RAW_POST_RESP);
+  EXPECT_TRUE(rawSub.recvPost());
+  EXPECT_EQ(rawSub.lastCmd, CMD_ALIAS_RAW_POST_RESP);
+  unixPub.close();
+  tcpPub.close();
+  unixSub.close();
+  tcpSub.close();
+}
+
+// service writes CMD_ALIAS_RESP again after CMD_UNKNOWN_ALIAS_REQ
+TEST(AliasTest, resendUnknownAlias) {
+  LocalService svc{{ALIAS_TEST_SOCK}};
+  RawClient rawSub;
+  subscribeRaw(rawSub, ALIAS_TEST_SOCK, "alias.resend", "alias-resend-sub");
+  Agent pub;
+  pub.config(FLORA_AGENT_CONFIG_URI, ALIAS_TEST_SOCK "#alias-resend-pub");
+  pub.start();
+
+  postValue(pub, "alias.resend", 1);
+  uint32_t id = recvTopicAlias(rawSub, "alias.resend");
+  ASSERT_NE(id, 0);
+  EXPECT_TRUE(rawSub.recvPost());
+  int8_t buf[64];
+  int32_t c = RequestSerializer::serialize_unknown_alias(
+      ALIAS_KIND_TOPIC, id, buf, sizeof(buf), rawSub.flags);
+  ASSERT_GT(c, 0);
+  ASSERT_TRUE(rawSub.send(buf, c));
+  ASSERT_TRUE(rawSub.sync());
+  postValue(pub, "alias.resend", 2);
+  EXPECT_EQ(recvTopicAlias(rawSub, "alias.resend"), id);
+  EXPECT_TRUE(rawSub.recvPost());
+  pub.close();
+}
+
+// post of unknown topic alias dropped by client, CMD_UNKNOWN_ALIAS_REQ
+// sent once, posts received after CMD_ALIAS_RESP
+TEST(AliasTest, askUnknownAlias) {
+  FakeService fake{ALIAS_FAKE_PATH};
+  ASSERT_TRUE(fake.listen());
+  Agent sub;
+  RecvValues recvs;
+  sub.config(FLORA_AGENT_CONFIG_URI, ALIAS_FAKE_SOCK "#alias-ask-sub");
+  subscribeValues(sub, "alias.ask", recvs);
+  thread starter([&sub]() { sub.start(); });
+  ASSERT_TRUE(fake.accept());
+  starter.join();
+  ASSERT_NE(fake.recv(CMD_SUBSCRIBE_REQ), nullptr);
+
+  int8_t buf[256];
+  int32_t c;
+  int32_t i;
+  shared_ptr<Caps> args;
+  for (i = 1; i <= 2; ++i) {
+    args = Caps::new_instance();
+    args->write(i);
+    c = ResponseSerializer::serialize_alias_post(7, FLORA_MSGTYPE_INSTANT,
+                                                 args, 0, 0, buf,
+                                                 sizeof(buf), 0);
+    ASSERT_GT(c, 0);
+    ASSERT_TRUE(fake.send(buf, c));
+  }
+  auto req = fake.recv(CMD_UNKNOWN_ALIAS_REQ);
+  ASSERT_NE(req, nullptr);
+  uint32_t kind;
+  uint32_t id;
+  ASSERT_EQ(RequestParser::parse_unknown_alias(req, kind, id), 0);
+  EXPECT_EQ(kind, ALIAS_KIND_TOPIC);
+  EXPECT_EQ(id, 7);
+
+  c = ResponseSerializer::serialize_alias(ALIAS_KIND_TOPIC, 7, "alias.ask",
+                                          buf, sizeof(buf), 0);
+  ASSERT_GT(c, 0);
+  ASSERT_TRUE(fake.send(buf, c));
+  args = Caps::new_instance();
+  args->write(3);
+  c = ResponseSerializer::serialize_alias_post(7, FLORA_MSGTYPE_INSTANT, args,
+                                               0, 0, buf, sizeof(buf), 0);
+  ASSERT_GT(c, 0);
+  ASSERT_TRUE(fake.send(buf, c));
+  EXPECT_TRUE(waitFor([&recvs]() { return recvs.size() >= 1; }));
+  usleep(100000);
+  EXPECT_EQ(recvs.get(), vector<int32_t>{3});
+  // asked once for both dropped posts
+  EXPECT_EQ(fake.recv(CMD_UNKNOWN_ALIAS_REQ, 200), nullptr);
+  sub.close();
+}
+
+// alias table of service is per connection, registered again by Agent
+// after reconnected
+TEST(AliasTest, reconnect) {
+  FakeService fake{ALIAS_FAKE_PATH};
+  ASSERT_TRUE(fake.listen());
+  Agent pub;
+  pub.config(FLORA_AGENT_CONFIG_URI, ALIAS_FAKE_SOCK "#alias-reconn-pub");
+  pub.config(FLORA_AGENT_CONFIG_RECONN_INTERVAL, 100);
+  thread starter([&pub]() { pub.start(); });
+  ASSERT_TRUE(fake.accept());
+  starter.join();
+  EXPECT_EQ(pub.alias("alias.reconn"), FLORA_CLI_SUCCESS);
+  string name;
+  uint32_t id;
+  auto req = fake.recv(CMD_ALIAS_REQ);
+  ASSERT_NE(req, nullptr);
+  ASSERT_EQ(RequestParser::parse_alias(req, name, id), 0);
+  EXPECT_EQ(name, "alias.reconn");
+
+  fake.closeClient();
+  ASSERT_TRUE(fake.accept());
+  req = fake.recv(CMD_ALIAS_REQ);
+  ASSERT_NE(req, nullptr);
+  ASSERT_EQ(RequestParser::parse_alias(req, name, id), 0);
+  EXPECT_EQ(name, "alias.reconn");
+  // posted by the alias registered again, once new client ready
+  auto msg = Caps::new_instance();
+  msg->write(1);
+  EXPECT_TRUE(waitFor([&pub, &msg]() {
+    return pub.post("alias.reconn", msg) == FLORA_CLI_SUCCESS;
+  }));
+  req = fake.recv(CMD_ALIAS_RAW_POST_REQ);
+  ASSERT_NE(req, nullptr);
+  uint32_t alias;
+  uint32_t msgtype;
+  ASSERT_EQ(RequestParser::parse_alias_raw_post(req, alias, msgtype), 0);
+  EXPECT_EQ(alias, id);
+  pub.close();
+}
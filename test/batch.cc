@@ -0,0 +1,199 @@
+#include <unistd.h>
+#include <string>
+#include <vector>
+#include "gtest/gtest.h"
+#include "flora-agent.h"
+#include "raw-cli.h"
+#include "svc.h"
+
+using namespace std;
+using namespace flora;
+using namespace flora::internal;
+
+namespace {
+
+shared_ptr<Caps> newMsg(int32_t v, uint32_t padding) {
+  auto msg = Caps::new_instance();
+  msg->write(v);
+  msg->write(string(padding, 'b'));
+  return msg;
+}
+
+void expectInOrder(RecvValues& recvs, int32_t count) {
+  auto values = recvs.get();
+  ASSERT_EQ(values.size(), count);
+  int32_t i;
+  for (i = 0; i < count; ++i)
+    EXPECT_EQ(values[i], i);
+}
+
+// frames of CMD_POST_REQ appended to 'frames'
+void appendPost(RawClient& cli, const char* name, int32_t v,
+                vector<int8_t>& frames) {
+  int8_t buf[256];
+  auto msg = newMsg(v, 0);
+  int32_t c = RequestSerializer::serialize_post(
+      name, FLORA_MSGTYPE_INSTANT, msg, buf, sizeof(buf), cli.flags);
+  ASSERT_GT(c, 0);
+  frames.insert(frames.end(), buf, buf + c);
+}
+
+// return: bytes of CMD_BATCH_REQ wrapping 'frames'
+vector<int8_t> wrapBatch(RawClient& cli, const vector<int8_t>& frames) {
+  vector<int8_t> buf(frames.size() + BATCH_FRAME_OVERHEAD);
+  int32_t c = RequestSerializer::serialize_batch(
+      frames.data(), frames.size(), buf.data(), buf.size(), cli.flags);
+  buf.resize(c > 0 ? c : 0);
+  return buf;
+}
+
+} // namespace
+
+TEST(BatchTest, flushBySize) {
+  Agent sub;
+  Agent pub;
+  RecvValues recvs;
+  string uri = Service::floraUri;
+  sub.config(FLORA_AGENT_CONFIG_URI, (uri + "#batch-size-sub").c_str());
+  subscribeValues(sub, "batch.size", recvs);
+  sub.start();
+  roundTrip(sub);
+  pub.config(FLORA_AGENT_CONFIG_URI, (uri + "#batch-size-pub").c_str());
+  pub.config(FLORA_AGENT_CONFIG_BATCH, 2048, 60000);
+  pub.start();
+
+  auto msg = newMsg(0, 1200);
+  EXPECT_EQ(pub.post("batch.size", msg), FLORA_CLI_SUCCESS);
+  usleep(300000);
+  EXPECT_EQ(recvs.size(), 0);
+  // batched posts over 2048 bytes, flushed without waiting interval
+  msg = newMsg(1, 1200);
+  EXPECT_EQ(pub.post("batch.size", msg), FLORA_CLI_SUCCESS);
+  EXPECT_TRUE(waitFor([&recvs]() { return recvs.size() >= 2; }));
+  expectInOrder(recvs, 2);
+  pub.close();
+  sub.close();
+}
+
+TEST(BatchTest, flushByInterval) {
+  Agent sub;
+  Agent pub;
+  RecvValues recvs;
+  string uri = Service::floraUri;
+  sub.config(FLORA_AGENT_CONFIG_URI, (uri + "#batch-interval-sub").c_str());
+  subscribeValues(sub, "batch.interval", recvs);
+  sub.start();
+  roundTrip(sub);
+  pub.config(FLORA_AGENT_CONFIG_URI, (uri + "#batch-interval-pub").c_str());
+  pub.config(FLORA_AGENT_CONFIG_BATCH, 16384, 500);
+  pub.start();
+
+  int32_t i;
+  for (i = 0; i < 3; ++i) {
+    auto msg = newMsg(i, 0);
+    EXPECT_EQ(pub.post("batch.interval", msg), FLORA_CLI_SUCCESS);
+  }
+  usleep(200000);
+  EXPECT_EQ(recvs.size(), 0);
+  EXPECT_TRUE(waitFor([&recvs]() { return recvs.size() >= 3; }, 2000));
+  expectInOrder(recvs, 3);
+  pub.close();
+  sub.close();
+}
+
+// CMD_BATCH_REQ larger than max msg size of service not sent,
+// batched frames sent one by one instead
+TEST(BatchTest, fallbackOversized) {
+  Agent sub;
+  Agent pub;
+  RecvValues recvs;
+  string uri = Service::floraUri;
+  sub.config(FLORA_AGENT_CONFIG_URI, (uri + "#batch-large-sub").c_str());
+  subscribeValues(sub, "batch.large", recvs);
+  sub.start();
+  roundTrip(sub);
+  pub.config(FLORA_AGENT_CONFIG_URI, (uri + "#batch-large-pub").c_str());
+  pub.config(FLORA_AGENT_CONFIG_BUFSIZE, 256 * 1024);
+  pub.config(FLORA_AGENT_CONFIG_BATCH, 200 * 1024, 60000);
+  pub.start();
+
+  int32_t i;
+  for (i = 0; i < 60; ++i) {
+    auto msg = newMsg(i, 4096);
+    EXPECT_EQ(pub.post("batch.large", msg), FLORA_CLI_SUCCESS);
+  }
+  EXPECT_EQ(pub.flush(), FLORA_CLI_SUCCESS);
+  EXPECT_TRUE(waitFor([&recvs]() { return recvs.size() >= 60; }));
+  expectInOrder(recvs, 60);
+  // connection not closed by service
+  auto msg = newMsg(60, 0);
+  EXPECT_EQ(pub.post("batch.large", msg), FLORA_CLI_SUCCESS);
+  EXPECT_EQ(pub.flush(), FLORA_CLI_SUCCESS);
+  EXPECT_TRUE(waitFor([&recvs]() { return recvs.size() >= 61; }));
+  pub.close();
+  sub.close();
+}
+
+TEST(BatchTest, rawBatch) {
+  Agent sub;
+  RecvValues recvs;
+  string uri = Service::floraUri;
+  sub.config(FLORA_AGENT_CONFIG_URI, (uri + "#batch-raw-sub").c_str());
+  subscribeValues(sub, "batch.raw", recvs);
+  sub.start();
+  roundTrip(sub);
+
+  RawClient cli;
+  ASSERT_TRUE(cli.connect(uri));
+  ASSERT_TRUE(cli.auth("batch-raw-pub"));
+  vector<int8_t> frames;
+  appendPost(cli, "batch.raw", 0, frames);
+  appendPost(cli, "batch.raw", 1, frames);
+  auto batch = wrapBatch(cli, frames);
+  ASSERT_FALSE(batch.empty());
+  ASSERT_TRUE(cli.send(batch.data(), batch.size()));
+  EXPECT_TRUE(waitFor([&recvs]() { return recvs.size() >= 2; }));
+  expectInOrder(recvs, 2);
+  sub.close();
+}
+
+// CMD_BATCH_REQ and CMD_AUTH_REQ never packed in CMD_BATCH_REQ
+TEST(BatchTest, rejectNested) {
+  Agent sub;
+  RecvValues recvs;
+  string uri = Service::floraUri;
+  sub.config(FLORA_AGENT_CONFIG_URI, (uri + "#batch-nested-sub").c_str());
+  subscribeValues(sub, "batch.nested", recvs);
+  sub.start();
+  roundTrip(sub);
+
+  RawClient cli;
+  ASSERT_TRUE(cli.connect(uri));
+  ASSERT_TRUE(cli.auth("batch-nested-pub"));
+  vector<int8_t> frames;
+  appendPost(cli, "batch.nested", 0, frames);
+  auto batch = wrapBatch(cli, wrapBatch(cli, frames));
+  ASSERT_FALSE(batch.empty());
+  ASSERT_TRUE(cli.send(batch.data(), batch.size()));
+  EXPECT_TRUE(cli.waitClosed());
+  usleep(100000);
+  EXPECT_EQ(recvs.size(), 0);
+  sub.close();
+}
+
+TEST(BatchTest, rejectAuth) {
+  string uri = Service::floraUri;
+  RawClient cli;
+  ASSERT_TRUE(cli.connect(uri));
+  ASSERT_TRUE(cli.auth("batch-auth-pub"));
+  int8_t buf[256];
+  int32_t c = RequestSerializer::serialize_auth(
+      FLORA_VERSION, "batch-auth-pub2", getpid(), 0, buf, sizeof(buf),
+      cli.flags);
+  ASSERT_GT(c, 0);
+  vector<int8_t> frames(buf, buf + c);
+  auto batch = wrapBatch(cli, frames);
+  ASSERT_FALSE(batch.empty());
+  ASSERT_TRUE(cli.send(batch.data(), batch.size()));
+  EXPECT_TRUE(cli.waitClosed());
+}
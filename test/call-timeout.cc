@@ -0,0 +1,220 @@
+#include <unistd.h>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "gtest/gtest.h"
+#include "fake-svc.h"
+#include "flora-agent.h"
+#include "svc.h"
+
+using namespace std;
+using namespace std::chrono;
+using namespace flora;
+using namespace flora::internal;
+
+#define TIMEOUT_TEST_SOCK "unix:/tmp/flora-test-timeout.sock"
+#define TIMEOUT_FAKE_PATH "/tmp/flora-test-timeout-fake.sock"
+#define TIMEOUT_FAKE_SOCK "unix:" TIMEOUT_FAKE_PATH
+// milliseconds, timeout of calls in tests
+#define TEST_CALL_TIMEOUT 100
+// milliseconds, allowed delay of callbacks after deadline
+#define TEST_CALLBACK_DELAY 200
+
+namespace {
+
+// result codes and elapsed milliseconds of async call callbacks
+class CallResults {
+public:
+  CallResults() : start(steady_clock::now()) {}
+
+  function<void(int32_t, Response&)> callback() {
+    return [this](int32_t code, Response& resp) {
+      lock_guard<mutex> locker(resMutex);
+      codes.push_back(code);
+      elapsed.push_back(
+          duration_cast<milliseconds>(steady_clock::now() - start).count());
+    };
+  }
+
+  vector<int32_t> getCodes() {
+    lock_guard<mutex> locker(resMutex);
+    return codes;
+  }
+
+  int64_t getElapsed(size_t i) {
+    lock_guard<mutex> locker(resMutex);
+    return i < elapsed.size() ? elapsed[i] : -1;
+  }
+
+  size_t size() { return getCodes().size(); }
+
+  // wait until 'ms' milliseconds after call
+  void sleepUntil(int64_t ms) {
+    this_thread::sleep_until(start + milliseconds(ms));
+  }
+
+private:
+  steady_clock::time_point start;
+  mutex resMutex;
+  vector<int32_t> codes;
+  vector<int64_t> elapsed;
+};
+
+// 'agent' connected to 'fake'
+void connectFake(FakeService& fake, Agent& agent, const char* uri) {
+  agent.config(FLORA_AGENT_CONFIG_URI, uri);
+  thread starter([&agent]() { agent.start(); });
+  EXPECT_TRUE(fake.accept());
+  starter.join();
+}
+
+// id of CMD_CALL_REQ received by 'fake'
+// return: 0 if not received
+int32_t recvCallId(FakeService& fake) {
+  auto req = fake.recv(CMD_CALL_REQ);
+  const char* name;
+  shared_ptr<Caps> args;
+  const char* target;
+  int32_t id;
+  uint32_t timeout;
+  if (req == nullptr ||
+      RequestParser::parse_call(req, name, args, target, id, timeout) != 0)
+    return 0;
+  return id;
+}
+
+} // namespace
+
+// service never replies, call completed by client deadline once,
+// late reply ignored
+TEST(CallTimeoutTest, silentService) {
+  FakeService fake{TIMEOUT_FAKE_PATH};
+  ASSERT_TRUE(fake.listen());
+  Agent caller;
+  connectFake(fake, caller, TIMEOUT_FAKE_SOCK "#timeout-silent-caller");
+
+  auto msg = Caps::new_instance();
+  CallResults results;
+  ASSERT_EQ(caller.call("timeout.silent", msg, "timeout-callee",
+                        results.callback(), TEST_CALL_TIMEOUT),
+            FLORA_CLI_SUCCESS);
+  int32_t id = recvCallId(fake);
+  ASSERT_NE(id, 0);
+  EXPECT_TRUE(waitFor([&results]() { return results.size() >= 1; }));
+  EXPECT_GE(results.getElapsed(0),
+            TEST_CALL_TIMEOUT + CALL_TIMEOUT_TRANSFER_COST);
+  EXPECT_LT(results.getElapsed(0), TEST_CALL_TIMEOUT +
+                                       CALL_TIMEOUT_TRANSFER_COST +
+                                       TEST_CALLBACK_DELAY);
+
+  Response resp;
+  resp.ret_code = 0;
+  int8_t buf[256];
+  int32_t c = ResponseSerializer::serialize_reply(id, FLORA_CLI_SUCCESS,
+                                                  &resp, 0, buf,
+                                                  sizeof(buf), 0);
+  ASSERT_GT(c, 0);
+  ASSERT_TRUE(fake.send(buf, c));
+  usleep(TEST_CALLBACK_DELAY * 1000);
+  EXPECT_EQ(results.getCodes(), vector<int32_t>{FLORA_CLI_ETIMEOUT});
+  caller.close();
+}
+
+// sync call of timeout 0 waits DEFAULT_CALL_TIMEOUT plus transfer cost
+TEST(CallTimeoutTest, syncDefaultTimeout) {
+  FakeService fake{TIMEOUT_FAKE_PATH};
+  ASSERT_TRUE(fake.listen());
+  Agent caller;
+  connectFake(fake, caller, TIMEOUT_FAKE_SOCK "#timeout-sync-caller");
+
+  auto msg = Caps::new_instance();
+  Response resp;
+  auto start = steady_clock::now();
+  EXPECT_EQ(caller.call("timeout.sync", msg, "timeout-callee", resp),
+            FLORA_CLI_ETIMEOUT);
+  auto elapsed =
+      duration_cast<milliseconds>(steady_clock::now() - start).count();
+  EXPECT_GE(elapsed, DEFAULT_CALL_TIMEOUT + CALL_TIMEOUT_TRANSFER_COST);
+  EXPECT_LT(elapsed, DEFAULT_CALL_TIMEOUT + CALL_TIMEOUT_TRANSFER_COST +
+                         TEST_CALLBACK_DELAY);
+  caller.close();
+}
+
+// callee holds reply, ETIMEOUT of dispatcher received before client
+// deadline, client deadline and late reply add no callback
+TEST(CallTimeoutTest, heldReply) {
+  LocalService svc{TIMEOUT_TEST_SOCK};
+  Agent callee;
+  Agent caller;
+  mutex replyMutex;
+  vector<shared_ptr<Reply>> replies;
+  callee.config(FLORA_AGENT_CONFIG_URI, TIMEOUT_TEST_SOCK "#timeout-callee");
+  callee.declare_method("timeout.held",
+      [&replyMutex, &replies](const char* name, shared_ptr<Caps>& msg,
+                              shared_ptr<Reply>& reply) {
+        lock_guard<mutex> locker(replyMutex);
+        replies.push_back(reply);
+      });
+  callee.start();
+  roundTrip(callee);
+  caller.config(FLORA_AGENT_CONFIG_URI, TIMEOUT_TEST_SOCK "#timeout-caller");
+  caller.start();
+
+  auto msg = Caps::new_instance();
+  CallResults results;
+  ASSERT_EQ(caller.call("timeout.held", msg, "timeout-callee",
+                        results.callback(), TEST_CALL_TIMEOUT),
+            FLORA_CLI_SUCCESS);
+  EXPECT_TRUE(waitFor([&results]() { return results.size() >= 1; }));
+  EXPECT_LT(results.getElapsed(0),
+            TEST_CALL_TIMEOUT + CALL_TIMEOUT_TRANSFER_COST);
+  results.sleepUntil(TEST_CALL_TIMEOUT + CALL_TIMEOUT_TRANSFER_COST +
+                     TEST_CALLBACK_DELAY);
+  replyMutex.lock();
+  EXPECT_EQ(replies.size(), 1);
+  for (auto& reply : replies)
+    reply->end(0);
+  replies.clear();
+  replyMutex.unlock();
+  usleep(TEST_CALLBACK_DELAY * 1000);
+  EXPECT_EQ(results.getCodes(), vector<int32_t>{FLORA_CLI_ETIMEOUT});
+  caller.close();
+  callee.close();
+}
+
+// reply received in time, timeout of client deadline suppressed
+TEST(CallTimeoutTest, replyInTime) {
+  LocalService svc{TIMEOUT_TEST_SOCK};
+  Agent callee;
+  Agent caller;
+  callee.config(FLORA_AGENT_CONFIG_URI, TIMEOUT_TEST_SOCK "#timeout-callee");
+  callee.declare_method("timeout.reply",
+      [](const char* name, shared_ptr<Caps>& msg, shared_ptr<Reply>& reply) {
+        reply->end(7);
+      });
+  callee.start();
+  roundTrip(callee);
+  caller.config(FLORA_AGENT_CONFIG_URI, TIMEOUT_TEST_SOCK "#timeout-caller");
+  caller.start();
+
+  auto msg = Caps::new_instance();
+  CallResults results;
+  int32_t retCode{-1};
+  auto cb = results.callback();
+  ASSERT_EQ(caller.call("timeout.reply", msg, "timeout-callee",
+                        [cb, &retCode](int32_t code, Response& resp) {
+                          retCode = resp.ret_code;
+                          cb(code, resp);
+                        },
+                        TEST_CALL_TIMEOUT),
+            FLORA_CLI_SUCCESS);
+  EXPECT_TRUE(waitFor([&results]() { return results.size() >= 1; }));
+  results.sleepUntil(TEST_CALL_TIMEOUT + CALL_TIMEOUT_TRANSFER_COST +
+                     TEST_CALLBACK_DELAY);
+  EXPECT_EQ(results.getCodes(), vector<int32_t>{FLORA_CLI_SUCCESS});
+  EXPECT_EQ(retCode, 7);
+  caller.close();
+  callee.close();
+}
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <poll.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <memory>
+#include <string>
+#include <vector>
+#include "caps.h"
+#include "defs.h"
+#include "ser-helper.h"
+
+// service side of one client connection at a time, frames written by test
+// for replies flora::Dispatcher never sends, or never sends late
+class FakeService {
+public:
+  // 'path': unix socket path, clients connect to "unix:" + path
+  FakeService(const char* path) : path(path) {}
+
+  ~FakeService() {
+    closeClient();
+    if (listenFd >= 0) {
+      ::close(listenFd);
+      unlink(path.c_str());
+    }
+  }
+
+  bool listen() {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path.c_str());
+    unlink(path.c_str());
+    listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    return listenFd >= 0 &&
+           ::bind(listenFd, (struct sockaddr*)&addr, sizeof(addr)) == 0 &&
+           ::listen(listenFd, 4) == 0;
+  }
+
+  // accept next client and reply its CMD_AUTH_REQ
+  // 'version': protocol version of service told to client
+  bool accept(uint32_t version = FLORA_VERSION) {
+    closeClient();
+    if (!readable(listenFd, 3000))
+      return false;
+    clientFd = ::accept(listenFd, nullptr, nullptr);
+    if (clientFd < 0 || recv(CMD_AUTH_REQ) == nullptr)
+      return false;
+    int8_t buf[64];
+    int32_t c = flora::internal::ResponseSerializer::serialize_auth(
+        FLORA_CLI_SUCCESS, version, 64 * 1024, buf, sizeof(buf), 0);
+    return c > 0 && send(buf, c);
+  }
+
+  void closeClient() {
+    if (clientFd >= 0)
+      ::close(clientFd);
+    clientFd = -1;
+    data.clear();
+  }
+
+  bool send(const void* buf, uint32_t size) {
+    return ::send(clientFd, buf, size, MSG_NOSIGNAL) == (ssize_t)size;
+  }
+
+  // next frame of 'cmd' with cmd read, frames of other cmds skipped
+  // return: nullptr if no frame in 'timeout' milliseconds, or closed
+  std::shared_ptr<Caps> recv(int32_t cmd, int timeout = 3000) {
+    while (true) {
+      uint32_t version;
+      uint32_t length;
+      if (data.size() >= 8 &&
+          Caps::binary_info(data.data(), &version, &length) == CAPS_SUCCESS &&
+          data.size() >= length) {
+        std::shared_ptr<Caps> caps;
+        int32_t c = -1;
+        if (Caps::parse(data.data(), length, caps) != CAPS_SUCCESS ||
+            caps->read(c) != CAPS_SUCCESS)
+          caps.reset();
+        data.erase(data.begin(), data.begin() + length);
+        if (caps == nullptr || c == cmd)
+          return caps;
+        continue;
+      }
+      int8_t buf[4096];
+      if (!readable(clientFd, timeout))
+        return nullptr;
+      ssize_t r = ::recv(clientFd, buf, sizeof(buf), 0);
+      if (r <= 0)
+        return nullptr;
+      data.insert(data.end(), buf, buf + r);
+    }
+  }
+
+private:
+  static bool readable(int fd, int timeout) {
+    struct pollfd pfd;
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+    return poll(&pfd, 1, timeout) == 1;
+  }
+
+private:
+  std::string path;
+  int listenFd = -1;
+  int clientFd = -1;
+  std::vector<int8_t> data;
+};
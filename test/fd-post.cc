@@ -0,0 +1,166 @@
+#include "defs.h"
+
+#ifdef HAVE_SHM
+#include <sys/mman.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+#include "gtest/gtest.h"
+#include "flora-agent.h"
+#include "memfd.h"
+#include "raw-cli.h"
+#include "svc.h"
+
+using namespace std;
+using namespace flora;
+using namespace flora::internal;
+
+#define FD_TEST_SOCK "unix:/tmp/flora-test-fd.sock"
+
+namespace {
+
+shared_ptr<Caps> newMsg(int32_t v, uint32_t padding) {
+  auto msg = Caps::new_instance();
+  msg->write(v);
+  msg->write(string(padding, 'f'));
+  return msg;
+}
+
+// memfd of 'fdSize' bytes, serialized 'msg' at beginning
+// return: -1 if failed
+int newMemfd(shared_ptr<Caps>& msg, uint32_t fdSize, uint32_t memfdFlags,
+             uint32_t seals, uint32_t serFlags) {
+  int fd = memfd_open("flora-test", memfdFlags);
+  if (fd < 0)
+    return -1;
+  vector<int8_t> data(msg->serialize(nullptr, 0, serFlags));
+  msg->serialize(data.data(), data.size(), serFlags);
+  if (ftruncate(fd, fdSize) < 0 ||
+      write(fd, data.data(), min<size_t>(data.size(), fdSize)) < 0 ||
+      (seals && fcntl(fd, F_ADD_SEALS, seals) < 0)) {
+    ::close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+// CMD_FD_POST_REQ of 'msg' in memfd created by 'memfdFlags',
+// memfd size 'fdSize', 0 for serialized size of 'msg'
+void sendFdPost(RawClient& cli, const char* name, shared_ptr<Caps>& msg,
+                uint32_t fdSize, uint32_t memfdFlags, uint32_t seals) {
+  uint32_t argsSize = msg->serialize(nullptr, 0, cli.flags);
+  int fd = newMemfd(msg, fdSize ? fdSize : argsSize, memfdFlags, seals,
+                    cli.flags);
+  ASSERT_GE(fd, 0);
+  int8_t buf[256];
+  int32_t c = RequestSerializer::serialize_fd_post(
+      name, FLORA_MSGTYPE_INSTANT, argsSize, buf, sizeof(buf), cli.flags);
+  ASSERT_GT(c, 0);
+  EXPECT_TRUE(cli.sendFd(buf, c, fd));
+  ::close(fd);
+}
+
+} // namespace
+
+// post not less than FD_POST_THRESHOLD sent by memfd,
+// whether or not it fits in buffer of publisher
+TEST(FdPostTest, agentPost) {
+  LocalService svc{{FD_TEST_SOCK}};
+  Agent sub;
+  Agent pub;
+  RecvValues recvs;
+  const uint32_t sizes[] = {16, FD_POST_THRESHOLD * 2, FD_POST_THRESHOLD * 8};
+  sub.config(FLORA_AGENT_CONFIG_URI, FD_TEST_SOCK "#fd-sub");
+  sub.subscribe("fd.agent",
+      [&recvs, &sizes](const char* name, shared_ptr<Caps>& msg,
+                       uint32_t type) {
+        int32_t v{-1};
+        string s;
+        EXPECT_EQ(msg->read(v), CAPS_SUCCESS);
+        EXPECT_EQ(msg->read(s), CAPS_SUCCESS);
+        ASSERT_TRUE(v >= 0 && v < 3);
+        EXPECT_EQ(s.length(), sizes[v]);
+        recvs.add(v);
+      });
+  sub.start();
+  roundTrip(sub);
+  pub.config(FLORA_AGENT_CONFIG_URI, FD_TEST_SOCK "#fd-pub");
+  pub.config(FLORA_AGENT_CONFIG_BUFSIZE, FD_POST_THRESHOLD * 4);
+  pub.start();
+
+  int32_t i;
+  for (i = 0; i < 3; ++i) {
+    auto msg = newMsg(i, sizes[i]);
+    EXPECT_EQ(pub.post("fd.agent", msg), FLORA_CLI_SUCCESS);
+  }
+  EXPECT_TRUE(waitFor([&recvs]() { return recvs.size() >= 3; }));
+  EXPECT_EQ(recvs.get(), (vector<int32_t>{0, 1, 2}));
+  pub.close();
+  sub.close();
+}
+
+TEST(FdPostTest, sealedMemfd) {
+  LocalService svc{{FD_TEST_SOCK}};
+  Agent sub;
+  RecvValues recvs;
+  sub.config(FLORA_AGENT_CONFIG_URI, FD_TEST_SOCK "#fd-sealed-sub");
+  subscribeValues(sub, "fd.sealed", recvs);
+  sub.start();
+  roundTrip(sub);
+
+  RawClient cli;
+  ASSERT_TRUE(cli.connect(FD_TEST_SOCK));
+  ASSERT_TRUE(cli.auth("fd-sealed-pub"));
+  auto msg = newMsg(1, 64);
+  sendFdPost(cli, "fd.sealed", msg, 0, MFD_CLOEXEC | MFD_ALLOW_SEALING,
+             FD_POST_SEALS);
+  EXPECT_TRUE(waitFor([&recvs]() { return recvs.size() >= 1; }));
+  auto values = recvs.get();
+  ASSERT_EQ(values.size(), 1);
+  EXPECT_EQ(values[0], 1);
+  sub.close();
+}
+
+// memfd could be modified after checked by service
+TEST(FdPostTest, unsealedMemfd) {
+  LocalService svc{{FD_TEST_SOCK}};
+  Agent sub;
+  RecvValues recvs;
+  sub.config(FLORA_AGENT_CONFIG_URI, FD_TEST_SOCK "#fd-unsealed-sub");
+  subscribeValues(sub, "fd.unsealed", recvs);
+  sub.start();
+  roundTrip(sub);
+
+  RawClient cli;
+  ASSERT_TRUE(cli.connect(FD_TEST_SOCK));
+  ASSERT_TRUE(cli.auth("fd-unsealed-pub"));
+  auto msg = newMsg(1, 64);
+  sendFdPost(cli, "fd.unsealed", msg, 0, MFD_CLOEXEC, 0);
+  EXPECT_TRUE(cli.waitClosed());
+  usleep(100000);
+  EXPECT_EQ(recvs.size(), 0);
+  sub.close();
+}
+
+// memfd smaller than args size in header
+TEST(FdPostTest, undersizedMemfd) {
+  LocalService svc{{FD_TEST_SOCK}};
+  Agent sub;
+  RecvValues recvs;
+  sub.config(FLORA_AGENT_CONFIG_URI, FD_TEST_SOCK "#fd-small-sub");
+  subscribeValues(sub, "fd.small", recvs);
+  sub.start();
+  roundTrip(sub);
+
+  RawClient cli;
+  ASSERT_TRUE(cli.connect(FD_TEST_SOCK));
+  ASSERT_TRUE(cli.auth("fd-small-pub"));
+  auto msg = newMsg(1, 64);
+  sendFdPost(cli, "fd.small", msg, 16, MFD_CLOEXEC | MFD_ALLOW_SEALING,
+             FD_POST_SEALS);
+  EXPECT_TRUE(cli.waitClosed());
+  usleep(100000);
+  EXPECT_EQ(recvs.size(), 0);
+  sub.close();
+}
+#endif // HAVE_SHM
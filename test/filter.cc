@@ -0,0 +1,281 @@
+#include <unistd.h>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "gtest/gtest.h"
+#include "fake-svc.h"
+#include "flora-agent.h"
+#include "raw-cli.h"
+#include "svc.h"
+
+using namespace std;
+using namespace flora;
+using namespace flora::internal;
+
+#define FILTER_TEST_SOCK "unix:/tmp/flora-test-filter.sock"
+#define FILTER_FAKE_PATH "/tmp/flora-test-filter-fake.sock"
+#define FILTER_FAKE_SOCK "unix:" FILTER_FAKE_PATH
+
+namespace {
+
+// first field of each post is its id
+void postAll(Agent& pub, const char* name) {
+  vector<shared_ptr<Caps>> msgs;
+  int32_t i;
+  for (i = 0; i < 7; ++i) {
+    msgs.push_back(Caps::new_instance());
+    msgs.back()->write(i);
+  }
+  // matched
+  msgs[0]->write(3);
+  msgs[0]->write(1);
+  msgs[0]->write("temperature");
+  // int field not equal
+  msgs[1]->write(4);
+  msgs[1]->write(1);
+  msgs[1]->write("temperature");
+  // string field prefix not matched
+  msgs[2]->write(3);
+  msgs[2]->write(1);
+  msgs[2]->write("humidity");
+  // string field missing
+  msgs[3]->write(3);
+  msgs[3]->write(1);
+  // matched, int64 field, any type of field 2
+  msgs[4]->write((int64_t)3);
+  msgs[4]->write("x");
+  msgs[4]->write("temp");
+  // string field of other type
+  msgs[5]->write(3);
+  msgs[5]->write(1);
+  msgs[5]->write(2);
+  // matched, last one
+  msgs[6]->write(3);
+  msgs[6]->write(0);
+  msgs[6]->write("temp.c");
+  for (auto& msg : msgs)
+    EXPECT_EQ(pub.post(name, msg), FLORA_CLI_SUCCESS);
+}
+
+const vector<int32_t> matchedIds{0, 4, 6};
+const uint32_t postCount = 7;
+
+void subscribeFiltered(Agent& agent, const char* name, RecvValues& recvs) {
+  SubscribeFilter filter;
+  filter.any().equals(3).any().prefix("temp");
+  agent.subscribe(name, filter,
+      [&recvs](const char* name, shared_ptr<Caps>& msg, uint32_t type) {
+        int32_t id{-1};
+        EXPECT_EQ(msg->read(id), CAPS_SUCCESS);
+        recvs.add(id);
+      });
+}
+
+void postValue(Agent& pub, const char* name, int32_t v) {
+  auto msg = Caps::new_instance();
+  msg->write(v);
+  EXPECT_EQ(pub.post(name, msg), FLORA_CLI_SUCCESS);
+}
+
+// return: whether 'agent' connected in 3 seconds
+bool waitConnected(Agent& agent) {
+  return waitFor([&agent]() {
+    auto msg = Caps::new_instance();
+    Response resp;
+    return agent.call("flora.test.sync", msg, "flora.test.nobody", resp,
+                      100) != FLORA_CLI_ECONN;
+  });
+}
+
+} // namespace
+
+TEST(FilterTest, matchedOnly) {
+  Agent sub;
+  Agent pub;
+  RecvValues recvs;
+  string uri = Service::floraUri;
+  sub.config(FLORA_AGENT_CONFIG_URI, (uri + "#filter-sub").c_str());
+  subscribeFiltered(sub, "filter.temp", recvs);
+  sub.start();
+  roundTrip(sub);
+  pub.config(FLORA_AGENT_CONFIG_URI, (uri + "#filter-pub").c_str());
+  pub.start();
+
+  postAll(pub, "filter.temp");
+  // last post matched, posts before it all dispatched when received
+  EXPECT_TRUE(waitFor(
+      [&recvs]() { return recvs.size() >= matchedIds.size(); }));
+  usleep(100000);
+  EXPECT_EQ(recvs.get(), matchedIds);
+  pub.close();
+  sub.close();
+}
+
+// client of version before FLORA_VERSION_FILTER subscribes without
+// filter, receives all posts whatever filters of other subscribers
+TEST(FilterTest, oldClient) {
+  Agent sub;
+  Agent pub;
+  RecvValues recvs;
+  string uri = Service::floraUri;
+  sub.config(FLORA_AGENT_CONFIG_URI, (uri + "#filter-new-sub").c_str());
+  subscribeFiltered(sub, "filter.old", recvs);
+  sub.start();
+  roundTrip(sub);
+
+  RawClient cli;
+  ASSERT_TRUE(cli.connect(uri));
+  ASSERT_TRUE(cli.auth("filter-old-sub", FLORA_VERSION_FILTER - 1));
+  int8_t buf[256];
+  int32_t c = RequestSerializer::serialize_subscribe("filter.old", buf,
+                                                     sizeof(buf), cli.flags);
+  ASSERT_GT(c, 0);
+  ASSERT_TRUE(cli.send(buf, c));
+  ASSERT_TRUE(cli.sync());
+
+  pub.config(FLORA_AGENT_CONFIG_URI, (uri + "#filter-old-pub").c_str());
+  pub.start();
+  postAll(pub, "filter.old");
+  uint32_t posts = 0;
+  while (posts < postCount && cli.recvPost())
+    ++posts;
+  EXPECT_EQ(posts, postCount);
+  EXPECT_TRUE(waitFor(
+      [&recvs]() { return recvs.size() >= matchedIds.size(); }));
+  EXPECT_EQ(recvs.get(), matchedIds);
+  pub.close();
+  sub.close();
+}
+
+// filters never valid rejected before connected, not subscribed
+TEST(FilterTest, invalidFilter) {
+  Agent sub;
+  Agent pub;
+  RecvValues recvs;
+  atomic<bool> rejectedCalled{false};
+  PostHandler rejected = [&rejectedCalled](const char* name,
+                                           shared_ptr<Caps>& msg,
+                                           uint32_t type) {
+    rejectedCalled = true;
+  };
+  SubscribeFilter filter;
+  filter.equals(1);
+  EXPECT_EQ(sub.subscribe("filter.invalid.*", filter, rejected),
+            FLORA_CLI_EINVAL);
+  SubscribeFilter tooMany;
+  uint32_t i;
+  for (i = 0; i <= FLORA_FILTER_MAX_FIELDS; ++i)
+    tooMany.equals(1);
+  EXPECT_EQ(sub.subscribe("filter.invalid.many", tooMany, rejected),
+            FLORA_CLI_EINVAL);
+  string uri = Service::floraUri;
+  sub.config(FLORA_AGENT_CONFIG_URI, (uri + "#filter-invalid-sub").c_str());
+  subscribeValues(sub, "filter.invalid.many", recvs);
+  sub.start();
+  roundTrip(sub);
+  EXPECT_EQ(sub.subscribe("filter.invalid.*", filter, rejected),
+            FLORA_CLI_EINVAL);
+  pub.config(FLORA_AGENT_CONFIG_URI, (uri + "#filter-invalid-pub").c_str());
+  pub.start();
+
+  postValue(pub, "filter.invalid.many", 1);
+  postValue(pub, "filter.invalid.many", 2);
+  EXPECT_TRUE(waitFor([&recvs]() { return recvs.size() >= 2; }));
+  EXPECT_EQ(recvs.get(), (vector<int32_t>{1, 2}));
+  EXPECT_FALSE(rejectedCalled);
+  pub.close();
+  sub.close();
+}
+
+// filter rejected by client for service version, handler not registered
+TEST(FilterTest, oldService) {
+  FakeService fake{FILTER_FAKE_PATH};
+  ASSERT_TRUE(fake.listen());
+  Agent sub;
+  RecvValues recvs;
+  atomic<bool> rejectedCalled{false};
+  sub.config(FLORA_AGENT_CONFIG_URI, FILTER_FAKE_SOCK "#filter-old-svc-sub");
+  thread starter([&sub]() { sub.start(); });
+  ASSERT_TRUE(fake.accept(FLORA_VERSION_FILTER - 1));
+  starter.join();
+
+  SubscribeFilter filter;
+  filter.equals(1);
+  EXPECT_EQ(sub.subscribe("filter.old.svc", filter,
+                [&rejectedCalled](const char* name, shared_ptr<Caps>& msg,
+                                  uint32_t type) { rejectedCalled = true; }),
+            FLORA_CLI_EINVAL);
+  EXPECT_EQ(fake.recv(CMD_SUBSCRIBE_REQ, 200), nullptr);
+  subscribeValues(sub, "filter.old.svc", recvs);
+  ASSERT_NE(fake.recv(CMD_SUBSCRIBE_REQ), nullptr);
+
+  auto args = Caps::new_instance();
+  args->write(5);
+  int8_t buf[256];
+  int32_t c = ResponseSerializer::serialize_post(
+      "filter.old.svc", FLORA_MSGTYPE_INSTANT, args, 0, "", buf, sizeof(buf),
+      0);
+  ASSERT_GT(c, 0);
+  ASSERT_TRUE(fake.send(buf, c));
+  EXPECT_TRUE(waitFor([&recvs]() { return recvs.size() >= 1; }));
+  EXPECT_EQ(recvs.get(), vector<int32_t>{5});
+  EXPECT_FALSE(rejectedCalled);
+  sub.close();
+}
+
+// filter of subscribed name replaced, handler kept, replaced filter used
+// after reconnected
+TEST(FilterTest, replaceFilter) {
+  unique_ptr<LocalService> svc(new LocalService{FILTER_TEST_SOCK});
+  Agent sub;
+  Agent pub;
+  RecvValues recvs;
+  atomic<bool> replacingCalled{false};
+  sub.config(FLORA_AGENT_CONFIG_URI, FILTER_TEST_SOCK "#filter-replace-sub");
+  sub.config(FLORA_AGENT_CONFIG_RECONN_INTERVAL, 100);
+  SubscribeFilter filter;
+  filter.equals(1);
+  EXPECT_EQ(sub.subscribe("filter.replace", filter,
+                [&recvs](const char* name, shared_ptr<Caps>& msg,
+                         uint32_t type) {
+                  int32_t v{-1};
+                  EXPECT_EQ(msg->read(v), CAPS_SUCCESS);
+                  recvs.add(v);
+                }),
+            FLORA_CLI_SUCCESS);
+  sub.start();
+  roundTrip(sub);
+  pub.config(FLORA_AGENT_CONFIG_URI, FILTER_TEST_SOCK "#filter-replace-pub");
+  pub.config(FLORA_AGENT_CONFIG_RECONN_INTERVAL, 100);
+  pub.start();
+  postValue(pub, "filter.replace", 1);
+  postValue(pub, "filter.replace", 2);
+  EXPECT_TRUE(waitFor([&recvs]() { return recvs.size() >= 1; }));
+
+  SubscribeFilter replaced;
+  replaced.equals(2);
+  EXPECT_EQ(sub.subscribe("filter.replace", replaced,
+                [&replacingCalled](const char* name, shared_ptr<Caps>& msg,
+                                   uint32_t type) { replacingCalled = true; }),
+            FLORA_CLI_SUCCESS);
+  roundTrip(sub);
+  postValue(pub, "filter.replace", 1);
+  postValue(pub, "filter.replace", 2);
+  EXPECT_TRUE(waitFor([&recvs]() { return recvs.size() >= 2; }));
+
+  // subscribed again by Agent with filter saved
+  svc.reset();
+  svc.reset(new LocalService{FILTER_TEST_SOCK});
+  ASSERT_TRUE(waitConnected(sub));
+  ASSERT_TRUE(waitConnected(pub));
+  postValue(pub, "filter.replace", 1);
+  postValue(pub, "filter.replace", 2);
+  EXPECT_TRUE(waitFor([&recvs]() { return recvs.size() >= 3; }));
+  usleep(100000);
+  EXPECT_EQ(recvs.get(), (vector<int32_t>{1, 2, 2}));
+  EXPECT_FALSE(replacingCalled);
+  pub.close();
+  sub.close();
+}
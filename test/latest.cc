@@ -0,0 +1,181 @@
+#include <unistd.h>
+#include <atomic>
+#include <string>
+#include <vector>
+#include "gtest/gtest.h"
+#include "flora-agent.h"
+#include "svc.h"
+
+using namespace std;
+using namespace flora;
+
+#define LATEST_TEST_SOCK "unix:/tmp/flora-test-latest.sock"
+#define LATEST_TEST_TCP "tcp://127.0.0.1:37813/"
+
+namespace {
+
+void postValues(Agent& pub, const char* name, int32_t count,
+                uint32_t padding) {
+  int32_t i;
+  for (i = 0; i < count; ++i) {
+    auto msg = Caps::new_instance();
+    msg->write(i);
+    msg->write(string(padding, 'l'));
+    EXPECT_EQ(pub.post(name, msg), FLORA_CLI_SUCCESS);
+  }
+}
+
+void expectIncreasing(const vector<int32_t>& values) {
+  size_t i;
+  for (i = 1; i < values.size(); ++i)
+    EXPECT_LT(values[i - 1], values[i]);
+}
+
+} // namespace
+
+// posts in interval held by service, the last one sent when interval ends
+TEST(LatestTest, maxRate) {
+  Agent sub;
+  Agent ctl;
+  Agent pub;
+  RecvValues recvs;
+  RecvValues ctlRecvs;
+  string uri = Service::floraUri;
+  sub.config(FLORA_AGENT_CONFIG_URI, (uri + "#latest-rate-sub").c_str());
+  SubscribeFilter filter;
+  filter.max_rate(5);
+  sub.subscribe("latest.rate", filter,
+      [&recvs](const char* name, shared_ptr<Caps>& msg, uint32_t type) {
+        int32_t v{-1};
+        EXPECT_EQ(msg->read(v), CAPS_SUCCESS);
+        recvs.add(v);
+      });
+  sub.start();
+  roundTrip(sub);
+  ctl.config(FLORA_AGENT_CONFIG_URI, (uri + "#latest-rate-ctl").c_str());
+  subscribeValues(ctl, "latest.rate", ctlRecvs);
+  ctl.start();
+  roundTrip(ctl);
+  pub.config(FLORA_AGENT_CONFIG_URI, (uri + "#latest-rate-pub").c_str());
+  pub.start();
+
+  postValues(pub, "latest.rate", 50, 0);
+  EXPECT_TRUE(waitFor([&ctlRecvs]() { return ctlRecvs.size() >= 50; }));
+  // held one sent in 200ms after the last forwarded one
+  EXPECT_TRUE(waitFor(
+      [&recvs]() {
+        auto values = recvs.get();
+        return !values.empty() && values.back() == 49;
+      },
+      1000));
+  auto values = recvs.get();
+  EXPECT_LT(values.size(), 10);
+  expectIncreasing(values);
+  pub.close();
+  ctl.close();
+  sub.close();
+}
+
+// frames queued for a slow subscriber replaced by newer ones
+TEST(LatestTest, replaceQueued) {
+  // all posts queued for ctl if it reads slower than pub writes
+  LocalService svc{{LATEST_TEST_SOCK},
+                   {{FLORA_POLL_OPT_WRITE_QUEUE_LIMIT, 4 * 1024 * 1024}}};
+  Agent sub;
+  Agent ctl;
+  Agent pub;
+  RecvValues recvs;
+  RecvValues ctlRecvs;
+  atomic<bool> blocked{true};
+  sub.config(FLORA_AGENT_CONFIG_URI, LATEST_TEST_SOCK "#latest-sub");
+  SubscribeFilter filter;
+  filter.latest();
+  sub.subscribe("latest.queue", filter,
+      [&recvs, &blocked](const char* name, shared_ptr<Caps>& msg,
+                         uint32_t type) {
+        int32_t v{-1};
+        EXPECT_EQ(msg->read(v), CAPS_SUCCESS);
+        recvs.add(v);
+        // socket of subscriber not read, frames queued by service
+        while (blocked)
+          usleep(10000);
+      });
+  sub.start();
+  roundTrip(sub);
+  ctl.config(FLORA_AGENT_CONFIG_URI, LATEST_TEST_SOCK "#latest-ctl");
+  subscribeValues(ctl, "latest.queue", ctlRecvs);
+  ctl.start();
+  roundTrip(ctl);
+  pub.config(FLORA_AGENT_CONFIG_URI, LATEST_TEST_SOCK "#latest-pub");
+  pub.start();
+
+  postValues(pub, "latest.queue", 200, 16 * 1024);
+  EXPECT_TRUE(waitFor([&ctlRecvs]() { return ctlRecvs.size() >= 200; }));
+  blocked = false;
+  EXPECT_TRUE(waitFor([&recvs]() {
+    auto values = recvs.get();
+    return !values.empty() && values.back() == 199;
+  }));
+  auto values = recvs.get();
+  EXPECT_LT(values.size(), 200);
+  expectIncreasing(values);
+  pub.close();
+  ctl.close();
+  sub.close();
+}
+
+// newer frame not admitted by FLORA_POLL_WQ_DROP_NEWEST, older one of
+// same subscription kept
+TEST(LatestTest, replaceRejected) {
+  LocalService svc{{LATEST_TEST_SOCK, LATEST_TEST_TCP},
+                   {{FLORA_POLL_OPT_WRITE_QUEUE_LIMIT, 200 * 1024},
+                    {FLORA_POLL_OPT_WRITE_QUEUE_POLICY,
+                     FLORA_POLL_WQ_DROP_NEWEST}},
+                   256 * 1024};
+  Agent sub;
+  Agent pub;
+  RecvValues recvs;
+  atomic<bool> blocked{true};
+  atomic<bool> entered{false};
+  sub.config(FLORA_AGENT_CONFIG_URI, LATEST_TEST_SOCK "#latest-full-sub");
+  sub.config(FLORA_AGENT_CONFIG_BUFSIZE, 256 * 1024);
+  sub.subscribe("latest.fill",
+      [&blocked, &entered](const char* name, shared_ptr<Caps>& msg,
+                           uint32_t type) {
+        entered = true;
+        while (blocked)
+          usleep(10000);
+      });
+  SubscribeFilter filter;
+  filter.latest();
+  sub.subscribe("latest.full", filter,
+      [&recvs](const char* name, shared_ptr<Caps>& msg, uint32_t type) {
+        int32_t v{-1};
+        EXPECT_EQ(msg->read(v), CAPS_SUCCESS);
+        recvs.add(v);
+      });
+  sub.start();
+  roundTrip(sub);
+  // no memfd, large post forwarded as one frame
+  pub.config(FLORA_AGENT_CONFIG_URI, LATEST_TEST_TCP "#latest-full-pub");
+  pub.config(FLORA_AGENT_CONFIG_BUFSIZE, 256 * 1024);
+  pub.start();
+
+  postValues(pub, "latest.fill", 100, 16 * 1024);
+  // subscriber reads nothing more, socket buffer and outbound queue full
+  EXPECT_TRUE(waitFor([&entered]() { return entered.load(); }));
+  postValues(pub, "latest.fill", 100, 16 * 1024);
+  postValues(pub, "latest.full", 1, 0);
+  // larger than cork buffer, queued directly, never fits
+  auto msg = Caps::new_instance();
+  msg->write(1);
+  msg->write(string(100 * 1024, 'l'));
+  EXPECT_EQ(pub.post("latest.full", msg), FLORA_CLI_SUCCESS);
+  roundTrip(pub);
+  blocked = false;
+  EXPECT_TRUE(waitFor([&recvs]() { return recvs.size() >= 1; }));
+  usleep(100000);
+  EXPECT_EQ(recvs.get(), vector<int32_t>{0});
+  pub.close();
+  sub.close();
+}
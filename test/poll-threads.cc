@@ -0,0 +1,163 @@
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "gtest/gtest.h"
+#include "defs.h"
+#include "flora-agent.h"
+#include "svc.h"
+
+using namespace std;
+using namespace flora;
+
+#define THREADS_SELECT_SOCK "unix:/tmp/flora-test-threads-select.sock"
+#define THREADS_SELECT_TCP "tcp://127.0.0.1:37816/"
+#define THREADS_EPOLL_SOCK "unix:/tmp/flora-test-threads-epoll.sock"
+#define THREADS_EPOLL_TCP "tcp://127.0.0.1:37817/"
+#define POLL_THREADS 4
+// more connections than reading threads, each thread reads several
+#define TEST_AGENTS 8
+#define TEST_POSTS 100
+#define TEST_CALLS 50
+
+namespace {
+
+// 'uri' with client id
+string agentUri(const char* uri, const char* role, int32_t i) {
+  return string(uri) + "#threads-" + role + to_string(i);
+}
+
+// posts of publishers on both transports received by all subscribers
+// in order of each publisher
+void fanOut(const char* sock, const char* tcp, uint32_t selector) {
+  LocalService svc{{sock, tcp},
+                   {{FLORA_POLL_OPT_THREADS, POLL_THREADS},
+                    {FLORA_POLL_OPT_SELECTOR, selector}}};
+  vector<unique_ptr<Agent>> subs;
+  vector<unique_ptr<RecvValues>> recvs;
+  int32_t i;
+  for (i = 0; i < TEST_AGENTS; ++i) {
+    subs.emplace_back(new Agent());
+    recvs.emplace_back(new RecvValues());
+    subs[i]->config(FLORA_AGENT_CONFIG_URI,
+                    agentUri(i % 2 ? tcp : sock, "sub", i).c_str());
+    subscribeValues(*subs[i], "threads.fanout", *recvs[i]);
+    subs[i]->start();
+    roundTrip(*subs[i]);
+  }
+  Agent pubs[2];
+  pubs[0].config(FLORA_AGENT_CONFIG_URI, agentUri(sock, "pub", 0).c_str());
+  pubs[1].config(FLORA_AGENT_CONFIG_URI, agentUri(tcp, "pub", 1).c_str());
+  thread posters[2];
+  for (i = 0; i < 2; ++i) {
+    pubs[i].start();
+    posters[i] = thread([&pubs, i]() {
+      int32_t j;
+      for (j = 0; j < TEST_POSTS; ++j) {
+        auto msg = Caps::new_instance();
+        msg->write(i * TEST_POSTS + j);
+        EXPECT_EQ(pubs[i].post("threads.fanout", msg), FLORA_CLI_SUCCESS);
+      }
+    });
+  }
+  for (auto& t : posters)
+    t.join();
+
+  for (i = 0; i < TEST_AGENTS; ++i) {
+    RecvValues& r = *recvs[i];
+    EXPECT_TRUE(waitFor([&r]() { return r.size() >= 2 * TEST_POSTS; }))
+        << "subscriber " << i;
+    int32_t last[2] = {-1, -1};
+    for (int32_t v : r.get()) {
+      int32_t& l = last[v / TEST_POSTS];
+      EXPECT_LT(l, v) << "subscriber " << i;
+      l = v;
+    }
+    EXPECT_EQ(last[0], TEST_POSTS - 1);
+    EXPECT_EQ(last[1], 2 * TEST_POSTS - 1);
+  }
+  for (auto& pub : pubs)
+    pub.close();
+  for (auto& sub : subs)
+    sub->close();
+}
+
+// calls of callers running concurrently replied by callees on other
+// reading threads
+void calls(const char* sock, const char* tcp, uint32_t selector) {
+  LocalService svc{{sock, tcp},
+                   {{FLORA_POLL_OPT_THREADS, POLL_THREADS},
+                    {FLORA_POLL_OPT_SELECTOR, selector}}};
+  vector<unique_ptr<Agent>> callees;
+  vector<unique_ptr<Agent>> callers;
+  int32_t i;
+  for (i = 0; i < TEST_AGENTS / 2; ++i) {
+    callees.emplace_back(new Agent());
+    callees[i]->config(FLORA_AGENT_CONFIG_URI,
+                       agentUri(i % 2 ? tcp : sock, "callee", i).c_str());
+    // ret code: index of callee, data: argument + 1
+    callees[i]->declare_method("threads.add",
+        [i](const char* name, shared_ptr<Caps>& msg,
+            shared_ptr<Reply>& reply) {
+          int32_t v{-1};
+          EXPECT_EQ(msg->read(v), CAPS_SUCCESS);
+          auto data = Caps::new_instance();
+          data->write(v + 1);
+          reply->end(i, data);
+        });
+    callees[i]->start();
+    roundTrip(*callees[i]);
+  }
+  vector<thread> threads;
+  for (i = 0; i < TEST_AGENTS / 2; ++i) {
+    callers.emplace_back(new Agent());
+    callers[i]->config(FLORA_AGENT_CONFIG_URI,
+                       agentUri(i % 2 ? sock : tcp, "caller", i).c_str());
+    callers[i]->start();
+    Agent* caller = callers[i].get();
+    threads.emplace_back([caller, i]() {
+      int32_t j;
+      for (j = 0; j < TEST_CALLS; ++j) {
+        int32_t callee = (i + j) % (TEST_AGENTS / 2);
+        string target = "threads-callee" + to_string(callee);
+        auto msg = Caps::new_instance();
+        msg->write(j);
+        Response resp;
+        ASSERT_EQ(caller->call("threads.add", msg, target.c_str(), resp,
+                               1000),
+                  FLORA_CLI_SUCCESS);
+        EXPECT_EQ(resp.ret_code, callee);
+        int32_t v{-1};
+        ASSERT_NE(resp.data, nullptr);
+        EXPECT_EQ(resp.data->read(v), CAPS_SUCCESS);
+        EXPECT_EQ(v, j + 1);
+      }
+    });
+  }
+  for (auto& t : threads)
+    t.join();
+  for (auto& caller : callers)
+    caller->close();
+  for (auto& callee : callees)
+    callee->close();
+}
+
+} // namespace
+
+TEST(PollThreadsTest, fanOutSelect) {
+  fanOut(THREADS_SELECT_SOCK, THREADS_SELECT_TCP, FLORA_POLL_SELECTOR_SELECT);
+}
+
+TEST(PollThreadsTest, callsSelect) {
+  calls(THREADS_SELECT_SOCK, THREADS_SELECT_TCP, FLORA_POLL_SELECTOR_SELECT);
+}
+
+#ifdef HAVE_EPOLL
+TEST(PollThreadsTest, fanOutEpoll) {
+  fanOut(THREADS_EPOLL_SOCK, THREADS_EPOLL_TCP, FLORA_POLL_SELECTOR_EPOLL);
+}
+
+TEST(PollThreadsTest, callsEpoll) {
+  calls(THREADS_EPOLL_SOCK, THREADS_EPOLL_TCP, FLORA_POLL_SELECTOR_EPOLL);
+}
+#endif // HAVE_EPOLL
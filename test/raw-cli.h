@@ -0,0 +1,171 @@
+#pragma once
+
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <memory>
+#include <string>
+#include <vector>
+#include "caps.h"
+#include "defs.h"
+#include "ser-helper.h"
+#include "sock-conn.h"
+#include "uri.h"
+
+// client sending frames as given, for frames flora::Client never sends
+// only socket transports, "shm:" connected as "unix:"
+class RawClient {
+public:
+  bool connect(const std::string& uri, uint32_t timeout = 1000) {
+    rokid::Uri urip;
+    if (!urip.parse(uri.c_str()))
+      return false;
+    conn = std::make_shared<SocketConn>(timeout);
+    if (urip.scheme == "tcp") {
+      flags = CAPS_FLAG_NET_BYTEORDER;
+      return conn->connect(urip.host, urip.port);
+    }
+    return conn->connect(urip.path);
+  }
+
+  // 'fds' sent with auth request, as ShmConn sends shared memory fds
+  bool auth(const char* name, uint32_t version = FLORA_VERSION,
+            const std::vector<int>& fds = std::vector<int>()) {
+    int8_t buf[256];
+    int32_t c = flora::internal::RequestSerializer::serialize_auth(
+        version, name, getpid(), 0, buf, sizeof(buf), flags);
+    if (c <= 0)
+      return false;
+    if (!(fds.empty() ? conn->send(buf, c) : sendFds(buf, c, fds)))
+      return false;
+    auto resp = recv(CMD_AUTH_RESP);
+    int32_t result;
+    uint32_t svcVersion;
+    uint32_t maxMsgSize;
+    return resp != nullptr &&
+           flora::internal::ResponseParser::parse_auth(
+               resp, result, svcVersion, maxMsgSize) == 0 &&
+           result == FLORA_CLI_SUCCESS;
+  }
+
+  bool send(const void* data, uint32_t size) {
+    return conn->send(data, size);
+  }
+
+  bool sendFd(const void* data, uint32_t size, int fd) {
+    return conn->send_fd(data, size, fd);
+  }
+
+  // all 'fds' in one SCM_RIGHTS message, unix socket only
+  bool sendFds(const void* data, uint32_t size, const std::vector<int>& fds) {
+    struct iovec iov;
+    struct msghdr msg;
+    std::vector<int8_t> cbuf(CMSG_SPACE(sizeof(int) * fds.size()));
+
+    iov.iov_base = const_cast<void*>(data);
+    iov.iov_len = size;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = cbuf.data();
+    msg.msg_controllen = cbuf.size();
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int) * fds.size());
+    memcpy(CMSG_DATA(cmsg), fds.data(), sizeof(int) * fds.size());
+    return sendmsg(conn->get_socket(), &msg, MSG_NOSIGNAL) == (ssize_t)size;
+  }
+
+  // return after requests sent before handled by service,
+  // frames received before the reply skipped
+  bool sync() {
+    int8_t buf[256];
+    std::shared_ptr<Caps> args;
+    int32_t c = flora::internal::RequestSerializer::serialize_call(
+        "flora.test.sync", args, "flora.test.nobody", 0, 1000, buf,
+        sizeof(buf), flags);
+    return c > 0 && conn->send(buf, c) && recv(CMD_REPLY_RESP) != nullptr;
+  }
+
+  // next frame with cmd read, frames of other cmds skipped if 'cmd' >= 0
+  // return: nullptr if timeout or closed
+  std::shared_ptr<Caps> recv(int32_t cmd = -1) {
+    while (true) {
+      auto caps = nextFrame();
+      if (caps == nullptr)
+        return nullptr;
+      if (caps->read(lastCmd) != CAPS_SUCCESS)
+        return nullptr;
+      if (cmd < 0 || lastCmd == cmd)
+        return caps;
+    }
+  }
+
+  // next post frame of any cmd, other frames skipped
+  // return: false if timeout, closed or frame corrupted
+  bool recvPost() {
+    while (recv() != nullptr) {
+      switch (lastCmd) {
+      case CMD_RAW_POST_RESP:
+      case CMD_ALIAS_RAW_POST_RESP:
+        return recvArgs() != nullptr;
+      case CMD_FD_POST_RESP: {
+        int fd = conn->take_fd();
+        if (fd >= 0)
+          ::close(fd);
+        return true;
+      }
+      case CMD_POST_RESP:
+      case CMD_ALIAS_POST_RESP:
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // args frame following header of CMD_RAW_POST_RESP
+  std::shared_ptr<Caps> recvArgs() { return nextFrame(); }
+
+  // wait until service closes the connection
+  // return: false if still connected after timeout
+  bool waitClosed() {
+    while (nextFrame() != nullptr)
+      ;
+    return eof;
+  }
+
+public:
+  uint32_t flags = 0;
+  int32_t lastCmd = -1;
+
+private:
+  std::shared_ptr<Caps> nextFrame() {
+    std::shared_ptr<Caps> caps;
+    while (true) {
+      uint32_t version;
+      uint32_t length;
+      if (data.size() >= 8 &&
+          Caps::binary_info(data.data(), &version, &length) == CAPS_SUCCESS &&
+          data.size() >= length) {
+        if (Caps::parse(data.data(), length, caps) != CAPS_SUCCESS)
+          caps.reset();
+        data.erase(data.begin(), data.begin() + length);
+        return caps;
+      }
+      int8_t buf[4096];
+      int32_t c = conn->recv(buf, sizeof(buf));
+      if (c <= 0) {
+        // -2: timeout
+        eof = c != -2;
+        return nullptr;
+      }
+      data.insert(data.end(), buf, buf + c);
+    }
+  }
+
+private:
+  std::shared_ptr<SocketConn> conn;
+  std::vector<int8_t> data;
+  bool eof = false;
+};
@@ -0,0 +1,156 @@
+#include <vector>
+#include "gtest/gtest.h"
+#include "flora-agent.h"
+#include "raw-cli.h"
+#include "svc.h"
+
+using namespace std;
+using namespace flora;
+using namespace flora::internal;
+
+namespace {
+
+shared_ptr<Caps> newMsg(int32_t v) {
+  auto msg = Caps::new_instance();
+  msg->write(v);
+  msg->write((int64_t)0x0102030405060708LL);
+  msg->write("raw");
+  return msg;
+}
+
+// header frame of CMD_RAW_POST_REQ and args frame following it
+void serializeRawPost(RawClient& cli, const char* name, int32_t v,
+                      vector<int8_t>& header, vector<int8_t>& args) {
+  int8_t buf[1024];
+  auto msg = newMsg(v);
+  int32_t c = RequestSerializer::serialize_raw_post(
+      name, FLORA_MSGTYPE_INSTANT, msg, buf, sizeof(buf), cli.flags);
+  ASSERT_GT(c, 0);
+  uint32_t version;
+  uint32_t length;
+  ASSERT_EQ(Caps::binary_info(buf, &version, &length), CAPS_SUCCESS);
+  ASSERT_LT(length, (uint32_t)c);
+  header.assign(buf, buf + length);
+  args.assign(buf + length, buf + c);
+}
+
+} // namespace
+
+// args frame forwarded as is to subscribers of same byte order,
+// re-encoded for others
+TEST(RawPostTest, byteOrder) {
+  LocalService svc{{"unix:/tmp/flora-test-order.sock",
+                    "tcp://127.0.0.1:37811/"}};
+  const char* uris[2] = {"unix:/tmp/flora-test-order.sock#unix",
+                         "tcp://127.0.0.1:37811/#tcp"};
+  Agent subs[2];
+  Agent pubs[2];
+  RecvValues recvs[2];
+  uint32_t i;
+  for (i = 0; i < 2; ++i) {
+    subs[i].config(FLORA_AGENT_CONFIG_URI, (string(uris[i]) + "-sub").c_str());
+    subs[i].subscribe("raw.order",
+        [&recvs, i](const char* name, shared_ptr<Caps>& msg, uint32_t type) {
+          int32_t v{-1};
+          int64_t v64{0};
+          string s;
+          EXPECT_EQ(msg->read(v), CAPS_SUCCESS);
+          EXPECT_EQ(msg->read(v64), CAPS_SUCCESS);
+          EXPECT_EQ(msg->read(s), CAPS_SUCCESS);
+          EXPECT_EQ(v64, 0x0102030405060708LL);
+          EXPECT_EQ(s, "raw");
+          recvs[i].add(v);
+        });
+    subs[i].start();
+    roundTrip(subs[i]);
+    pubs[i].config(FLORA_AGENT_CONFIG_URI, (string(uris[i]) + "-pub").c_str());
+    pubs[i].start();
+  }
+  for (i = 0; i < 2; ++i) {
+    auto msg = newMsg(0x11223344 + i);
+    EXPECT_EQ(pubs[i].post("raw.order", msg), FLORA_CLI_SUCCESS);
+    roundTrip(pubs[i]);
+  }
+  for (i = 0; i < 2; ++i) {
+    EXPECT_TRUE(waitFor([&recvs, i]() { return recvs[i].size() >= 2; }));
+    auto values = recvs[i].get();
+    ASSERT_EQ(values.size(), 2);
+    EXPECT_EQ(values[0], 0x11223344);
+    EXPECT_EQ(values[1], 0x11223345);
+  }
+  for (i = 0; i < 2; ++i) {
+    pubs[i].close();
+    subs[i].close();
+  }
+}
+
+// args frame may come with later reads, post dispatched when it arrives
+// header without args frame when connection closed never dispatched
+TEST(RawPostTest, headerWithoutArgs) {
+  Agent sub;
+  RecvValues recvs;
+  string uri = Service::floraUri;
+  sub.config(FLORA_AGENT_CONFIG_URI, (uri + "#raw-sub").c_str());
+  subscribeValues(sub, "raw.noargs", recvs);
+  sub.start();
+  roundTrip(sub);
+
+  vector<int8_t> header;
+  vector<int8_t> args;
+  {
+    RawClient cli;
+    ASSERT_TRUE(cli.connect(uri));
+    ASSERT_TRUE(cli.auth("raw-pub"));
+    serializeRawPost(cli, "raw.noargs", 1, header, args);
+    ASSERT_TRUE(cli.send(header.data(), header.size()));
+    usleep(200000);
+    EXPECT_EQ(recvs.size(), 0);
+    ASSERT_TRUE(cli.send(args.data(), args.size()));
+    EXPECT_TRUE(waitFor([&recvs]() { return recvs.size() >= 1; }));
+
+    serializeRawPost(cli, "raw.noargs", 2, header, args);
+    ASSERT_TRUE(cli.send(header.data(), header.size()));
+  }
+
+  // service still works after the connection closed with header pending
+  Agent pub;
+  pub.config(FLORA_AGENT_CONFIG_URI, (uri + "#raw-pub2").c_str());
+  pub.start();
+  auto msg = newMsg(3);
+  EXPECT_EQ(pub.post("raw.noargs", msg), FLORA_CLI_SUCCESS);
+  EXPECT_TRUE(waitFor([&recvs]() { return recvs.size() >= 2; }));
+  usleep(100000);
+  auto values = recvs.get();
+  ASSERT_EQ(values.size(), 2);
+  EXPECT_EQ(values[0], 1);
+  EXPECT_EQ(values[1], 3);
+  pub.close();
+  sub.close();
+}
+
+// header as the last frame of CMD_BATCH_REQ is a protocol error
+TEST(RawPostTest, headerWithoutArgsInBatch) {
+  Agent sub;
+  RecvValues recvs;
+  string uri = Service::floraUri;
+  sub.config(FLORA_AGENT_CONFIG_URI, (uri + "#raw-batch-sub").c_str());
+  subscribeValues(sub, "raw.batch.noargs", recvs);
+  sub.start();
+  roundTrip(sub);
+
+  RawClient cli;
+  ASSERT_TRUE(cli.connect(uri));
+  ASSERT_TRUE(cli.auth("raw-batch-pub"));
+  vector<int8_t> header;
+  vector<int8_t> args;
+  serializeRawPost(cli, "raw.batch.noargs", 1, header, args);
+  int8_t buf[1024];
+  int32_t c = RequestSerializer::serialize_batch(header.data(), header.size(),
+                                                 buf, sizeof(buf), cli.flags);
+  ASSERT_GT(c, 0);
+  ASSERT_TRUE(cli.send(buf, c));
+  EXPECT_TRUE(cli.waitClosed());
+  usleep(100000);
+  EXPECT_EQ(recvs.size(), 0);
+  sub.close();
+}
@@ -0,0 +1,169 @@
+#include "defs.h"
+
+#ifdef HAVE_SHM
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <chrono>
+#include <new>
+#include <thread>
+#include <vector>
+#include "gtest/gtest.h"
+#include "flora-agent.h"
+#include "memfd.h"
+#include "raw-cli.h"
+#include "ser-helper.h"
+#include "shm-ring.h"
+#include "svc.h"
+
+using namespace std;
+using namespace flora;
+using namespace flora::internal;
+
+#define SHM_TEST_SOCK "shm:/tmp/flora-test-shm.sock"
+
+namespace {
+
+// shared memory and doorbells as ShmConn creates, rings driven by test
+class RawShm {
+public:
+  ~RawShm() {
+    if (control)
+      munmap(control, memSize);
+    for (int fd : fds) {
+      if (fd >= 0)
+        ::close(fd);
+    }
+    for (int fd : peers)
+      ::close(fd);
+  }
+
+  // 'doorbellFlags': flags of doorbell socketpairs, 0 for blocking
+  bool init(int doorbellFlags) {
+    fds.assign(SHM_FD_COUNT, -1);
+    fds[SHM_FD_MEM] =
+        memfd_open("flora-test", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    memSize = ShmControl::mem_size(SHM_RING_CAPACITY);
+    if (fds[SHM_FD_MEM] < 0 || ftruncate(fds[SHM_FD_MEM], memSize) < 0 ||
+        fcntl(fds[SHM_FD_MEM], F_ADD_SEALS, SHM_MEM_SEALS) < 0)
+      return false;
+    void* p = mmap(nullptr, memSize, PROT_READ | PROT_WRITE, MAP_SHARED,
+                   fds[SHM_FD_MEM], 0);
+    if (p == MAP_FAILED)
+      return false;
+    control = new (p) ShmControl();
+    control->magic = SHM_MAGIC;
+    control->capacity = SHM_RING_CAPACITY;
+    control->rings[SHM_RING_C2S].reader_waiting.store(1);
+    c2s.attach(control, SHM_RING_C2S);
+    int sv[2];
+    int i;
+    for (i = SHM_FD_SVC_DOORBELL; i < SHM_FD_SVC_RING; ++i) {
+      if (socketpair(AF_UNIX, SOCK_DGRAM | doorbellFlags, 0, sv) < 0)
+        return false;
+      fds[i] = sv[1];
+      if (i == SHM_FD_SVC_DOORBELL)
+        fds[SHM_FD_SVC_RING] = sv[0];
+      else
+        peers.push_back(sv[0]);
+    }
+    return true;
+  }
+
+  // write 'size' bytes to c2s ring, ring service
+  bool write(const void* data, uint32_t size) {
+    struct iovec iov;
+    iov.iov_base = const_cast<void*>(data);
+    iov.iov_len = size;
+    if (c2s.write(&iov, 1) != (int32_t)size)
+      return false;
+    if (c2s.wake_reader()) {
+      char c = 1;
+      ::send(fds[SHM_FD_SVC_RING], &c, sizeof(c), MSG_DONTWAIT);
+    }
+    return true;
+  }
+
+  // client asleep on s2c ring, service rings client doorbell every write
+  void waitData() {
+    control->rings[SHM_RING_S2C].reader_waiting.store(1);
+  }
+
+  uint32_t s2cTail() { return control->rings[SHM_RING_S2C].tail.load(); }
+
+public:
+  // SHM_FD_* sent to service
+  vector<int> fds;
+  // peers of client doorbells, never read
+  vector<int> peers;
+  ShmControl* control = nullptr;
+  uint32_t memSize = 0;
+  ShmRing c2s;
+};
+
+} // namespace
+
+// service accesses client fds by send/recv only, other fd types rejected
+TEST(ShmTest, rejectPipeDoorbells) {
+  LocalService svc{SHM_TEST_SOCK};
+  RawShm shm;
+  ASSERT_TRUE(shm.init(SOCK_NONBLOCK));
+  int pfds[2];
+  ASSERT_EQ(pipe(pfds), 0);
+  vector<int> fds{shm.fds[SHM_FD_MEM], pfds[0], pfds[1], pfds[1], pfds[1]};
+  RawClient cli;
+  ASSERT_TRUE(cli.connect(SHM_TEST_SOCK));
+  // not upgraded, auth response received from socket
+  EXPECT_TRUE(cli.auth("shm-test-pipe", FLORA_VERSION, fds));
+  EXPECT_TRUE(cli.sync());
+  ::close(pfds[0]);
+  ::close(pfds[1]);
+}
+
+// client doorbells never read and O_NONBLOCK cleared, service not blocked
+TEST(ShmTest, blockingDoorbells) {
+  LocalService svc{SHM_TEST_SOCK};
+  RawShm shm;
+  ASSERT_TRUE(shm.init(0));
+  RawClient cli;
+  ASSERT_TRUE(cli.connect(SHM_TEST_SOCK));
+  int8_t buf[256];
+  int32_t c = RequestSerializer::serialize_auth(
+      FLORA_VERSION, "shm-test-blocking", getpid(), 0, buf, sizeof(buf), 0);
+  ASSERT_GT(c, 0);
+  shm.waitData();
+  ASSERT_TRUE(cli.sendFds(buf, c, shm.fds));
+  ASSERT_TRUE(waitFor([&shm]() { return shm.s2cTail() != 0; }));
+
+  // far more than datagrams queued by a doorbell socket
+  shared_ptr<Caps> args;
+  c = RequestSerializer::serialize_call("flora.test.sync", args,
+                                        "flora.test.nobody", 0, 1000, buf,
+                                        sizeof(buf), 0);
+  ASSERT_GT(c, 0);
+  int i;
+  for (i = 0; i < 1000; ++i) {
+    uint32_t tail = shm.s2cTail();
+    shm.waitData();
+    ASSERT_TRUE(shm.write(buf, c));
+    auto deadline = chrono::steady_clock::now() + chrono::seconds(3);
+    while (shm.s2cTail() == tail) {
+      ASSERT_LT(chrono::steady_clock::now(), deadline) << "call " << i;
+      this_thread::yield();
+    }
+  }
+
+  // service still works
+  Agent agent;
+  RecvValues recvs;
+  agent.config(FLORA_AGENT_CONFIG_URI, SHM_TEST_SOCK "#shm-test-agent");
+  subscribeValues(agent, "shm.blocking", recvs);
+  agent.start();
+  roundTrip(agent);
+  auto msg = Caps::new_instance();
+  msg->write(1);
+  agent.post("shm.blocking", msg);
+  EXPECT_TRUE(waitFor([&recvs]() { return recvs.size() >= 1; }));
+  agent.close();
+}
+#endif // HAVE_SHM
@@ -0,0 +1,229 @@
+#include <map>
+#include <memory>
+#include <string>
+#include "gtest/gtest.h"
+#include "flora-agent.h"
+#include "flora-svc.h"
+#include "svc.h"
+
+using namespace std;
+using namespace flora;
+
+#define STATS_TEST_SOCK "unix:/tmp/flora-test-stats.sock"
+#define STATS_TEST_C_SOCK "unix:/tmp/flora-test-stats-c.sock"
+
+namespace {
+
+struct AdapterCounters {
+  uint64_t framesIn = 0;
+  uint64_t bytesIn = 0;
+  uint64_t framesOut = 0;
+  uint64_t bytesOut = 0;
+};
+
+struct TopicCounters {
+  uint32_t subscribers = 0;
+  uint64_t posts = 0;
+  uint64_t fanout = 0;
+  uint64_t bytes = 0;
+};
+
+struct MethodCounters {
+  uint64_t replies = 0;
+  uint64_t timeouts = 0;
+};
+
+// counters of Dispatcher::stats tested, keyed by name
+class StatsSnapshot {
+public:
+  bool parse(shared_ptr<Caps>& stats) {
+    shared_ptr<Caps> list;
+    uint32_t count;
+    uint32_t i;
+    if (stats == nullptr || stats->read(list) != CAPS_SUCCESS ||
+        list->read(count) != CAPS_SUCCESS)
+      return false;
+    for (i = 0; i < count; ++i) {
+      shared_ptr<Caps> item;
+      string name;
+      uint32_t id;
+      int32_t pid;
+      if (list->read(item) != CAPS_SUCCESS ||
+          item->read(name) != CAPS_SUCCESS ||
+          item->read(id) != CAPS_SUCCESS || item->read(pid) != CAPS_SUCCESS)
+        return false;
+      AdapterCounters& a = adapters[name];
+      if (item->read(a.framesIn) != CAPS_SUCCESS ||
+          item->read(a.bytesIn) != CAPS_SUCCESS ||
+          item->read(a.framesOut) != CAPS_SUCCESS ||
+          item->read(a.bytesOut) != CAPS_SUCCESS)
+        return false;
+    }
+    if (stats->read(list) != CAPS_SUCCESS || list->read(count) != CAPS_SUCCESS)
+      return false;
+    for (i = 0; i < count; ++i) {
+      shared_ptr<Caps> item;
+      string name;
+      if (list->read(item) != CAPS_SUCCESS ||
+          item->read(name) != CAPS_SUCCESS)
+        return false;
+      TopicCounters& t = topics[name];
+      if (item->read(t.subscribers) != CAPS_SUCCESS ||
+          item->read(t.posts) != CAPS_SUCCESS ||
+          item->read(t.fanout) != CAPS_SUCCESS ||
+          item->read(t.bytes) != CAPS_SUCCESS)
+        return false;
+    }
+    if (stats->read(list) != CAPS_SUCCESS || list->read(count) != CAPS_SUCCESS)
+      return false;
+    for (i = 0; i < count; ++i) {
+      shared_ptr<Caps> item;
+      string name;
+      if (list->read(item) != CAPS_SUCCESS ||
+          item->read(name) != CAPS_SUCCESS)
+        return false;
+      MethodCounters& m = methods[name];
+      if (item->read(m.replies) != CAPS_SUCCESS ||
+          item->read(m.timeouts) != CAPS_SUCCESS)
+        return false;
+    }
+    return true;
+  }
+
+public:
+  map<string, AdapterCounters> adapters;
+  map<string, TopicCounters> topics;
+  map<string, MethodCounters> methods;
+};
+
+// FLORA_STATS_METHOD replied to 'agent' parsed to 'snapshot'
+void callStats(Agent& agent, StatsSnapshot& snapshot) {
+  auto msg = Caps::new_instance();
+  Response resp;
+  ASSERT_EQ(agent.call(FLORA_STATS_METHOD, msg, "", resp, 1000),
+            FLORA_CLI_SUCCESS);
+  EXPECT_EQ(resp.ret_code, FLORA_CLI_SUCCESS);
+  ASSERT_TRUE(snapshot.parse(resp.data));
+}
+
+} // namespace
+
+// counters of posts, calls and adapters in FLORA_STATS_METHOD reply
+TEST(StatsTest, statsMethod) {
+  LocalService svc{STATS_TEST_SOCK};
+  Agent sub1;
+  Agent sub2;
+  Agent pub;
+  RecvValues recvs1;
+  RecvValues recvs2;
+  sub1.config(FLORA_AGENT_CONFIG_URI, STATS_TEST_SOCK "#stats-sub1");
+  subscribeValues(sub1, "stats.topic", recvs1);
+  sub1.declare_method("stats.method",
+      [](const char* name, shared_ptr<Caps>& msg, shared_ptr<Reply>& reply) {
+        reply->end(0);
+      });
+  sub1.start();
+  roundTrip(sub1);
+  sub2.config(FLORA_AGENT_CONFIG_URI, STATS_TEST_SOCK "#stats-sub2");
+  subscribeValues(sub2, "stats.topic", recvs2);
+  sub2.start();
+  roundTrip(sub2);
+  pub.config(FLORA_AGENT_CONFIG_URI, STATS_TEST_SOCK "#stats-pub");
+  pub.start();
+
+  StatsSnapshot before;
+  callStats(pub, before);
+  int32_t i;
+  for (i = 0; i < 3; ++i) {
+    auto msg = Caps::new_instance();
+    msg->write(i);
+    EXPECT_EQ(pub.post("stats.topic", msg), FLORA_CLI_SUCCESS);
+  }
+  auto msg = Caps::new_instance();
+  Response resp;
+  EXPECT_EQ(pub.call("stats.method", msg, "stats-sub1", resp, 1000),
+            FLORA_CLI_SUCCESS);
+  EXPECT_TRUE(waitFor([&recvs1, &recvs2]() {
+    return recvs1.size() >= 3 && recvs2.size() >= 3;
+  }));
+  StatsSnapshot after;
+  callStats(pub, after);
+
+  ASSERT_EQ(after.topics.count("stats.topic"), 1);
+  TopicCounters& t0 = before.topics["stats.topic"];
+  TopicCounters& t1 = after.topics["stats.topic"];
+  EXPECT_EQ(t1.subscribers, 2);
+  EXPECT_EQ(t1.posts - t0.posts, 3);
+  EXPECT_EQ(t1.fanout - t0.fanout, 6);
+  EXPECT_GT(t1.bytes, t0.bytes);
+
+  ASSERT_EQ(after.methods.count("stats.method"), 1);
+  EXPECT_EQ(after.methods["stats.method"].replies, 1);
+  EXPECT_EQ(after.methods["stats.method"].timeouts, 0);
+
+  ASSERT_EQ(after.adapters.count("stats-pub"), 1);
+  ASSERT_EQ(after.adapters.count("stats-sub1"), 1);
+  ASSERT_EQ(after.adapters.count("stats-sub2"), 1);
+  AdapterCounters& p0 = before.adapters["stats-pub"];
+  AdapterCounters& p1 = after.adapters["stats-pub"];
+  // header and args frames of 3 posts, call and FLORA_STATS_METHOD call
+  EXPECT_EQ(p1.framesIn - p0.framesIn, 8);
+  // replies of FLORA_STATS_METHOD and call, second stats reply not counted
+  EXPECT_EQ(p1.framesOut - p0.framesOut, 2);
+  EXPECT_GT(p1.bytesIn, p0.bytesIn);
+  EXPECT_GT(p1.bytesOut, p0.bytesOut);
+  AdapterCounters& s0 = before.adapters["stats-sub1"];
+  AdapterCounters& s1 = after.adapters["stats-sub1"];
+  // topic and sender alias before first post, 3 posts and call
+  EXPECT_EQ(s1.framesOut - s0.framesOut, 6);
+  // reply
+  EXPECT_EQ(s1.framesIn - s0.framesIn, 1);
+  EXPECT_EQ(after.adapters["stats-sub2"].framesOut -
+                before.adapters["stats-sub2"].framesOut,
+            5);
+  pub.close();
+  sub2.close();
+  sub1.close();
+}
+
+// flora_dispatcher_stats returns the same layout as FLORA_STATS_METHOD
+TEST(StatsTest, dispatcherStatsC) {
+  EXPECT_EQ(flora_dispatcher_stats(0), 0);
+  flora_dispatcher_t disp = flora_dispatcher_new(0, 0);
+  flora_poll_t poll;
+  ASSERT_EQ(flora_poll_new(STATS_TEST_C_SOCK, &poll), FLORA_POLL_SUCCESS);
+  ASSERT_EQ(flora_poll_start(poll, disp), FLORA_POLL_SUCCESS);
+  flora_dispatcher_run(disp, 0);
+
+  Agent sub;
+  Agent pub;
+  RecvValues recvs;
+  sub.config(FLORA_AGENT_CONFIG_URI, STATS_TEST_C_SOCK "#stats-c-sub");
+  subscribeValues(sub, "stats.c", recvs);
+  sub.start();
+  roundTrip(sub);
+  pub.config(FLORA_AGENT_CONFIG_URI, STATS_TEST_C_SOCK "#stats-c-pub");
+  pub.start();
+  auto msg = Caps::new_instance();
+  msg->write(1);
+  EXPECT_EQ(pub.post("stats.c", msg), FLORA_CLI_SUCCESS);
+  EXPECT_TRUE(waitFor([&recvs]() { return recvs.size() >= 1; }));
+
+  caps_t stats = flora_dispatcher_stats(disp);
+  ASSERT_NE(stats, 0);
+  StatsSnapshot snapshot;
+  auto caps = Caps::convert(stats);
+  EXPECT_TRUE(snapshot.parse(caps));
+  caps_destroy(stats);
+  EXPECT_EQ(snapshot.adapters.count("stats-c-sub"), 1);
+  EXPECT_EQ(snapshot.adapters.count("stats-c-pub"), 1);
+  EXPECT_EQ(snapshot.topics["stats.c"].posts, 1);
+  EXPECT_EQ(snapshot.topics["stats.c"].fanout, 1);
+
+  pub.close();
+  sub.close();
+  flora_dispatcher_close(disp);
+  flora_poll_stop(poll);
+  flora_poll_delete(poll);
+  flora_dispatcher_delete(disp);
+}
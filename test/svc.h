@@ -1,7 +1,15 @@
 #pragma once
 
+#include <chrono>
+#include <initializer_list>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "gtest/gtest.h"
 #include "thr-pool.h"
+#include "flora-agent.h"
 #include "flora-svc.h"
 
 class Service {
@@ -33,3 +41,85 @@ private:
   std::shared_ptr<flora::Poll> poll;
 };
 
+
+// FLORA_POLL_OPT_* and value of each option
+typedef std::vector<std::pair<uint32_t, uint32_t>> PollOptions;
+
+// service of a test itself, listening on all 'uris'
+// for tests depend on transports, poll or dispatcher options
+class LocalService {
+public:
+  LocalService(std::initializer_list<const char*> uris,
+               const PollOptions& opts = PollOptions(), uint32_t bufsize = 0) {
+    disp = flora::Dispatcher::new_instance(0, bufsize);
+    for (auto uri : uris) {
+      auto poll = flora::Poll::new_instance(uri);
+      for (auto& opt : opts)
+        poll->config(opt.first, opt.second);
+      poll->start(disp);
+      polls.push_back(poll);
+    }
+    disp->run(false);
+  }
+
+  ~LocalService() {
+    disp->close();
+    for (auto& poll : polls)
+      poll->stop();
+  }
+
+private:
+  std::shared_ptr<flora::Dispatcher> disp;
+  std::vector<std::shared_ptr<flora::Poll>> polls;
+};
+
+// int32 values received by subscriber callbacks
+class RecvValues {
+public:
+  void add(int32_t v) {
+    std::lock_guard<std::mutex> locker(valueMutex);
+    values.push_back(v);
+  }
+
+  std::vector<int32_t> get() {
+    std::lock_guard<std::mutex> locker(valueMutex);
+    return values;
+  }
+
+  size_t size() { return get().size(); }
+
+private:
+  std::mutex valueMutex;
+  std::vector<int32_t> values;
+};
+
+// subscribe 'name', first int32 of each post added to 'recvs'
+inline void subscribeValues(flora::Agent& agent, const char* name,
+                            RecvValues& recvs) {
+  agent.subscribe(name, [&recvs](const char* name,
+                                 std::shared_ptr<Caps>& msg, uint32_t type) {
+    int32_t v{-1};
+    EXPECT_EQ(msg->read(v), CAPS_SUCCESS);
+    recvs.add(v);
+  });
+}
+
+// return: whether 'cond' became true in 'timeout' milliseconds
+template <typename F>
+bool waitFor(F cond, uint32_t timeout = 3000) {
+  auto deadline = std::chrono::steady_clock::now() +
+                  std::chrono::milliseconds(timeout);
+  while (!cond()) {
+    if (std::chrono::steady_clock::now() >= deadline)
+      return false;
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  return true;
+}
+
+// return after requests sent before by 'agent' handled by service
+inline void roundTrip(flora::Agent& agent) {
+  flora::Response resp;
+  auto msg = Caps::new_instance();
+  agent.call("flora.test.sync", msg, "flora.test.nobody", resp, 1000);
+}
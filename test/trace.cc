@@ -0,0 +1,137 @@
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "gtest/gtest.h"
+#include "flora-agent.h"
+#include "svc.h"
+
+using namespace std;
+using namespace flora;
+
+#define TRACE_TEST_SOCK "unix:/tmp/flora-test-trace.sock"
+// subscriber of network byte order
+#define TRACE_TEST_TCP "tcp://127.0.0.1:37815/"
+
+namespace {
+
+typedef vector<uint64_t> Timestamps;
+
+// MsgSender::timestamp of each post received, keyed by first int32
+class RecvTraces {
+public:
+  void subscribe(Agent& agent, const char* name) {
+    agent.subscribe(name, [this](const char* name, shared_ptr<Caps>& msg,
+                                 uint32_t type) {
+      int32_t v{-1};
+      EXPECT_EQ(msg->read(v), CAPS_SUCCESS);
+      Timestamps ts;
+      uint32_t i;
+      for (i = 0; i < FLORA_TRACE_POINTS; ++i)
+        ts.push_back(MsgSender::timestamp(i));
+      lock_guard<mutex> locker(traceMutex);
+      traces[v] = ts;
+    });
+  }
+
+  map<int32_t, Timestamps> get() {
+    lock_guard<mutex> locker(traceMutex);
+    return traces;
+  }
+
+  size_t size() { return get().size(); }
+
+private:
+  mutex traceMutex;
+  map<int32_t, Timestamps> traces;
+};
+
+// count of latencies at 'index' of Client::trace_stats item 'name'
+// return: 0 if 'name' not found
+uint64_t traceCount(shared_ptr<Caps>& stats, const char* name,
+                    uint32_t index) {
+  uint32_t n;
+  uint32_t i;
+  if (stats == nullptr || stats->read(n) != CAPS_SUCCESS)
+    return 0;
+  for (i = 0; i < n; ++i) {
+    shared_ptr<Caps> item;
+    string itemName;
+    if (stats->read(item) != CAPS_SUCCESS ||
+        item->read(itemName) != CAPS_SUCCESS)
+      return 0;
+    if (itemName != name)
+      continue;
+    uint64_t v = 0;
+    uint32_t j;
+    // count, p50, p99, p999 of each latency
+    for (j = 0; j <= index * 4; ++j) {
+      if (item->read(v) != CAPS_SUCCESS)
+        return 0;
+    }
+    return v;
+  }
+  return 0;
+}
+
+} // namespace
+
+// timestamps of traced post set and ordered, untraced post none
+TEST(TraceTest, timestamps) {
+  LocalService svc{TRACE_TEST_SOCK, TRACE_TEST_TCP};
+  Agent sub;
+  Agent netSub;
+  Agent tracedPub;
+  Agent pub;
+  RecvTraces traces;
+  RecvTraces netTraces;
+  EXPECT_EQ(sub.trace_stats(), nullptr);
+  sub.config(FLORA_AGENT_CONFIG_URI, TRACE_TEST_SOCK "#trace-sub");
+  traces.subscribe(sub, "trace.topic");
+  sub.start();
+  roundTrip(sub);
+  netSub.config(FLORA_AGENT_CONFIG_URI, TRACE_TEST_TCP "#trace-net-sub");
+  netTraces.subscribe(netSub, "trace.topic");
+  netSub.start();
+  roundTrip(netSub);
+  tracedPub.config(FLORA_AGENT_CONFIG_URI, TRACE_TEST_SOCK "#trace-pub");
+  tracedPub.config(FLORA_AGENT_CONFIG_TRACE, 1);
+  tracedPub.start();
+  pub.config(FLORA_AGENT_CONFIG_URI, TRACE_TEST_SOCK "#trace-untraced-pub");
+  pub.start();
+
+  auto msg = Caps::new_instance();
+  msg->write(1);
+  EXPECT_EQ(tracedPub.post("trace.topic", msg), FLORA_CLI_SUCCESS);
+  msg = Caps::new_instance();
+  msg->write(2);
+  EXPECT_EQ(pub.post("trace.topic", msg), FLORA_CLI_SUCCESS);
+  EXPECT_TRUE(waitFor([&traces, &netTraces]() {
+    return traces.size() >= 2 && netTraces.size() >= 2;
+  }));
+
+  for (auto* recvs : {&traces, &netTraces}) {
+    auto values = recvs->get();
+    ASSERT_EQ(values.size(), 2);
+    Timestamps& traced = values[1];
+    uint32_t i;
+    for (i = 0; i < FLORA_TRACE_POINTS; ++i)
+      EXPECT_NE(traced[i], 0) << "point " << i;
+    for (i = 1; i < FLORA_TRACE_POINTS; ++i)
+      EXPECT_LE(traced[i - 1], traced[i]) << "point " << i;
+    EXPECT_EQ(values[2], Timestamps(FLORA_TRACE_POINTS, 0));
+  }
+
+  // untraced post not counted
+  for (auto* agent : {&sub, &netSub}) {
+    auto stats = agent->trace_stats();
+    EXPECT_EQ(traceCount(stats, "trace.topic", 0), 1);
+    stats = agent->trace_stats();
+    EXPECT_EQ(traceCount(stats, "trace.topic", 1), 1);
+  }
+  pub.close();
+  tracedPub.close();
+  netSub.close();
+  sub.close();
+}
@@ -0,0 +1,135 @@
+#include <string>
+#include <vector>
+#include "gtest/gtest.h"
+#include "flora-agent.h"
+#include "svc.h"
+
+using namespace std;
+using namespace flora;
+
+namespace {
+
+struct TestPost {
+  const char* name;
+  int32_t value;
+};
+
+void postAll(Agent& pub, const vector<TestPost>& posts) {
+  for (auto& p : posts) {
+    auto msg = Caps::new_instance();
+    msg->write(p.value);
+    EXPECT_EQ(pub.post(p.name, msg), FLORA_CLI_SUCCESS);
+  }
+}
+
+// posts of one publisher delivered in order, so posts before last
+// matched one all handled when 'expected' values received
+void expectValues(RecvValues& recvs, const vector<int32_t>& expected) {
+  EXPECT_TRUE(waitFor(
+      [&recvs, &expected]() { return recvs.size() >= expected.size(); }));
+  EXPECT_EQ(recvs.get(), expected);
+}
+
+} // namespace
+
+TEST(WildcardTest, singleLevel) {
+  Agent sub;
+  Agent pub;
+  RecvValues recvs;
+  string uri = Service::floraUri;
+  sub.config(FLORA_AGENT_CONFIG_URI, (uri + "#wc-single-sub").c_str());
+  subscribeValues(sub, "wc.*.temp", recvs);
+  sub.start();
+  roundTrip(sub);
+  pub.config(FLORA_AGENT_CONFIG_URI, (uri + "#wc-single-pub").c_str());
+  pub.start();
+
+  postAll(pub, {{"wc.a.temp", 0},
+                {"wc.temp", 1},
+                {"wc.a.b.temp", 2},
+                {"wc.b.temp", 3},
+                {"wc.a.humid", 4},
+                {"wcx.a.temp", 5},
+                {"wc.c.temp", 6}});
+  expectValues(recvs, {0, 3, 6});
+  pub.close();
+  sub.close();
+}
+
+// "#" at last level matches zero or more levels
+TEST(WildcardTest, trailingHash) {
+  Agent sub;
+  Agent pub;
+  RecvValues recvs;
+  string uri = Service::floraUri;
+  sub.config(FLORA_AGENT_CONFIG_URI, (uri + "#wc-hash-sub").c_str());
+  subscribeValues(sub, "wch.#", recvs);
+  sub.start();
+  roundTrip(sub);
+  pub.config(FLORA_AGENT_CONFIG_URI, (uri + "#wc-hash-pub").c_str());
+  pub.start();
+
+  postAll(pub, {{"wch", 0},
+                {"wch.a", 1},
+                {"wchx.a", 2},
+                {"wch.a.b", 3},
+                {"x.wch", 4},
+                {"wch.z", 5}});
+  expectValues(recvs, {0, 1, 3, 5});
+  pub.close();
+  sub.close();
+}
+
+// post delivered to each matched handler once
+TEST(WildcardTest, exactAndPattern) {
+  Agent sub;
+  Agent pub;
+  RecvValues exactRecvs;
+  RecvValues patternRecvs;
+  string uri = Service::floraUri;
+  sub.config(FLORA_AGENT_CONFIG_URI, (uri + "#wc-both-sub").c_str());
+  subscribeValues(sub, "wcx.a", exactRecvs);
+  subscribeValues(sub, "wcx.*", patternRecvs);
+  sub.start();
+  roundTrip(sub);
+  pub.config(FLORA_AGENT_CONFIG_URI, (uri + "#wc-both-pub").c_str());
+  pub.start();
+
+  postAll(pub, {{"wcx.a", 0}, {"wcx.b", 1}, {"wcx.a", 2}});
+  expectValues(patternRecvs, {0, 1, 2});
+  expectValues(exactRecvs, {0, 2});
+  pub.close();
+  sub.close();
+}
+
+TEST(WildcardTest, unsubscribePattern) {
+  Agent sub;
+  Agent ctl;
+  Agent pub;
+  RecvValues recvs;
+  RecvValues ctlRecvs;
+  string uri = Service::floraUri;
+  sub.config(FLORA_AGENT_CONFIG_URI, (uri + "#wc-unsub-sub").c_str());
+  subscribeValues(sub, "wcu.*", recvs);
+  sub.start();
+  roundTrip(sub);
+  ctl.config(FLORA_AGENT_CONFIG_URI, (uri + "#wc-unsub-ctl").c_str());
+  subscribeValues(ctl, "wcu.end", ctlRecvs);
+  ctl.start();
+  roundTrip(ctl);
+  pub.config(FLORA_AGENT_CONFIG_URI, (uri + "#wc-unsub-pub").c_str());
+  pub.start();
+
+  postAll(pub, {{"wcu.a", 0}});
+  expectValues(recvs, {0});
+  sub.unsubscribe("wcu.*");
+  roundTrip(sub);
+  postAll(pub, {{"wcu.b", 1}, {"wcu.end", 2}});
+  // posts before "wcu.end" dispatched when control subscriber got it
+  expectValues(ctlRecvs, {2});
+  usleep(100000);
+  EXPECT_EQ(recvs.get(), vector<int32_t>{0});
+  pub.close();
+  ctl.close();
+  sub.close();
+}
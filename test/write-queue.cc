@@ -0,0 +1,120 @@
+#include <string>
+#include "gtest/gtest.h"
+#include "flora-agent.h"
+#include "raw-cli.h"
+#include "svc.h"
+
+using namespace std;
+using namespace flora;
+using namespace flora::internal;
+
+#define WQ_TEST_SOCK "unix:/tmp/flora-test-wq.sock"
+// frames partially written more often than unix socket
+#define WQ_TEST_TCP "tcp://127.0.0.1:37812/"
+
+namespace {
+
+void postValues(Agent& pub, const char* name, int32_t begin, int32_t end,
+                uint32_t padding) {
+  int32_t i;
+  for (i = begin; i < end; ++i) {
+    auto msg = Caps::new_instance();
+    msg->write(i);
+    msg->write(string(padding, 'q'));
+    EXPECT_EQ(pub.post(name, msg), FLORA_CLI_SUCCESS);
+  }
+}
+
+// raw client subscribed 'name', not reading until test reads
+void subscribeRaw(RawClient& cli, const char* uri, const char* name) {
+  ASSERT_TRUE(cli.connect(uri));
+  ASSERT_TRUE(cli.auth(name));
+  int8_t buf[256];
+  int32_t c = RequestSerializer::serialize_subscribe(name, buf, sizeof(buf),
+                                                     cli.flags);
+  ASSERT_GT(c, 0);
+  ASSERT_TRUE(cli.send(buf, c));
+  ASSERT_TRUE(cli.sync());
+}
+
+} // namespace
+
+// tail of a frame partially written to socket never dropped,
+// or the subscriber could not parse frames after it
+TEST(WriteQueueTest, dropOldestPartial) {
+  LocalService svc{{WQ_TEST_SOCK, WQ_TEST_TCP},
+                   {{FLORA_POLL_OPT_WRITE_QUEUE_LIMIT, 200 * 1024},
+                    {FLORA_POLL_OPT_WRITE_QUEUE_POLICY,
+                     FLORA_POLL_WQ_DROP_OLDEST}}};
+  RawClient cli;
+  subscribeRaw(cli, WQ_TEST_TCP, "wq.oldest");
+  Agent pub;
+  pub.config(FLORA_AGENT_CONFIG_URI, WQ_TEST_SOCK "#wq-oldest-pub");
+  pub.start();
+
+  postValues(pub, "wq.oldest", 0, 300, 16 * 1024);
+  // sent by memfd
+  postValues(pub, "wq.oldest", 300, 301, FD_POST_THRESHOLD);
+  roundTrip(pub);
+  uint32_t posts = 0;
+  while (cli.recvPost())
+    ++posts;
+  EXPECT_GT(posts, 0);
+  EXPECT_LT(posts, 301);
+  // all frames parsed, connection not closed
+  EXPECT_TRUE(cli.sync());
+  pub.close();
+}
+
+// message larger than queue limit dropped at once, queued ones kept
+TEST(WriteQueueTest, dropOversized) {
+  LocalService svc{{WQ_TEST_SOCK, WQ_TEST_TCP},
+                   {{FLORA_POLL_OPT_WRITE_QUEUE_LIMIT, 1024 * 1024},
+                    {FLORA_POLL_OPT_WRITE_QUEUE_POLICY,
+                     FLORA_POLL_WQ_DROP_OLDEST}},
+                   2 * 1024 * 1024};
+  RawClient cli;
+  subscribeRaw(cli, WQ_TEST_SOCK, "wq.oversized");
+  Agent pub;
+  // no memfd, oversized post forwarded as one frame
+  pub.config(FLORA_AGENT_CONFIG_URI, WQ_TEST_TCP "#wq-oversized-pub");
+  pub.config(FLORA_AGENT_CONFIG_BUFSIZE, 2 * 1024 * 1024);
+  pub.start();
+
+  // socket buffer full, others queued within limit
+  postValues(pub, "wq.oversized", 0, 100, 8 * 1024);
+  postValues(pub, "wq.oversized", 100, 101, 1200 * 1024);
+  postValues(pub, "wq.oversized", 101, 102, 0);
+  roundTrip(pub);
+  uint32_t posts = 0;
+  while (cli.recvPost())
+    ++posts;
+  EXPECT_EQ(posts, 101);
+  EXPECT_TRUE(cli.sync());
+  pub.close();
+}
+
+// slow subscriber closed by dispatcher thread, poll thread releases it
+TEST(WriteQueueTest, disconnectSlow) {
+  LocalService svc{{WQ_TEST_SOCK},
+                   {{FLORA_POLL_OPT_WRITE_QUEUE_LIMIT, 200 * 1024}}};
+  RawClient cli;
+  subscribeRaw(cli, WQ_TEST_SOCK, "wq.disconnect");
+  Agent pub;
+  pub.config(FLORA_AGENT_CONFIG_URI, WQ_TEST_SOCK "#wq-disconnect-pub");
+  pub.start();
+
+  postValues(pub, "wq.disconnect", 0, 100, 16 * 1024);
+  EXPECT_TRUE(cli.waitClosed());
+  // service still works
+  Agent sub;
+  RecvValues recvs;
+  sub.config(FLORA_AGENT_CONFIG_URI, WQ_TEST_SOCK "#wq-disconnect-sub");
+  subscribeValues(sub, "wq.disconnect", recvs);
+  sub.start();
+  roundTrip(sub);
+  postValues(pub, "wq.disconnect", 100, 101, 0);
+  EXPECT_TRUE(waitFor([&recvs]() { return recvs.size() >= 1; }));
+  pub.close();
+  sub.close();
+}